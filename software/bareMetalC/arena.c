@@ -0,0 +1,190 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_arena.h"
+
+// A small residual block:
+//   a = x * w1; b = a * w2; c = b * w3; c = a + c; d = c * w4
+#define I 64
+#define K 64
+#define J1 64
+#define J2 128
+#define J3 32
+
+#define N_RANDOM_TENSORS 100
+#define N_RANDOM_LAYERS 40
+
+static elem_t x[I][K] row_align(1);
+static elem_t w1[K][J1] row_align(1);
+static elem_t w2[J1][J2] row_align(1);
+static elem_t w3[J2][J1] row_align(1);
+static elem_t w4[J1][J3] row_align(1);
+
+// The activations, each in its own buffer
+static elem_t a[I][J1] row_align(1);
+static elem_t b[I][J2] row_align(1);
+static elem_t c[I][J1] row_align(1);
+static elem_t d[I][J3] row_align(1);
+
+static elem_t gold[I][J3];
+
+static char buffer[sizeof(a) + sizeof(b) + sizeof(c) + sizeof(d)] __attribute__((aligned(GEMMINI_ARENA_ALIGN)));
+
+static void run_matmul(size_t dim_J, size_t dim_K, const elem_t * A, const elem_t * B, elem_t * C) {
+  tiled_matmul_auto(I, dim_J, dim_K, (elem_t*)A, (elem_t*)B, NULL, C,
+      dim_K, dim_J, dim_J, dim_J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      RELU, 0.125, 0, false,
+      false, false,
+      false, false,
+      0,
+      WS);
+}
+
+static void block(elem_t * a, elem_t * b, elem_t * c, elem_t * d) {
+  run_matmul(J1, K, (elem_t*)x, (elem_t*)w1, a);
+  run_matmul(J2, J1, a, (elem_t*)w2, b);
+  run_matmul(J1, J2, b, (elem_t*)w3, c);
+  tiled_resadd_auto(I, J1, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+      a, c, c, true, WS);
+  run_matmul(J3, J1, c, (elem_t*)w4, d);
+  gemmini_fence();
+}
+
+// The same block, fetching each activation from the arena in the layer that
+// uses it, as the networks do
+static void arena_block(struct gemmini_arena_t * arena) {
+  run_matmul(J1, K, (elem_t*)x, (elem_t*)w1, (elem_t*)GEMMINI_ARENA_GET(arena, a));
+  gemmini_arena_next_layer(arena);
+  run_matmul(J2, J1, (elem_t*)GEMMINI_ARENA_GET(arena, a), (elem_t*)w2, (elem_t*)GEMMINI_ARENA_GET(arena, b));
+  gemmini_arena_next_layer(arena);
+  run_matmul(J1, J2, (elem_t*)GEMMINI_ARENA_GET(arena, b), (elem_t*)w3, (elem_t*)GEMMINI_ARENA_GET(arena, c));
+  gemmini_arena_next_layer(arena);
+  tiled_resadd_auto(I, J1, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+      (elem_t*)GEMMINI_ARENA_GET(arena, a), (elem_t*)GEMMINI_ARENA_GET(arena, c),
+      (elem_t*)GEMMINI_ARENA_GET(arena, c), true, WS);
+  gemmini_arena_next_layer(arena);
+  run_matmul(J3, J1, (elem_t*)GEMMINI_ARENA_GET(arena, c), (elem_t*)w4, (elem_t*)GEMMINI_ARENA_GET(arena, d));
+  gemmini_fence();
+}
+
+static void check_plan(const struct gemmini_arena_t * arena) {
+  for (size_t t = 0; t < arena->n_tensors; t++) {
+    const struct gemmini_arena_tensor_t * x = &arena->tensors[t];
+
+    if (x->offset % GEMMINI_ARENA_ALIGN != 0 || x->offset + x->bytes > arena->size) {
+      printf("%s is misplaced at offset %llu\n", x->name, (unsigned long long)x->offset);
+      exit(1);
+    }
+
+    for (size_t u = t + 1; u < arena->n_tensors; u++) {
+      const struct gemmini_arena_tensor_t * y = &arena->tensors[u];
+
+      if (gemmini_arena_live_together(x, y) &&
+          x->offset < y->offset + y->bytes && y->offset < x->offset + x->bytes) {
+        printf("%s and %s are live together but overlap\n", x->name, y->name);
+        exit(1);
+      }
+    }
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (elem_t * ptr = &x[0][0]; ptr < &x[0][0] + sizeof(x) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 16) - 8;
+    for (elem_t * ptr = &w1[0][0]; ptr < &w1[0][0] + sizeof(w1) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (elem_t * ptr = &w2[0][0]; ptr < &w2[0][0] + sizeof(w2) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (elem_t * ptr = &w3[0][0]; ptr < &w3[0][0] + sizeof(w3) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (elem_t * ptr = &w4[0][0]; ptr < &w4[0][0] + sizeof(w4) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+
+    block((elem_t*)a, (elem_t*)b, (elem_t*)c, (elem_t*)d);
+    memcpy(gold, d, sizeof(d));
+
+    static struct gemmini_arena_t arena;
+    gemmini_arena_reset(&arena);
+
+    GEMMINI_ARENA_USE(&arena, a);
+    gemmini_arena_next_layer(&arena);
+    GEMMINI_ARENA_USE(&arena, a);
+    GEMMINI_ARENA_USE(&arena, b);
+    gemmini_arena_next_layer(&arena);
+    GEMMINI_ARENA_USE(&arena, b);
+    GEMMINI_ARENA_USE(&arena, c);
+    gemmini_arena_next_layer(&arena);
+    GEMMINI_ARENA_USE(&arena, a);
+    GEMMINI_ARENA_USE(&arena, c);
+    gemmini_arena_next_layer(&arena);
+    GEMMINI_ARENA_USE(&arena, c);
+    GEMMINI_ARENA_USE(&arena, d);
+    gemmini_arena_next_layer(&arena);
+
+    gemmini_arena_plan(&arena);
+    gemmini_arena_print(&arena);
+    check_plan(&arena);
+
+    // b dies before d is written, so d fits in b's space
+    if (arena.size >= gemmini_arena_unplanned_size(&arena)) {
+      printf("The arena saved nothing\n");
+      exit(1);
+    }
+
+    // Stale data must not leak into the results
+    memset(buffer, 0x55, sizeof(buffer));
+    gemmini_arena_bind(&arena, buffer);
+
+    arena_block(&arena);
+
+    if (arena.layer != arena.n_layers - 1) {
+      printf("The block ended on layer %d of %d\n", arena.layer, arena.n_layers);
+      exit(1);
+    }
+
+    if (!MAT_IS_EQUAL(I, J3, GEMMINI_ARENA_GET(&arena, d), gold)) {
+      printf("The block's output differs when its activations share an arena\n");
+      exit(1);
+    }
+
+    // Random lifetimes and sizes
+    static char names[N_RANDOM_TENSORS][8];
+    static struct gemmini_arena_t random;
+    gemmini_arena_reset(&random);
+
+    for (int t = 0; t < N_RANDOM_TENSORS; t++)
+      sprintf(names[t], "t%d", t);
+
+    for (int layer = 0; layer < N_RANDOM_LAYERS; layer++) {
+      for (int t = 0; t < N_RANDOM_TENSORS; t++)
+        if (rand() % 8 == 0)
+          gemmini_arena_use(&random, names[t], (t * 7919) % 4096 + 1);
+      gemmini_arena_next_layer(&random);
+    }
+
+    gemmini_arena_plan(&random);
+    gemmini_arena_print(&random);
+    check_plan(&random);
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,180 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_async.h"
+
+// q, k and v are independent projections of x, and s = q + k depends on two
+// of them. Only s, and the CPU reading the results, should need a fence
+#define I 32
+#define K 64
+#define J 48
+
+static elem_t x[I][K] row_align(1);
+static elem_t wq[K][J] row_align(1);
+static elem_t wk[K][J] row_align(1);
+static elem_t wv[K][J] row_align(1);
+
+static elem_t q[I][J] row_align(1);
+static elem_t k[I][J] row_align(1);
+static elem_t v[I][J] row_align(1);
+static elem_t s[I][J] row_align(1);
+
+static elem_t gold_q[I][J], gold_k[I][J], gold_v[I][J], gold_s[I][J];
+
+// Two heads of J/2 columns of q and k
+static elem_t scores[2][I][I] row_align(1);
+static elem_t gold_scores[2][I][I];
+
+static gemmini_handle_t project(const elem_t * w, elem_t * out, bool async) {
+  if (async)
+    return tiled_matmul_auto_async(I, J, K, (elem_t*)x, w, NULL, out,
+        K, J, J, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, 0.125, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+
+  tiled_matmul_auto(I, J, K, (elem_t*)x, w, NULL, out,
+      K, J, J, J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, 0.125, 0, false,
+      false, false,
+      false, false,
+      0,
+      WS);
+  return GEMMINI_HANDLE_DONE;
+}
+
+static void expect_fences(uint64_t fences, const char * when) {
+  if (gemmini_async.fences != fences) {
+    printf("%llu fences %s, instead of %llu\n", (unsigned long long)gemmini_async.fences, when,
+        (unsigned long long)fences);
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < I; i++)
+      for (size_t kk = 0; kk < K; kk++)
+        x[i][kk] = (rand() % 16) - 8;
+
+    for (size_t kk = 0; kk < K; kk++)
+      for (size_t j = 0; j < J; j++) {
+        wq[kk][j] = (rand() % 8) - 4;
+        wk[kk][j] = (rand() % 8) - 4;
+        wv[kk][j] = (rand() % 8) - 4;
+      }
+
+    project((elem_t*)wq, (elem_t*)gold_q, false);
+    project((elem_t*)wk, (elem_t*)gold_k, false);
+    project((elem_t*)wv, (elem_t*)gold_v, false);
+    tiled_resadd_auto(I, J, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+        (elem_t*)gold_q, (elem_t*)gold_k, (elem_t*)gold_s, false, WS);
+
+    const gemmini_handle_t hq = project((elem_t*)wq, (elem_t*)q, true);
+    const gemmini_handle_t hk = project((elem_t*)wk, (elem_t*)k, true);
+    const gemmini_handle_t hv = project((elem_t*)wv, (elem_t*)v, true);
+    expect_fences(0, "between independent projections");
+
+    if (hq == hk || hk == hv || gemmini_done(hv)) {
+      printf("The projections' handles are wrong\n");
+      exit(1);
+    }
+
+    // Reading x and the weights, or writing an unrelated buffer, doesn't wait
+    gemmini_wait_read(x, sizeof(x));
+    gemmini_wait_write(s, sizeof(s));
+    expect_fences(0, "for CPU accesses that the projections don't conflict with");
+
+    // s reads what q and k write
+    const gemmini_handle_t hs = tiled_resadd_auto_async(I, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+        (elem_t*)q, (elem_t*)k, (elem_t*)s, false, WS);
+    expect_fences(1, "before the dependent add");
+
+    if (!gemmini_done(hq) || !gemmini_done(hv) || gemmini_done(hs)) {
+      printf("The fence before the add didn't complete the projections\n");
+      exit(1);
+    }
+
+    // v completed with the fence before the add
+    gemmini_wait_read(v, sizeof(v));
+    expect_fences(1, "for reading v, which had already completed");
+
+    gemmini_wait_read(&s[I - 1][J - 1], 1);
+    expect_fences(2, "for reading s");
+    if (!gemmini_done(hs)) {
+      printf("s isn't done after waiting on it\n");
+      exit(1);
+    }
+
+    gemmini_wait(hs);
+    expect_fences(2, "for a handle that was already done");
+
+    if (!MAT_IS_EQUAL(I, J, q, gold_q) || !MAT_IS_EQUAL(I, J, k, gold_k) ||
+        !MAT_IS_EQUAL(I, J, v, gold_v) || !MAT_IS_EQUAL(I, J, s, gold_s)) {
+      printf("The asynchronous results differ\n");
+      exit(1);
+    }
+
+    // Writing an input of an outstanding op waits for it
+    project((elem_t*)wq, (elem_t*)q, true);
+    gemmini_wait_write(wq, sizeof(wq));
+    expect_fences(3, "for overwriting a weight that is still being read");
+
+    // CPU ops run at submission
+    const gemmini_handle_t hc = tiled_resadd_auto_async(I, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+        (elem_t*)q, (elem_t*)k, (elem_t*)s, false, CPU);
+    if (!gemmini_done(hc) || !MAT_IS_EQUAL(I, J, s, gold_s)) {
+      printf("The CPU add didn't run at submission\n");
+      exit(1);
+    }
+
+    // Only the second head reads the end of q's last row, which this writes
+    tiled_resadd_auto_async(1, J / 2, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+        &v[0][0], &v[1][0], &q[I - 1][J / 2], false, WS);
+    expect_fences(3, "before an add that no outstanding op touches");
+
+    for (int cpu = 1; cpu >= 0; cpu--)
+      tiled_matmul_heads_auto_async(2, I, I, J / 2,
+          (elem_t*)q, (elem_t*)k, NULL, cpu ? (elem_t*)gold_scores : (elem_t*)scores,
+          J, J, 0, I,
+          J / 2, J / 2, 0, I * I,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, 0.125, 0, false,
+          false, true,
+          false, false,
+          0,
+          cpu ? CPU : WS);
+    expect_fences(4, "before the heads that read what the add writes");
+
+    gemmini_wait_read(scores, sizeof(scores));
+    if (!MAT_IS_EQUAL(I, I, scores[0], gold_scores[0]) || !MAT_IS_EQUAL(I, I, scores[1], gold_scores[1])) {
+      printf("The asynchronous heads differ\n");
+      exit(1);
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,189 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// Ragged sequence lengths that span several query blocks. SEQ_LEN_KV fits a
+// row of scores in the accumulator, and SEQ_LEN_KV_LONG doesn't
+#define SEQ_LEN_Q 70
+#define SEQ_LEN_KV 150
+#define SEQ_LEN_KV_LONG (ATTN_MAX_ONCHIP_SEQ_KV + 90)
+#define HEAD_DIM 64
+
+#define BERT_SCALE 0.05
+
+// The long reference takes every exponential relative to the row's global
+// max. The online softmax rescales per-block exponentials instead, which
+// I-BERT's polynomial approximation only matches up to a few output units,
+// more of them the more key blocks there are
+#define TOLERANCE 8
+
+static elem_t Q[SEQ_LEN_Q][HEAD_DIM];
+static elem_t K[SEQ_LEN_KV_LONG][HEAD_DIM];
+static elem_t V[SEQ_LEN_KV_LONG][HEAD_DIM];
+static elem_t probs[SEQ_LEN_Q][SEQ_LEN_KV];
+static elem_t gold[SEQ_LEN_Q][HEAD_DIM];
+static elem_t out[SEQ_LEN_Q][HEAD_DIM];
+static elem_t out_cpu[SEQ_LEN_Q][HEAD_DIM];
+
+#define STREAM_CAPACITY 1024
+static struct gemmini_cmd cmds[STREAM_CAPACITY];
+
+// out = softmax(Q * K^T) * V as a SOFTMAX matmul followed by a matmul with V
+static void gold_matmuls(enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto(SEQ_LEN_Q, SEQ_LEN_KV, HEAD_DIM,
+      (elem_t*)Q, (elem_t*)K, NULL, (elem_t*)probs,
+      HEAD_DIM, HEAD_DIM, 0, SEQ_LEN_KV,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      SOFTMAX, ACC_SCALE_IDENTITY, BERT_SCALE, false,
+      false, true,
+      false, false,
+      0,
+      tiled_matmul_type);
+  gemmini_fence();
+
+  tiled_matmul_auto(SEQ_LEN_Q, HEAD_DIM, SEQ_LEN_KV,
+      (elem_t*)probs, (elem_t*)V, NULL, (elem_t*)gold,
+      SEQ_LEN_KV, HEAD_DIM, 0, HEAD_DIM,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+      false, false,
+      false, false,
+      0,
+      tiled_matmul_type);
+  gemmini_fence();
+}
+
+// out = softmax(Q * K^T) * V with the integer exponentials of a SOFTMAX
+// matmul, normalized in double precision
+static void gold_online(size_t seq_len_kv) {
+  const scale_t a = 0.3585;
+  const scale_t b = 1.353;
+  const scale_t c = 0.344;
+
+  const acc_t qln2 = (acc_t) (0.693147 / BERT_SCALE);
+  const acc_t qln2_inv = 65536 / qln2;
+  const acc_t qb = b / BERT_SCALE;
+  const acc_t qc = c / (a*BERT_SCALE*BERT_SCALE);
+
+  for (size_t i = 0; i < SEQ_LEN_Q; i++) {
+    acc_t scores[SEQ_LEN_KV_LONG];
+    for (size_t j = 0; j < seq_len_kv; j++) {
+      scores[j] = 0;
+      for (size_t d = 0; d < HEAD_DIM; d++)
+        scores[j] += Q[i][d] * K[j][d];
+    }
+
+    acc_t max = scores[0];
+    for (size_t j = 1; j < seq_len_kv; j++)
+      if (scores[j] > max) max = scores[j];
+
+    double sum = 0;
+    for (size_t j = 0; j < seq_len_kv; j++) {
+      scores[j] = softmax_iexp(scores[j] - max, qln2, qln2_inv, qb, qc);
+      sum += scores[j];
+    }
+
+    for (size_t d = 0; d < HEAD_DIM; d++) {
+      double x = 0;
+      for (size_t j = 0; j < seq_len_kv; j++)
+        x += scores[j] * V[j][d];
+      gold[i][d] = scale_and_sat(ROUND_NEAR_EVEN(x * 127 / sum), NO_ACTIVATION, ACC_SCALE_IDENTITY, 0);
+    }
+  }
+}
+
+static void check_attention(size_t seq_len_kv, int tolerance, enum tiled_matmul_type_t tiled_matmul_type) {
+  static const char * type_str[] = {"OS", "WS", "CPU"};
+  printf("%s blocked attention over %zu keys...\n", type_str[tiled_matmul_type], seq_len_kv);
+
+  uint64_t start = read_cycles();
+  tiled_attention_auto(SEQ_LEN_Q, seq_len_kv, HEAD_DIM,
+      (elem_t*)Q, (elem_t*)K, (elem_t*)V, (elem_t*)out,
+      HEAD_DIM, HEAD_DIM, HEAD_DIM, HEAD_DIM,
+      BERT_SCALE, tiled_matmul_type);
+  uint64_t end = read_cycles();
+  printf("%s blocked attention took %llu cycles\n", type_str[tiled_matmul_type], end - start);
+
+  for (size_t i = 0; i < SEQ_LEN_Q; i++)
+    for (size_t d = 0; d < HEAD_DIM; d++) {
+      const int diff = out[i][d] - gold[i][d];
+      if (diff > tolerance || diff < -tolerance) {
+        printf("Row %zu, column %zu: got %d instead of %d\n", i, d, out[i][d], gold[i][d]);
+        exit(1);
+      }
+    }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < SEQ_LEN_Q; i++)
+      for (size_t d = 0; d < HEAD_DIM; d++)
+        Q[i][d] = (rand() % 8) - 4;
+
+    for (size_t i = 0; i < SEQ_LEN_KV_LONG; i++)
+      for (size_t d = 0; d < HEAD_DIM; d++) {
+        K[i][d] = (rand() % 8) - 4;
+        V[i][d] = (rand() % 3) - 1;
+      }
+
+    // The softmax stays in the accumulator, so the blocks must match the two
+    // matmuls exactly, on either target
+    gold_matmuls(CPU);
+    check_attention(SEQ_LEN_KV, 0, CPU);
+    gold_matmuls(WS);
+    check_attention(SEQ_LEN_KV, 0, WS);
+
+    // One fence per block of queries, and the closing one. The emulator runs
+    // each command as it's issued, so this is what keeps the blocks' matmuls
+    // overlapping on the accelerator
+    struct gemmini_stream stream;
+    gemmini_stream_init(&stream, cmds, STREAM_CAPACITY);
+    gemmini_capture_begin(&stream);
+    tiled_attention_auto(SEQ_LEN_Q, SEQ_LEN_KV, HEAD_DIM,
+        (elem_t*)Q, (elem_t*)K, (elem_t*)V, (elem_t*)out,
+        HEAD_DIM, HEAD_DIM, HEAD_DIM, HEAD_DIM,
+        BERT_SCALE, WS);
+    gemmini_capture_end();
+
+    size_t fences = 0;
+    for (size_t c = 0; c < stream.len; c++)
+      fences += cmds[c].funct == GEMMINI_CMD_FENCE;
+
+    const size_t blocks = (SEQ_LEN_Q + ATTN_BLOCK_Q - 1) / ATTN_BLOCK_Q;
+    if (fences != blocks + 1) {
+      printf("WS blocked attention fenced %zu times for %zu blocks\n", fences, blocks);
+      exit(1);
+    }
+
+    gold_online(SEQ_LEN_KV_LONG);
+    check_attention(SEQ_LEN_KV_LONG, TOLERANCE, CPU);
+    memcpy(out_cpu, out, sizeof(out));
+
+    // The accelerator only computes the integer matmuls of the online
+    // softmax, so it must match the CPU exactly
+    check_attention(SEQ_LEN_KV_LONG, TOLERANCE, WS);
+    if (memcmp(out_cpu, out, sizeof(out)) != 0) {
+      printf("WS blocked attention doesn't match the CPU\n");
+      exit(1);
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,182 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_autotune.h"
+#include "include/ternary_pack.h"
+
+// Ragged I and K, so that tiles split unevenly. The mpgemm keeps J a multiple
+// of 4*DIM, so that it spans whole blocks of packed weights
+#define MAT_DIM_I 100
+#define MAT_DIM_J 192
+#define MAT_DIM_K 300
+
+#define IN_ROW_DIM 17
+#define IN_COL_DIM 17
+#define IN_CHANNELS 32
+#define OUT_CHANNELS 64
+#define KERNEL_DIM 3
+#define PADDING 1
+#define N_PATCHES (IN_ROW_DIM * IN_COL_DIM)
+
+static elem_t A[MAT_DIM_I][MAT_DIM_K];
+static elem_t B[MAT_DIM_K][MAT_DIM_J];
+static elem_t B_packed[MAT_DIM_K][MAT_DIM_J / 4];
+static acc_t D[MAT_DIM_J];
+static elem_t C[MAT_DIM_I][MAT_DIM_J];
+static elem_t C_gold[MAT_DIM_I][MAT_DIM_J];
+
+static elem_t input[IN_ROW_DIM][IN_COL_DIM][IN_CHANNELS];
+static elem_t weights[KERNEL_DIM * KERNEL_DIM * IN_CHANNELS][OUT_CHANNELS];
+static acc_t bias[OUT_CHANNELS];
+static elem_t output[N_PATCHES][OUT_CHANNELS];
+static elem_t output_gold[N_PATCHES][OUT_CHANNELS];
+
+static void run_matmul(enum tiled_matmul_type_t tiled_matmul_type, elem_t out[MAT_DIM_I][MAT_DIM_J]) {
+  tiled_matmul_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      (elem_t*)A, (elem_t*)B, D, (elem_t*)out,
+      MAT_DIM_K, MAT_DIM_J, 0, MAT_DIM_J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      RELU, 0.125, 0, true,
+      false, false,
+      false, false,
+      0,
+      tiled_matmul_type);
+}
+
+// The accelerator's bias preload doesn't cover mpgemm's widened accumulator
+// rows, so the mpgemm has no bias
+static void run_mpgemm(enum tiled_matmul_type_t tiled_matmul_type, elem_t out[MAT_DIM_I][MAT_DIM_J]) {
+  tiled_mpgemm_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+      (elem_t*)A, (elem_t*)B_packed, NULL, (elem_t*)out,
+      MAT_DIM_K, MAT_DIM_J, 0, MAT_DIM_J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      RELU, 0.125, 0, true,
+      false,
+      false, false,
+      tiled_matmul_type);
+}
+
+static void run_conv(enum tiled_matmul_type_t tiled_conv_type, elem_t out[N_PATCHES][OUT_CHANNELS]) {
+  tiled_conv_auto(
+      1, IN_ROW_DIM, IN_COL_DIM, IN_CHANNELS,
+      OUT_CHANNELS, IN_ROW_DIM, IN_COL_DIM,
+      1, 1, 1, PADDING, KERNEL_DIM,
+      false, false, false, false, false,
+
+      (elem_t*)input, (elem_t*)weights, bias, (elem_t*)out,
+
+      RELU, 0.125, 0, 0, 0,
+
+      tiled_conv_type);
+}
+
+static void check(const void * got, const void * gold, size_t size, const char * name) {
+  if (memcmp(got, gold, size) != 0) {
+    printf("%s with tuned tiles doesn't match the CPU\n", name);
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (elem_t * ptr = &A[0][0]; ptr < &A[0][0] + sizeof(A) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 16) - 8;
+    for (elem_t * ptr = &B[0][0]; ptr < &B[0][0] + sizeof(B) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 3) - 1;
+    for (size_t j = 0; j < MAT_DIM_J; j++)
+      D[j] = (rand() % 64) - 32;
+    ternary_pack(TERNARY_KJ, MAT_DIM_K, MAT_DIM_J, (elem_t*)B, MAT_DIM_J, 1, (elem_t*)B_packed);
+
+    for (elem_t * ptr = &input[0][0][0]; ptr < &input[0][0][0] + sizeof(input) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 32) - 16;
+    for (elem_t * ptr = &weights[0][0]; ptr < &weights[0][0] + sizeof(weights) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (size_t i = 0; i < OUT_CHANNELS; i++)
+      bias[i] = (rand() % 64) - 32;
+
+    printf("Tuning the matmul\n");
+    tiled_matmul_autotune(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        (elem_t*)A, (elem_t*)B, D, (elem_t*)C,
+        MAT_DIM_K, MAT_DIM_J, 0, MAT_DIM_J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        RELU, 0.125, 0, true,
+        false, false,
+        false, false,
+        0);
+
+    const int matmul_key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_MATMUL_KEY(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        RELU, false, false, false, false);
+    if (gemmini_tuned_tiles(GEMMINI_TUNE_MATMUL, matmul_key) == NULL) {
+      printf("The matmul wasn't tuned\n");
+      exit(1);
+    }
+
+    run_matmul(CPU, C_gold);
+    memset(C, 0, sizeof(C));
+    run_matmul(WS, C);
+    check(C, C_gold, sizeof(C), "Matmul");
+
+    printf("Tuning the mpgemm\n");
+    tiled_mpgemm_autotune(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+        (elem_t*)A, (elem_t*)B_packed, NULL, (elem_t*)C,
+        MAT_DIM_K, MAT_DIM_J, 0, MAT_DIM_J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        RELU, 0.125, 0, true,
+        false,
+        false, false);
+
+    if (gemmini_tuned_tiles(GEMMINI_TUNE_MPGEMM, matmul_key) == NULL) {
+      printf("The mpgemm wasn't tuned\n");
+      exit(1);
+    }
+
+    run_mpgemm(CPU, C_gold);
+    memset(C, 0, sizeof(C));
+    run_mpgemm(WS, C);
+    check(C, C_gold, sizeof(C), "Mpgemm");
+
+    printf("Tuning the conv\n");
+    tiled_conv_autotune(
+        1, IN_ROW_DIM, IN_COL_DIM, IN_CHANNELS,
+        OUT_CHANNELS, IN_ROW_DIM, IN_COL_DIM,
+        1, 1, 1, PADDING, KERNEL_DIM,
+        false, false, false, false, false,
+        (elem_t*)input, (elem_t*)weights, bias, (elem_t*)output,
+        RELU, 0.125, 0, 0, 0);
+
+    const int conv_key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_CONV_KEY(1, IN_ROW_DIM, IN_COL_DIM,
+        IN_CHANNELS, OUT_CHANNELS, IN_ROW_DIM, IN_COL_DIM,
+        1, 1, 1, PADDING, KERNEL_DIM,
+        false, false, 1, 1, false);
+    if (gemmini_tuned_tiles(GEMMINI_TUNE_CONV, conv_key) == NULL) {
+      printf("The conv wasn't tuned\n");
+      exit(1);
+    }
+
+    run_conv(CPU, output_gold);
+    memset(output, 0, sizeof(output));
+    run_conv(WS, output);
+    check(output, output_gold, sizeof(output), "Conv");
+
+    gemmini_tune_print_lut();
+
+    printf("SUCCESS\n");
+    exit(0);
+}
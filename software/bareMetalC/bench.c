@@ -0,0 +1,303 @@
+// See LICENSE for license details.
+
+// Table-driven benchmark suite. Every layer in "layers" runs on each path
+// that supports it:
+//
+//   ws      tiled_matmul_auto, tiled_conv_auto or tiled_conv_dw_auto on WS
+//   mpgemm  the same layer with packed ternary weights: tiled_mpgemm_auto or
+//           tiled_conv_mpgemm_auto. Needs J or out_channels to be a multiple
+//           of 4*DIM
+//   gemv    gemv_auto, for matmuls of at most DIM rows
+//   cpu     the *_auto functions on the CPU
+//
+// and prints one CSV row per (layer, path), each starting with "bench,":
+//
+//   bench,model,layer,path,shape,macs,cycles,macs_per_cycle,utilization_pct
+//
+// where utilization is against the peak MACs per cycle of the path: DIM*DIM
+// for the mesh, or 4*DIM*DIM for mpgemm, whose computes each produce 4*DIM
+// outputs from packed ternary weights.
+// "bench [model] [path]" only runs the given model ("all" for every one) and
+// path. BENCH_PATHS sets the paths run by default.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+#define BENCH_WS (1 << 0)
+#define BENCH_MPGEMM (1 << 1)
+#define BENCH_GEMV (1 << 2)
+#define BENCH_CPU (1 << 3)
+
+#ifndef BENCH_PATHS
+#define BENCH_PATHS (BENCH_WS | BENCH_MPGEMM | BENCH_GEMV | BENCH_CPU)
+#endif
+
+enum bench_kind_t { BENCH_MATMUL, BENCH_CONV, BENCH_CONV_DW };
+
+struct bench_layer_t {
+  const char * model;
+  const char * name;
+  enum bench_kind_t kind;
+
+  // Matmuls: I x K times K x J
+  int I, J, K;
+
+  // Convs, with square inputs and kernels. Depthwise convs have
+  // out_channels == in_channels
+  int batch_size, in_dim, in_channels, out_channels, kernel_dim, stride, padding;
+};
+
+#define MATMUL(model, name, I, J, K) {model, name, BENCH_MATMUL, I, J, K, 0, 0, 0, 0, 0, 0, 0}
+#define CONV(model, name, batch_size, in_dim, in_channels, out_channels, kernel_dim, stride, padding) \
+  {model, name, BENCH_CONV, 0, 0, 0, batch_size, in_dim, in_channels, out_channels, kernel_dim, stride, padding}
+#define CONV_DW(model, name, batch_size, in_dim, channels, kernel_dim, stride, padding) \
+  {model, name, BENCH_CONV_DW, 0, 0, 0, batch_size, in_dim, channels, channels, kernel_dim, stride, padding}
+
+static const struct bench_layer_t layers[] = {
+  // ResNet-50, batch 1: the stem, one 3x3 conv and 1x1 expansion per stage,
+  // and the classifier
+  CONV("resnet50", "conv1", 1, 224, 3, 64, 7, 2, 3),
+  CONV("resnet50", "res2_3x3", 1, 56, 64, 64, 3, 1, 1),
+  CONV("resnet50", "res2_1x1_expand", 1, 56, 64, 256, 1, 1, 0),
+  CONV("resnet50", "res3_3x3", 1, 28, 128, 128, 3, 1, 1),
+  CONV("resnet50", "res4_3x3", 1, 14, 256, 256, 3, 1, 1),
+  CONV("resnet50", "res5_3x3", 1, 7, 512, 512, 3, 1, 1),
+  CONV("resnet50", "res5_1x1_expand", 1, 7, 512, 2048, 1, 1, 0),
+  MATMUL("resnet50", "fc", 1, 1000, 2048),
+
+  // MobileNetV2, batch 1: depthwise and pointwise convs from each resolution
+  CONV("mobilenetv2", "conv1", 1, 224, 3, 32, 3, 2, 1),
+  CONV_DW("mobilenetv2", "dw_112", 1, 112, 32, 3, 1, 1),
+  CONV_DW("mobilenetv2", "dw_56", 1, 56, 144, 3, 1, 1),
+  CONV("mobilenetv2", "pw_56_project", 1, 56, 144, 24, 1, 1, 0),
+  CONV_DW("mobilenetv2", "dw_14", 1, 14, 384, 3, 1, 1),
+  CONV("mobilenetv2", "pw_14_project", 1, 14, 384, 64, 1, 1, 0),
+  CONV("mobilenetv2", "pw_7_head", 1, 7, 320, 1280, 1, 1, 0),
+
+  // BERT-base encoder, 128 tokens
+  MATMUL("bert_base", "qkv_proj", 128, 768, 768),
+  MATMUL("bert_base", "attn_out", 128, 768, 768),
+  MATMUL("bert_base", "ffn_up", 128, 3072, 768),
+  MATMUL("bert_base", "ffn_down", 128, 768, 3072),
+
+  // A 0.7B-parameter BitNet (hidden 1536, FFN 4096): 128-token prefill and
+  // single-token decode
+  MATMUL("bitnet_0.7b", "prefill_qkv_proj", 128, 1536, 1536),
+  MATMUL("bitnet_0.7b", "decode_qkv_proj", 1, 1536, 1536),
+  MATMUL("bitnet_0.7b", "decode_ffn_up", 1, 4096, 1536),
+  MATMUL("bitnet_0.7b", "decode_ffn_down", 1, 1536, 4096),
+
+  // The shapes of the former conv_perf, conv_dw_perf and tiled_matmul_ws_perf
+  CONV("legacy", "conv_perf", 4, 224, 3, 32, 3, 2, 1),
+  CONV_DW("legacy", "conv_dw_perf", 3, 112, 17, 3, 2, 1),
+  MATMUL("legacy", "tiled_matmul_ws_perf", 128, 256, 256),
+};
+
+#define N_LAYERS (sizeof(layers) / sizeof(layers[0]))
+
+// Shared by every layer; the values don't affect the timing
+static elem_t A[1 << 21] row_align(1);
+static elem_t B[1 << 23] row_align(1);
+static elem_t C[1 << 21] row_align(1);
+static acc_t bias[1 << 12] row_align_acc(1);
+
+static int bench_out_dim(const struct bench_layer_t * l) {
+  return (l->in_dim + 2*l->padding - l->kernel_dim) / l->stride + 1;
+}
+
+static uint64_t bench_macs(const struct bench_layer_t * l) {
+  if (l->kind == BENCH_MATMUL)
+    return (uint64_t)l->I * l->J * l->K;
+
+  const uint64_t out_pixels = (uint64_t)l->batch_size * bench_out_dim(l) * bench_out_dim(l);
+  const uint64_t kernel_size = (uint64_t)l->kernel_dim * l->kernel_dim;
+  return l->kind == BENCH_CONV_DW ? out_pixels * l->in_channels * kernel_size :
+    out_pixels * l->out_channels * kernel_size * l->in_channels;
+}
+
+static int bench_peak_macs_per_cycle(int path) {
+  return path == BENCH_MPGEMM ? 4 * DIM * DIM : DIM * DIM;
+}
+
+static bool bench_supports(const struct bench_layer_t * l, int path) {
+  switch (path) {
+    case BENCH_MPGEMM:
+      return (l->kind == BENCH_MATMUL && l->J % (4*DIM) == 0) ||
+        (l->kind == BENCH_CONV && l->out_channels % (4*DIM) == 0);
+    case BENCH_GEMV:
+      return l->kind == BENCH_MATMUL && l->I <= DIM;
+    default:
+      return true;
+  }
+}
+
+static void bench_check_size(const struct bench_layer_t * l) {
+  size_t a, b, c;
+
+  if (l->kind == BENCH_MATMUL) {
+    a = (size_t)l->I * l->K;
+    b = (size_t)l->K * l->J;
+    c = (size_t)l->I * l->J;
+  } else {
+    const size_t out_dim = bench_out_dim(l);
+    a = (size_t)l->batch_size * l->in_dim * l->in_dim * l->in_channels;
+    b = (size_t)l->kernel_dim * l->kernel_dim * l->in_channels * (l->kind == BENCH_CONV_DW ? 1 : l->out_channels);
+    c = (size_t)l->batch_size * out_dim * out_dim * l->out_channels;
+  }
+
+  if (a > sizeof(A) || b > sizeof(B) || c > sizeof(C) || (size_t)l->out_channels > sizeof(bias) / sizeof(bias[0]) ||
+      (size_t)l->J > sizeof(bias) / sizeof(bias[0])) {
+    printf("%s %s is too large for the benchmark's buffers\n", l->model, l->name);
+    exit(1);
+  }
+}
+
+static void bench_run(const struct bench_layer_t * l, int path) {
+  const enum tiled_matmul_type_t type = path == BENCH_CPU ? CPU : WS;
+
+  if (l->kind == BENCH_MATMUL && path == BENCH_GEMV) {
+    const size_t KB = (l->K + DIM - 1) / DIM;
+    gemv_auto(l->I, l->J, l->K, A, B, bias, C,
+        l->K, KB * DIM, 0, l->J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, true,
+        false, false,
+        false, false,
+        0, 0, 0);
+  } else if (l->kind == BENCH_MATMUL && path == BENCH_MPGEMM) {
+    tiled_mpgemm_auto(l->I, l->J, l->K, A, B, NULL, C,
+        l->K, l->J, 0, l->J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false,
+        false, false,
+        type);
+  } else if (l->kind == BENCH_MATMUL) {
+    tiled_matmul_auto(l->I, l->J, l->K, A, B, bias, C,
+        l->K, l->J, 0, l->J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, true,
+        false, false,
+        false, false,
+        0,
+        type);
+  } else if (l->kind == BENCH_CONV && path == BENCH_MPGEMM) {
+    tiled_conv_mpgemm_auto(
+        l->batch_size, l->in_dim, l->in_dim, l->in_channels,
+        l->out_channels, bench_out_dim(l), bench_out_dim(l),
+        l->stride, 1, 1, l->padding, l->kernel_dim,
+        false, false, false,
+        A, B, bias, C,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+        type);
+  } else if (l->kind == BENCH_CONV) {
+    tiled_conv_auto(
+        l->batch_size, l->in_dim, l->in_dim, l->in_channels,
+        l->out_channels, bench_out_dim(l), bench_out_dim(l),
+        l->stride, 1, 1, l->padding, l->kernel_dim,
+        false, false, false, false, false,
+        A, B, bias, C,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+        type);
+  } else {
+    tiled_conv_dw_auto(
+        l->batch_size, l->in_dim, l->in_dim, l->in_channels,
+        bench_out_dim(l), bench_out_dim(l),
+        l->stride, l->padding, l->kernel_dim,
+        A, B, bias, C,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+        type);
+  }
+
+  gemmini_fence();
+}
+
+static void bench_print_shape(const struct bench_layer_t * l) {
+  if (l->kind == BENCH_MATMUL)
+    printf("%dx%dx%d", l->I, l->J, l->K);
+  else
+    printf("%dx%dx%dx%d_%s%dx%d_s%d_p%d", l->batch_size, l->in_dim, l->in_dim, l->in_channels,
+        l->kind == BENCH_CONV_DW ? "dw" : "", l->kernel_dim, l->out_channels, l->stride, l->padding);
+}
+
+int main(int argc, char * argv[]) {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    static const char * path_names[] = {"ws", "mpgemm", "gemv", "cpu"};
+    const int n_paths = sizeof(path_names) / sizeof(path_names[0]);
+
+    const char * model = argc > 1 && strcmp(argv[1], "all") != 0 ? argv[1] : NULL;
+    int paths = BENCH_PATHS;
+
+    if (argc > 2) {
+      paths = 0;
+      for (int p = 0; p < n_paths; p++)
+        if (strcmp(argv[2], path_names[p]) == 0)
+          paths = 1 << p;
+    }
+
+    if (argc > 3 || paths == 0) {
+      printf("usage: %s [model|all] [ws|mpgemm|gemv|cpu]\n", argv[0]);
+      exit(1);
+    }
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < sizeof(A); i++)
+      A[i] = (rand() % 16) - 8;
+    for (size_t i = 0; i < sizeof(B); i++)
+      B[i] = rand() % 256;
+    for (size_t i = 0; i < sizeof(bias) / sizeof(bias[0]); i++)
+      bias[i] = (rand() % 64) - 32;
+
+    printf("bench,model,layer,path,shape,macs,cycles,macs_per_cycle,utilization_pct\n");
+
+    size_t rows = 0;
+    for (size_t i = 0; i < N_LAYERS; i++) {
+      const struct bench_layer_t * l = &layers[i];
+      if (model != NULL && strcmp(model, l->model) != 0)
+        continue;
+
+      bench_check_size(l);
+
+      for (int p = 0; p < n_paths; p++) {
+        const int path = 1 << p;
+        if (!(paths & path) || !bench_supports(l, path))
+          continue;
+
+        const uint64_t start = read_cycles();
+        bench_run(l, path);
+        const uint64_t end = read_cycles();
+
+        const uint64_t cycles = end - start;
+        const uint64_t macs = bench_macs(l);
+        const double macs_per_cycle = cycles == 0 ? 0 : (double)macs / cycles;
+
+        printf("bench,%s,%s,%s,", l->model, l->name, path_names[p]);
+        bench_print_shape(l);
+        printf(",%llu,%llu,%.3f,%.2f\n", (unsigned long long)macs, (unsigned long long)cycles,
+            macs_per_cycle, 100 * macs_per_cycle / bench_peak_macs_per_cycle(path));
+        rows++;
+      }
+    }
+
+    if (rows == 0) {
+      printf("No layers matched\n");
+      exit(1);
+    }
+
+    exit(0);
+}
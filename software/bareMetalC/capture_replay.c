@@ -0,0 +1,126 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// A two-layer network: a conv whose input is relocatable, feeding a fully
+// connected layer whose output is relocatable
+#define IN_ROW_DIM 17
+#define IN_COL_DIM 17
+#define IN_CHANNELS 16
+#define OUT_CHANNELS 32
+#define KERNEL_DIM 3
+#define PADDING 1
+#define N_PATCHES (IN_ROW_DIM * IN_COL_DIM)
+#define FC_DIM 48
+
+#define INPUTS 2
+#define MAX_CMDS 4096
+
+static elem_t input[INPUTS][IN_ROW_DIM][IN_COL_DIM][IN_CHANNELS];
+static elem_t conv_weights[KERNEL_DIM * KERNEL_DIM * IN_CHANNELS][OUT_CHANNELS];
+static acc_t conv_bias[OUT_CHANNELS];
+static elem_t conv_out[N_PATCHES][OUT_CHANNELS];
+static elem_t fc_weights[OUT_CHANNELS][FC_DIM];
+static acc_t fc_bias[FC_DIM];
+static elem_t output[INPUTS][N_PATCHES][FC_DIM];
+static elem_t gold[INPUTS][N_PATCHES][FC_DIM];
+
+static struct gemmini_cmd cmds[MAX_CMDS];
+
+static void network(const elem_t * in, elem_t * out, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_conv_auto(
+      1, IN_ROW_DIM, IN_COL_DIM, IN_CHANNELS,
+      OUT_CHANNELS, IN_ROW_DIM, IN_COL_DIM,
+      1, 1, 1, PADDING, KERNEL_DIM,
+      false, false, false, false, false,
+
+      in, (elem_t*)conv_weights, (acc_t*)conv_bias, (elem_t*)conv_out,
+
+      RELU, 0.125, 0, 0, 0,
+
+      tiled_matmul_type);
+
+  gemmini_fence();
+
+  tiled_matmul_auto(N_PATCHES, FC_DIM, OUT_CHANNELS,
+      (elem_t*)conv_out, (elem_t*)fc_weights, fc_bias, out,
+      OUT_CHANNELS, FC_DIM, 0, FC_DIM,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, 0.25, 0, true,
+      false, false,
+      false, false,
+      0,
+      tiled_matmul_type);
+
+  gemmini_fence();
+}
+
+static void check_output(size_t n, const char * name) {
+  if (memcmp(output[n], gold[n], sizeof(gold[n])) != 0) {
+    printf("%s output %zu doesn't match the CPU\n", name, n);
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (elem_t * ptr = &input[0][0][0][0]; ptr < &input[0][0][0][0] + sizeof(input) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 32) - 16;
+    for (elem_t * ptr = &conv_weights[0][0]; ptr < &conv_weights[0][0] + sizeof(conv_weights) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (elem_t * ptr = &fc_weights[0][0]; ptr < &fc_weights[0][0] + sizeof(fc_weights) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (size_t i = 0; i < OUT_CHANNELS; i++)
+      conv_bias[i] = (rand() % 64) - 32;
+    for (size_t i = 0; i < FC_DIM; i++)
+      fc_bias[i] = (rand() % 64) - 32;
+
+    for (size_t n = 0; n < INPUTS; n++)
+      network(&input[n][0][0][0], &gold[n][0][0], CPU);
+
+    struct gemmini_stream stream;
+    gemmini_stream_init(&stream, cmds, MAX_CMDS);
+    gemmini_stream_buffer(&stream, input[0], sizeof(input[0]));
+    gemmini_stream_buffer(&stream, output[0], sizeof(output[0]));
+
+    printf("Capturing the first input\n");
+    uint64_t start = read_cycles();
+    gemmini_capture_begin(&stream);
+    network(&input[0][0][0][0], &output[0][0][0], WS);
+    gemmini_capture_end();
+    uint64_t end = read_cycles();
+    printf("Captured %zu commands in %llu cycles\n", stream.len, end - start);
+    check_output(0, "Captured");
+
+    for (size_t n = 0; n < INPUTS; n++) {
+      memset(output, 0, sizeof(output));
+
+      printf("Replaying input %zu\n", n);
+      const void * buffers[] = {input[n], output[n]};
+      start = read_cycles();
+      gemmini_stream_replay(&stream, buffers);
+      end = read_cycles();
+      printf("Replay took %llu cycles\n", end - start);
+      check_output(n, "Replayed");
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
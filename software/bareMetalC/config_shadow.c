@@ -0,0 +1,144 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// Repeating a layer shouldn't re-issue its config commands, and a layer with
+// a different activation must still get its own
+#define I 32
+#define K 64
+#define J 48
+
+#define MAX_CMDS 1024
+
+static elem_t in[I][K] row_align(1);
+static elem_t w[K][J] row_align(1);
+static acc_t bias[J] row_align_acc(1);
+
+static elem_t out[I][J] row_align(1);
+static elem_t gold[I][J];
+static elem_t gold_gelu[I][J];
+
+static struct gemmini_cmd cmds[MAX_CMDS];
+
+static void run_layer(int act, elem_t * C, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto(I, J, K, (elem_t*)in, (elem_t*)w, bias, C,
+      K, J, J, J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      act, act == IGELU ? ACC_SCALE_IDENTITY : 0.125, act == IGELU ? 0.05 : 0, true,
+      false, false,
+      false, false,
+      0,
+      tiled_matmul_type);
+}
+
+static void check(int act, const char * when) {
+  if (!MAT_IS_EQUAL(I, J, out, (act == IGELU ? gold_gelu : gold))) {
+    printf("The output %s doesn't match the CPU\n", when);
+    exit(1);
+  }
+  memset(out, 0, sizeof(out));
+}
+
+// The config commands that a sequence of layers issues
+static size_t count_configs(const int * acts, size_t n) {
+  struct gemmini_stream stream;
+  gemmini_stream_init(&stream, cmds, MAX_CMDS);
+
+  gemmini_capture_begin(&stream);
+  for (size_t l = 0; l < n; l++)
+    run_layer(acts[l], (elem_t*)out, WS);
+  gemmini_capture_end();
+
+  check(acts[n - 1], "of a captured layer");
+
+  size_t configs = 0;
+  for (size_t c = 0; c < stream.len; c++)
+    configs += stream.cmds[c].funct == k_CONFIG;
+  return configs;
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < I; i++)
+      for (size_t k = 0; k < K; k++)
+        in[i][k] = (rand() % 16) - 8;
+    for (size_t k = 0; k < K; k++)
+      for (size_t j = 0; j < J; j++)
+        w[k][j] = (rand() % 8) - 4;
+    for (size_t j = 0; j < J; j++)
+      bias[j] = (rand() % 64) - 32;
+
+    run_layer(NO_ACTIVATION, (elem_t*)gold, CPU);
+    run_layer(IGELU, (elem_t*)gold_gelu, CPU);
+
+    const int once[] = {NO_ACTIVATION};
+    const int twice[] = {NO_ACTIVATION, NO_ACTIVATION};
+    const int gelu_once[] = {IGELU};
+    const int gelu_twice[] = {IGELU, IGELU};
+    const int mixed[] = {NO_ACTIVATION, IGELU, NO_ACTIVATION};
+
+    const size_t configs_once = count_configs(once, 1);
+    const size_t configs_twice = count_configs(twice, 2);
+    const size_t configs_gelu_once = count_configs(gelu_once, 1);
+    const size_t configs_gelu_twice = count_configs(gelu_twice, 2);
+    const size_t configs_mixed = count_configs(mixed, 3);
+
+    printf("Config commands: %llu for one layer, %llu for two, %llu for one IGELU layer, %llu for two, %llu mixed\n",
+        (unsigned long long)configs_once, (unsigned long long)configs_twice,
+        (unsigned long long)configs_gelu_once, (unsigned long long)configs_gelu_twice,
+        (unsigned long long)configs_mixed);
+
+    if (configs_once == 0 || configs_twice != configs_once || configs_gelu_twice != configs_gelu_once) {
+      printf("A repeated layer re-issued its config commands\n");
+      exit(1);
+    }
+
+    if (configs_mixed <= configs_once) {
+      printf("The IGELU layer didn't re-configure the accelerator\n");
+      exit(1);
+    }
+
+    // Layers outside a capture rely on the configs the last ones left behind
+    run_layer(NO_ACTIVATION, (elem_t*)out, WS);
+    check(NO_ACTIVATION, "after a captured IGELU layer");
+    run_layer(NO_ACTIVATION, (elem_t*)out, WS);
+    check(NO_ACTIVATION, "of a repeated layer");
+
+    // A stream replayed after other layers still carries all of its configs
+    struct gemmini_stream stream;
+    gemmini_stream_init(&stream, cmds, MAX_CMDS);
+    gemmini_capture_begin(&stream);
+    run_layer(IGELU, (elem_t*)out, WS);
+    gemmini_capture_end();
+    check(IGELU, "of the captured IGELU layer");
+
+    run_layer(NO_ACTIVATION, (elem_t*)out, WS);
+    check(NO_ACTIVATION, "before the replay");
+
+    gemmini_stream_replay(&stream, NULL);
+    gemmini_fence();
+    check(IGELU, "of the replayed IGELU layer");
+
+    run_layer(NO_ACTIVATION, (elem_t*)out, WS);
+    check(NO_ACTIVATION, "after the replay");
+
+    printf("SUCCESS\n");
+    exit(0);
+}
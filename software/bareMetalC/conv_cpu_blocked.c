@@ -0,0 +1,111 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// The CPU convolution works through blocks of output pixels, output channels
+// and input channels. Its layers are shaped so that none of those tile evenly,
+// and each must still match the accelerator
+
+#define MAX_BATCHES 2
+#define MAX_IN_DIM 17
+#define MAX_CHANNELS (CONV_CPU_KCHS + 9)
+#define MAX_KERNEL_DIM 3
+
+struct conv_case {
+  const char * name;
+  int batches, in_dim, in_channels, out_channels;
+  int stride, input_dilation, kernel_dilation, padding, kernel_dim;
+  bool wrot180, trans_output_1203, trans_input_3120, trans_weight_1203, trans_weight_0132;
+  int pool_size, pool_stride, pool_padding;
+};
+
+static const struct conv_case cases[] = {
+  {"wide",                  2, 9,   MAX_CHANNELS, MAX_CHANNELS, 1, 1, 1, 1, 3, false, false, false, false, false, 0, 0, 0},
+  {"strided and pooled",    1, 17,  17, 12,                     2, 1, 1, 1, 3, false, false, false, false, false, 3, 2, 1},
+  {"NHWC to HWNC",          2, 11,  5, 19,                      1, 1, 1, 1, 3, false, true,  false, false, false, 0, 0, 0},
+  {"input dilated",         2, 9,   5, 7,                       1, 2, 1, -1, 3, false, false, false, false, false, 0, 0, 0},
+  {"input dilated, rot180", 2, 9,   5, 7,                       1, 2, 1, 1, 3, true,  false, false, false, false, 0, 0, 0},
+  {"kernel dilated, CHWN",  2, 17,  18, 19,                     1, 1, 2, 2, 3, false, false, true,  false, false, 0, 0, 0},
+  {"WIHO weights",          2, 9,   18, 19,                     2, 1, 1, 1, 3, false, false, false, true,  false, 0, 0, 0},
+  {"HWOI weights",          2, 9,   18, 19,                     2, 1, 1, 1, 3, false, false, false, false, true,  0, 0, 0},
+};
+
+static elem_t input[MAX_BATCHES * MAX_IN_DIM * MAX_IN_DIM * MAX_CHANNELS];
+static elem_t weights[MAX_KERNEL_DIM * MAX_KERNEL_DIM * MAX_CHANNELS * MAX_CHANNELS];
+static acc_t bias[MAX_CHANNELS];
+static elem_t output[MAX_BATCHES * MAX_IN_DIM * MAX_IN_DIM * MAX_CHANNELS];
+static elem_t gold[MAX_BATCHES * MAX_IN_DIM * MAX_IN_DIM * MAX_CHANNELS];
+
+static int out_dim(const struct conv_case * c) {
+  const int in_dim = c->in_dim + (c->input_dilation - 1) * (c->in_dim - 1);
+  const int kernel_dim = c->kernel_dilation * (c->kernel_dim - 1) + 1;
+  return (in_dim + 2 * c->padding - kernel_dim) / c->stride + 1;
+}
+
+static void run_conv(const struct conv_case * c, elem_t * out, enum tiled_matmul_type_t tiled_conv_type) {
+  tiled_conv_auto(
+      c->batches, c->in_dim, c->in_dim, c->in_channels,
+      c->out_channels, out_dim(c), out_dim(c),
+      c->stride, c->input_dilation, c->kernel_dilation, c->padding, c->kernel_dim,
+      c->wrot180, c->trans_output_1203, c->trans_input_3120, c->trans_weight_1203, c->trans_weight_0132,
+
+      input, weights, bias, out,
+
+      NO_ACTIVATION, ACC_SCALE_IDENTITY,
+      c->pool_size, c->pool_stride, c->pool_padding,
+
+      tiled_conv_type);
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < sizeof(input) / sizeof(elem_t); i++)
+      input[i] = (rand() % 16) - 8;
+    for (size_t i = 0; i < sizeof(weights) / sizeof(elem_t); i++)
+      weights[i] = (rand() % 5) - 2;
+    for (size_t i = 0; i < MAX_CHANNELS; i++)
+      bias[i] = (rand() % 64) - 32;
+
+    for (size_t t = 0; t < sizeof(cases) / sizeof(cases[0]); t++) {
+      const struct conv_case * c = &cases[t];
+
+      int rows = out_dim(c);
+      if (c->pool_stride != 0)
+        rows = (rows + 2 * c->pool_padding - c->pool_size) / c->pool_stride + 1;
+      const size_t len = c->batches * rows * rows * c->out_channels;
+
+      printf("%s conv...\n", c->name);
+
+      // Pooled outputs are maxed in place, so they mustn't depend on what the
+      // output held before
+      memset(gold, elem_t_max, sizeof(gold));
+      run_conv(c, gold, CPU);
+      run_conv(c, output, WS);
+      gemmini_fence();
+
+      if (memcmp(output, gold, len) != 0) {
+        printf("The %s conv doesn't match the accelerator\n", c->name);
+        exit(1);
+      }
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
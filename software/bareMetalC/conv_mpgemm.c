@@ -0,0 +1,148 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/ternary_pack.h"
+
+#define BATCH_SIZE 2
+#define IN_ROW_DIM 17
+#define IN_COL_DIM 17
+#define IN_CHANNELS 18
+#define OUT_CHANNELS (8*DIM)
+#define KERNEL_DIM 3
+#define PADDING 1
+#define STRIDE 1
+
+#define NO_BIAS false
+
+#define OUT_ROW_DIM ((IN_ROW_DIM + 2*PADDING - KERNEL_DIM) / STRIDE + 1)
+#define OUT_COL_DIM ((IN_COL_DIM + 2*PADDING - KERNEL_DIM) / STRIDE + 1)
+#define PATCH_SIZE (KERNEL_DIM * KERNEL_DIM * IN_CHANNELS)
+#define N_PATCHES (BATCH_SIZE * OUT_ROW_DIM * OUT_COL_DIM)
+
+static elem_t input[BATCH_SIZE][IN_ROW_DIM][IN_COL_DIM][IN_CHANNELS];
+static elem_t weights_mat[PATCH_SIZE][OUT_CHANNELS];
+static elem_t weights_packed[PATCH_SIZE][OUT_CHANNELS / 4];
+static acc_t bias[OUT_CHANNELS];
+static elem_t output[N_PATCHES][OUT_CHANNELS];
+static elem_t output_mat[N_PATCHES][OUT_CHANNELS];
+
+// Reference convolution over the unpacked {-1, 0, 1} weights
+void conv(elem_t input[BATCH_SIZE][IN_ROW_DIM][IN_COL_DIM][IN_CHANNELS],
+        elem_t weights[PATCH_SIZE][OUT_CHANNELS],
+        acc_t bias[OUT_CHANNELS],
+        elem_t output[N_PATCHES][OUT_CHANNELS]) {
+
+    for (int b = 0; b < BATCH_SIZE; b++) {
+        for (int orow = 0; orow < OUT_ROW_DIM; orow++) {
+            for (int ocol = 0; ocol < OUT_COL_DIM; ocol++) {
+                for (int och = 0; och < OUT_CHANNELS; och++) {
+                    acc_t result = NO_BIAS ? 0 : bias[och];
+
+                    for (int krow = 0; krow < KERNEL_DIM; krow++) {
+                        for (int kcol = 0; kcol < KERNEL_DIM; kcol++) {
+                            for (int kch = 0; kch < IN_CHANNELS; kch++) {
+                                int irow = orow * STRIDE + krow - PADDING;
+                                int icol = ocol * STRIDE + kcol - PADDING;
+
+                                elem_t pixel = irow < 0 || irow >= IN_ROW_DIM ||
+                                    icol < 0 || icol >= IN_COL_DIM ?
+                                    0 : input[b][irow][icol][kch];
+
+                                result += weights[(krow * KERNEL_DIM + kcol) * IN_CHANNELS + kch][och] * pixel;
+                            }
+                        }
+                    }
+
+                    // Clip result
+                    result = result > elem_t_max ? elem_t_max : (result < elem_t_min ? elem_t_min : result);
+
+                    output[(b * OUT_ROW_DIM + orow) * OUT_COL_DIM + ocol][och] = result;
+                }
+            }
+        }
+    }
+}
+
+bool vec_is_equal(elem_t * a, elem_t * b, int len) {
+    for (int i = 0; i < len; i++)
+        if (a[i] != b[i])
+            return false;
+    return true;
+}
+
+static void check_conv(enum tiled_matmul_type_t tiled_conv_type) {
+    static const char * type_str[] = {"OS", "WS", "CPU"};
+    printf("%s ternary conv...\n", type_str[tiled_conv_type]);
+
+    uint64_t start = read_cycles();
+    tiled_conv_mpgemm_auto(
+        BATCH_SIZE, IN_ROW_DIM, IN_COL_DIM, IN_CHANNELS,
+        OUT_CHANNELS, OUT_ROW_DIM, OUT_COL_DIM,
+        STRIDE, 1, 1, PADDING, KERNEL_DIM,
+        false, false, false,
+
+        (elem_t*)input,
+        (elem_t*)weights_packed,
+        NO_BIAS ? NULL : (acc_t*)bias,
+        (elem_t*)output_mat,
+
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+
+        tiled_conv_type);
+    gemmini_fence();
+    uint64_t end = read_cycles();
+    printf("%s ternary conv took %llu cycles\n", type_str[tiled_conv_type], end - start);
+
+    if (!vec_is_equal(&output[0][0], &output_mat[0][0], sizeof(output) / sizeof(elem_t))) {
+        for (int p = 0; p < N_PATCHES; p++)
+            for (int och = 0; och < OUT_CHANNELS; och++)
+                if (output[p][och] != output_mat[p][och]) {
+                    printf("Pixel %d, channel %d: got %d instead of %d\n",
+                        p, och, output_mat[p][och], output[p][och]);
+                    exit(1);
+                }
+    }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    printf("Input dimensions (rows by columns): %u by %u\n", IN_ROW_DIM, IN_COL_DIM);
+    printf("Output dimensions (rows by columns): %u by %u\n\n", OUT_ROW_DIM, OUT_COL_DIM);
+
+    for (elem_t * ptr = &input[0][0][0][0]; ptr < &input[0][0][0][0] + sizeof(input) / sizeof(elem_t); ptr++)
+        *ptr = (rand() % 32) - 16;
+
+    for (int k = 0; k < PATCH_SIZE; k++)
+        for (int och = 0; och < OUT_CHANNELS; och++)
+            weights_mat[k][och] = rand() % 3 - 1;
+
+    for (int och = 0; och < OUT_CHANNELS; och++)
+        bias[och] = (rand() % 64) - 32;
+
+    printf("Pack weights...\n");
+    ternary_pack(TERNARY_KJ, PATCH_SIZE, OUT_CHANNELS, (elem_t*)weights_mat, OUT_CHANNELS, 1, (elem_t*)weights_packed);
+
+    conv(input, weights_mat, bias, output);
+
+    check_conv(CPU);
+    check_conv(WS);
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,185 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// Every CPU kernel must give the same result however many threads it is
+// split across. Baremetal builds run them on one hart either way
+
+// Split by rows
+#define I 64
+#define K 80
+#define J 48
+
+// Split by columns, with B transposed
+#define WI 4
+#define WK 256
+#define WJ 200
+
+// Ternary weights, split by rows and by columns
+#define TI 36
+#define TK 64
+#define TJ 256
+
+// Convs
+#define BATCHES 2
+#define IN_DIM 10
+#define IN_CHANNELS 16
+#define OUT_CHANNELS 24
+#define KERNEL_DIM 3
+#define DW_DIM 16
+#define DW_CHANNELS 32
+
+static elem_t in[I][K];
+static elem_t w[K][J];
+static acc_t bias[I][J];
+static elem_t out[2][I][J];
+static elem_t norm_out[2][I][J];
+
+static elem_t w_in[WI][WK];
+static elem_t w_wt[WJ][WK];
+static elem_t w_out[2][WI][WJ];
+
+static elem_t t_in[TI][TK];
+static elem_t t_w[TK][TJ / 4];
+static elem_t t_out[2][TI][TJ];
+
+static elem_t c_in[BATCHES][IN_DIM][IN_DIM][IN_CHANNELS];
+static elem_t c_w[KERNEL_DIM][KERNEL_DIM][IN_CHANNELS][OUT_CHANNELS];
+static acc_t c_bias[OUT_CHANNELS];
+static elem_t c_out[2][BATCHES][IN_DIM][IN_DIM][OUT_CHANNELS];
+static elem_t c_pool_out[2][BATCHES][IN_DIM / 2][IN_DIM / 2][OUT_CHANNELS];
+
+static elem_t dw_in[BATCHES][DW_DIM][DW_DIM][DW_CHANNELS];
+static elem_t dw_w[DW_CHANNELS][KERNEL_DIM][KERNEL_DIM];
+static acc_t dw_bias[DW_CHANNELS];
+static elem_t dw_out[2][BATCHES][DW_DIM][DW_DIM][DW_CHANNELS];
+
+static void fill(elem_t * x, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % 16) - 8;
+}
+
+static void check(const char * what, const void * x, const void * y, size_t n) {
+  if (memcmp(x, y, n) != 0) {
+    printf("The threaded %s differs\n", what);
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    fill(&in[0][0], I * K);
+    fill(&w[0][0], K * J);
+    fill(&w_in[0][0], WI * WK);
+    fill(&w_wt[0][0], WJ * WK);
+    fill(&t_in[0][0], TI * TK);
+    for (size_t k = 0; k < TK; k++)
+      for (size_t j = 0; j < TJ / 4; j++)
+        t_w[k][j] = rand();
+    fill(&c_in[0][0][0][0], sizeof(c_in));
+    fill(&c_w[0][0][0][0], sizeof(c_w));
+    fill(&dw_in[0][0][0][0], sizeof(dw_in));
+    fill(&dw_w[0][0][0], sizeof(dw_w));
+    for (size_t i = 0; i < I; i++)
+      for (size_t j = 0; j < J; j++)
+        bias[i][j] = (rand() % 256) - 128;
+    for (size_t c = 0; c < OUT_CHANNELS; c++)
+      c_bias[c] = (rand() % 256) - 128;
+    for (size_t c = 0; c < DW_CHANNELS; c++)
+      dw_bias[c] = (rand() % 256) - 128;
+
+    // One thread, then an uneven split
+    for (int run = 0; run < 2; run++) {
+#ifndef BAREMETAL
+      gemmini_cpu_threads = run == 0 ? 1 : 3;
+#endif
+
+      tiled_matmul_auto(I, J, K, (elem_t*)in, (elem_t*)w, (acc_t*)bias, (elem_t*)out[run],
+          K, J, J, J,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          RELU, 0.05, 0, false,
+          false, false,
+          false, false,
+          0,
+          CPU);
+
+      // Normalized rows stay whole
+      tiled_matmul_auto(I, J, K, (elem_t*)in, (elem_t*)w, (acc_t*)bias, (elem_t*)norm_out[run],
+          K, J, J, J,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          LAYERNORM, ACC_SCALE_IDENTITY, 0, false,
+          false, false,
+          false, false,
+          0,
+          CPU);
+
+      tiled_matmul_auto(WI, WJ, WK, (elem_t*)w_in, (elem_t*)w_wt, NULL, (elem_t*)w_out[run],
+          WK, WK, 0, WJ,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, 0.05, 0, false,
+          false, true,
+          false, false,
+          0,
+          CPU);
+
+      tiled_mpgemm_auto(TI, TJ, TK, (elem_t*)t_in, (elem_t*)t_w, NULL, (elem_t*)t_out[run],
+          TK, TJ, TJ, TJ,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, 0.25, 0, false,
+          false,
+          false, false,
+          CPU);
+
+      tiled_conv_auto(BATCHES, IN_DIM, IN_DIM, IN_CHANNELS,
+          OUT_CHANNELS, IN_DIM, IN_DIM,
+          1, 1, 1, 1, KERNEL_DIM,
+          false, false, false, false, false,
+          (elem_t*)c_in, (elem_t*)c_w, c_bias, (elem_t*)c_out[run],
+          RELU, 0.05,
+          0, 0, 0,
+          CPU);
+
+      tiled_conv_auto(BATCHES, IN_DIM, IN_DIM, IN_CHANNELS,
+          OUT_CHANNELS, IN_DIM, IN_DIM,
+          1, 1, 1, 1, KERNEL_DIM,
+          false, false, false, false, false,
+          (elem_t*)c_in, (elem_t*)c_w, c_bias, (elem_t*)c_pool_out[run],
+          RELU, 0.05,
+          2, 2, 0,
+          CPU);
+
+      tiled_conv_dw_auto(BATCHES, DW_DIM, DW_DIM,
+          DW_CHANNELS, DW_DIM, DW_DIM,
+          1, 1, KERNEL_DIM,
+          (elem_t*)dw_in, (elem_t*)dw_w, dw_bias, (elem_t*)dw_out[run],
+          NO_ACTIVATION, 0.05,
+          0, 0, 0,
+          CPU);
+    }
+
+    check("matmul", out[0], out[1], sizeof(out[0]));
+    check("layernorm", norm_out[0], norm_out[1], sizeof(norm_out[0]));
+    check("wide matmul", w_out[0], w_out[1], sizeof(w_out[0]));
+    check("ternary matmul", t_out[0], t_out[1], sizeof(t_out[0]));
+    check("conv", c_out[0], c_out[1], sizeof(c_out[0]));
+    check("pooled conv", c_pool_out[0], c_pool_out[1], sizeof(c_pool_out[0]));
+    check("depthwise conv", dw_out[0], dw_out[1], sizeof(dw_out[0]));
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,114 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+#define ACTIVATION NO_ACTIVATION
+
+// A ragged batch that spans two row blocks, so the second block reuses every
+// weight tile preloaded for the first
+#define MAT_DIM_I (DIM + 4)
+#define MAT_DIM_K 256
+#define MAT_DIM_J 120
+
+#define JB ((MAT_DIM_J + DIM - 1) / DIM)
+#define KB ((MAT_DIM_K + DIM - 1) / DIM)
+
+#define A_STRIDE MAT_DIM_K
+#define B_STRIDE (KB*DIM)
+#define D_STRIDE MAT_DIM_J
+#define C_STRIDE MAT_DIM_J
+
+static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t full_B[MAT_DIM_K][MAT_DIM_J];
+static elem_t full_B_reordered[JB*DIM][KB*DIM] row_align(1);
+static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
+static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+// Same tile-major weight layout as gemv_single
+static void reorder_K(elem_t *src, elem_t *dst)
+{
+  size_t out = 0;
+
+  for (size_t jb = 0; jb < JB; ++jb)
+    for (size_t k = 0; k < DIM; ++k)
+      for (size_t kb = 0; kb < KB; ++kb)
+        for (size_t j = 0; j < DIM; ++j) {
+          const size_t row = kb*DIM + k, col = jb*DIM + j;
+          dst[out++] = row < MAT_DIM_K && col < MAT_DIM_J ? src[row*MAT_DIM_J + col] : 0;
+        }
+}
+
+static void check_batch(size_t dim_I, bool no_bias) {
+  for (size_t i = 0; i < dim_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j) {
+      acc_t sum = no_bias ? 0 : full_D[i][j];
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        sum += full_A[i][k] * full_B[k][j];
+      gold[i][j] = sum > elem_t_max ? elem_t_max : sum < elem_t_min ? elem_t_min : sum;
+    }
+
+  printf("Batch of %zu rows (no_bias: %d)\n", dim_I, no_bias);
+  uint64_t start = read_cycles();
+
+  gemv_auto(dim_I, MAT_DIM_J, MAT_DIM_K,
+          (elem_t*)full_A, (elem_t*)full_B_reordered, no_bias ? NULL : &full_D[0][0], (elem_t*)full_C,
+          A_STRIDE, B_STRIDE, D_STRIDE, C_STRIDE,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+          false, false,        /* transpose_A, transpose_B */
+          false, false,        /* full_C, low_D */
+          0, 0, 0);            /* a_spad_id, b_spad_id, c_spad_id */
+
+  gemmini_fence();
+
+  uint64_t end = read_cycles();
+  printf("Cycles taken: %llu\n", end-start);
+
+  for (size_t i = 0; i < dim_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (full_C[i][j] != gold[i][j]) {
+        printf("Row %zu, column %zu: got %d instead of %d\n", i, j, full_C[i][j], gold[i][j]);
+        exit(1);
+      }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < MAT_DIM_I; ++i)
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        full_A[i][k] = (rand() % 16) - 8;
+
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      for (size_t j = 0; j < MAT_DIM_J; ++j)
+        full_B[k][j] = rand() % 3 - 1;
+
+    for (size_t i = 0; i < MAT_DIM_I; ++i)
+      for (size_t j = 0; j < MAT_DIM_J; ++j)
+        full_D[i][j] = (rand() % 64) - 32;
+
+    reorder_K((elem_t *)full_B, (elem_t *)full_B_reordered);
+
+    check_batch(1, true);
+    check_batch(5, false);
+    check_batch(MAT_DIM_I, false);
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,89 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/ternary_pack.h"
+
+// GEMVs with packed ternary weights, for a single row and for a small batch.
+// K doesn't divide into blocks, and J spans several packed blocks. The
+// accelerator can't add a bias to mpgemm outputs, so there is none
+#define MAT_DIM_I 6
+#define MAT_DIM_K 300
+#define MAT_DIM_J 512
+
+#define A_STRIDE MAT_DIM_K
+#define B_STRIDE MAT_DIM_J
+#define C_STRIDE MAT_DIM_J
+
+static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t full_W[MAT_DIM_K][MAT_DIM_J];
+static elem_t full_B[MAT_DIM_K][MAT_DIM_J / 4] row_align(1);
+static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+static void check_batch(size_t dim_I) {
+  for (size_t i = 0; i < dim_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j) {
+      acc_t sum = 0;
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        sum += full_A[i][k] * full_W[k][j];
+      gold[i][j] = sum > elem_t_max ? elem_t_max : sum < elem_t_min ? elem_t_min : sum;
+    }
+
+  printf("Batch of %zu rows\n", dim_I);
+  uint64_t start = read_cycles();
+
+  gemv_mpgemm_auto(dim_I, MAT_DIM_J, MAT_DIM_K,
+          (elem_t*)full_A, (elem_t*)full_B, NULL, (elem_t*)full_C,
+          A_STRIDE, B_STRIDE, 0, C_STRIDE,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+          false,               /* transpose_B */
+          false, false);       /* full_C, low_D */
+
+  gemmini_fence();
+
+  uint64_t end = read_cycles();
+  printf("Cycles taken: %llu\n", end-start);
+
+  for (size_t i = 0; i < dim_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (full_C[i][j] != gold[i][j]) {
+        printf("Row %zu, column %zu: got %d instead of %d\n", i, j, full_C[i][j], gold[i][j]);
+        exit(1);
+      }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < MAT_DIM_I; ++i)
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        full_A[i][k] = (rand() % 16) - 8;
+
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      for (size_t j = 0; j < MAT_DIM_J; ++j)
+        full_W[k][j] = rand() % 3 - 1;
+
+    ternary_pack(TERNARY_KJ, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, MAT_DIM_J, 1, (elem_t*)full_B);
+
+    check_batch(1);
+    check_batch(MAT_DIM_I);
+
+    printf("SUCCESS\n");
+    exit(0);
+}
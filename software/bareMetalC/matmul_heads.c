@@ -0,0 +1,196 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// Heads are interleaved along the columns of Q, K, and V, as in the
+// transformer benchmarks, while each head's scores get their own matrix.
+// Ragged sizes make every head span several partial tiles
+#define HEADS 4
+#define SEQ_LEN_Q 70
+#define SEQ_LEN_KV 150
+#define HEAD_DIM 40
+#define HIDDEN_DIM (HEADS * HEAD_DIM)
+
+#define BERT_SCALE 0.05
+
+// Heads too deep for one of them to fit in the scratchpad at once
+#define DEEP_HEADS 2
+#define DEEP_I 20
+#define DEEP_J 24
+#define DEEP_K 4200
+
+static elem_t Q[SEQ_LEN_Q][HIDDEN_DIM];
+static elem_t K[SEQ_LEN_KV][HIDDEN_DIM];
+static elem_t V[SEQ_LEN_KV][HIDDEN_DIM];
+static acc_t bias[HEADS][SEQ_LEN_KV];
+static elem_t scores[HEADS][SEQ_LEN_Q][SEQ_LEN_KV];
+static elem_t scores_gold[HEADS][SEQ_LEN_Q][SEQ_LEN_KV];
+static elem_t out[SEQ_LEN_Q][HIDDEN_DIM];
+static elem_t out_gold[SEQ_LEN_Q][HIDDEN_DIM];
+
+static elem_t deep_A[DEEP_I][DEEP_HEADS * DEEP_K];
+static elem_t deep_B[DEEP_K][DEEP_HEADS * DEEP_J];
+static elem_t deep_out[DEEP_I][DEEP_HEADS * DEEP_J];
+static elem_t deep_gold[DEEP_I][DEEP_HEADS * DEEP_J];
+
+// scores[h] = Q_h * K_h^T + bias[h], with one head per call
+static void scores_per_head(elem_t C[HEADS][SEQ_LEN_Q][SEQ_LEN_KV], const acc_t * D, int act,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  for (size_t h = 0; h < HEADS; h++)
+    tiled_matmul_auto(SEQ_LEN_Q, SEQ_LEN_KV, HEAD_DIM,
+        &Q[0][h*HEAD_DIM], &K[0][h*HEAD_DIM], D == NULL ? NULL : D + h*SEQ_LEN_KV, &C[h][0][0],
+        HIDDEN_DIM, HIDDEN_DIM, 0, SEQ_LEN_KV,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        act, ACC_SCALE_IDENTITY, BERT_SCALE, true,
+        false, true,
+        false, false,
+        0,
+        tiled_matmul_type);
+}
+
+// scores[h] = Q_h * K_h^T + bias[h], with every head in one call
+static void scores_heads(const acc_t * D, int act) {
+  tiled_matmul_heads_auto(HEADS, SEQ_LEN_Q, SEQ_LEN_KV, HEAD_DIM,
+      &Q[0][0], &K[0][0], D, &scores[0][0][0],
+      HIDDEN_DIM, HIDDEN_DIM, 0, SEQ_LEN_KV,
+      HEAD_DIM, HEAD_DIM, SEQ_LEN_KV, SEQ_LEN_Q*SEQ_LEN_KV,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      act, ACC_SCALE_IDENTITY, BERT_SCALE, true,
+      false, true,
+      false, false,
+      0,
+      WS);
+}
+
+static void check_scores(const char * name) {
+  for (size_t h = 0; h < HEADS; h++)
+    for (size_t i = 0; i < SEQ_LEN_Q; i++)
+      for (size_t j = 0; j < SEQ_LEN_KV; j++)
+        if (scores[h][i][j] != scores_gold[h][i][j]) {
+          printf("%s: head %zu, row %zu, column %zu: got %d instead of %d\n",
+              name, h, i, j, scores[h][i][j], scores_gold[h][i][j]);
+          exit(1);
+        }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < SEQ_LEN_Q; i++)
+      for (size_t d = 0; d < HIDDEN_DIM; d++)
+        Q[i][d] = (rand() % 8) - 4;
+
+    for (size_t i = 0; i < SEQ_LEN_KV; i++)
+      for (size_t d = 0; d < HIDDEN_DIM; d++) {
+        K[i][d] = (rand() % 8) - 4;
+        V[i][d] = (rand() % 8) - 4;
+      }
+
+    for (size_t h = 0; h < HEADS; h++)
+      for (size_t j = 0; j < SEQ_LEN_KV; j++)
+        bias[h][j] = (rand() % 64) - 32;
+
+    printf("Q * K^T + bias over %d heads\n", HEADS);
+    scores_per_head(scores_gold, &bias[0][0], NO_ACTIVATION, CPU);
+    uint64_t start = read_cycles();
+    scores_heads(&bias[0][0], NO_ACTIVATION);
+    uint64_t end = read_cycles();
+    printf("Cycles taken: %llu\n", end-start);
+    check_scores("Q * K^T + bias");
+
+    // The softmax runs in the accumulator, so the reference is one WS matmul
+    // per head rather than the CPU
+    printf("softmax(Q * K^T) over %d heads\n", HEADS);
+    scores_per_head(scores_gold, NULL, SOFTMAX, WS);
+    start = read_cycles();
+    scores_heads(NULL, SOFTMAX);
+    end = read_cycles();
+    printf("Cycles taken: %llu\n", end-start);
+    check_scores("softmax(Q * K^T)");
+
+    // out_h = scores_h * V_h, written back interleaved like Q
+    printf("scores * V over %d heads\n", HEADS);
+    for (size_t h = 0; h < HEADS; h++)
+      tiled_matmul_auto(SEQ_LEN_Q, HEAD_DIM, SEQ_LEN_KV,
+          &scores[h][0][0], &V[0][h*HEAD_DIM], NULL, &out_gold[0][h*HEAD_DIM],
+          SEQ_LEN_KV, HIDDEN_DIM, 0, HIDDEN_DIM,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+          false, false,
+          false, false,
+          0,
+          CPU);
+
+    start = read_cycles();
+    tiled_matmul_heads_auto(HEADS, SEQ_LEN_Q, HEAD_DIM, SEQ_LEN_KV,
+        &scores[0][0][0], &V[0][0], NULL, &out[0][0],
+        SEQ_LEN_KV, HIDDEN_DIM, 0, HIDDEN_DIM,
+        SEQ_LEN_Q*SEQ_LEN_KV, HEAD_DIM, 0, HEAD_DIM,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+    end = read_cycles();
+    printf("Cycles taken: %llu\n", end-start);
+
+    if (memcmp(out, out_gold, sizeof(out)) != 0) {
+      printf("scores * V doesn't match the per-head matmuls\n");
+      exit(1);
+    }
+
+    printf("%d heads with K = %d\n", DEEP_HEADS, DEEP_K);
+    for (size_t i = 0; i < DEEP_I; i++)
+      for (size_t k = 0; k < DEEP_HEADS * DEEP_K; k++)
+        deep_A[i][k] = (rand() % 8) - 4;
+    for (size_t k = 0; k < DEEP_K; k++)
+      for (size_t j = 0; j < DEEP_HEADS * DEEP_J; j++)
+        deep_B[k][j] = (rand() % 8) - 4;
+
+    for (size_t h = 0; h < DEEP_HEADS; h++)
+      tiled_matmul_auto(DEEP_I, DEEP_J, DEEP_K,
+          &deep_A[0][h*DEEP_K], &deep_B[0][h*DEEP_J], NULL, &deep_gold[0][h*DEEP_J],
+          DEEP_HEADS * DEEP_K, DEEP_HEADS * DEEP_J, 0, DEEP_HEADS * DEEP_J,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, 0.05, 0, false,
+          false, false,
+          false, false,
+          0,
+          CPU);
+
+    tiled_matmul_heads_auto(DEEP_HEADS, DEEP_I, DEEP_J, DEEP_K,
+        &deep_A[0][0], &deep_B[0][0], NULL, &deep_out[0][0],
+        DEEP_HEADS * DEEP_K, DEEP_HEADS * DEEP_J, 0, DEEP_HEADS * DEEP_J,
+        DEEP_K, DEEP_J, 0, DEEP_J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, 0.05, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+
+    if (memcmp(deep_out, deep_gold, sizeof(deep_out)) != 0) {
+      printf("The deep heads don't match the per-head matmuls\n");
+      exit(1);
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
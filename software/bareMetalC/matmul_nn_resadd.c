@@ -0,0 +1,113 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_nn.h"
+
+// tiled_matmul_nn_resadd_auto_async, as the ResNet bottlenecks call it. A
+// residual scaled up by res_scale / scale = 50 takes one pass, so WS adds it
+// in the accumulator, and must match the CPU exactly. At 250 it would take
+// two, so WS falls back on the layer followed by a separate resadd, like OS
+// always does. The fallback must match those two steps run on the CPU
+#define DIM_I 60
+#define DIM_J 90
+#define DIM_K 70
+
+#define RES_SCALE 1.0
+#define SCALE 0.02
+#define SMALL_SCALE 0.004
+
+static elem_t A[DIM_I][DIM_K] row_align(1);
+static elem_t B[DIM_K][DIM_J] row_align(1);
+static acc_t D[DIM_J] row_align_acc(1);
+static elem_t R[DIM_I][DIM_J] row_align(1);
+static elem_t C[DIM_I][DIM_J] row_align(1);
+static elem_t gold[DIM_I][DIM_J];
+
+static void check(const char * name) {
+  for (size_t i = 0; i < DIM_I; i++)
+    for (size_t j = 0; j < DIM_J; j++)
+      if (C[i][j] != gold[i][j]) {
+        printf("%s: row %zu, column %zu: got %d instead of %d\n", name, i, j, C[i][j], gold[i][j]);
+        exit(1);
+      }
+}
+
+// The layer with no activation, and then the residual addition
+static void unfused_gold(acc_scale_t scale) {
+  tiled_matmul_auto(DIM_I, DIM_J, DIM_K,
+      (elem_t*)A, (elem_t*)B, D, (elem_t*)gold,
+      DIM_K, DIM_J, DIM_J, DIM_J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, scale, 0, true,
+      false, false,
+      false, false,
+      0,
+      CPU);
+  tiled_resadd_auto(DIM_I, DIM_J, RES_SCALE, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+      (elem_t*)R, (elem_t*)gold, (elem_t*)gold, true, CPU);
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < DIM_I; i++)
+      for (size_t k = 0; k < DIM_K; k++)
+        A[i][k] = (rand() % 16) - 8;
+    for (size_t k = 0; k < DIM_K; k++)
+      for (size_t j = 0; j < DIM_J; j++)
+        B[k][j] = (rand() % 5) - 2;
+    for (size_t j = 0; j < DIM_J; j++)
+      D[j] = (rand() % 512) - 256;
+    for (size_t i = 0; i < DIM_I; i++)
+      for (size_t j = 0; j < DIM_J; j++)
+        R[i][j] = (rand() % 9) - 4;
+
+    printf("Fused on WS\n");
+    tiled_matmul_resadd_auto(DIM_I, DIM_J, DIM_K,
+        (elem_t*)A, (elem_t*)B, D, (elem_t*)R, (elem_t*)gold,
+        DIM_K, DIM_J, DIM_J, DIM_J, DIM_J,
+        RES_SCALE / SCALE, RELU, SCALE, true,
+        CPU);
+
+    gemmini_wait(tiled_matmul_nn_resadd_auto_async(DIM_I, DIM_J, DIM_K, A, B, D, R, C,
+        RES_SCALE, RELU, SCALE, true,
+        WS, false, "fused"));
+    check("Fused on WS");
+
+    tiled_matmul_nn_resadd_auto_async(DIM_I, DIM_J, DIM_K, A, B, D, R, C,
+        RES_SCALE, RELU, SCALE, true,
+        WS, true, "fused, checked");
+
+    printf("Unfused on OS\n");
+    unfused_gold(SCALE);
+    gemmini_wait(tiled_matmul_nn_resadd_auto_async(DIM_I, DIM_J, DIM_K, A, B, D, R, C,
+        RES_SCALE, RELU, SCALE, true,
+        OS, false, "unfused"));
+    check("Unfused on OS");
+
+    printf("Unfused on WS, past RESADD_MAX_FUSED_PASSES\n");
+    unfused_gold(SMALL_SCALE);
+    gemmini_wait(tiled_matmul_nn_resadd_auto_async(DIM_I, DIM_J, DIM_K, A, B, D, R, C,
+        RES_SCALE, RELU, SMALL_SCALE, true,
+        WS, false, "unfused, two passes"));
+    check("Unfused on WS");
+
+    printf("SUCCESS\n");
+    exit(0);
+}
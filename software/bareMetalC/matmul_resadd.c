@@ -0,0 +1,125 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// Matmuls that add a residual in the accumulator must match the CPU, which
+// must in turn match A * B + bias + the scaled residual computed directly.
+// The layers span several tiles in each dimension, and none divide evenly.
+// Residuals scaled by more than 1 go through the array, in one pass or, past
+// elem_t_max, in several
+
+#define MAX_I 100
+#define MAX_J 200
+#define MAX_K 2100
+
+struct resadd_case {
+  const char * name;
+  int I, J, K;
+  int bias; // 0: none, 1: one per output, 2: repeated down the rows
+  int act;
+  scale_t R_scale;
+  acc_scale_t scale;
+  bool in_place;
+};
+
+static const struct resadd_case cases[] = {
+  {"biased",            MAX_I, MAX_J, 70,    1, NO_ACTIVATION, 1.0,  0.125, false},
+  {"repeating bias",    37,    90,    33,    2, RELU,          0.5,  0.25,  false},
+  {"no bias, in place", 52,    48,    64,    0, RELU,          0.25, 0.5,   true},
+  {"deep",              64,    64,    MAX_K, 2, NO_ACTIVATION, 1.0,  0.01,  true},
+  {"scaled up",         MAX_I, MAX_J, 70,    1, RELU,          40.0, 0.02,  false},
+  {"scaled up, in place", 45,  70,    90,    0, NO_ACTIVATION, 300.0, 0.003, true},
+};
+
+static elem_t A[MAX_I * MAX_K];
+static elem_t B[MAX_K * MAX_J];
+static acc_t D[MAX_I * MAX_J];
+static elem_t R[MAX_I * MAX_J];
+static elem_t C[MAX_I * MAX_J];
+static elem_t gold[MAX_I * MAX_J];
+
+static void run(const struct resadd_case * c, elem_t * out, enum tiled_matmul_type_t tiled_matmul_type) {
+  if (c->in_place)
+    memcpy(out, R, sizeof(R));
+
+  tiled_matmul_resadd_auto(c->I, c->J, c->K,
+      A, B, c->bias == 0 ? NULL : D, c->in_place ? out : R, out,
+      c->K, c->J, c->J, c->J, c->J,
+      c->R_scale, c->act, c->scale, c->bias == 2,
+      tiled_matmul_type);
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < sizeof(A); i++)
+      A[i] = (rand() % 16) - 8;
+    for (size_t i = 0; i < sizeof(B); i++)
+      B[i] = (rand() % 5) - 2;
+    for (size_t i = 0; i < MAX_I * MAX_J; i++) {
+      D[i] = (rand() % 512) - 256;
+      R[i] = rand();
+    }
+
+    for (size_t t = 0; t < sizeof(cases) / sizeof(cases[0]); t++) {
+      const struct resadd_case * c = &cases[t];
+      const int minimum = c->act == RELU ? 0 : elem_t_min;
+      const struct matmul_resadd_scale_t res = matmul_resadd_scale(c->R_scale);
+
+      printf("%s matmul...\n", c->name);
+
+      run(c, gold, CPU);
+
+      for (int i = 0; i < c->I; i++)
+        for (int j = 0; j < c->J; j++) {
+          acc_t sum = c->bias == 0 ? 0 : D[(c->bias == 2 ? 0 : i) * c->J + j];
+          // Up to the rounding of the residual's mvin, it comes in at R_scale
+          const acc_t residual = matmul_resadd_residual(R[i * c->J + j], &res);
+          const float error = residual - R[i * c->J + j] * c->R_scale;
+          if (error > res.passes * res.m / 2.f || error < -(res.passes * res.m / 2.f)) {
+            printf("The %s residual %d is %d instead of about %f\n",
+                c->name, R[i * c->J + j], residual, R[i * c->J + j] * c->R_scale);
+            exit(1);
+          }
+          sum += residual;
+          for (int k = 0; k < c->K; k++)
+            sum += A[i * c->K + k] * B[k * c->J + j];
+
+          acc_t expected = ACC_SCALE(sum, c->scale);
+          expected = expected < minimum ? minimum : expected;
+
+          if (gold[i * c->J + j] != expected) {
+            printf("The CPU's %s matmul is %d instead of %d at (%d, %d)\n",
+                c->name, gold[i * c->J + j], expected, i, j);
+            exit(1);
+          }
+        }
+
+      run(c, C, WS);
+      gemmini_fence();
+
+      if (memcmp(C, gold, c->I * c->J) != 0) {
+        printf("The %s matmul doesn't match the CPU\n", c->name);
+        exit(1);
+      }
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -9,6 +9,7 @@
 #include <sys/mman.h>
 #endif
 #include "include/gemmini_testutils.h"
+#include "include/ternary_pack.h"
 
 #define PRINT 1
 
@@ -38,37 +39,15 @@ void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
   }
 }
 
-static void init_mats_packed(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t B[MAT_DIM_K][MAT_DIM_J/4]) {
+static void init_mats(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t W[MAT_DIM_K][MAT_DIM_J]) {
 
   for (size_t i = 0; i < MAT_DIM_I; ++i)
     for (size_t k = 0; k < MAT_DIM_K; ++k)
-        A[i][k] = rand() % 2; // 0 또는 1
-
-  for (size_t k = 0; k < MAT_DIM_K; ++k) {
-    for (size_t j_packed = 0; j_packed < MAT_DIM_J / 4; ++j_packed) {
-      uint8_t packed_val = 0;
-
-      // 4개의 2-bit 값을 생성하여 하나의 uint8_t로 묶습니다.
-      for (int i = 0; i < 4; ++i) {
-          // -1, 0, 1 중 하나를 랜덤하게 생성
-          int ternary_val =  (k+j_packed*4 + i) % 3 - 1; 
-          // printf("%d ", ternary_val);
-
-          // 2-bit로 인코딩 (0b11: -1, 0b00: 0, 0b01: 1)
-          uint8_t two_bit_val = 0;
-          if (ternary_val == 1) {
-              two_bit_val = 1; // 0b01
-          } else if (ternary_val == -1) {
-              two_bit_val = 3; // 0b11
-          }
-          
-          // packed_val에 2비트씩 채워넣기
-          packed_val |= (two_bit_val & 0x03) << (i * 2);
-      }
-      B[k][j_packed] = packed_val;
-      // printf("\n");
-    }
-  }
+        A[i][k] = rand() % 2;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      W[k][j] = (k + j) % 3 - 1;
 }
 
 
@@ -83,11 +62,13 @@ int main() {
     gemmini_flush(0);
 
     static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+    static elem_t full_W[MAT_DIM_K][MAT_DIM_J];
     static elem_t full_B[MAT_DIM_K][MAT_DIM_J/4] row_align(1);
     static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
     static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
 
-    init_mats_packed(full_A, full_B);
+    init_mats(full_A, full_W);
+    ternary_pack(TERNARY_KJ, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, MAT_DIM_J, 1, (elem_t*)full_B);
 
     counter_configure(0, RDMA_BYTES_REC);
     counter_configure(1, WDMA_BYTES_SENT);
@@ -104,7 +85,9 @@ int main() {
             A_STRIDE, B_STRIDE, D_STRIDE, C_STRIDE,
             MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
             ACTIVATION, ACC_SCALE_IDENTITY, 0, REPEATING_BIAS,
-            false, false);                   // full_C, low_D
+            B_TRANSPOSE,
+            false, false,                    // full_C, low_D
+            WS);
 
 
     gemmini_fence();
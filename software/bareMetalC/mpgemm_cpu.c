@@ -0,0 +1,149 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/ternary_pack.h"
+
+#define CHECK_ACCELERATOR 1
+
+#define ACTIVATION RELU
+
+// Ragged I and K exercise the edges of the CPU kernel's register blocks
+#define MAT_DIM_I 37
+#define MAT_DIM_K 70
+#define MAT_DIM_J 320
+
+#define A_STRIDE MAT_DIM_K
+#define B_STRIDE MAT_DIM_J
+#define D_STRIDE MAT_DIM_J
+#define C_STRIDE MAT_DIM_J
+
+void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i) {
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      printf("%d ", m[i][j]);
+    printf("\n");
+  }
+}
+
+int full_is_equal(elem_t x[MAT_DIM_I][MAT_DIM_J], elem_t y[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (x[i][j] != y[i][j])
+        return 0;
+  return 1;
+}
+
+static void init_mats(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t W[MAT_DIM_K][MAT_DIM_J],
+    acc_t D[MAT_DIM_I][MAT_DIM_J]) {
+  // Include elem_t_min, whose negation wraps in the ternary multiplier
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      A[i][k] = (i + k) % 17 == 0 ? elem_t_min : (rand() % 256) - 128;
+
+  for (size_t k = 0; k < MAT_DIM_K; ++k)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      W[k][j] = rand() % 3 - 1;
+
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      D[i][j] = (rand() % 64) - 32;
+}
+
+static void gold_mpgemm(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t B[MAT_DIM_K][MAT_DIM_J/4],
+    acc_t D[MAT_DIM_I][MAT_DIM_J], elem_t C[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j) {
+      acc_t sum = D == NULL ? 0 : D[i][j];
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        sum += TERNARY_MUL(A[i][k], TERNARY_CODE(B[k][j/4], j%4));
+      C[i][j] = scale_and_sat(sum, ACTIVATION, ACC_SCALE_IDENTITY, 0);
+    }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+    static elem_t full_W[MAT_DIM_K][MAT_DIM_J];
+    static elem_t full_B[MAT_DIM_K][MAT_DIM_J/4] row_align(1);
+    static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+    static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
+    static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+    init_mats(full_A, full_W, full_D);
+    ternary_pack(TERNARY_KJ, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, MAT_DIM_J, 1, (elem_t*)full_B);
+
+    for (int no_bias = 0; no_bias <= 1; no_bias++) {
+      acc_t (*D)[MAT_DIM_J] = no_bias ? NULL : full_D;
+      gold_mpgemm(full_A, full_B, D, gold);
+
+      printf("Starting CPU mpgemm (no_bias: %d)\n", no_bias);
+      uint64_t start = read_cycles();
+
+      tiled_mpgemm_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+              (elem_t*)full_A, (elem_t*)full_B, D == NULL ? NULL : &D[0][0], (elem_t*)full_C,
+              A_STRIDE, B_STRIDE, D_STRIDE, C_STRIDE,
+              MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+              ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+              false,                           // transpose_B
+              false, false,                    // full_C, low_D
+              CPU);
+
+      uint64_t end = read_cycles();
+      printf("Cycles taken: %llu\n", end-start);
+
+      if (!full_is_equal(full_C, gold)) {
+        printf("C:\n");
+        full_printMatrix(full_C);
+        printf("Gold:\n");
+        full_printMatrix(gold);
+        printf("CPU mpgemm does not match the reference\n");
+        exit(1);
+      }
+    }
+
+#if CHECK_ACCELERATOR
+    // The accelerator's bias preload does not cover mpgemm's widened
+    // accumulator rows, so only the bias-free case is compared
+    printf("Starting gemmini mpgemm\n");
+
+    gold_mpgemm(full_A, full_B, NULL, gold);
+
+    tiled_mpgemm_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+            (elem_t*)full_A, (elem_t*)full_B, NULL, (elem_t*)full_C,
+            A_STRIDE, B_STRIDE, D_STRIDE, C_STRIDE,
+            MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+            ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+            false,                             // transpose_B
+            false, false,                      // full_C, low_D
+            WS);
+
+    gemmini_fence();
+
+    if (!full_is_equal(full_C, gold)) {
+      printf("C:\n");
+      full_printMatrix(full_C);
+      printf("Gold:\n");
+      full_printMatrix(gold);
+      printf("Gemmini mpgemm does not match the reference\n");
+      exit(1);
+    }
+#endif
+
+  exit(0);
+}
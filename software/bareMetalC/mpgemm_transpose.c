@@ -9,6 +9,7 @@
 #include <sys/mman.h>
 #endif
 #include "include/gemmini_testutils.h"
+#include "include/ternary_pack.h"
 
 #define PRINT 1
 
@@ -36,63 +37,16 @@ void full_printMatrix(elem_t m[MAT_DIM_I][MAT_DIM_J]) {
     printf("\n");
   }
 }
-void print_B(elem_t m[MAT_DIM_J][MAT_DIM_K/4]) {
-  for (size_t i = 0; i < MAT_DIM_J; ++i) {
-    for (size_t j = 0; j < MAT_DIM_K/4; ++j)
-      printf("%d ", m[i][j]);
-    printf("\n");
-  }
-}
-void print_B_reordered(elem_t m[MAT_DIM_J/4][MAT_DIM_K]) {
-  for (size_t i = 0; i < MAT_DIM_J/4; ++i) {
-    for (size_t j = 0; j < MAT_DIM_K; ++j)
-      printf("%d ", m[i][j]);
-    printf("\n");
-  }
-}
-static void init_mats_packed(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t B[MAT_DIM_J][MAT_DIM_K/4]) {
+static void init_mats(elem_t A[MAT_DIM_I][MAT_DIM_K], elem_t W[MAT_DIM_J][MAT_DIM_K]) {
 
   for (size_t i = 0; i < MAT_DIM_I; ++i)
     for (size_t k = 0; k < MAT_DIM_K; ++k)
-        A[i][k] = rand()%2; // 0 또는 1
-
-  for (size_t k = 0; k < MAT_DIM_J; ++k) {
-    for (size_t j_packed = 0; j_packed < MAT_DIM_K / 4; ++j_packed) {
-      uint8_t packed_val = 0;
-
-      // 4개의 2-bit 값을 생성하여 하나의 uint8_t로 묶습니다.
-      for (int i = 0; i < 4; ++i) {
-          // -1, 0, 1 중 하나를 랜덤하게 생성
-          int ternary_val =  rand() % 3 - 1; 
-
-          // 2-bit로 인코딩 (0b11: -1, 0b00: 0, 0b01: 1)
-          uint8_t two_bit_val = 0;
-          if (ternary_val == 1) {
-              two_bit_val = 1; // 0b01
-          } else if (ternary_val == -1) {
-              two_bit_val = 3; // 0b11
-          }
-          
-          // packed_val에 2비트씩 채워넣기
-          packed_val |= (two_bit_val & 0x03) << (i * 2);
-      }
-      B[k][j_packed] = packed_val;
-      // printf("\n");
-    }
-  }
-}
+        A[i][k] = rand() % 2;
 
-static void mat_reorder(elem_t In[MAT_DIM_J][MAT_DIM_K/4], elem_t Out[MAT_DIM_J/4][MAT_DIM_K]) {
-  int dim_4 = DIM/4;
-  for (size_t i = 0; i < MAT_DIM_J/4; i++){
-    for (size_t j = 0; j < MAT_DIM_K/(4*dim_4); j++){
-      for (size_t ii = 0; ii < 4; ii++){
-        for (size_t jj = 0; jj < dim_4; jj++){
-          Out[i][j*(dim_4*4) + ii*dim_4 + jj] = In[i*4 + ii][j*dim_4 + jj];
-        }
-      }
-    }
-  }
+  // Stored out x in, as the weights of a linear layer usually are
+  for (size_t j = 0; j < MAT_DIM_J; ++j)
+    for (size_t k = 0; k < MAT_DIM_K; ++k)
+      W[j][k] = rand() % 3 - 1;
 }
 
 int main() {
@@ -106,13 +60,13 @@ int main() {
     gemmini_flush(0);
 
     static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
-    static elem_t full_B[MAT_DIM_J][MAT_DIM_K/4] row_align(1);
-    static elem_t full_B_reordered[MAT_DIM_J/4][MAT_DIM_K] row_align(1);
+    static elem_t full_W[MAT_DIM_J][MAT_DIM_K];
+    static elem_t full_B[MAT_DIM_J/4][MAT_DIM_K] row_align(1);
     static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
     static acc_t full_D[MAT_DIM_I][MAT_DIM_J] row_align_acc(1);
 
-    init_mats_packed(full_A, full_B);
-    mat_reorder(full_B, full_B_reordered);
+    init_mats(full_A, full_W);
+    ternary_pack(TERNARY_JK_DIM, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, 1, MAT_DIM_K, (elem_t*)full_B);
 
     counter_configure(0, RDMA_BYTES_REC);
     counter_configure(1, WDMA_BYTES_SENT);
@@ -125,12 +79,13 @@ int main() {
     uint64_t start = read_cycles();
 
     tiled_mpgemm_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
-            (elem_t*)full_A, (elem_t*)full_B_reordered, NO_BIAS ? NULL : &full_D[0][0], full_C,
+            (elem_t*)full_A, (elem_t*)full_B, NO_BIAS ? NULL : &full_D[0][0], full_C,
             A_STRIDE, B_STRIDE, D_STRIDE, C_STRIDE,
             MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
             ACTIVATION, 1.0, 0, REPEATING_BIAS,
             B_TRANSPOSE,
-            false, false);                   // full_C, low_D
+            false, false,                    // full_C, low_D
+            WS);
 
 
     gemmini_fence();
@@ -151,10 +106,6 @@ int main() {
 #ifdef PRINT
     printf("C:\n");
     full_printMatrix(full_C);
-    // printf("B: \n");
-    // print_B(full_B);
-    // printf("B_reordered: \n");
-    // print_B_reordered(full_B_reordered);
 #endif
 
 
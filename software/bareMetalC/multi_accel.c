@@ -0,0 +1,228 @@
+// See LICENSE for license details.
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+
+// Layers split across several harts, each with its own accelerator, must
+// match the same layers run whole. Baremetal builds run on however many harts
+// the target has, up to GEMMINI_HARTS; Linux builds start HARTS threads
+#define GEMMINI_HARTS 4
+#define HARTS 4
+
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_multi.h"
+
+// Split by rows
+#define I 100
+#define K 64
+#define J 48
+
+// Split by columns
+#define WI 16
+#define WJ 200
+
+// Ternary weights, split by columns
+#define TI 20
+#define TJ 256
+
+// Convs, split by output channels
+#define BATCHES 2
+#define IN_DIM 9
+#define IN_CHANNELS 18
+#define OUT_CHANNELS 70
+#define T_OUT_CHANNELS 128
+#define KERNEL_DIM 3
+#define POOL_DIM ((IN_DIM + 2 - 3) / 2 + 1)
+
+static elem_t in[I][K];
+static elem_t w[K][J];
+static acc_t bias[I][J];
+static elem_t out[I][J], gold[I][J];
+
+static elem_t w_wide[WJ][K];
+static acc_t bias_wide[WJ];
+static elem_t out_wide[WI][WJ], gold_wide[WI][WJ];
+
+static elem_t t_w[K][TJ / 4];
+static elem_t t_out[TI][TJ], t_gold[TI][TJ];
+
+static elem_t c_in[BATCHES][IN_DIM][IN_DIM][IN_CHANNELS];
+static elem_t c_w[KERNEL_DIM][KERNEL_DIM][IN_CHANNELS][OUT_CHANNELS];
+static elem_t c_tw[KERNEL_DIM][KERNEL_DIM][IN_CHANNELS][T_OUT_CHANNELS / 4];
+static acc_t c_bias[T_OUT_CHANNELS];
+static elem_t c_out[BATCHES][POOL_DIM][POOL_DIM][OUT_CHANNELS], c_gold[BATCHES][POOL_DIM][POOL_DIM][OUT_CHANNELS];
+static elem_t c_tout[BATCHES][IN_DIM][IN_DIM][T_OUT_CHANNELS], c_tgold[BATCHES][IN_DIM][IN_DIM][T_OUT_CHANNELS];
+static elem_t c_trans_out[IN_DIM][IN_DIM][BATCHES][OUT_CHANNELS], c_trans_gold[IN_DIM][IN_DIM][BATCHES][OUT_CHANNELS];
+
+static void run_matmul(int coreid, int ncores, elem_t * C, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto_multi(coreid, ncores, I, J, K,
+      (elem_t*)in, (elem_t*)w, bias, C,
+      K, J, J, J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      RELU, 0.25, 0, false,
+      false, false,
+      false, false,
+      0,
+      tiled_matmul_type);
+}
+
+static void run_wide_matmul(int coreid, int ncores, elem_t * C, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto_multi(coreid, ncores, WI, WJ, K,
+      (elem_t*)in, (elem_t*)w_wide, bias_wide, C,
+      K, K, WJ, WJ,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, 0.25, 0, true,
+      false, true,
+      false, false,
+      0,
+      tiled_matmul_type);
+}
+
+static void run_mpgemm(int coreid, int ncores, elem_t * C, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_mpgemm_auto_multi(coreid, ncores, TI, TJ, K,
+      (elem_t*)in, (elem_t*)t_w, NULL, C,
+      K, TJ, TJ, TJ,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+      false,
+      false, false,
+      tiled_matmul_type);
+}
+
+static void run_conv(int coreid, int ncores, elem_t * output, enum tiled_matmul_type_t tiled_conv_type) {
+  tiled_conv_auto_multi(coreid, ncores,
+      BATCHES, IN_DIM, IN_DIM, IN_CHANNELS,
+      OUT_CHANNELS, IN_DIM, IN_DIM,
+      1, 1, 1, 1, KERNEL_DIM,
+      false, false, false, false, false,
+      (elem_t*)c_in, (elem_t*)c_w, c_bias, output,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 3, 2, 1,
+      tiled_conv_type);
+}
+
+static void run_mpgemm_conv(int coreid, int ncores, elem_t * output, enum tiled_matmul_type_t tiled_conv_type) {
+  tiled_conv_mpgemm_auto_multi(coreid, ncores,
+      BATCHES, IN_DIM, IN_DIM, IN_CHANNELS,
+      T_OUT_CHANNELS, IN_DIM, IN_DIM,
+      1, 1, 1, 1, KERNEL_DIM,
+      false, false, false,
+      (elem_t*)c_in, (elem_t*)c_tw, c_bias, output,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+      tiled_conv_type);
+}
+
+// Transposed convs run whole on hart 0
+static void run_trans_conv(int coreid, int ncores, elem_t * output, enum tiled_matmul_type_t tiled_conv_type) {
+  tiled_conv_auto_multi(coreid, ncores,
+      BATCHES, IN_DIM, IN_DIM, IN_CHANNELS,
+      OUT_CHANNELS, IN_DIM, IN_DIM,
+      1, 1, 1, 1, KERNEL_DIM,
+      false, true, false, false, false,
+      (elem_t*)c_in, (elem_t*)c_w, c_bias, output,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+      tiled_conv_type);
+}
+
+static void fill(elem_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % range) - range / 2;
+}
+
+static void init() {
+  fill((elem_t*)in, sizeof(in), 16);
+  fill((elem_t*)w, sizeof(w), 8);
+  fill((elem_t*)w_wide, sizeof(w_wide), 8);
+  fill((elem_t*)t_w, sizeof(t_w), 256);
+  fill((elem_t*)c_in, sizeof(c_in), 16);
+  fill((elem_t*)c_w, sizeof(c_w), 4);
+  fill((elem_t*)c_tw, sizeof(c_tw), 256);
+  for (size_t i = 0; i < I; i++)
+    for (size_t j = 0; j < J; j++)
+      bias[i][j] = (rand() % 256) - 128;
+  for (size_t j = 0; j < WJ; j++)
+    bias_wide[j] = (rand() % 256) - 128;
+  for (size_t c = 0; c < T_OUT_CHANNELS; c++)
+    c_bias[c] = (rand() % 64) - 32;
+
+  run_matmul(0, 1, (elem_t*)gold, CPU);
+  run_wide_matmul(0, 1, (elem_t*)gold_wide, CPU);
+  run_mpgemm(0, 1, (elem_t*)t_gold, CPU);
+  run_conv(0, 1, (elem_t*)c_gold, CPU);
+  run_mpgemm_conv(0, 1, (elem_t*)c_tgold, CPU);
+  run_trans_conv(0, 1, (elem_t*)c_trans_gold, CPU);
+}
+
+static void run(int coreid, int ncores) {
+  gemmini_flush(0);
+
+  run_matmul(coreid, ncores, (elem_t*)out, WS);
+  run_wide_matmul(coreid, ncores, (elem_t*)out_wide, WS);
+  run_mpgemm(coreid, ncores, (elem_t*)t_out, WS);
+  run_conv(coreid, ncores, (elem_t*)c_out, WS);
+  run_mpgemm_conv(coreid, ncores, (elem_t*)c_tout, WS);
+  run_trans_conv(coreid, ncores, (elem_t*)c_trans_out, WS);
+}
+
+static void check(const char * what, const void * x, const void * y, size_t n) {
+  if (memcmp(x, y, n) != 0) {
+    printf("The split %s doesn't match the CPU\n", what);
+    exit(1);
+  }
+}
+
+static void check_all() {
+  check("matmul", out, gold, sizeof(out));
+  check("wide matmul", out_wide, gold_wide, sizeof(out_wide));
+  check("ternary matmul", t_out, t_gold, sizeof(t_out));
+  check("conv", c_out, c_gold, sizeof(c_out));
+  check("ternary conv", c_tout, c_tgold, sizeof(c_tout));
+  check("transposed conv", c_trans_out, c_trans_gold, sizeof(c_trans_out));
+}
+
+#ifdef BAREMETAL
+void thread_entry(int cid, int nc) {
+  if (cid == 0)
+    init();
+  gemmini_barrier(nc);
+
+  run(cid, nc);
+
+  if (cid == 0) {
+    check_all();
+    printf("SUCCESS on %d harts\n", nc);
+  }
+  gemmini_barrier(nc);
+  exit(0);
+}
+#endif
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    init();
+
+#ifdef BAREMETAL
+    run(0, 1);
+#else
+    gemmini_multi_launch(HARTS, run);
+#endif
+
+    check_all();
+
+    printf("SUCCESS\n");
+    exit(0);
+}
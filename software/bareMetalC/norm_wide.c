@@ -0,0 +1,105 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+
+// Layernorms and softmaxes of rows that the CPU computes in several blocks
+// must still match the Normalizer. The blocks are shrunk so that the rows
+// still fit in the accumulator
+#define NORM_CPU_BLOCK 64
+#include "include/gemmini_testutils.h"
+
+#define I 20
+#define K 32
+#define J (3 * NORM_CPU_BLOCK + 8)
+// Ternary rows are only normalized like the CPU when they are a multiple of
+// 4*DIM wide and have no bias
+#define TJ (4 * NORM_CPU_BLOCK)
+#define BERT_SCALE 0.05
+
+static elem_t in[I][K] row_align(1);
+static elem_t w[K][J] row_align(1);
+static elem_t w_packed[K][TJ / 4] row_align(1);
+static acc_t bias[J] row_align_acc(1);
+static elem_t out[I][TJ] row_align(1);
+static elem_t gold[I][TJ] row_align(1);
+
+static void run_matmul(int act, elem_t * C, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto(I, J, K, (elem_t*)in, (elem_t*)w, bias, C,
+      K, J, TJ, TJ,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      act, ACC_SCALE_IDENTITY, BERT_SCALE, true,
+      false, false,
+      false, false,
+      0,
+      tiled_matmul_type);
+}
+
+static void run_mpgemm(int act, elem_t * C, enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_mpgemm_auto(I, TJ, K, (elem_t*)in, (elem_t*)w_packed, NULL, C,
+      K, TJ, TJ, TJ,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      act, ACC_SCALE_IDENTITY, BERT_SCALE, false,
+      false,
+      false, false,
+      tiled_matmul_type);
+}
+
+static void check(const char * what, int act, size_t cols) {
+  gemmini_fence();
+  for (size_t i = 0; i < I; i++)
+    if (memcmp(out[i], gold[i], cols) != 0) {
+      printf("The %s %s of %d columns doesn't match the CPU\n", what,
+          act == LAYERNORM ? "layernorm" : "softmax", (int)cols);
+      exit(1);
+    }
+}
+
+int main() {
+#if defined(FAST) || !defined(HAS_NORMALIZATIONS)
+    exit(0);
+#endif
+
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < I; i++)
+      for (size_t k = 0; k < K; k++)
+        in[i][k] = (rand() % 7) - 3;
+    for (size_t k = 0; k < K; k++) {
+      for (size_t j = 0; j < J; j++)
+        w[k][j] = (rand() % 7) - 3;
+      for (size_t j = 0; j < TJ / 4; j++)
+        w_packed[k][j] = rand();
+    }
+    // Rows whose mean is far from 0
+    for (size_t j = 0; j < J; j++)
+      bias[j] = 100 + (rand() % 64);
+
+    const int acts[] = {LAYERNORM, SOFTMAX};
+    for (int a = 0; a < 2; a++) {
+      run_matmul(acts[a], (elem_t*)gold, CPU);
+      run_matmul(acts[a], (elem_t*)out, WS);
+      check("matmul", acts[a], J);
+
+      run_mpgemm(acts[a], (elem_t*)gold, CPU);
+      run_mpgemm(acts[a], (elem_t*)out, WS);
+      check("ternary matmul", acts[a], TJ);
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -98,10 +98,10 @@ int main() {
   // 소프트웨어 정답 계산
   // -------------------------
   static full_t tmp1[DIM][DIM];
-  matmul(A, B1, D, gold_caseA);
+  matmul_short(A, B1, D, gold_caseA);
 
   matmul(A, B1, D, tmp1);
-  matmul(A, B2, D, gold_caseB);     // no accumulate
+  matmul_short(A, B2, D, gold_caseB);     // no accumulate
 
   // -------------------------
   // 비교 및 출력
@@ -0,0 +1,123 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_profile.h"
+
+// A conv feeding a fully connected layer, each in its own scope
+#define IN_ROW_DIM 17
+#define IN_COL_DIM 17
+#define IN_CHANNELS 16
+#define OUT_CHANNELS 32
+#define KERNEL_DIM 3
+#define PADDING 1
+#define N_PATCHES (IN_ROW_DIM * IN_COL_DIM)
+#define FC_DIM 48
+
+static elem_t input[IN_ROW_DIM][IN_COL_DIM][IN_CHANNELS];
+static elem_t conv_weights[KERNEL_DIM * KERNEL_DIM * IN_CHANNELS][OUT_CHANNELS];
+static acc_t conv_bias[OUT_CHANNELS];
+static elem_t conv_out[N_PATCHES][OUT_CHANNELS];
+static elem_t fc_weights[OUT_CHANNELS][FC_DIM];
+static acc_t fc_bias[FC_DIM];
+static elem_t output[N_PATCHES][FC_DIM];
+
+static void conv() {
+  tiled_conv_auto(
+      1, IN_ROW_DIM, IN_COL_DIM, IN_CHANNELS,
+      OUT_CHANNELS, IN_ROW_DIM, IN_COL_DIM,
+      1, 1, 1, PADDING, KERNEL_DIM,
+      false, false, false, false, false,
+
+      (elem_t*)input, (elem_t*)conv_weights, (acc_t*)conv_bias, (elem_t*)conv_out,
+
+      RELU, 0.125, 0, 0, 0,
+
+      WS);
+}
+
+static void fc() {
+  tiled_matmul_auto(N_PATCHES, FC_DIM, OUT_CHANNELS,
+      (elem_t*)conv_out, (elem_t*)fc_weights, fc_bias, (elem_t*)output,
+      OUT_CHANNELS, FC_DIM, 0, FC_DIM,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, 0.25, 0, true,
+      false, false,
+      false, false,
+      0,
+      WS);
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (elem_t * ptr = &input[0][0][0]; ptr < &input[0][0][0] + sizeof(input) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 32) - 16;
+    for (elem_t * ptr = &conv_weights[0][0]; ptr < &conv_weights[0][0] + sizeof(conv_weights) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+    for (elem_t * ptr = &fc_weights[0][0]; ptr < &fc_weights[0][0] + sizeof(fc_weights) / sizeof(elem_t); ptr++)
+      *ptr = (rand() % 8) - 4;
+
+    // The bytes the conv reads, counted directly
+    counter_reset();
+    counter_configure(0, RDMA_BYTES_REC);
+    conv();
+    gemmini_fence();
+    const uint32_t conv_bytes = counter_read(0);
+    counter_configure(0, DISABLE);
+
+    printf("Profiling %d passes\n", GEMMINI_PROFILE_PASSES);
+    for (int pass = 0; pass < GEMMINI_PROFILE_PASSES; pass++) {
+      GEMMINI_PROFILE("conv", conv());
+      GEMMINI_PROFILE("fc", fc());
+    }
+
+    gemmini_profile_report_csv();
+    gemmini_profile_report_json();
+
+    for (size_t s = 0; s < gemmini_profile_n_scopes; s++) {
+      const struct gemmini_profile_scope_t * scope = &gemmini_profile_scopes[s];
+
+      if (scope->runs != GEMMINI_PROFILE_PASSES) {
+        printf("%s ran %zu times instead of %d\n", scope->name, scope->runs, GEMMINI_PROFILE_PASSES);
+        exit(1);
+      }
+
+      for (int e = 1; e <= GEMMINI_PROFILE_EVENTS; e++)
+        if (scope->event_runs[e] != 1) {
+          printf("%s counted %s %u times instead of once\n", scope->name,
+              gemmini_profile_event_names[e - 1], scope->event_runs[e]);
+          exit(1);
+        }
+
+      if (gemmini_profile_value(scope, RDMA_BYTES_REC) == 0 ||
+          gemmini_profile_value(scope, WDMA_BYTES_SENT) == 0) {
+        printf("%s moved no data\n", scope->name);
+        exit(1);
+      }
+    }
+
+    if (gemmini_profile_value(&gemmini_profile_scopes[0], RDMA_BYTES_REC) != conv_bytes) {
+      printf("The conv scope read %llu bytes instead of %u\n",
+          (unsigned long long)gemmini_profile_value(&gemmini_profile_scopes[0], RDMA_BYTES_REC), conv_bytes);
+      exit(1);
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,186 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_roofline.h"
+
+// Each shape runs with int8 weights and then with packed ternary ones, so the
+// two land next to each other in the report. Ternary J and conv output
+// channels are multiples of 4*DIM, so they span whole packed blocks
+static const size_t matmul_shapes[][3] = { // I, J, K
+  {64, 256, 256},
+  {256, 256, 256},
+  {256, 1024, 256},
+  {16, 512, 512},
+};
+
+static const size_t gemv_shapes[][3] = { // I, J, K
+  {1, 512, 512},
+  {1, 1024, 1024},
+  {4, 1024, 1024},
+};
+
+static const int conv_shapes[][4] = { // in_dim, in_channels, out_channels, kernel_dim
+  {28, 64, 128, 3},
+  {14, 64, 64, 3},
+  {7, 256, 256, 3},
+  {14, 256, 64, 1},
+};
+
+#define N_MATMULS (sizeof(matmul_shapes) / sizeof(matmul_shapes[0]))
+#define N_GEMVS (sizeof(gemv_shapes) / sizeof(gemv_shapes[0]))
+#define N_CONVS (sizeof(conv_shapes) / sizeof(conv_shapes[0]))
+#define N_POINTS (2 * (N_MATMULS + N_GEMVS + N_CONVS))
+
+// Shared by every shape; the values don't affect the traffic
+static elem_t A[1 << 18] row_align(1);
+static elem_t B[1 << 20] row_align(1);
+static elem_t C[1 << 18] row_align(1);
+static acc_t bias[1024] row_align_acc(1);
+
+static struct gemmini_roofline_point_t points[N_POINTS];
+static size_t n_points = 0;
+
+static void run_matmul(const char * kernel, size_t I, size_t J, size_t K, bool ternary) {
+  struct gemmini_roofline_point_t * p = &points[n_points++];
+
+  gemmini_roofline_start();
+  if (ternary)
+    tiled_mpgemm_auto(I, J, K, A, B, NULL, C,
+        K, J, 0, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false,
+        false, false,
+        WS);
+  else
+    tiled_matmul_auto(I, J, K, A, B, NULL, C,
+        K, J, 0, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+  gemmini_roofline_stop(p, kernel, ternary, (uint64_t)I * J * K);
+
+  snprintf(p->shape, sizeof(p->shape), "%zux%zux%zu", I, J, K);
+}
+
+static void run_gemv(size_t I, size_t J, size_t K, bool ternary) {
+  struct gemmini_roofline_point_t * p = &points[n_points++];
+  const size_t KB = (K + DIM - 1) / DIM;
+
+  gemmini_roofline_start();
+  if (ternary)
+    gemv_mpgemm_auto(I, J, K, A, B, NULL, C,
+        K, J, 0, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false,
+        false, false);
+  else
+    gemv_auto(I, J, K, A, B, NULL, C,
+        K, KB * DIM, 0, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false, false,
+        false, false,
+        0, 0, 0);
+  gemmini_roofline_stop(p, "gemv", ternary, (uint64_t)I * J * K);
+
+  snprintf(p->shape, sizeof(p->shape), "%zux%zux%zu", I, J, K);
+}
+
+static void run_conv(int in_dim, int in_channels, int out_channels, int kernel_dim, bool ternary) {
+  struct gemmini_roofline_point_t * p = &points[n_points++];
+  const int padding = kernel_dim / 2;
+
+  gemmini_roofline_start();
+  if (ternary)
+    tiled_conv_mpgemm_auto(
+        1, in_dim, in_dim, in_channels,
+        out_channels, in_dim, in_dim,
+        1, 1, 1, padding, kernel_dim,
+        false, false, false,
+        A, B, bias, C,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+        WS);
+  else
+    tiled_conv_auto(
+        1, in_dim, in_dim, in_channels,
+        out_channels, in_dim, in_dim,
+        1, 1, 1, padding, kernel_dim,
+        false, false, false, false, false,
+        A, B, bias, C,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, 0, 0,
+        WS);
+  gemmini_roofline_stop(p, "conv", ternary,
+      (uint64_t)in_dim * in_dim * out_channels * kernel_dim * kernel_dim * in_channels);
+
+  snprintf(p->shape, sizeof(p->shape), "%dx%dx%d_%dx%d", in_dim, in_dim, in_channels, kernel_dim, out_channels);
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < sizeof(A); i++)
+      A[i] = (rand() % 16) - 8;
+    for (size_t i = 0; i < sizeof(B); i++)
+      B[i] = rand() % 256;
+
+    for (size_t s = 0; s < N_MATMULS; s++)
+      for (int ternary = 0; ternary <= 1; ternary++)
+        run_matmul(ternary ? "mpgemm" : "matmul",
+            matmul_shapes[s][0], matmul_shapes[s][1], matmul_shapes[s][2], ternary);
+
+    for (size_t s = 0; s < N_GEMVS; s++)
+      for (int ternary = 0; ternary <= 1; ternary++)
+        run_gemv(gemv_shapes[s][0], gemv_shapes[s][1], gemv_shapes[s][2], ternary);
+
+    for (size_t s = 0; s < N_CONVS; s++)
+      for (int ternary = 0; ternary <= 1; ternary++)
+        run_conv(conv_shapes[s][0], conv_shapes[s][1], conv_shapes[s][2], conv_shapes[s][3], ternary);
+
+    gemmini_roofline_print_csv_header();
+    for (size_t i = 0; i < n_points; i++)
+      gemmini_roofline_print_csv(&points[i]);
+    printf("\n");
+
+#ifdef GEMMINI_EMULATOR
+    gemmini_roofline_plot(points, n_points, false);
+#else
+    gemmini_roofline_plot(points, n_points, true);
+#endif
+
+    // Packing four weights per byte must cut the traffic of every shape
+    for (size_t i = 0; i < n_points; i += 2) {
+      const struct gemmini_roofline_point_t * int8 = &points[i];
+      const struct gemmini_roofline_point_t * ternary = &points[i + 1];
+
+      if (ternary->rdma_bytes >= int8->rdma_bytes) {
+        printf("Ternary %s %s read %llu bytes, but int8 read only %llu\n",
+            ternary->kernel, ternary->shape,
+            (unsigned long long)ternary->rdma_bytes, (unsigned long long)int8->rdma_bytes);
+        exit(1);
+      }
+    }
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,141 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/ternary_pack.h"
+
+#define MAT_DIM_I 20
+#define MAT_DIM_K 96
+#define MAT_DIM_J 256
+
+static elem_t full_A[MAT_DIM_I][MAT_DIM_K] row_align(1);
+static elem_t full_W[MAT_DIM_J][MAT_DIM_K];
+static elem_t full_W_unpacked[MAT_DIM_J][MAT_DIM_K];
+static elem_t full_B[MAT_DIM_K * MAT_DIM_J / 4] row_align(1);
+static elem_t full_C[MAT_DIM_I][MAT_DIM_J] row_align(1);
+static elem_t gold[MAT_DIM_I][MAT_DIM_J];
+
+int full_is_equal(elem_t x[MAT_DIM_I][MAT_DIM_J], elem_t y[MAT_DIM_I][MAT_DIM_J]) {
+  for (size_t i = 0; i < MAT_DIM_I; ++i)
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      if (x[i][j] != y[i][j])
+        return 0;
+  return 1;
+}
+
+static void check_unpack(enum ternary_layout_t layout) {
+  ternary_unpack(layout, MAT_DIM_K, MAT_DIM_J, full_B, (elem_t*)full_W_unpacked, 1, MAT_DIM_K);
+
+  for (size_t j = 0; j < MAT_DIM_J; j++)
+    for (size_t k = 0; k < MAT_DIM_K; k++)
+      if (full_W_unpacked[j][k] != full_W[j][k]) {
+        printf("Layout %d: weight (%zu, %zu) unpacked as %d instead of %d\n",
+            layout, k, j, full_W_unpacked[j][k], full_W[j][k]);
+        exit(1);
+      }
+}
+
+static void check_mpgemm(bool transpose_B) {
+  tiled_mpgemm_auto(MAT_DIM_I, MAT_DIM_J, MAT_DIM_K,
+          (elem_t*)full_A, full_B, NULL, (elem_t*)full_C,
+          MAT_DIM_K, transpose_B ? MAT_DIM_K : MAT_DIM_J, MAT_DIM_J, MAT_DIM_J,
+          MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+          NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+          transpose_B,
+          false, false,                      // full_C, low_D
+          WS);
+
+  gemmini_fence();
+
+  if (!full_is_equal(full_C, gold)) {
+    printf("mpgemm with transpose_B=%d does not match the reference\n", transpose_B);
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < MAT_DIM_I; ++i)
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        full_A[i][k] = (rand() % 16) - 8;
+
+    // Weights are stored out x in, so both layouts are packed through strides
+    for (size_t j = 0; j < MAT_DIM_J; ++j)
+      for (size_t k = 0; k < MAT_DIM_K; ++k)
+        full_W[j][k] = rand() % 3 - 1;
+
+    for (size_t i = 0; i < MAT_DIM_I; ++i)
+      for (size_t j = 0; j < MAT_DIM_J; ++j) {
+        acc_t sum = 0;
+        for (size_t k = 0; k < MAT_DIM_K; ++k)
+          sum += full_A[i][k] * full_W[j][k];
+        gold[i][j] = sum > elem_t_max ? elem_t_max : sum < elem_t_min ? elem_t_min : sum;
+      }
+
+    printf("Packing TERNARY_KJ\n");
+    ternary_pack(TERNARY_KJ, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, 1, MAT_DIM_K, full_B);
+    check_unpack(TERNARY_KJ);
+    check_mpgemm(false);
+
+    printf("Packing TERNARY_JK\n");
+    ternary_pack(TERNARY_JK, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, 1, MAT_DIM_K, full_B);
+    check_unpack(TERNARY_JK);
+
+    printf("Packing TERNARY_JK_DIM\n");
+    ternary_pack(TERNARY_JK_DIM, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, 1, MAT_DIM_K, full_B);
+    check_unpack(TERNARY_JK_DIM);
+    check_mpgemm(true);
+
+#ifndef BAREMETAL
+    // Round trip through the on-disk format, streaming with several threads
+    printf("Packing a weight file\n");
+
+    const char * src_path = "ternary_pack_src.bin";
+    const char * dst_path = "ternary_pack_dst.bin";
+
+    FILE * src = fopen(src_path, "wb");
+    if (src == NULL || fwrite(full_W, 1, sizeof(full_W), src) != sizeof(full_W) || fclose(src) != 0) {
+      printf("Could not write %s\n", src_path);
+      exit(1);
+    }
+
+    ternary_pack_file(src_path, true, MAT_DIM_K, MAT_DIM_J, 0.5, TERNARY_KJ, dst_path, 3);
+
+    struct ternary_file_header_t header;
+    const elem_t * mapped = ternary_file_map(dst_path, &header);
+
+    if (header.K != MAT_DIM_K || header.J != MAT_DIM_J || header.layout != TERNARY_KJ ||
+        header.scale != 0.5 || header.data_offset % TERNARY_FILE_ALIGN != 0) {
+      printf("Ternary file header does not match what was packed\n");
+      exit(1);
+    }
+
+    ternary_pack(TERNARY_KJ, MAT_DIM_K, MAT_DIM_J, (elem_t*)full_W, 1, MAT_DIM_K, full_B);
+    if (memcmp(mapped, full_B, sizeof(full_B)) != 0) {
+      printf("Ternary file contents do not match ternary_pack\n");
+      exit(1);
+    }
+
+    ternary_file_unmap(mapped, &header);
+    remove(src_path);
+    remove(dst_path);
+#endif
+
+  printf("SUCCESS\n");
+  exit(0);
+}
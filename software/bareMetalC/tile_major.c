@@ -0,0 +1,213 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+
+// Each layer runs once with row-major B and once with tile-major B, and the
+// results must match
+
+// A tall, narrow weight matrix, whose row-major rows are each one DIM-byte
+// DMA request
+#define I 32
+#define K 256
+#define J 16
+
+// Padded on every side, with B transposed
+#define PI 20
+#define PK 40
+#define PJ 50
+
+// Packed ternary weights
+#define TI 16
+#define TK 64
+#define TJ 128
+
+// A GEMV over a batch of 2
+#define VI 2
+#define VK 100
+#define VJ 48
+
+static elem_t in[I][K] row_align(1);
+static elem_t w[K][J] row_align(1);
+static elem_t w_tiles[TILE_MAJOR_ELEMS(K, J)] row_align(1);
+static elem_t out[I][J] row_align(1);
+static elem_t gold[I][J] row_align(1);
+
+static elem_t p_in[PI][PK] row_align(1);
+static elem_t p_wt[PJ][PK] row_align(1);
+static elem_t p_wt_tiles[TILE_MAJOR_ELEMS(PJ, PK)] row_align(1);
+static acc_t p_bias[PJ] row_align_acc(1);
+static elem_t p_out[PI][PJ] row_align(1);
+static elem_t p_gold[PI][PJ] row_align(1);
+
+static elem_t t_in[TI][TK] row_align(1);
+static elem_t t_w[TK][TJ / 4] row_align(1);
+static elem_t t_w_tiles[TILE_MAJOR_ELEMS(TK, TJ / 4)] row_align(1);
+static elem_t t_out[TI][TJ] row_align(1);
+static elem_t t_gold[TI][TJ] row_align(1);
+
+static elem_t v_in[VI][VK] row_align(1);
+static elem_t v_w[VK][VJ] row_align(1);
+static elem_t v_w_tiles[TILE_MAJOR_ELEMS(VK, VJ)] row_align(1);
+static elem_t v_out[VI][VJ] row_align(1);
+static elem_t v_gold[VI][VJ] row_align(1);
+
+static void fill(elem_t * x, size_t n, int range) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = (rand() % range) - range / 2;
+}
+
+static void check(const char * what, const elem_t * x, const elem_t * y, size_t n) {
+  if (memcmp(x, y, n * sizeof(elem_t)) != 0) {
+    printf("%s differs with tile-major weights\n", what);
+    exit(1);
+  }
+}
+
+#ifdef GEMMINI_EMULATOR
+static uint32_t read_latency(void) {
+  gemmini_fence();
+  return counter_read(0);
+}
+#endif
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    fill(&in[0][0], I * K, 16);
+    fill(&w[0][0], K * J, 8);
+    fill(&p_in[0][0], PI * PK, 16);
+    fill(&p_wt[0][0], PJ * PK, 8);
+    fill(&t_in[0][0], TI * TK, 16);
+    fill(&t_w[0][0], TK * TJ / 4, 256);
+    fill(&v_in[0][0], VI * VK, 16);
+    fill(&v_w[0][0], VK * VJ, 8);
+    for (size_t j = 0; j < PJ; j++)
+      p_bias[j] = (rand() % 64) - 32;
+
+    tile_major_pack(K, J, &w[0][0], J, w_tiles);
+    tile_major_pack(PJ, PK, &p_wt[0][0], PK, p_wt_tiles);
+    tile_major_pack(TK, TJ / 4, &t_w[0][0], TJ / 4, t_w_tiles);
+    tile_major_pack(VK, VJ, &v_w[0][0], VJ, v_w_tiles);
+
+    // The padding of a partial tile is zero-filled, and unpacking restores B
+    static elem_t unpacked[PJ][PK];
+    tile_major_unpack(PJ, PK, p_wt_tiles, &unpacked[0][0], PK);
+    check("Unpacking", &unpacked[0][0], &p_wt[0][0], PJ * PK);
+    if (p_wt_tiles[tile_major_offset(PK, PJ - 1, PK)] != 0) {
+      printf("The padding of a partial tile isn't zero\n");
+      exit(1);
+    }
+
+#ifdef GEMMINI_EMULATOR
+    counter_configure(0, RDMA_TOTAL_LATENCY);
+    counter_reset();
+#endif
+
+    tiled_matmul_auto(I, J, K, (elem_t*)in, (elem_t*)w, NULL, (elem_t*)gold,
+        K, J, J, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        RELU, 0.25, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+
+#ifdef GEMMINI_EMULATOR
+    const uint32_t row_major_latency = read_latency();
+    counter_reset();
+#endif
+
+    tiled_matmul_tile_major_auto(I, J, K, (elem_t*)in, w_tiles, NULL, (elem_t*)out,
+        K, J, J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        RELU, 0.25, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+
+#ifdef GEMMINI_EMULATOR
+    const uint32_t tile_major_latency = read_latency();
+    printf("DMA read latency: %u cycles row-major, %u cycles tile-major\n",
+        row_major_latency, tile_major_latency);
+    if (tile_major_latency >= row_major_latency) {
+      printf("Tile-major weights didn't shorten the loads\n");
+      exit(1);
+    }
+#endif
+
+    gemmini_fence();
+    check("The narrow matmul", &out[0][0], &gold[0][0], I * J);
+
+    tiled_matmul_auto(PI, PJ, PK, (elem_t*)p_in, (elem_t*)p_wt, p_bias, (elem_t*)p_gold,
+        PK, PK, PJ, PJ,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, 0.125, 0, true,
+        false, true,
+        false, false,
+        0,
+        WS);
+    tiled_matmul_tile_major_auto(PI, PJ, PK, (elem_t*)p_in, p_wt_tiles, p_bias, (elem_t*)p_out,
+        PK, PJ, PJ,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, 0.125, 0, true,
+        false, true,
+        false, false,
+        0,
+        WS);
+    gemmini_fence();
+    check("The padded, transposed matmul", &p_out[0][0], &p_gold[0][0], PI * PJ);
+
+    tiled_mpgemm_auto(TI, TJ, TK, (elem_t*)t_in, (elem_t*)t_w, NULL, (elem_t*)t_gold,
+        TK, TJ, TJ, TJ,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false,
+        false, false,
+        WS);
+    tiled_mpgemm_tile_major_auto(TI, TJ, TK, (elem_t*)t_in, t_w_tiles, NULL, (elem_t*)t_out,
+        TK, TJ, TJ,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false, false,
+        WS);
+    gemmini_fence();
+    check("The ternary matmul", &t_out[0][0], &t_gold[0][0], TI * TJ);
+
+    tiled_matmul_auto(VI, VJ, VK, (elem_t*)v_in, (elem_t*)v_w, NULL, (elem_t*)v_gold,
+        VK, VJ, VJ, VJ,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, 0.25, 0, false,
+        false, false,
+        false, false,
+        0,
+        WS);
+    gemv_tile_major_auto(VI, VJ, VK, (elem_t*)v_in, v_w_tiles, NULL, (elem_t*)v_out,
+        VK, VJ, VJ,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, 0.25, 0, false,
+        false, false,
+        false, false,
+        0, 0, 0);
+    gemmini_fence();
+    check("The GEMV", &v_out[0][0], &v_gold[0][0], VI * VJ);
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -0,0 +1,142 @@
+// See LICENSE for license details.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <sys/mman.h>
+#endif
+#include "include/gemmini_testutils.h"
+#include "include/gemmini_weights.h"
+
+// One int8 layer with a bias, and one ternary layer, run from a weight
+// container and from the arrays it was built from
+#define I 32
+#define K 64
+#define J 64
+#define TERNARY_SCALE 0.0625
+
+static elem_t in[I][K] row_align(1);
+static elem_t w[K][J] row_align(1);
+static acc_t b[J] row_align_acc(1);
+static elem_t tw[K][J];
+static elem_t tw_packed[K][J / 4] row_align(1);
+
+static elem_t out[I][J] row_align(1);
+static elem_t gold[I][J] row_align(1);
+
+static uint8_t container[1 << 14] __attribute__((aligned(GEMMINI_WEIGHTS_ALIGN)));
+
+static void layer(const elem_t * w, const acc_t * b, elem_t * out) {
+  tiled_matmul_auto(I, J, K, (elem_t*)in, (elem_t*)w, b, out,
+      K, J, J, J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      RELU, 0.25, 0, true,
+      false, false,
+      false, false,
+      0,
+      WS);
+}
+
+static void ternary_layer(const elem_t * packed, elem_t * out) {
+  tiled_mpgemm_auto(I, J, K, (elem_t*)in, (elem_t*)packed, NULL, out,
+      K, J, J, J,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+      false,
+      false, false,
+      WS);
+}
+
+static void check(const char * what) {
+  gemmini_fence();
+  if (!MAT_IS_EQUAL(I, J, out, gold)) {
+    printf("%s differs when its weights come from the container\n", what);
+    exit(1);
+  }
+}
+
+static void run(const struct gemmini_weights_t * weights) {
+  layer((elem_t*)w, b, (elem_t*)gold);
+  layer((elem_t*)GEMMINI_WEIGHTS_GET(weights, w), (acc_t*)GEMMINI_WEIGHTS_GET(weights, b), (elem_t*)out);
+  check("The int8 layer");
+
+  ternary_layer((elem_t*)tw_packed, (elem_t*)gold);
+  ternary_layer((elem_t*)gemmini_weights_get(weights, "tw", sizeof(tw_packed)), (elem_t*)out);
+  check("The ternary layer");
+
+  if (gemmini_weights_scale(weights, "tw") != (float)TERNARY_SCALE) {
+    printf("The ternary layer's scale was lost\n");
+    exit(1);
+  }
+}
+
+int main() {
+#ifndef BAREMETAL
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+      perror("mlockall failed");
+      exit(1);
+    }
+#endif
+
+    gemmini_flush(0);
+
+    for (size_t i = 0; i < I; i++)
+      for (size_t k = 0; k < K; k++)
+        in[i][k] = (rand() % 16) - 8;
+
+    for (size_t k = 0; k < K; k++)
+      for (size_t j = 0; j < J; j++) {
+        w[k][j] = (rand() % 8) - 4;
+        tw[k][j] = (rand() % 3) - 1;
+      }
+
+    for (size_t j = 0; j < J; j++)
+      b[j] = (rand() % 64) - 32;
+
+    ternary_pack(TERNARY_KJ, K, J, (elem_t*)tw, J, 1, (elem_t*)tw_packed);
+
+    static struct gemmini_weights_builder_t builder;
+    gemmini_weights_build_start(&builder, container, sizeof(container));
+    gemmini_weights_build_add(&builder, "w", GEMMINI_WEIGHTS_ELEM, K, J, w, 1);
+    gemmini_weights_build_add(&builder, "b", GEMMINI_WEIGHTS_ACC, 1, J, b, 1);
+    gemmini_weights_build_add_ternary(&builder, "tw", TERNARY_KJ, K, J, (elem_t*)tw, J, 1, TERNARY_SCALE);
+    const size_t bytes = gemmini_weights_build_finish(&builder);
+
+    printf("Container: %llu bytes, %u tensors\n", (unsigned long long)bytes, builder.n_tensors);
+
+    struct gemmini_weights_t weights;
+    gemmini_weights_open(&weights, container, bytes);
+
+    for (uint32_t t = 0; t < weights.header->n_tensors; t++)
+      if (weights.table[t].offset % GEMMINI_WEIGHTS_ALIGN != 0) {
+        printf("%s isn't aligned\n", weights.table[t].name);
+        exit(1);
+      }
+
+    run(&weights);
+
+#ifndef BAREMETAL
+    // The same container through a file
+    char path[] = "/tmp/gemmini_weights_XXXXXX";
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+      perror("mkstemp failed");
+      exit(1);
+    }
+    close(fd);
+
+    gemmini_weights_save(path, container, bytes);
+    gemmini_weights_map(&weights, path);
+    unlink(path);
+
+    run(&weights);
+    gemmini_weights_unmap(&weights);
+#endif
+
+    printf("SUCCESS\n");
+    exit(0);
+}
@@ -10,6 +10,538 @@
 #include "mobilenet_params.h"
 #include "images.h"
 
+// Every activation lives in one arena, planned from the layers' lifetimes,
+// instead of in its own static buffer from mobilenet_params.h
+#ifndef ACTIVATION_ARENA
+#define ACTIVATION_ARENA 1
+#endif
+
+#if ACTIVATION_ARENA
+#include "include/gemmini_arena.h"
+
+static struct gemmini_arena_t activations;
+
+#ifdef BAREMETAL
+#ifndef ACTIVATION_ARENA_BYTES
+#define ACTIVATION_ARENA_BYTES (16 << 20)
+#endif
+
+static char activation_arena[ACTIVATION_ARENA_BYTES] __attribute__((aligned(GEMMINI_ARENA_ALIGN)));
+#endif
+
+// main() moves the arena on to the next layer at the same points as
+// plan_activations, so touching a tensor outside the layers it was planned for
+// exits instead of silently sharing memory with another live tensor
+#define NEXT_LAYER() gemmini_arena_next_layer(&activations)
+
+// The activations each layer of main() reads or writes, in the order they run.
+// The im2col buffers are only used when convs run as matmuls
+static void plan_activations(bool conv) {
+#define USE(name) GEMMINI_ARENA_USE(&activations, name)
+#define USE_IF_MATMUL(name) if (!conv) USE(name)
+
+    // conv_1
+    USE_IF_MATMUL(conv_1_in); USE(conv_1_out); NEXT_LAYER();
+
+    // conv_dw_2
+    USE(conv_1_out); USE(conv_dw_2_out); NEXT_LAYER();
+
+    // conv_3
+    USE(conv_dw_2_out); USE(conv_3_out); NEXT_LAYER();
+
+    // conv_4
+    USE(conv_3_out); USE(conv_4_out); NEXT_LAYER();
+
+    // conv_dw_5
+    USE(conv_4_out); USE(conv_dw_5_out); NEXT_LAYER();
+
+    // conv_6
+    USE(conv_dw_5_out); USE(conv_6_out); NEXT_LAYER();
+
+    // conv_7
+    USE(conv_6_out); USE(conv_7_out); NEXT_LAYER();
+
+    // conv_dw_8
+    USE(conv_7_out); USE(conv_dw_8_out); NEXT_LAYER();
+
+    // conv_9
+    USE(conv_dw_8_out); USE(conv_9_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_6_out); USE(conv_9_out); NEXT_LAYER();
+
+    // conv_10
+    USE(conv_9_out); USE(conv_10_out); NEXT_LAYER();
+
+    // conv_dw_11
+    USE(conv_10_out); USE(conv_dw_11_out); NEXT_LAYER();
+
+    // conv_12
+    USE(conv_dw_11_out); USE(conv_12_out); NEXT_LAYER();
+
+    // conv_13
+    USE(conv_12_out); USE(conv_13_out); NEXT_LAYER();
+
+    // conv_dw_14
+    USE(conv_13_out); USE(conv_dw_14_out); NEXT_LAYER();
+
+    // conv_15
+    USE(conv_dw_14_out); USE(conv_15_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_12_out); USE(conv_15_out); NEXT_LAYER();
+
+    // conv_16
+    USE(conv_15_out); USE(conv_16_out); NEXT_LAYER();
+
+    // conv_dw_17
+    USE(conv_16_out); USE(conv_dw_17_out); NEXT_LAYER();
+
+    // conv_18
+    USE(conv_dw_17_out); USE(conv_18_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_15_out); USE(conv_18_out); NEXT_LAYER();
+
+    // conv_19
+    USE(conv_18_out); USE(conv_19_out); NEXT_LAYER();
+
+    // conv_dw_20
+    USE(conv_19_out); USE(conv_dw_20_out); NEXT_LAYER();
+
+    // conv_21
+    USE(conv_dw_20_out); USE(conv_21_out); NEXT_LAYER();
+
+    // conv_22
+    USE(conv_21_out); USE(conv_22_out); NEXT_LAYER();
+
+    // conv_dw_23
+    USE(conv_22_out); USE(conv_dw_23_out); NEXT_LAYER();
+
+    // conv_24
+    USE(conv_dw_23_out); USE(conv_24_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_21_out); USE(conv_24_out); NEXT_LAYER();
+
+    // conv_25
+    USE(conv_24_out); USE(conv_25_out); NEXT_LAYER();
+
+    // conv_dw_26
+    USE(conv_25_out); USE(conv_dw_26_out); NEXT_LAYER();
+
+    // conv_27
+    USE(conv_dw_26_out); USE(conv_27_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_24_out); USE(conv_27_out); NEXT_LAYER();
+
+    // conv_28
+    USE(conv_27_out); USE(conv_28_out); NEXT_LAYER();
+
+    // conv_dw_29
+    USE(conv_28_out); USE(conv_dw_29_out); NEXT_LAYER();
+
+    // conv_30
+    USE(conv_dw_29_out); USE(conv_30_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_27_out); USE(conv_30_out); NEXT_LAYER();
+
+    // conv_31
+    USE(conv_30_out); USE(conv_31_out); NEXT_LAYER();
+
+    // conv_dw_32
+    USE(conv_31_out); USE(conv_dw_32_out); NEXT_LAYER();
+
+    // conv_33
+    USE(conv_dw_32_out); USE(conv_33_out); NEXT_LAYER();
+
+    // conv_34
+    USE(conv_33_out); USE(conv_34_out); NEXT_LAYER();
+
+    // conv_dw_35
+    USE(conv_34_out); USE(conv_dw_35_out); NEXT_LAYER();
+
+    // conv_36
+    USE(conv_dw_35_out); USE(conv_36_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_33_out); USE(conv_36_out); NEXT_LAYER();
+
+    // conv_37
+    USE(conv_36_out); USE(conv_37_out); NEXT_LAYER();
+
+    // conv_dw_38
+    USE(conv_37_out); USE(conv_dw_38_out); NEXT_LAYER();
+
+    // conv_39
+    USE(conv_dw_38_out); USE(conv_39_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_36_out); USE(conv_39_out); NEXT_LAYER();
+
+    // conv_40
+    USE(conv_39_out); USE(conv_40_out); NEXT_LAYER();
+
+    // conv_dw_41
+    USE(conv_40_out); USE(conv_dw_41_out); NEXT_LAYER();
+
+    // conv_42
+    USE(conv_dw_41_out); USE(conv_42_out); NEXT_LAYER();
+
+    // conv_43
+    USE(conv_42_out); USE(conv_43_out); NEXT_LAYER();
+
+    // conv_dw_44
+    USE(conv_43_out); USE(conv_dw_44_out); NEXT_LAYER();
+
+    // conv_45
+    USE(conv_dw_44_out); USE(conv_45_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_42_out); USE(conv_45_out); NEXT_LAYER();
+
+    // conv_46
+    USE(conv_45_out); USE(conv_46_out); NEXT_LAYER();
+
+    // conv_dw_47
+    USE(conv_46_out); USE(conv_dw_47_out); NEXT_LAYER();
+
+    // conv_48
+    USE(conv_dw_47_out); USE(conv_48_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_45_out); USE(conv_48_out); NEXT_LAYER();
+
+    // conv_49
+    USE(conv_48_out); USE(conv_49_out); NEXT_LAYER();
+
+    // conv_dw_50
+    USE(conv_49_out); USE(conv_dw_50_out); NEXT_LAYER();
+
+    // conv_51
+    USE(conv_dw_50_out); USE(conv_51_out); NEXT_LAYER();
+
+    // conv_52
+    USE(conv_51_out); USE(conv_52_out); NEXT_LAYER();
+
+    // Global averaging
+    USE(conv_52_out); NEXT_LAYER();
+
+    // fc_53
+    USE(fc_53_out); NEXT_LAYER();
+
+#undef USE
+#undef USE_IF_MATMUL
+
+    gemmini_arena_plan(&activations);
+
+#ifdef BAREMETAL
+    if (activations.size > sizeof(activation_arena)) {
+        printf("The activations need %llu bytes; rebuild with ACTIVATION_ARENA_BYTES of at least that\n",
+            (unsigned long long)activations.size);
+        exit(1);
+    }
+    gemmini_arena_bind(&activations, activation_arena);
+#else
+    void * base;
+    if (posix_memalign(&base, GEMMINI_ARENA_ALIGN, activations.size) != 0) {
+        perror("Can't allocate the activation arena");
+        exit(1);
+    }
+    gemmini_arena_bind(&activations, base);
+#endif
+
+    gemmini_arena_print(&activations);
+}
+
+#define conv_1_in GEMMINI_ARENA_GET(&activations, conv_1_in)
+#define conv_1_out GEMMINI_ARENA_GET(&activations, conv_1_out)
+#define conv_dw_2_out GEMMINI_ARENA_GET(&activations, conv_dw_2_out)
+#define conv_3_out GEMMINI_ARENA_GET(&activations, conv_3_out)
+#define conv_4_out GEMMINI_ARENA_GET(&activations, conv_4_out)
+#define conv_dw_5_out GEMMINI_ARENA_GET(&activations, conv_dw_5_out)
+#define conv_6_out GEMMINI_ARENA_GET(&activations, conv_6_out)
+#define conv_7_out GEMMINI_ARENA_GET(&activations, conv_7_out)
+#define conv_dw_8_out GEMMINI_ARENA_GET(&activations, conv_dw_8_out)
+#define conv_9_out GEMMINI_ARENA_GET(&activations, conv_9_out)
+#define conv_10_out GEMMINI_ARENA_GET(&activations, conv_10_out)
+#define conv_dw_11_out GEMMINI_ARENA_GET(&activations, conv_dw_11_out)
+#define conv_12_out GEMMINI_ARENA_GET(&activations, conv_12_out)
+#define conv_13_out GEMMINI_ARENA_GET(&activations, conv_13_out)
+#define conv_dw_14_out GEMMINI_ARENA_GET(&activations, conv_dw_14_out)
+#define conv_15_out GEMMINI_ARENA_GET(&activations, conv_15_out)
+#define conv_16_out GEMMINI_ARENA_GET(&activations, conv_16_out)
+#define conv_dw_17_out GEMMINI_ARENA_GET(&activations, conv_dw_17_out)
+#define conv_18_out GEMMINI_ARENA_GET(&activations, conv_18_out)
+#define conv_19_out GEMMINI_ARENA_GET(&activations, conv_19_out)
+#define conv_dw_20_out GEMMINI_ARENA_GET(&activations, conv_dw_20_out)
+#define conv_21_out GEMMINI_ARENA_GET(&activations, conv_21_out)
+#define conv_22_out GEMMINI_ARENA_GET(&activations, conv_22_out)
+#define conv_dw_23_out GEMMINI_ARENA_GET(&activations, conv_dw_23_out)
+#define conv_24_out GEMMINI_ARENA_GET(&activations, conv_24_out)
+#define conv_25_out GEMMINI_ARENA_GET(&activations, conv_25_out)
+#define conv_dw_26_out GEMMINI_ARENA_GET(&activations, conv_dw_26_out)
+#define conv_27_out GEMMINI_ARENA_GET(&activations, conv_27_out)
+#define conv_28_out GEMMINI_ARENA_GET(&activations, conv_28_out)
+#define conv_dw_29_out GEMMINI_ARENA_GET(&activations, conv_dw_29_out)
+#define conv_30_out GEMMINI_ARENA_GET(&activations, conv_30_out)
+#define conv_31_out GEMMINI_ARENA_GET(&activations, conv_31_out)
+#define conv_dw_32_out GEMMINI_ARENA_GET(&activations, conv_dw_32_out)
+#define conv_33_out GEMMINI_ARENA_GET(&activations, conv_33_out)
+#define conv_34_out GEMMINI_ARENA_GET(&activations, conv_34_out)
+#define conv_dw_35_out GEMMINI_ARENA_GET(&activations, conv_dw_35_out)
+#define conv_36_out GEMMINI_ARENA_GET(&activations, conv_36_out)
+#define conv_37_out GEMMINI_ARENA_GET(&activations, conv_37_out)
+#define conv_dw_38_out GEMMINI_ARENA_GET(&activations, conv_dw_38_out)
+#define conv_39_out GEMMINI_ARENA_GET(&activations, conv_39_out)
+#define conv_40_out GEMMINI_ARENA_GET(&activations, conv_40_out)
+#define conv_dw_41_out GEMMINI_ARENA_GET(&activations, conv_dw_41_out)
+#define conv_42_out GEMMINI_ARENA_GET(&activations, conv_42_out)
+#define conv_43_out GEMMINI_ARENA_GET(&activations, conv_43_out)
+#define conv_dw_44_out GEMMINI_ARENA_GET(&activations, conv_dw_44_out)
+#define conv_45_out GEMMINI_ARENA_GET(&activations, conv_45_out)
+#define conv_46_out GEMMINI_ARENA_GET(&activations, conv_46_out)
+#define conv_dw_47_out GEMMINI_ARENA_GET(&activations, conv_dw_47_out)
+#define conv_48_out GEMMINI_ARENA_GET(&activations, conv_48_out)
+#define conv_49_out GEMMINI_ARENA_GET(&activations, conv_49_out)
+#define conv_dw_50_out GEMMINI_ARENA_GET(&activations, conv_dw_50_out)
+#define conv_51_out GEMMINI_ARENA_GET(&activations, conv_51_out)
+#define conv_52_out GEMMINI_ARENA_GET(&activations, conv_52_out)
+#define fc_53_out GEMMINI_ARENA_GET(&activations, fc_53_out)
+#else
+#define NEXT_LAYER()
+#endif
+
+// The weights and biases can come from a container instead of
+// mobilenet_params.h, so they can change without a rebuild: a file mapped at run
+// time on Linux, or one linked in from WEIGHTS_PATH on baremetal. Without
+// WEIGHTS_FROM_CONTAINER, "mobilenet export [path]" writes the container for
+// the weights built into mobilenet_params.h
+#ifndef WEIGHTS_FROM_CONTAINER
+#define WEIGHTS_FROM_CONTAINER 0
+#endif
+
+#ifndef WEIGHTS_PATH
+#define WEIGHTS_PATH "mobilenet_weights.bin"
+#endif
+
+#include "include/gemmini_weights.h"
+
+#define MOBILENET_WEIGHTS(ELEM, ACC) \
+    ELEM(conv_1_w) ACC(conv_1_b) \
+    ELEM(conv_dw_2_w) ACC(conv_dw_2_b) \
+    ELEM(conv_3_w) ACC(conv_3_b) \
+    ELEM(conv_4_w) ACC(conv_4_b) \
+    ELEM(conv_dw_5_w) ACC(conv_dw_5_b) \
+    ELEM(conv_6_w) ACC(conv_6_b) \
+    ELEM(conv_7_w) ACC(conv_7_b) \
+    ELEM(conv_dw_8_w) ACC(conv_dw_8_b) \
+    ELEM(conv_9_w) ACC(conv_9_b) \
+    ELEM(conv_10_w) ACC(conv_10_b) \
+    ELEM(conv_dw_11_w) ACC(conv_dw_11_b) \
+    ELEM(conv_12_w) ACC(conv_12_b) \
+    ELEM(conv_13_w) ACC(conv_13_b) \
+    ELEM(conv_dw_14_w) ACC(conv_dw_14_b) \
+    ELEM(conv_15_w) ACC(conv_15_b) \
+    ELEM(conv_16_w) ACC(conv_16_b) \
+    ELEM(conv_dw_17_w) ACC(conv_dw_17_b) \
+    ELEM(conv_18_w) ACC(conv_18_b) \
+    ELEM(conv_19_w) ACC(conv_19_b) \
+    ELEM(conv_dw_20_w) ACC(conv_dw_20_b) \
+    ELEM(conv_21_w) ACC(conv_21_b) \
+    ELEM(conv_22_w) ACC(conv_22_b) \
+    ELEM(conv_dw_23_w) ACC(conv_dw_23_b) \
+    ELEM(conv_24_w) ACC(conv_24_b) \
+    ELEM(conv_25_w) ACC(conv_25_b) \
+    ELEM(conv_dw_26_w) ACC(conv_dw_26_b) \
+    ELEM(conv_27_w) ACC(conv_27_b) \
+    ELEM(conv_28_w) ACC(conv_28_b) \
+    ELEM(conv_dw_29_w) ACC(conv_dw_29_b) \
+    ELEM(conv_30_w) ACC(conv_30_b) \
+    ELEM(conv_31_w) ACC(conv_31_b) \
+    ELEM(conv_dw_32_w) ACC(conv_dw_32_b) \
+    ELEM(conv_33_w) ACC(conv_33_b) \
+    ELEM(conv_34_w) ACC(conv_34_b) \
+    ELEM(conv_dw_35_w) ACC(conv_dw_35_b) \
+    ELEM(conv_36_w) ACC(conv_36_b) \
+    ELEM(conv_37_w) ACC(conv_37_b) \
+    ELEM(conv_dw_38_w) ACC(conv_dw_38_b) \
+    ELEM(conv_39_w) ACC(conv_39_b) \
+    ELEM(conv_40_w) ACC(conv_40_b) \
+    ELEM(conv_dw_41_w) ACC(conv_dw_41_b) \
+    ELEM(conv_42_w) ACC(conv_42_b) \
+    ELEM(conv_43_w) ACC(conv_43_b) \
+    ELEM(conv_dw_44_w) ACC(conv_dw_44_b) \
+    ELEM(conv_45_w) ACC(conv_45_b) \
+    ELEM(conv_46_w) ACC(conv_46_b) \
+    ELEM(conv_dw_47_w) ACC(conv_dw_47_b) \
+    ELEM(conv_48_w) ACC(conv_48_b) \
+    ELEM(conv_49_w) ACC(conv_49_b) \
+    ELEM(conv_dw_50_w) ACC(conv_dw_50_b) \
+    ELEM(conv_51_w) ACC(conv_51_b) \
+    ELEM(conv_52_w) ACC(conv_52_b) \
+    ELEM(fc_53_w) ACC(fc_53_b)
+
+#if WEIGHTS_FROM_CONTAINER
+static struct gemmini_weights_t weights;
+
+#ifdef BAREMETAL
+GEMMINI_WEIGHTS_INCBIN(mobilenet_weights, WEIGHTS_PATH);
+#endif
+
+#define conv_1_w GEMMINI_WEIGHTS_GET(&weights, conv_1_w)
+#define conv_1_b GEMMINI_WEIGHTS_GET(&weights, conv_1_b)
+#define conv_dw_2_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_2_w)
+#define conv_dw_2_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_2_b)
+#define conv_3_w GEMMINI_WEIGHTS_GET(&weights, conv_3_w)
+#define conv_3_b GEMMINI_WEIGHTS_GET(&weights, conv_3_b)
+#define conv_4_w GEMMINI_WEIGHTS_GET(&weights, conv_4_w)
+#define conv_4_b GEMMINI_WEIGHTS_GET(&weights, conv_4_b)
+#define conv_dw_5_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_5_w)
+#define conv_dw_5_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_5_b)
+#define conv_6_w GEMMINI_WEIGHTS_GET(&weights, conv_6_w)
+#define conv_6_b GEMMINI_WEIGHTS_GET(&weights, conv_6_b)
+#define conv_7_w GEMMINI_WEIGHTS_GET(&weights, conv_7_w)
+#define conv_7_b GEMMINI_WEIGHTS_GET(&weights, conv_7_b)
+#define conv_dw_8_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_8_w)
+#define conv_dw_8_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_8_b)
+#define conv_9_w GEMMINI_WEIGHTS_GET(&weights, conv_9_w)
+#define conv_9_b GEMMINI_WEIGHTS_GET(&weights, conv_9_b)
+#define conv_10_w GEMMINI_WEIGHTS_GET(&weights, conv_10_w)
+#define conv_10_b GEMMINI_WEIGHTS_GET(&weights, conv_10_b)
+#define conv_dw_11_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_11_w)
+#define conv_dw_11_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_11_b)
+#define conv_12_w GEMMINI_WEIGHTS_GET(&weights, conv_12_w)
+#define conv_12_b GEMMINI_WEIGHTS_GET(&weights, conv_12_b)
+#define conv_13_w GEMMINI_WEIGHTS_GET(&weights, conv_13_w)
+#define conv_13_b GEMMINI_WEIGHTS_GET(&weights, conv_13_b)
+#define conv_dw_14_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_14_w)
+#define conv_dw_14_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_14_b)
+#define conv_15_w GEMMINI_WEIGHTS_GET(&weights, conv_15_w)
+#define conv_15_b GEMMINI_WEIGHTS_GET(&weights, conv_15_b)
+#define conv_16_w GEMMINI_WEIGHTS_GET(&weights, conv_16_w)
+#define conv_16_b GEMMINI_WEIGHTS_GET(&weights, conv_16_b)
+#define conv_dw_17_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_17_w)
+#define conv_dw_17_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_17_b)
+#define conv_18_w GEMMINI_WEIGHTS_GET(&weights, conv_18_w)
+#define conv_18_b GEMMINI_WEIGHTS_GET(&weights, conv_18_b)
+#define conv_19_w GEMMINI_WEIGHTS_GET(&weights, conv_19_w)
+#define conv_19_b GEMMINI_WEIGHTS_GET(&weights, conv_19_b)
+#define conv_dw_20_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_20_w)
+#define conv_dw_20_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_20_b)
+#define conv_21_w GEMMINI_WEIGHTS_GET(&weights, conv_21_w)
+#define conv_21_b GEMMINI_WEIGHTS_GET(&weights, conv_21_b)
+#define conv_22_w GEMMINI_WEIGHTS_GET(&weights, conv_22_w)
+#define conv_22_b GEMMINI_WEIGHTS_GET(&weights, conv_22_b)
+#define conv_dw_23_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_23_w)
+#define conv_dw_23_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_23_b)
+#define conv_24_w GEMMINI_WEIGHTS_GET(&weights, conv_24_w)
+#define conv_24_b GEMMINI_WEIGHTS_GET(&weights, conv_24_b)
+#define conv_25_w GEMMINI_WEIGHTS_GET(&weights, conv_25_w)
+#define conv_25_b GEMMINI_WEIGHTS_GET(&weights, conv_25_b)
+#define conv_dw_26_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_26_w)
+#define conv_dw_26_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_26_b)
+#define conv_27_w GEMMINI_WEIGHTS_GET(&weights, conv_27_w)
+#define conv_27_b GEMMINI_WEIGHTS_GET(&weights, conv_27_b)
+#define conv_28_w GEMMINI_WEIGHTS_GET(&weights, conv_28_w)
+#define conv_28_b GEMMINI_WEIGHTS_GET(&weights, conv_28_b)
+#define conv_dw_29_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_29_w)
+#define conv_dw_29_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_29_b)
+#define conv_30_w GEMMINI_WEIGHTS_GET(&weights, conv_30_w)
+#define conv_30_b GEMMINI_WEIGHTS_GET(&weights, conv_30_b)
+#define conv_31_w GEMMINI_WEIGHTS_GET(&weights, conv_31_w)
+#define conv_31_b GEMMINI_WEIGHTS_GET(&weights, conv_31_b)
+#define conv_dw_32_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_32_w)
+#define conv_dw_32_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_32_b)
+#define conv_33_w GEMMINI_WEIGHTS_GET(&weights, conv_33_w)
+#define conv_33_b GEMMINI_WEIGHTS_GET(&weights, conv_33_b)
+#define conv_34_w GEMMINI_WEIGHTS_GET(&weights, conv_34_w)
+#define conv_34_b GEMMINI_WEIGHTS_GET(&weights, conv_34_b)
+#define conv_dw_35_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_35_w)
+#define conv_dw_35_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_35_b)
+#define conv_36_w GEMMINI_WEIGHTS_GET(&weights, conv_36_w)
+#define conv_36_b GEMMINI_WEIGHTS_GET(&weights, conv_36_b)
+#define conv_37_w GEMMINI_WEIGHTS_GET(&weights, conv_37_w)
+#define conv_37_b GEMMINI_WEIGHTS_GET(&weights, conv_37_b)
+#define conv_dw_38_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_38_w)
+#define conv_dw_38_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_38_b)
+#define conv_39_w GEMMINI_WEIGHTS_GET(&weights, conv_39_w)
+#define conv_39_b GEMMINI_WEIGHTS_GET(&weights, conv_39_b)
+#define conv_40_w GEMMINI_WEIGHTS_GET(&weights, conv_40_w)
+#define conv_40_b GEMMINI_WEIGHTS_GET(&weights, conv_40_b)
+#define conv_dw_41_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_41_w)
+#define conv_dw_41_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_41_b)
+#define conv_42_w GEMMINI_WEIGHTS_GET(&weights, conv_42_w)
+#define conv_42_b GEMMINI_WEIGHTS_GET(&weights, conv_42_b)
+#define conv_43_w GEMMINI_WEIGHTS_GET(&weights, conv_43_w)
+#define conv_43_b GEMMINI_WEIGHTS_GET(&weights, conv_43_b)
+#define conv_dw_44_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_44_w)
+#define conv_dw_44_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_44_b)
+#define conv_45_w GEMMINI_WEIGHTS_GET(&weights, conv_45_w)
+#define conv_45_b GEMMINI_WEIGHTS_GET(&weights, conv_45_b)
+#define conv_46_w GEMMINI_WEIGHTS_GET(&weights, conv_46_w)
+#define conv_46_b GEMMINI_WEIGHTS_GET(&weights, conv_46_b)
+#define conv_dw_47_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_47_w)
+#define conv_dw_47_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_47_b)
+#define conv_48_w GEMMINI_WEIGHTS_GET(&weights, conv_48_w)
+#define conv_48_b GEMMINI_WEIGHTS_GET(&weights, conv_48_b)
+#define conv_49_w GEMMINI_WEIGHTS_GET(&weights, conv_49_w)
+#define conv_49_b GEMMINI_WEIGHTS_GET(&weights, conv_49_b)
+#define conv_dw_50_w GEMMINI_WEIGHTS_GET(&weights, conv_dw_50_w)
+#define conv_dw_50_b GEMMINI_WEIGHTS_GET(&weights, conv_dw_50_b)
+#define conv_51_w GEMMINI_WEIGHTS_GET(&weights, conv_51_w)
+#define conv_51_b GEMMINI_WEIGHTS_GET(&weights, conv_51_b)
+#define conv_52_w GEMMINI_WEIGHTS_GET(&weights, conv_52_w)
+#define conv_52_b GEMMINI_WEIGHTS_GET(&weights, conv_52_b)
+#define fc_53_w GEMMINI_WEIGHTS_GET(&weights, fc_53_w)
+#define fc_53_b GEMMINI_WEIGHTS_GET(&weights, fc_53_b)
+
+#elif !defined(BAREMETAL)
+static void export_weights(const char * path) {
+#define BYTES(name) + gemmini_weights_align(sizeof(name))
+    const size_t capacity = GEMMINI_WEIGHTS_ALIGN + MOBILENET_WEIGHTS(BYTES, BYTES) +
+        GEMMINI_WEIGHTS_MAX_TENSORS * sizeof(struct gemmini_weights_entry_t);
+#undef BYTES
+
+    static struct gemmini_weights_builder_t builder;
+    void * container;
+    if (posix_memalign(&container, GEMMINI_WEIGHTS_ALIGN, capacity) != 0) {
+        perror("Can't allocate the weight container");
+        exit(1);
+    }
+    gemmini_weights_build_start(&builder, container, capacity);
+
+#define ADD_ELEM(name) gemmini_weights_build_add(&builder, #name, GEMMINI_WEIGHTS_ELEM, \
+        sizeof(name) / sizeof(name[0]), sizeof(name[0]) / sizeof(elem_t), name, 1);
+#define ADD_ACC(name) gemmini_weights_build_add(&builder, #name, GEMMINI_WEIGHTS_ACC, \
+        1, sizeof(name) / sizeof(acc_t), name, 1);
+    MOBILENET_WEIGHTS(ADD_ELEM, ADD_ACC)
+#undef ADD_ELEM
+#undef ADD_ACC
+
+    const size_t bytes = gemmini_weights_build_finish(&builder);
+    gemmini_weights_save(path, container, bytes);
+    printf("Wrote %u tensors, %llu bytes, to %s\n", builder.n_tensors, (unsigned long long)bytes, path);
+    free(container);
+}
+#endif
+
+// The layers are submitted asynchronously, so a layer's cycle count normally
+// covers its submission, plus any wait for the layers before it. SYNC_LAYERS
+// waits for each layer to finish before reading the cycle counter, so every
+// count is the layer's own run time, at the cost of the overlap between layers
+#ifndef SYNC_LAYERS
+#define SYNC_LAYERS 0
+#endif
+
+static uint64_t layer_end_cycles() {
+    if (SYNC_LAYERS)
+        gemmini_wait_all();
+    return read_cycles();
+}
+
 int main (int argc, char * argv[]) {
 #ifndef BAREMETAL
     if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
@@ -18,6 +550,19 @@ int main (int argc, char * argv[]) {
     }
 #endif
 
+#if WEIGHTS_FROM_CONTAINER
+#ifdef BAREMETAL
+    gemmini_weights_open(&weights, mobilenet_weights, mobilenet_weights_end - mobilenet_weights);
+#else
+    gemmini_weights_map(&weights, argc >= 5 ? argv[4] : WEIGHTS_PATH);
+#endif
+#elif !defined(BAREMETAL)
+    if (argc >= 2 && strcmp(argv[1], "export") == 0) {
+        export_weights(argc >= 3 ? argv[2] : WEIGHTS_PATH);
+        exit(0);
+    }
+#endif
+
     gemmini_flush(0);
 
     enum tiled_matmul_type_t tiled_matmul_type = WS;
@@ -65,6 +610,10 @@ int main (int argc, char * argv[]) {
         exit(1);
     }
 
+#if ACTIVATION_ARENA
+    plan_activations(conv);
+#endif
+
     uint64_t start, end;
     uint64_t im2col_cycles = 0, matmul_cycles = 0, conv_cycles = 0, pool_cycles = 0, conv_dw_cycles = 0, res_add_cycles = 0, other_cycles = 0;
 
@@ -77,23 +626,23 @@ int main (int argc, char * argv[]) {
             conv_1_params.I, conv_1_params.K,
             images, conv_1_in, &conv_1_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_1_params.I, conv_1_params.J, conv_1_params.K,
+        tiled_matmul_nn_auto_async(conv_1_params.I, conv_1_params.J, conv_1_params.K,
             conv_1_in, conv_1_w, conv_1_b, conv_1_out,
             RELU, conv_1_params.output_scale, true,
             tiled_matmul_type, check, "conv_1");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_1_params.batch_size, conv_1_params.in_row_dim, conv_1_params.in_col_dim,
             conv_1_params.in_channels,
             conv_1_params.out_channels, conv_1_params.out_row_dim, conv_1_params.out_col_dim,
@@ -107,12 +656,13 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv_1: %llu\n", end-start);
     }
 
     // conv_dw_2
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -122,7 +672,7 @@ int main (int argc, char * argv[]) {
             conv_dw_2_params.kernel_size,
             conv_1_out, conv_dw_2_w, conv_dw_2_b, conv_dw_2_out, &conv_dw_2_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_2_params.batch_size, conv_dw_2_params.in_row_dim, conv_dw_2_params.in_col_dim,
             conv_dw_2_params.in_channels,
             conv_dw_2_params.out_row_dim, conv_dw_2_params.out_col_dim,
@@ -136,63 +686,66 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_2: %llu \n", end - start);
 
     // conv_3
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_3_params.I, conv_3_params.J, conv_3_params.K,
+        tiled_matmul_nn_auto_async(conv_3_params.I, conv_3_params.J, conv_3_params.K,
             conv_dw_2_out, conv_3_w, conv_3_b, conv_3_out,
             NO_ACTIVATION, conv_3_params.output_scale, true,
             tiled_matmul_type, check, "conv_3");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_3_params.I, conv_3_params.J, conv_3_params.K,
+        tiled_matmul_nn_auto_async(conv_3_params.I, conv_3_params.J, conv_3_params.K,
             conv_dw_2_out, conv_3_w, conv_3_b, conv_3_out,
             NO_ACTIVATION, conv_3_params.output_scale, true,
             tiled_matmul_type, check, "conv_3");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_3: %llu\n", end-start);
 
     // conv_4
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_4_params.I, conv_4_params.J, conv_4_params.K,
+        tiled_matmul_nn_auto_async(conv_4_params.I, conv_4_params.J, conv_4_params.K,
             conv_3_out, conv_4_w, conv_4_b, conv_4_out,
             RELU, conv_4_params.output_scale, true,
             tiled_matmul_type, check, "conv_4");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_4_params.I, conv_4_params.J, conv_4_params.K,
+        tiled_matmul_nn_auto_async(conv_4_params.I, conv_4_params.J, conv_4_params.K,
             conv_3_out, conv_4_w, conv_4_b, conv_4_out,
             RELU, conv_4_params.output_scale, true,
             tiled_matmul_type, check, "conv_4");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_4: %llu\n", end-start);
 
     // conv_dw_5
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -202,7 +755,7 @@ int main (int argc, char * argv[]) {
             conv_dw_5_params.kernel_size,
             conv_4_out, conv_dw_5_w, conv_dw_5_b, conv_dw_5_out, &conv_dw_5_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_5_params.batch_size, conv_dw_5_params.in_row_dim, conv_dw_5_params.in_col_dim,
             conv_dw_5_params.in_channels,
             conv_dw_5_params.out_row_dim, conv_dw_5_params.out_col_dim,
@@ -216,64 +769,67 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
 
     printf("conv_dw_5: %llu \n", end - start);
 
     // conv_6
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_6_params.I, conv_6_params.J, conv_6_params.K,
+        tiled_matmul_nn_auto_async(conv_6_params.I, conv_6_params.J, conv_6_params.K,
             conv_dw_5_out, conv_6_w, conv_6_b, conv_6_out,
             NO_ACTIVATION, conv_6_params.output_scale, true,
             tiled_matmul_type, check, "conv_6");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_6_params.I, conv_6_params.J, conv_6_params.K,
+        tiled_matmul_nn_auto_async(conv_6_params.I, conv_6_params.J, conv_6_params.K,
             conv_dw_5_out, conv_6_w, conv_6_b, conv_6_out,
             NO_ACTIVATION, conv_6_params.output_scale, true,
             tiled_matmul_type, check, "conv_6");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_6: %llu\n", end-start);
 
     // conv_7
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_7_params.I, conv_7_params.J, conv_7_params.K,
+        tiled_matmul_nn_auto_async(conv_7_params.I, conv_7_params.J, conv_7_params.K,
             conv_6_out, conv_7_w, conv_7_b, conv_7_out,
             RELU, conv_7_params.output_scale, true,
             tiled_matmul_type, check, "conv_7");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_7_params.I, conv_7_params.J, conv_7_params.K,
+        tiled_matmul_nn_auto_async(conv_7_params.I, conv_7_params.J, conv_7_params.K,
             conv_6_out, conv_7_w, conv_7_b, conv_7_out,
             RELU, conv_7_params.output_scale, true,
             tiled_matmul_type, check, "conv_7");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_7: %llu\n", end-start);
 
     // conv_dw_8
+    NEXT_LAYER();
     start = read_cycles();
     if (!conv) {
         conv_dw_with_col2im(conv_7_params.I, conv_7_params.J, conv_dw_8_params.I, conv_dw_8_params.J,
@@ -283,7 +839,7 @@ int main (int argc, char * argv[]) {
             conv_dw_8_params.kernel_size,
             conv_7_out, conv_dw_8_w, conv_dw_8_b, conv_dw_8_out, &conv_dw_8_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_8_params.batch_size, conv_dw_8_params.in_row_dim, conv_dw_8_params.in_col_dim,
             conv_dw_8_params.in_channels,
             conv_dw_8_params.out_row_dim, conv_dw_8_params.out_col_dim,
@@ -297,41 +853,43 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
 
     printf("conv_dw_8: %llu \n", end - start);
 
     // conv_9
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_9_params.I, conv_9_params.J, conv_9_params.K,
+        tiled_matmul_nn_auto_async(conv_9_params.I, conv_9_params.J, conv_9_params.K,
             conv_dw_8_out, conv_9_w, conv_9_b, conv_9_out,
             NO_ACTIVATION, conv_9_params.output_scale, true,
             tiled_matmul_type, check, "conv_9");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_9_params.I, conv_9_params.J, conv_9_params.K,
+        tiled_matmul_nn_auto_async(conv_9_params.I, conv_9_params.J, conv_9_params.K,
             conv_dw_8_out, conv_9_w, conv_9_b, conv_9_out,
             NO_ACTIVATION, conv_9_params.output_scale, true,
             tiled_matmul_type, check, "conv_9");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_9: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_9_params.I, conv_9_params.J,
+    tiled_resadd_auto_async(conv_9_params.I, conv_9_params.J,
         conv_9_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -341,36 +899,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_10
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_10_params.I, conv_10_params.J, conv_10_params.K,
+        tiled_matmul_nn_auto_async(conv_10_params.I, conv_10_params.J, conv_10_params.K,
             conv_9_out, conv_10_w, conv_10_b, conv_10_out,
             RELU, conv_10_params.output_scale, true,
             tiled_matmul_type, check, "conv_10");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_10_params.I, conv_10_params.J, conv_10_params.K,
+        tiled_matmul_nn_auto_async(conv_10_params.I, conv_10_params.J, conv_10_params.K,
             conv_9_out, conv_10_w, conv_10_b, conv_10_out,
             RELU, conv_10_params.output_scale, true,
             tiled_matmul_type, check, "conv_10");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_10: %llu\n", end-start);
 
     // conv_dw_11
+    NEXT_LAYER();
     start = read_cycles();
     if (!conv) {
         conv_dw_with_col2im(conv_10_params.I, conv_10_params.J, conv_dw_11_params.I, conv_dw_11_params.J,
@@ -379,7 +939,7 @@ int main (int argc, char * argv[]) {
             conv_dw_11_params.kernel_size,
             conv_10_out, conv_dw_11_w, conv_dw_11_b, conv_dw_11_out, &conv_dw_11_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_11_params.batch_size, conv_dw_11_params.in_row_dim, conv_dw_11_params.in_col_dim,
             conv_dw_11_params.in_channels,
             conv_dw_11_params.out_row_dim, conv_dw_11_params.out_col_dim,
@@ -393,63 +953,66 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_11: %llu \n", end - start);
 
     // conv_12
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_12_params.I, conv_12_params.J, conv_12_params.K,
+        tiled_matmul_nn_auto_async(conv_12_params.I, conv_12_params.J, conv_12_params.K,
             conv_dw_11_out, conv_12_w, conv_12_b, conv_12_out,
             NO_ACTIVATION, conv_12_params.output_scale, true,
             tiled_matmul_type, check, "conv_12");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_12_params.I, conv_12_params.J, conv_12_params.K,
+        tiled_matmul_nn_auto_async(conv_12_params.I, conv_12_params.J, conv_12_params.K,
             conv_dw_11_out, conv_12_w, conv_12_b, conv_12_out,
             NO_ACTIVATION, conv_12_params.output_scale, true,
             tiled_matmul_type, check, "conv_12");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_12: %llu\n", end-start);
 
     // conv_13
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_13_params.I, conv_13_params.J, conv_13_params.K,
+        tiled_matmul_nn_auto_async(conv_13_params.I, conv_13_params.J, conv_13_params.K,
             conv_12_out, conv_13_w, conv_13_b, conv_13_out,
             RELU, conv_13_params.output_scale, true,
             tiled_matmul_type, check, "conv_13");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_13_params.I, conv_13_params.J, conv_13_params.K,
+        tiled_matmul_nn_auto_async(conv_13_params.I, conv_13_params.J, conv_13_params.K,
             conv_12_out, conv_13_w, conv_13_b, conv_13_out,
             RELU, conv_13_params.output_scale, true,
             tiled_matmul_type, check, "conv_13");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_13: %llu\n", end-start);
 
     // conv_dw_14
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -459,7 +1022,7 @@ int main (int argc, char * argv[]) {
             conv_dw_14_params.kernel_size,
             conv_13_out, conv_dw_14_w, conv_dw_14_b, conv_dw_14_out, &conv_dw_14_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_14_params.batch_size, conv_dw_14_params.in_row_dim, conv_dw_14_params.in_col_dim,
             conv_dw_14_params.in_channels,
             conv_dw_14_params.out_row_dim, conv_dw_14_params.out_col_dim,
@@ -473,40 +1036,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_14: %llu \n", end - start);
 
     // conv_15
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_15_params.I, conv_15_params.J, conv_15_params.K,
+        tiled_matmul_nn_auto_async(conv_15_params.I, conv_15_params.J, conv_15_params.K,
             conv_dw_14_out, conv_15_w, conv_15_b, conv_15_out,
             NO_ACTIVATION, conv_15_params.output_scale, true,
             tiled_matmul_type, check, "conv_15");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_15_params.I, conv_15_params.J, conv_15_params.K,
+        tiled_matmul_nn_auto_async(conv_15_params.I, conv_15_params.J, conv_15_params.K,
             conv_dw_14_out, conv_15_w, conv_15_b, conv_15_out,
             NO_ACTIVATION, conv_15_params.output_scale, true,
             tiled_matmul_type, check, "conv_15");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_15: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_15_params.I, conv_15_params.J,
+    tiled_resadd_auto_async(conv_15_params.I, conv_15_params.J,
         conv_15_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -516,36 +1081,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_16
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_16_params.I, conv_16_params.J, conv_16_params.K,
+        tiled_matmul_nn_auto_async(conv_16_params.I, conv_16_params.J, conv_16_params.K,
             conv_15_out, conv_16_w, conv_16_b, conv_16_out,
             RELU, conv_16_params.output_scale, true,
             tiled_matmul_type, check, "conv_16");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_16_params.I, conv_16_params.J, conv_16_params.K,
+        tiled_matmul_nn_auto_async(conv_16_params.I, conv_16_params.J, conv_16_params.K,
             conv_15_out, conv_16_w, conv_16_b, conv_16_out,
             RELU, conv_16_params.output_scale, true,
             tiled_matmul_type, check, "conv_16");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_16: %llu\n", end-start);
 
     // conv_dw_17
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -555,7 +1122,7 @@ int main (int argc, char * argv[]) {
             conv_dw_17_params.kernel_size,
             conv_16_out, conv_dw_17_w, conv_dw_17_b, conv_dw_17_out, &conv_dw_17_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_17_params.batch_size, conv_dw_17_params.in_row_dim, conv_dw_17_params.in_col_dim,
             conv_dw_17_params.in_channels,
             conv_dw_17_params.out_row_dim, conv_dw_17_params.out_col_dim,
@@ -569,40 +1136,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_17: %llu \n", end - start);
 
     // conv_18
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_18_params.I, conv_18_params.J, conv_18_params.K,
+        tiled_matmul_nn_auto_async(conv_18_params.I, conv_18_params.J, conv_18_params.K,
             conv_dw_17_out, conv_18_w, conv_18_b, conv_18_out,
             NO_ACTIVATION, conv_18_params.output_scale, true,
             tiled_matmul_type, check, "conv_18");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_18_params.I, conv_18_params.J, conv_18_params.K,
+        tiled_matmul_nn_auto_async(conv_18_params.I, conv_18_params.J, conv_18_params.K,
             conv_dw_17_out, conv_18_w, conv_18_b, conv_18_out,
             NO_ACTIVATION, conv_18_params.output_scale, true,
             tiled_matmul_type, check, "conv_18");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_18: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_18_params.I, conv_18_params.J,
+    tiled_resadd_auto_async(conv_18_params.I, conv_18_params.J,
         conv_18_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -612,36 +1181,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_19
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_19_params.I, conv_19_params.J, conv_19_params.K,
+        tiled_matmul_nn_auto_async(conv_19_params.I, conv_19_params.J, conv_19_params.K,
             conv_18_out, conv_19_w, conv_19_b, conv_19_out,
             RELU, conv_19_params.output_scale, true,
             tiled_matmul_type, check, "conv_19");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_19_params.I, conv_19_params.J, conv_19_params.K,
+        tiled_matmul_nn_auto_async(conv_19_params.I, conv_19_params.J, conv_19_params.K,
             conv_18_out, conv_19_w, conv_19_b, conv_19_out,
             RELU, conv_19_params.output_scale, true,
             tiled_matmul_type, check, "conv_19");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_19: %llu\n", end-start);
 
     // conv_dw_20
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -651,7 +1222,7 @@ int main (int argc, char * argv[]) {
             conv_dw_20_params.kernel_size,
             conv_19_out, conv_dw_20_w, conv_dw_20_b, conv_dw_20_out, &conv_dw_20_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_20_params.batch_size, conv_dw_20_params.in_row_dim, conv_dw_20_params.in_col_dim,
             conv_dw_20_params.in_channels,
             conv_dw_20_params.out_row_dim, conv_dw_20_params.out_col_dim,
@@ -665,63 +1236,66 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_20: %llu \n", end - start);
 
     // conv_21
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_21_params.I, conv_21_params.J, conv_21_params.K,
+        tiled_matmul_nn_auto_async(conv_21_params.I, conv_21_params.J, conv_21_params.K,
             conv_dw_20_out, conv_21_w, conv_21_b, conv_21_out,
             NO_ACTIVATION, conv_21_params.output_scale, true,
             tiled_matmul_type, check, "conv_21");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_21_params.I, conv_21_params.J, conv_21_params.K,
+        tiled_matmul_nn_auto_async(conv_21_params.I, conv_21_params.J, conv_21_params.K,
             conv_dw_20_out, conv_21_w, conv_21_b, conv_21_out,
             NO_ACTIVATION, conv_21_params.output_scale, true,
             tiled_matmul_type, check, "conv_21");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_21: %llu\n", end-start);
 
     // conv_22
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_22_params.I, conv_22_params.J, conv_22_params.K,
+        tiled_matmul_nn_auto_async(conv_22_params.I, conv_22_params.J, conv_22_params.K,
             conv_21_out, conv_22_w, conv_22_b, conv_22_out,
             RELU, conv_22_params.output_scale, true,
             tiled_matmul_type, check, "conv_22");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_22_params.I, conv_22_params.J, conv_22_params.K,
+        tiled_matmul_nn_auto_async(conv_22_params.I, conv_22_params.J, conv_22_params.K,
             conv_21_out, conv_22_w, conv_22_b, conv_22_out,
             RELU, conv_22_params.output_scale, true,
             tiled_matmul_type, check, "conv_22");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_22: %llu\n", end-start);
 
     // conv_dw_23
+    NEXT_LAYER();
     start = read_cycles();
     if (!conv) {
         conv_dw_with_col2im(conv_22_params.I, conv_22_params.J, conv_dw_23_params.I, conv_dw_23_params.J,
@@ -730,7 +1304,7 @@ int main (int argc, char * argv[]) {
             conv_dw_23_params.kernel_size,
             conv_22_out, conv_dw_23_w, conv_dw_23_b, conv_dw_23_out, &conv_dw_23_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_23_params.batch_size, conv_dw_23_params.in_row_dim, conv_dw_23_params.in_col_dim,
             conv_dw_23_params.in_channels,
             conv_dw_23_params.out_row_dim, conv_dw_23_params.out_col_dim,
@@ -744,40 +1318,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_23: %llu \n", end - start);
 
     // conv_24
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_24_params.I, conv_24_params.J, conv_24_params.K,
+        tiled_matmul_nn_auto_async(conv_24_params.I, conv_24_params.J, conv_24_params.K,
             conv_dw_23_out, conv_24_w, conv_24_b, conv_24_out,
             NO_ACTIVATION, conv_24_params.output_scale, true,
             tiled_matmul_type, check, "conv_24");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_24_params.I, conv_24_params.J, conv_24_params.K,
+        tiled_matmul_nn_auto_async(conv_24_params.I, conv_24_params.J, conv_24_params.K,
             conv_dw_23_out, conv_24_w, conv_24_b, conv_24_out,
             NO_ACTIVATION, conv_24_params.output_scale, true,
             tiled_matmul_type, check, "conv_24");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_24: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_24_params.I, conv_24_params.J,
+    tiled_resadd_auto_async(conv_24_params.I, conv_24_params.J,
         conv_24_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -787,36 +1363,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_25
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_25_params.I, conv_25_params.J, conv_25_params.K,
+        tiled_matmul_nn_auto_async(conv_25_params.I, conv_25_params.J, conv_25_params.K,
             conv_24_out, conv_25_w, conv_25_b, conv_25_out,
             RELU, conv_25_params.output_scale, true,
             tiled_matmul_type, check, "conv_25");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_25_params.I, conv_25_params.J, conv_25_params.K,
+        tiled_matmul_nn_auto_async(conv_25_params.I, conv_25_params.J, conv_25_params.K,
             conv_24_out, conv_25_w, conv_25_b, conv_25_out,
             RELU, conv_25_params.output_scale, true,
             tiled_matmul_type, check, "conv_25");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_25: %llu\n", end-start);
 
     // conv_dw_26
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -826,7 +1404,7 @@ int main (int argc, char * argv[]) {
             conv_dw_26_params.kernel_size,
             conv_25_out, conv_dw_26_w, conv_dw_26_b, conv_dw_26_out, &conv_dw_26_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_26_params.batch_size, conv_dw_26_params.in_row_dim, conv_dw_26_params.in_col_dim,
             conv_dw_26_params.in_channels,
             conv_dw_26_params.out_row_dim, conv_dw_26_params.out_col_dim,
@@ -840,40 +1418,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_26: %llu \n", end - start);
 
     // conv_27
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_27_params.I, conv_27_params.J, conv_27_params.K,
+        tiled_matmul_nn_auto_async(conv_27_params.I, conv_27_params.J, conv_27_params.K,
             conv_dw_26_out, conv_27_w, conv_27_b, conv_27_out,
             NO_ACTIVATION, conv_27_params.output_scale, true,
             tiled_matmul_type, check, "conv_27");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_27_params.I, conv_27_params.J, conv_27_params.K,
+        tiled_matmul_nn_auto_async(conv_27_params.I, conv_27_params.J, conv_27_params.K,
             conv_dw_26_out, conv_27_w, conv_27_b, conv_27_out,
             NO_ACTIVATION, conv_27_params.output_scale, true,
             tiled_matmul_type, check, "conv_27");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_27: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_27_params.I, conv_27_params.J,
+    tiled_resadd_auto_async(conv_27_params.I, conv_27_params.J,
         conv_27_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -883,36 +1463,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_28
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_28_params.I, conv_28_params.J, conv_28_params.K,
+        tiled_matmul_nn_auto_async(conv_28_params.I, conv_28_params.J, conv_28_params.K,
             conv_27_out, conv_28_w, conv_28_b, conv_28_out,
             RELU, conv_28_params.output_scale, true,
             tiled_matmul_type, check, "conv_28");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_28_params.I, conv_28_params.J, conv_28_params.K,
+        tiled_matmul_nn_auto_async(conv_28_params.I, conv_28_params.J, conv_28_params.K,
             conv_27_out, conv_28_w, conv_28_b, conv_28_out,
             RELU, conv_28_params.output_scale, true,
             tiled_matmul_type, check, "conv_28");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_28: %llu\n", end-start);
 
     // conv_dw_29
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -922,7 +1504,7 @@ int main (int argc, char * argv[]) {
             conv_dw_29_params.kernel_size,
             conv_28_out, conv_dw_29_w, conv_dw_29_b, conv_dw_29_out, &conv_dw_29_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_29_params.batch_size, conv_dw_29_params.in_row_dim, conv_dw_29_params.in_col_dim,
             conv_dw_29_params.in_channels,
             conv_dw_29_params.out_row_dim, conv_dw_29_params.out_col_dim,
@@ -936,40 +1518,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_29: %llu \n", end - start);
 
     // conv_30
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_30_params.I, conv_30_params.J, conv_30_params.K,
+        tiled_matmul_nn_auto_async(conv_30_params.I, conv_30_params.J, conv_30_params.K,
             conv_dw_29_out, conv_30_w, conv_30_b, conv_30_out,
             NO_ACTIVATION, conv_30_params.output_scale, true,
             tiled_matmul_type, check, "conv_30");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_30_params.I, conv_30_params.J, conv_30_params.K,
+        tiled_matmul_nn_auto_async(conv_30_params.I, conv_30_params.J, conv_30_params.K,
             conv_dw_29_out, conv_30_w, conv_30_b, conv_30_out,
             NO_ACTIVATION, conv_30_params.output_scale, true,
             tiled_matmul_type, check, "conv_30");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_30: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_30_params.I, conv_30_params.J,
+    tiled_resadd_auto_async(conv_30_params.I, conv_30_params.J,
         conv_30_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -979,36 +1563,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_31
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_31_params.I, conv_31_params.J, conv_31_params.K,
+        tiled_matmul_nn_auto_async(conv_31_params.I, conv_31_params.J, conv_31_params.K,
             conv_30_out, conv_31_w, conv_31_b, conv_31_out,
             RELU, conv_31_params.output_scale, true,
             tiled_matmul_type, check, "conv_31");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_31_params.I, conv_31_params.J, conv_31_params.K,
+        tiled_matmul_nn_auto_async(conv_31_params.I, conv_31_params.J, conv_31_params.K,
             conv_30_out, conv_31_w, conv_31_b, conv_31_out,
             RELU, conv_31_params.output_scale, true,
             tiled_matmul_type, check, "conv_31");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_31: %llu\n", end-start);
 
     // conv_dw_32
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1018,7 +1604,7 @@ int main (int argc, char * argv[]) {
             conv_dw_32_params.kernel_size,
             conv_31_out, conv_dw_32_w, conv_dw_32_b, conv_dw_32_out, &conv_dw_32_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_32_params.batch_size, conv_dw_32_params.in_row_dim, conv_dw_32_params.in_col_dim,
             conv_dw_32_params.in_channels,
             conv_dw_32_params.out_row_dim, conv_dw_32_params.out_col_dim,
@@ -1032,63 +1618,66 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_32: %llu \n", end - start);
 
     // conv_33
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_33_params.I, conv_33_params.J, conv_33_params.K,
+        tiled_matmul_nn_auto_async(conv_33_params.I, conv_33_params.J, conv_33_params.K,
             conv_dw_32_out, conv_33_w, conv_33_b, conv_33_out,
             NO_ACTIVATION, conv_33_params.output_scale, true,
             tiled_matmul_type, check, "conv_33");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_33_params.I, conv_33_params.J, conv_33_params.K,
+        tiled_matmul_nn_auto_async(conv_33_params.I, conv_33_params.J, conv_33_params.K,
             conv_dw_32_out, conv_33_w, conv_33_b, conv_33_out,
             NO_ACTIVATION, conv_33_params.output_scale, true,
             tiled_matmul_type, check, "conv_33");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_33: %llu\n", end-start);
 
     // conv_34
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_34_params.I, conv_34_params.J, conv_34_params.K,
+        tiled_matmul_nn_auto_async(conv_34_params.I, conv_34_params.J, conv_34_params.K,
             conv_33_out, conv_34_w, conv_34_b, conv_34_out,
             RELU, conv_34_params.output_scale, true,
             tiled_matmul_type, check, "conv_34");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_34_params.I, conv_34_params.J, conv_34_params.K,
+        tiled_matmul_nn_auto_async(conv_34_params.I, conv_34_params.J, conv_34_params.K,
             conv_33_out, conv_34_w, conv_34_b, conv_34_out,
             RELU, conv_34_params.output_scale, true,
             tiled_matmul_type, check, "conv_34");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_34: %llu\n", end-start);
 
     // conv_dw_35
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1098,7 +1687,7 @@ int main (int argc, char * argv[]) {
             conv_dw_35_params.kernel_size,
             conv_34_out, conv_dw_35_w, conv_dw_35_b, conv_dw_35_out, &conv_dw_35_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_35_params.batch_size, conv_dw_35_params.in_row_dim, conv_dw_35_params.in_col_dim,
             conv_dw_35_params.in_channels,
             conv_dw_35_params.out_row_dim, conv_dw_35_params.out_col_dim,
@@ -1112,40 +1701,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_35: %llu \n", end - start);
 
     // conv_36
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_36_params.I, conv_36_params.J, conv_36_params.K,
+        tiled_matmul_nn_auto_async(conv_36_params.I, conv_36_params.J, conv_36_params.K,
             conv_dw_35_out, conv_36_w, conv_36_b, conv_36_out,
             NO_ACTIVATION, conv_36_params.output_scale, true,
             tiled_matmul_type, check, "conv_36");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_36_params.I, conv_36_params.J, conv_36_params.K,
+        tiled_matmul_nn_auto_async(conv_36_params.I, conv_36_params.J, conv_36_params.K,
             conv_dw_35_out, conv_36_w, conv_36_b, conv_36_out,
             NO_ACTIVATION, conv_36_params.output_scale, true,
             tiled_matmul_type, check, "conv_36");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_36: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_36_params.I, conv_36_params.J,
+    tiled_resadd_auto_async(conv_36_params.I, conv_36_params.J,
         conv_36_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -1155,36 +1746,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_37
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_37_params.I, conv_37_params.J, conv_37_params.K,
+        tiled_matmul_nn_auto_async(conv_37_params.I, conv_37_params.J, conv_37_params.K,
             conv_36_out, conv_37_w, conv_37_b, conv_37_out,
             RELU, conv_37_params.output_scale, true,
             tiled_matmul_type, check, "conv_37");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_37_params.I, conv_37_params.J, conv_37_params.K,
+        tiled_matmul_nn_auto_async(conv_37_params.I, conv_37_params.J, conv_37_params.K,
             conv_36_out, conv_37_w, conv_37_b, conv_37_out,
             RELU, conv_37_params.output_scale, true,
             tiled_matmul_type, check, "conv_37");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_37: %llu\n", end-start);
 
     // conv_dw_38
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1194,7 +1787,7 @@ int main (int argc, char * argv[]) {
         conv_dw_38_params.kernel_size,
         conv_37_out, conv_dw_38_w, conv_dw_38_b, conv_dw_38_out, &conv_dw_38_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_38_params.batch_size, conv_dw_38_params.in_row_dim, conv_dw_38_params.in_col_dim,
             conv_dw_38_params.in_channels,
             conv_dw_38_params.out_row_dim, conv_dw_38_params.out_col_dim,
@@ -1208,40 +1801,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_38: %llu \n", end - start);
 
     // conv_39
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_39_params.I, conv_39_params.J, conv_39_params.K,
+        tiled_matmul_nn_auto_async(conv_39_params.I, conv_39_params.J, conv_39_params.K,
             conv_dw_38_out, conv_39_w, conv_39_b, conv_39_out,
             NO_ACTIVATION, conv_39_params.output_scale, true,
             tiled_matmul_type, check, "conv_39");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_39_params.I, conv_39_params.J, conv_39_params.K,
+        tiled_matmul_nn_auto_async(conv_39_params.I, conv_39_params.J, conv_39_params.K,
             conv_dw_38_out, conv_39_w, conv_39_b, conv_39_out,
             NO_ACTIVATION, conv_39_params.output_scale, true,
             tiled_matmul_type, check, "conv_39");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_39: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_39_params.I, conv_39_params.J,
+    tiled_resadd_auto_async(conv_39_params.I, conv_39_params.J,
         conv_39_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -1251,36 +1846,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_40
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_40_params.I, conv_40_params.J, conv_40_params.K,
+        tiled_matmul_nn_auto_async(conv_40_params.I, conv_40_params.J, conv_40_params.K,
             conv_39_out, conv_40_w, conv_40_b, conv_40_out,
             RELU, conv_40_params.output_scale, true,
             tiled_matmul_type, check, "conv_40");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_40_params.I, conv_40_params.J, conv_40_params.K,
+        tiled_matmul_nn_auto_async(conv_40_params.I, conv_40_params.J, conv_40_params.K,
             conv_39_out, conv_40_w, conv_40_b, conv_40_out,
             RELU, conv_40_params.output_scale, true,
             tiled_matmul_type, check, "conv_40");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_40: %llu\n", end-start);
 
     // conv_dw_41
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1290,7 +1887,7 @@ int main (int argc, char * argv[]) {
             conv_dw_41_params.kernel_size,
             conv_40_out, conv_dw_41_w, conv_dw_41_b, conv_dw_41_out, &conv_dw_41_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_41_params.batch_size, conv_dw_41_params.in_row_dim, conv_dw_41_params.in_col_dim,
             conv_dw_41_params.in_channels,
             conv_dw_41_params.out_row_dim, conv_dw_41_params.out_col_dim,
@@ -1304,63 +1901,66 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_41: %llu \n", end - start);
 
     // conv_42
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_42_params.I, conv_42_params.J, conv_42_params.K,
+        tiled_matmul_nn_auto_async(conv_42_params.I, conv_42_params.J, conv_42_params.K,
             conv_dw_41_out, conv_42_w, conv_42_b, conv_42_out,
             NO_ACTIVATION, conv_42_params.output_scale, true,
             tiled_matmul_type, check, "conv_42");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_42_params.I, conv_42_params.J, conv_42_params.K,
+        tiled_matmul_nn_auto_async(conv_42_params.I, conv_42_params.J, conv_42_params.K,
             conv_dw_41_out, conv_42_w, conv_42_b, conv_42_out,
             NO_ACTIVATION, conv_42_params.output_scale, true,
             tiled_matmul_type, check, "conv_42");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_42: %llu\n", end-start);
 
     // conv_43
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_43_params.I, conv_43_params.J, conv_43_params.K,
+        tiled_matmul_nn_auto_async(conv_43_params.I, conv_43_params.J, conv_43_params.K,
             conv_42_out, conv_43_w, conv_43_b, conv_43_out,
             RELU, conv_43_params.output_scale, true,
             tiled_matmul_type, check, "conv_43");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_43_params.I, conv_43_params.J, conv_43_params.K,
+        tiled_matmul_nn_auto_async(conv_43_params.I, conv_43_params.J, conv_43_params.K,
             conv_42_out, conv_43_w, conv_43_b, conv_43_out,
             RELU, conv_43_params.output_scale, true,
             tiled_matmul_type, check, "conv_43");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_43: %llu\n", end-start);
 
     // conv_dw_44
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1370,7 +1970,7 @@ int main (int argc, char * argv[]) {
             conv_dw_44_params.kernel_size,
             conv_43_out, conv_dw_44_w, conv_dw_44_b, conv_dw_44_out, &conv_dw_44_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_44_params.batch_size, conv_dw_44_params.in_row_dim, conv_dw_44_params.in_col_dim,
             conv_dw_44_params.in_channels,
             conv_dw_44_params.out_row_dim, conv_dw_44_params.out_col_dim,
@@ -1384,40 +1984,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_44: %llu \n", end - start);
 
     // conv_45
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_45_params.I, conv_45_params.J, conv_45_params.K,
+        tiled_matmul_nn_auto_async(conv_45_params.I, conv_45_params.J, conv_45_params.K,
             conv_dw_44_out, conv_45_w, conv_45_b, conv_45_out,
             NO_ACTIVATION, conv_45_params.output_scale, true,
             tiled_matmul_type, check, "conv_45");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_45_params.I, conv_45_params.J, conv_45_params.K,
+        tiled_matmul_nn_auto_async(conv_45_params.I, conv_45_params.J, conv_45_params.K,
             conv_dw_44_out, conv_45_w, conv_45_b, conv_45_out,
             NO_ACTIVATION, conv_45_params.output_scale, true,
             tiled_matmul_type, check, "conv_45");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_45: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_45_params.I, conv_45_params.J,
+    tiled_resadd_auto_async(conv_45_params.I, conv_45_params.J,
         conv_45_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -1427,36 +2029,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_46
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_46_params.I, conv_46_params.J, conv_46_params.K,
+        tiled_matmul_nn_auto_async(conv_46_params.I, conv_46_params.J, conv_46_params.K,
             conv_45_out, conv_46_w, conv_46_b, conv_46_out,
             RELU, conv_46_params.output_scale, true,
             tiled_matmul_type, check, "conv_46");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_46_params.I, conv_46_params.J, conv_46_params.K,
+        tiled_matmul_nn_auto_async(conv_46_params.I, conv_46_params.J, conv_46_params.K,
             conv_45_out, conv_46_w, conv_46_b, conv_46_out,
             RELU, conv_46_params.output_scale, true,
             tiled_matmul_type, check, "conv_46");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_46: %llu\n", end-start);
 
     // conv_dw_47
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1466,7 +2070,7 @@ int main (int argc, char * argv[]) {
             conv_dw_47_params.kernel_size,
             conv_46_out, conv_dw_47_w, conv_dw_47_b, conv_dw_47_out, &conv_dw_47_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_47_params.batch_size, conv_dw_47_params.in_row_dim, conv_dw_47_params.in_col_dim,
             conv_dw_47_params.in_channels,
             conv_dw_47_params.out_row_dim, conv_dw_47_params.out_col_dim,
@@ -1480,40 +2084,42 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_47: %llu \n", end - start);
 
     // conv_48
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_48_params.I, conv_48_params.J, conv_48_params.K,
+        tiled_matmul_nn_auto_async(conv_48_params.I, conv_48_params.J, conv_48_params.K,
             conv_dw_47_out, conv_48_w, conv_48_b, conv_48_out,
             NO_ACTIVATION, conv_48_params.output_scale, true,
             tiled_matmul_type, check, "conv_48");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_48_params.I, conv_48_params.J, conv_48_params.K,
+        tiled_matmul_nn_auto_async(conv_48_params.I, conv_48_params.J, conv_48_params.K,
             conv_dw_47_out, conv_48_w, conv_48_b, conv_48_out,
             NO_ACTIVATION, conv_48_params.output_scale, true,
             tiled_matmul_type, check, "conv_48");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_48: %llu\n", end-start);
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_48_params.I, conv_48_params.J,
+    tiled_resadd_auto_async(conv_48_params.I, conv_48_params.J,
         conv_48_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -1523,36 +2129,38 @@ int main (int argc, char * argv[]) {
         false,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_49
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_49_params.I, conv_49_params.J, conv_49_params.K,
+        tiled_matmul_nn_auto_async(conv_49_params.I, conv_49_params.J, conv_49_params.K,
             conv_48_out, conv_49_w, conv_49_b, conv_49_out,
             RELU, conv_49_params.output_scale, true,
             tiled_matmul_type, check, "conv_49");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_49_params.I, conv_49_params.J, conv_49_params.K,
+        tiled_matmul_nn_auto_async(conv_49_params.I, conv_49_params.J, conv_49_params.K,
             conv_48_out, conv_49_w, conv_49_b, conv_49_out,
             RELU, conv_49_params.output_scale, true,
             tiled_matmul_type, check, "conv_49");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_49: %llu\n", end-start);
 
     // conv_dw_50
+    NEXT_LAYER();
     start = read_cycles();
 
     if (!conv) {
@@ -1562,7 +2170,7 @@ int main (int argc, char * argv[]) {
             conv_dw_50_params.kernel_size,
             conv_49_out, conv_dw_50_w, conv_dw_50_b, conv_dw_50_out, &conv_dw_50_params);
     } else {
-        tiled_conv_dw_auto(
+        tiled_conv_dw_auto_async(
             conv_dw_50_params.batch_size, conv_dw_50_params.in_row_dim, conv_dw_50_params.in_col_dim,
             conv_dw_50_params.in_channels,
             conv_dw_50_params.out_row_dim, conv_dw_50_params.out_col_dim,
@@ -1576,67 +2184,72 @@ int main (int argc, char * argv[]) {
             tiled_matmul_type);
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     conv_dw_cycles += end - start;
     printf("conv_dw_50: %llu \n", end - start);
 
     // conv_51
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_51_params.I, conv_51_params.J, conv_51_params.K,
+        tiled_matmul_nn_auto_async(conv_51_params.I, conv_51_params.J, conv_51_params.K,
             conv_dw_50_out, conv_51_w, conv_51_b, conv_51_out,
             NO_ACTIVATION, conv_51_params.output_scale, true,
             tiled_matmul_type, check, "conv_51");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_51_params.I, conv_51_params.J, conv_51_params.K,
+        tiled_matmul_nn_auto_async(conv_51_params.I, conv_51_params.J, conv_51_params.K,
             conv_dw_50_out, conv_51_w, conv_51_b, conv_51_out,
             NO_ACTIVATION, conv_51_params.output_scale, true,
             tiled_matmul_type, check, "conv_51");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_51: %llu\n", end-start);
 
     // conv_52
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_52_params.I, conv_52_params.J, conv_52_params.K,
+        tiled_matmul_nn_auto_async(conv_52_params.I, conv_52_params.J, conv_52_params.K,
             conv_51_out, conv_52_w, conv_52_b, conv_52_out,
             RELU, conv_52_params.output_scale, true,
             tiled_matmul_type, check, "conv_52");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_52_params.I, conv_52_params.J, conv_52_params.K,
+        tiled_matmul_nn_auto_async(conv_52_params.I, conv_52_params.J, conv_52_params.K,
             conv_51_out, conv_52_w, conv_52_b, conv_52_out,
             RELU, conv_52_params.output_scale, true,
             tiled_matmul_type, check, "conv_52");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
     }
 
     printf("matmul_52: %llu\n", end-start);
 
     // Global averaging
+    NEXT_LAYER();
     static elem_t average[1280][4] row_align(1);
 
     start = read_cycles();
 
+    gemmini_wait_read(conv_52_out, sizeof(conv_52_out));
+
     for (int batch = 0; batch < conv_52_params.batch_size; batch++) {
         for (int channel = 0; channel < conv_52_params.out_channels; channel++) {
             int sum = 0;
@@ -1653,18 +2266,21 @@ int main (int argc, char * argv[]) {
         }
     }
 
-    end = read_cycles();
+    end = layer_end_cycles();
     other_cycles += end - start;
 
     // fc_53
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_matmul_nn_auto(fc_53_params.I, fc_53_params.J, fc_53_params.K,
+    tiled_matmul_nn_auto_async(fc_53_params.I, fc_53_params.J, fc_53_params.K,
         fc_53_w, average, fc_53_b, fc_53_out,
         NO_ACTIVATION, fc_53_params.output_scale, false,
         tiled_matmul_type, check, "fc_53");
 
-    end = read_cycles();
+    gemmini_wait_read(fc_53_out, sizeof(fc_53_out));
+
+    end = layer_end_cycles();
     matmul_cycles += end - start;
 
     printf("matmul_53: %llu\n", end-start);
@@ -1689,6 +2305,8 @@ int main (int argc, char * argv[]) {
     uint64_t total_cycles = im2col_cycles + matmul_cycles + pool_cycles + conv_cycles + conv_dw_cycles + res_add_cycles + other_cycles;
 
     printf("\nTotal cycles: %llu (100%%)\n", total_cycles);
+    if (!SYNC_LAYERS)
+        printf("(Layers overlap: each count is submission plus any waiting done in it. Build with SYNC_LAYERS=1 for run times)\n");
     printf("Matmul cycles: %llu (%d%%)\n", matmul_cycles, (matmul_cycles * 100) / total_cycles);
     printf("Im2col cycles: %llu (%d%%)\n", im2col_cycles, (im2col_cycles * 100) / total_cycles);
     printf("Conv cycles: %llu (%d%%)\n", conv_cycles, (conv_cycles * 100) / total_cycles);
@@ -11,6 +11,549 @@
 // #include "resnet50_params_1batch.h"
 #include "images.h"
 
+// Every activation lives in one arena, planned from the layers' lifetimes,
+// instead of in its own static buffer from resnet50_params.h
+#ifndef ACTIVATION_ARENA
+#define ACTIVATION_ARENA 1
+#endif
+
+#if ACTIVATION_ARENA
+#include "include/gemmini_arena.h"
+
+static struct gemmini_arena_t activations;
+
+#ifdef BAREMETAL
+#ifndef ACTIVATION_ARENA_BYTES
+#define ACTIVATION_ARENA_BYTES (16 << 20)
+#endif
+
+static char activation_arena[ACTIVATION_ARENA_BYTES] __attribute__((aligned(GEMMINI_ARENA_ALIGN)));
+#endif
+
+// main() moves the arena on to the next layer at the same points as
+// plan_activations, so touching a tensor outside the layers it was planned for
+// exits instead of silently sharing memory with another live tensor
+#define NEXT_LAYER() gemmini_arena_next_layer(&activations)
+
+// The activations each layer of main() reads or writes, in the order they run.
+// The im2col buffers are only used when convs run as matmuls
+static void plan_activations(bool conv) {
+#define USE(name) GEMMINI_ARENA_USE(&activations, name)
+#define USE_IF_MATMUL(name) if (!conv) USE(name)
+
+    // conv_1
+    USE_IF_MATMUL(conv_1_in); USE_IF_MATMUL(conv_1_out); USE(conv_1_out_pooled); NEXT_LAYER();
+
+    // conv_2
+    USE(conv_1_out_pooled); USE_IF_MATMUL(conv_2_in); USE(conv_2_out); NEXT_LAYER();
+
+    // conv_3
+    USE(conv_2_out); USE_IF_MATMUL(conv_3_in); USE(conv_3_out); NEXT_LAYER();
+
+    // conv_4
+    USE(conv_3_out); USE(conv_4_out); NEXT_LAYER();
+
+    // conv_5
+    USE(conv_1_out_pooled); USE_IF_MATMUL(conv_5_in); USE(conv_5_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_5_out); USE(conv_4_out); NEXT_LAYER();
+
+    // conv_6
+    USE(conv_4_out); USE(conv_6_out); NEXT_LAYER();
+
+    // conv_7
+    USE(conv_6_out); USE_IF_MATMUL(conv_7_in); USE(conv_7_out); NEXT_LAYER();
+
+    // conv_8, with the residual added
+    USE(conv_7_out); USE(conv_4_out); USE(conv_8_out); NEXT_LAYER();
+
+    // conv_9
+    USE(conv_8_out); USE(conv_9_out); NEXT_LAYER();
+
+    // conv_10
+    USE(conv_9_out); USE_IF_MATMUL(conv_10_in); USE(conv_10_out); NEXT_LAYER();
+
+    // conv_11, with the residual added
+    USE(conv_10_out); USE(conv_8_out); USE(conv_11_out); NEXT_LAYER();
+
+    // conv_12
+    USE(conv_11_out); USE(conv_12_out); NEXT_LAYER();
+
+    // conv_13
+    USE(conv_12_out); USE_IF_MATMUL(conv_13_in); USE(conv_13_out); NEXT_LAYER();
+
+    // conv_14
+    USE(conv_13_out); USE(conv_14_out); NEXT_LAYER();
+
+    // conv_15
+    USE(conv_11_out); USE_IF_MATMUL(conv_15_in); USE(conv_15_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_15_out); USE(conv_14_out); NEXT_LAYER();
+
+    // conv_16
+    USE(conv_14_out); USE(conv_16_out); NEXT_LAYER();
+
+    // conv_17
+    USE(conv_16_out); USE_IF_MATMUL(conv_17_in); USE(conv_17_out); NEXT_LAYER();
+
+    // conv_18, with the residual added
+    USE(conv_17_out); USE(conv_14_out); USE(conv_18_out); NEXT_LAYER();
+
+    // conv_19
+    USE(conv_18_out); USE(conv_19_out); NEXT_LAYER();
+
+    // conv_20
+    USE(conv_19_out); USE_IF_MATMUL(conv_20_in); USE(conv_20_out); NEXT_LAYER();
+
+    // conv_21, with the residual added
+    USE(conv_20_out); USE(conv_18_out); USE(conv_21_out); NEXT_LAYER();
+
+    // conv_22
+    USE(conv_21_out); USE(conv_22_out); NEXT_LAYER();
+
+    // conv_23
+    USE(conv_22_out); USE_IF_MATMUL(conv_23_in); USE(conv_23_out); NEXT_LAYER();
+
+    // conv_24, with the residual added
+    USE(conv_23_out); USE(conv_21_out); USE(conv_24_out); NEXT_LAYER();
+
+    // conv_25
+    USE(conv_24_out); USE(conv_25_out); NEXT_LAYER();
+
+    // conv_26
+    USE(conv_25_out); USE_IF_MATMUL(conv_26_in); USE(conv_26_out); NEXT_LAYER();
+
+    // conv_27
+    USE(conv_26_out); USE(conv_27_out); NEXT_LAYER();
+
+    // conv_28
+    USE(conv_24_out); USE_IF_MATMUL(conv_28_in); USE(conv_28_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_28_out); USE(conv_27_out); NEXT_LAYER();
+
+    // conv_29
+    USE(conv_27_out); USE(conv_29_out); NEXT_LAYER();
+
+    // conv_30
+    USE(conv_29_out); USE_IF_MATMUL(conv_30_in); USE(conv_30_out); NEXT_LAYER();
+
+    // conv_31, with the residual added
+    USE(conv_30_out); USE(conv_27_out); USE(conv_31_out); NEXT_LAYER();
+
+    // conv_32
+    USE(conv_31_out); USE(conv_32_out); NEXT_LAYER();
+
+    // conv_33
+    USE(conv_32_out); USE_IF_MATMUL(conv_33_in); USE(conv_33_out); NEXT_LAYER();
+
+    // conv_34, with the residual added
+    USE(conv_33_out); USE(conv_31_out); USE(conv_34_out); NEXT_LAYER();
+
+    // conv_35
+    USE(conv_34_out); USE(conv_35_out); NEXT_LAYER();
+
+    // conv_36
+    USE(conv_35_out); USE_IF_MATMUL(conv_36_in); USE(conv_36_out); NEXT_LAYER();
+
+    // conv_37, with the residual added
+    USE(conv_36_out); USE(conv_34_out); USE(conv_37_out); NEXT_LAYER();
+
+    // conv_38
+    USE(conv_37_out); USE(conv_38_out); NEXT_LAYER();
+
+    // conv_39
+    USE(conv_38_out); USE_IF_MATMUL(conv_39_in); USE(conv_39_out); NEXT_LAYER();
+
+    // conv_40, with the residual added
+    USE(conv_39_out); USE(conv_37_out); USE(conv_40_out); NEXT_LAYER();
+
+    // conv_41
+    USE(conv_40_out); USE(conv_41_out); NEXT_LAYER();
+
+    // conv_42
+    USE(conv_41_out); USE_IF_MATMUL(conv_42_in); USE(conv_42_out); NEXT_LAYER();
+
+    // conv_43, with the residual added
+    USE(conv_42_out); USE(conv_40_out); USE(conv_43_out); NEXT_LAYER();
+
+    // conv_44
+    USE(conv_43_out); USE(conv_44_out); NEXT_LAYER();
+
+    // conv_45
+    USE(conv_44_out); USE_IF_MATMUL(conv_45_in); USE(conv_45_out); NEXT_LAYER();
+
+    // conv_46
+    USE(conv_45_out); USE(conv_46_out); NEXT_LAYER();
+
+    // conv_47
+    USE(conv_43_out); USE_IF_MATMUL(conv_47_in); USE(conv_47_out); NEXT_LAYER();
+
+    // Add residuals
+    USE(conv_47_out); USE(conv_46_out); NEXT_LAYER();
+
+    // conv_48
+    USE(conv_46_out); USE(conv_48_out); NEXT_LAYER();
+
+    // conv_49
+    USE(conv_48_out); USE_IF_MATMUL(conv_49_in); USE(conv_49_out); NEXT_LAYER();
+
+    // conv_50, with the residual added
+    USE(conv_49_out); USE(conv_46_out); USE(conv_50_out); NEXT_LAYER();
+
+    // conv_51
+    USE(conv_50_out); USE(conv_51_out); NEXT_LAYER();
+
+    // conv_52
+    USE(conv_51_out); USE_IF_MATMUL(conv_52_in); USE(conv_52_out); NEXT_LAYER();
+
+    // conv_53, with the residual added
+    USE(conv_52_out); USE(conv_50_out); USE(conv_53_out); NEXT_LAYER();
+
+    // Global averaging
+    USE(conv_53_out); NEXT_LAYER();
+
+    // fc_54
+    USE(fc_54_out); NEXT_LAYER();
+
+#undef USE
+#undef USE_IF_MATMUL
+
+    gemmini_arena_plan(&activations);
+
+#ifdef BAREMETAL
+    if (activations.size > sizeof(activation_arena)) {
+        printf("The activations need %llu bytes; rebuild with ACTIVATION_ARENA_BYTES of at least that\n",
+            (unsigned long long)activations.size);
+        exit(1);
+    }
+    gemmini_arena_bind(&activations, activation_arena);
+#else
+    void * base;
+    if (posix_memalign(&base, GEMMINI_ARENA_ALIGN, activations.size) != 0) {
+        perror("Can't allocate the activation arena");
+        exit(1);
+    }
+    gemmini_arena_bind(&activations, base);
+#endif
+
+    gemmini_arena_print(&activations);
+}
+
+#define conv_1_in GEMMINI_ARENA_GET(&activations, conv_1_in)
+#define conv_1_out GEMMINI_ARENA_GET(&activations, conv_1_out)
+#define conv_1_out_pooled GEMMINI_ARENA_GET(&activations, conv_1_out_pooled)
+#define conv_2_in GEMMINI_ARENA_GET(&activations, conv_2_in)
+#define conv_2_out GEMMINI_ARENA_GET(&activations, conv_2_out)
+#define conv_3_in GEMMINI_ARENA_GET(&activations, conv_3_in)
+#define conv_3_out GEMMINI_ARENA_GET(&activations, conv_3_out)
+#define conv_4_out GEMMINI_ARENA_GET(&activations, conv_4_out)
+#define conv_5_in GEMMINI_ARENA_GET(&activations, conv_5_in)
+#define conv_5_out GEMMINI_ARENA_GET(&activations, conv_5_out)
+#define conv_6_out GEMMINI_ARENA_GET(&activations, conv_6_out)
+#define conv_7_in GEMMINI_ARENA_GET(&activations, conv_7_in)
+#define conv_7_out GEMMINI_ARENA_GET(&activations, conv_7_out)
+#define conv_8_out GEMMINI_ARENA_GET(&activations, conv_8_out)
+#define conv_9_out GEMMINI_ARENA_GET(&activations, conv_9_out)
+#define conv_10_in GEMMINI_ARENA_GET(&activations, conv_10_in)
+#define conv_10_out GEMMINI_ARENA_GET(&activations, conv_10_out)
+#define conv_11_out GEMMINI_ARENA_GET(&activations, conv_11_out)
+#define conv_12_out GEMMINI_ARENA_GET(&activations, conv_12_out)
+#define conv_13_in GEMMINI_ARENA_GET(&activations, conv_13_in)
+#define conv_13_out GEMMINI_ARENA_GET(&activations, conv_13_out)
+#define conv_14_out GEMMINI_ARENA_GET(&activations, conv_14_out)
+#define conv_15_in GEMMINI_ARENA_GET(&activations, conv_15_in)
+#define conv_15_out GEMMINI_ARENA_GET(&activations, conv_15_out)
+#define conv_16_out GEMMINI_ARENA_GET(&activations, conv_16_out)
+#define conv_17_in GEMMINI_ARENA_GET(&activations, conv_17_in)
+#define conv_17_out GEMMINI_ARENA_GET(&activations, conv_17_out)
+#define conv_18_out GEMMINI_ARENA_GET(&activations, conv_18_out)
+#define conv_19_out GEMMINI_ARENA_GET(&activations, conv_19_out)
+#define conv_20_in GEMMINI_ARENA_GET(&activations, conv_20_in)
+#define conv_20_out GEMMINI_ARENA_GET(&activations, conv_20_out)
+#define conv_21_out GEMMINI_ARENA_GET(&activations, conv_21_out)
+#define conv_22_out GEMMINI_ARENA_GET(&activations, conv_22_out)
+#define conv_23_in GEMMINI_ARENA_GET(&activations, conv_23_in)
+#define conv_23_out GEMMINI_ARENA_GET(&activations, conv_23_out)
+#define conv_24_out GEMMINI_ARENA_GET(&activations, conv_24_out)
+#define conv_25_out GEMMINI_ARENA_GET(&activations, conv_25_out)
+#define conv_26_in GEMMINI_ARENA_GET(&activations, conv_26_in)
+#define conv_26_out GEMMINI_ARENA_GET(&activations, conv_26_out)
+#define conv_27_out GEMMINI_ARENA_GET(&activations, conv_27_out)
+#define conv_28_in GEMMINI_ARENA_GET(&activations, conv_28_in)
+#define conv_28_out GEMMINI_ARENA_GET(&activations, conv_28_out)
+#define conv_29_out GEMMINI_ARENA_GET(&activations, conv_29_out)
+#define conv_30_in GEMMINI_ARENA_GET(&activations, conv_30_in)
+#define conv_30_out GEMMINI_ARENA_GET(&activations, conv_30_out)
+#define conv_31_out GEMMINI_ARENA_GET(&activations, conv_31_out)
+#define conv_32_out GEMMINI_ARENA_GET(&activations, conv_32_out)
+#define conv_33_in GEMMINI_ARENA_GET(&activations, conv_33_in)
+#define conv_33_out GEMMINI_ARENA_GET(&activations, conv_33_out)
+#define conv_34_out GEMMINI_ARENA_GET(&activations, conv_34_out)
+#define conv_35_out GEMMINI_ARENA_GET(&activations, conv_35_out)
+#define conv_36_in GEMMINI_ARENA_GET(&activations, conv_36_in)
+#define conv_36_out GEMMINI_ARENA_GET(&activations, conv_36_out)
+#define conv_37_out GEMMINI_ARENA_GET(&activations, conv_37_out)
+#define conv_38_out GEMMINI_ARENA_GET(&activations, conv_38_out)
+#define conv_39_in GEMMINI_ARENA_GET(&activations, conv_39_in)
+#define conv_39_out GEMMINI_ARENA_GET(&activations, conv_39_out)
+#define conv_40_out GEMMINI_ARENA_GET(&activations, conv_40_out)
+#define conv_41_out GEMMINI_ARENA_GET(&activations, conv_41_out)
+#define conv_42_in GEMMINI_ARENA_GET(&activations, conv_42_in)
+#define conv_42_out GEMMINI_ARENA_GET(&activations, conv_42_out)
+#define conv_43_out GEMMINI_ARENA_GET(&activations, conv_43_out)
+#define conv_44_out GEMMINI_ARENA_GET(&activations, conv_44_out)
+#define conv_45_in GEMMINI_ARENA_GET(&activations, conv_45_in)
+#define conv_45_out GEMMINI_ARENA_GET(&activations, conv_45_out)
+#define conv_46_out GEMMINI_ARENA_GET(&activations, conv_46_out)
+#define conv_47_in GEMMINI_ARENA_GET(&activations, conv_47_in)
+#define conv_47_out GEMMINI_ARENA_GET(&activations, conv_47_out)
+#define conv_48_out GEMMINI_ARENA_GET(&activations, conv_48_out)
+#define conv_49_in GEMMINI_ARENA_GET(&activations, conv_49_in)
+#define conv_49_out GEMMINI_ARENA_GET(&activations, conv_49_out)
+#define conv_50_out GEMMINI_ARENA_GET(&activations, conv_50_out)
+#define conv_51_out GEMMINI_ARENA_GET(&activations, conv_51_out)
+#define conv_52_in GEMMINI_ARENA_GET(&activations, conv_52_in)
+#define conv_52_out GEMMINI_ARENA_GET(&activations, conv_52_out)
+#define conv_53_out GEMMINI_ARENA_GET(&activations, conv_53_out)
+#define fc_54_out GEMMINI_ARENA_GET(&activations, fc_54_out)
+#else
+#define NEXT_LAYER()
+#endif
+
+// The weights and biases can come from a container instead of
+// resnet50_params.h, so they can change without a rebuild: a file mapped at run
+// time on Linux, or one linked in from WEIGHTS_PATH on baremetal. Without
+// WEIGHTS_FROM_CONTAINER, "resnet50 export [path]" writes the container for
+// the weights built into resnet50_params.h
+#ifndef WEIGHTS_FROM_CONTAINER
+#define WEIGHTS_FROM_CONTAINER 0
+#endif
+
+#ifndef WEIGHTS_PATH
+#define WEIGHTS_PATH "resnet50_weights.bin"
+#endif
+
+#include "include/gemmini_weights.h"
+
+#define RESNET50_WEIGHTS(ELEM, ACC) \
+    ELEM(conv_1_w) ACC(conv_1_b) \
+    ELEM(conv_2_w) ACC(conv_2_b) \
+    ELEM(conv_3_w) ACC(conv_3_b) \
+    ELEM(conv_4_w) ACC(conv_4_b) \
+    ELEM(conv_5_w) ACC(conv_5_b) \
+    ELEM(conv_6_w) ACC(conv_6_b) \
+    ELEM(conv_7_w) ACC(conv_7_b) \
+    ELEM(conv_8_w) ACC(conv_8_b) \
+    ELEM(conv_9_w) ACC(conv_9_b) \
+    ELEM(conv_10_w) ACC(conv_10_b) \
+    ELEM(conv_11_w) ACC(conv_11_b) \
+    ELEM(conv_12_w) ACC(conv_12_b) \
+    ELEM(conv_13_w) ACC(conv_13_b) \
+    ELEM(conv_14_w) ACC(conv_14_b) \
+    ELEM(conv_15_w) ACC(conv_15_b) \
+    ELEM(conv_16_w) ACC(conv_16_b) \
+    ELEM(conv_17_w) ACC(conv_17_b) \
+    ELEM(conv_18_w) ACC(conv_18_b) \
+    ELEM(conv_19_w) ACC(conv_19_b) \
+    ELEM(conv_20_w) ACC(conv_20_b) \
+    ELEM(conv_21_w) ACC(conv_21_b) \
+    ELEM(conv_22_w) ACC(conv_22_b) \
+    ELEM(conv_23_w) ACC(conv_23_b) \
+    ELEM(conv_24_w) ACC(conv_24_b) \
+    ELEM(conv_25_w) ACC(conv_25_b) \
+    ELEM(conv_26_w) ACC(conv_26_b) \
+    ELEM(conv_27_w) ACC(conv_27_b) \
+    ELEM(conv_28_w) ACC(conv_28_b) \
+    ELEM(conv_29_w) ACC(conv_29_b) \
+    ELEM(conv_30_w) ACC(conv_30_b) \
+    ELEM(conv_31_w) ACC(conv_31_b) \
+    ELEM(conv_32_w) ACC(conv_32_b) \
+    ELEM(conv_33_w) ACC(conv_33_b) \
+    ELEM(conv_34_w) ACC(conv_34_b) \
+    ELEM(conv_35_w) ACC(conv_35_b) \
+    ELEM(conv_36_w) ACC(conv_36_b) \
+    ELEM(conv_37_w) ACC(conv_37_b) \
+    ELEM(conv_38_w) ACC(conv_38_b) \
+    ELEM(conv_39_w) ACC(conv_39_b) \
+    ELEM(conv_40_w) ACC(conv_40_b) \
+    ELEM(conv_41_w) ACC(conv_41_b) \
+    ELEM(conv_42_w) ACC(conv_42_b) \
+    ELEM(conv_43_w) ACC(conv_43_b) \
+    ELEM(conv_44_w) ACC(conv_44_b) \
+    ELEM(conv_45_w) ACC(conv_45_b) \
+    ELEM(conv_46_w) ACC(conv_46_b) \
+    ELEM(conv_47_w) ACC(conv_47_b) \
+    ELEM(conv_48_w) ACC(conv_48_b) \
+    ELEM(conv_49_w) ACC(conv_49_b) \
+    ELEM(conv_50_w) ACC(conv_50_b) \
+    ELEM(conv_51_w) ACC(conv_51_b) \
+    ELEM(conv_52_w) ACC(conv_52_b) \
+    ELEM(conv_53_w) ACC(conv_53_b) \
+    ELEM(fc_54_w) ACC(fc_54_b)
+
+#if WEIGHTS_FROM_CONTAINER
+static struct gemmini_weights_t weights;
+
+#ifdef BAREMETAL
+GEMMINI_WEIGHTS_INCBIN(resnet50_weights, WEIGHTS_PATH);
+#endif
+
+#define conv_1_w GEMMINI_WEIGHTS_GET(&weights, conv_1_w)
+#define conv_1_b GEMMINI_WEIGHTS_GET(&weights, conv_1_b)
+#define conv_2_w GEMMINI_WEIGHTS_GET(&weights, conv_2_w)
+#define conv_2_b GEMMINI_WEIGHTS_GET(&weights, conv_2_b)
+#define conv_3_w GEMMINI_WEIGHTS_GET(&weights, conv_3_w)
+#define conv_3_b GEMMINI_WEIGHTS_GET(&weights, conv_3_b)
+#define conv_4_w GEMMINI_WEIGHTS_GET(&weights, conv_4_w)
+#define conv_4_b GEMMINI_WEIGHTS_GET(&weights, conv_4_b)
+#define conv_5_w GEMMINI_WEIGHTS_GET(&weights, conv_5_w)
+#define conv_5_b GEMMINI_WEIGHTS_GET(&weights, conv_5_b)
+#define conv_6_w GEMMINI_WEIGHTS_GET(&weights, conv_6_w)
+#define conv_6_b GEMMINI_WEIGHTS_GET(&weights, conv_6_b)
+#define conv_7_w GEMMINI_WEIGHTS_GET(&weights, conv_7_w)
+#define conv_7_b GEMMINI_WEIGHTS_GET(&weights, conv_7_b)
+#define conv_8_w GEMMINI_WEIGHTS_GET(&weights, conv_8_w)
+#define conv_8_b GEMMINI_WEIGHTS_GET(&weights, conv_8_b)
+#define conv_9_w GEMMINI_WEIGHTS_GET(&weights, conv_9_w)
+#define conv_9_b GEMMINI_WEIGHTS_GET(&weights, conv_9_b)
+#define conv_10_w GEMMINI_WEIGHTS_GET(&weights, conv_10_w)
+#define conv_10_b GEMMINI_WEIGHTS_GET(&weights, conv_10_b)
+#define conv_11_w GEMMINI_WEIGHTS_GET(&weights, conv_11_w)
+#define conv_11_b GEMMINI_WEIGHTS_GET(&weights, conv_11_b)
+#define conv_12_w GEMMINI_WEIGHTS_GET(&weights, conv_12_w)
+#define conv_12_b GEMMINI_WEIGHTS_GET(&weights, conv_12_b)
+#define conv_13_w GEMMINI_WEIGHTS_GET(&weights, conv_13_w)
+#define conv_13_b GEMMINI_WEIGHTS_GET(&weights, conv_13_b)
+#define conv_14_w GEMMINI_WEIGHTS_GET(&weights, conv_14_w)
+#define conv_14_b GEMMINI_WEIGHTS_GET(&weights, conv_14_b)
+#define conv_15_w GEMMINI_WEIGHTS_GET(&weights, conv_15_w)
+#define conv_15_b GEMMINI_WEIGHTS_GET(&weights, conv_15_b)
+#define conv_16_w GEMMINI_WEIGHTS_GET(&weights, conv_16_w)
+#define conv_16_b GEMMINI_WEIGHTS_GET(&weights, conv_16_b)
+#define conv_17_w GEMMINI_WEIGHTS_GET(&weights, conv_17_w)
+#define conv_17_b GEMMINI_WEIGHTS_GET(&weights, conv_17_b)
+#define conv_18_w GEMMINI_WEIGHTS_GET(&weights, conv_18_w)
+#define conv_18_b GEMMINI_WEIGHTS_GET(&weights, conv_18_b)
+#define conv_19_w GEMMINI_WEIGHTS_GET(&weights, conv_19_w)
+#define conv_19_b GEMMINI_WEIGHTS_GET(&weights, conv_19_b)
+#define conv_20_w GEMMINI_WEIGHTS_GET(&weights, conv_20_w)
+#define conv_20_b GEMMINI_WEIGHTS_GET(&weights, conv_20_b)
+#define conv_21_w GEMMINI_WEIGHTS_GET(&weights, conv_21_w)
+#define conv_21_b GEMMINI_WEIGHTS_GET(&weights, conv_21_b)
+#define conv_22_w GEMMINI_WEIGHTS_GET(&weights, conv_22_w)
+#define conv_22_b GEMMINI_WEIGHTS_GET(&weights, conv_22_b)
+#define conv_23_w GEMMINI_WEIGHTS_GET(&weights, conv_23_w)
+#define conv_23_b GEMMINI_WEIGHTS_GET(&weights, conv_23_b)
+#define conv_24_w GEMMINI_WEIGHTS_GET(&weights, conv_24_w)
+#define conv_24_b GEMMINI_WEIGHTS_GET(&weights, conv_24_b)
+#define conv_25_w GEMMINI_WEIGHTS_GET(&weights, conv_25_w)
+#define conv_25_b GEMMINI_WEIGHTS_GET(&weights, conv_25_b)
+#define conv_26_w GEMMINI_WEIGHTS_GET(&weights, conv_26_w)
+#define conv_26_b GEMMINI_WEIGHTS_GET(&weights, conv_26_b)
+#define conv_27_w GEMMINI_WEIGHTS_GET(&weights, conv_27_w)
+#define conv_27_b GEMMINI_WEIGHTS_GET(&weights, conv_27_b)
+#define conv_28_w GEMMINI_WEIGHTS_GET(&weights, conv_28_w)
+#define conv_28_b GEMMINI_WEIGHTS_GET(&weights, conv_28_b)
+#define conv_29_w GEMMINI_WEIGHTS_GET(&weights, conv_29_w)
+#define conv_29_b GEMMINI_WEIGHTS_GET(&weights, conv_29_b)
+#define conv_30_w GEMMINI_WEIGHTS_GET(&weights, conv_30_w)
+#define conv_30_b GEMMINI_WEIGHTS_GET(&weights, conv_30_b)
+#define conv_31_w GEMMINI_WEIGHTS_GET(&weights, conv_31_w)
+#define conv_31_b GEMMINI_WEIGHTS_GET(&weights, conv_31_b)
+#define conv_32_w GEMMINI_WEIGHTS_GET(&weights, conv_32_w)
+#define conv_32_b GEMMINI_WEIGHTS_GET(&weights, conv_32_b)
+#define conv_33_w GEMMINI_WEIGHTS_GET(&weights, conv_33_w)
+#define conv_33_b GEMMINI_WEIGHTS_GET(&weights, conv_33_b)
+#define conv_34_w GEMMINI_WEIGHTS_GET(&weights, conv_34_w)
+#define conv_34_b GEMMINI_WEIGHTS_GET(&weights, conv_34_b)
+#define conv_35_w GEMMINI_WEIGHTS_GET(&weights, conv_35_w)
+#define conv_35_b GEMMINI_WEIGHTS_GET(&weights, conv_35_b)
+#define conv_36_w GEMMINI_WEIGHTS_GET(&weights, conv_36_w)
+#define conv_36_b GEMMINI_WEIGHTS_GET(&weights, conv_36_b)
+#define conv_37_w GEMMINI_WEIGHTS_GET(&weights, conv_37_w)
+#define conv_37_b GEMMINI_WEIGHTS_GET(&weights, conv_37_b)
+#define conv_38_w GEMMINI_WEIGHTS_GET(&weights, conv_38_w)
+#define conv_38_b GEMMINI_WEIGHTS_GET(&weights, conv_38_b)
+#define conv_39_w GEMMINI_WEIGHTS_GET(&weights, conv_39_w)
+#define conv_39_b GEMMINI_WEIGHTS_GET(&weights, conv_39_b)
+#define conv_40_w GEMMINI_WEIGHTS_GET(&weights, conv_40_w)
+#define conv_40_b GEMMINI_WEIGHTS_GET(&weights, conv_40_b)
+#define conv_41_w GEMMINI_WEIGHTS_GET(&weights, conv_41_w)
+#define conv_41_b GEMMINI_WEIGHTS_GET(&weights, conv_41_b)
+#define conv_42_w GEMMINI_WEIGHTS_GET(&weights, conv_42_w)
+#define conv_42_b GEMMINI_WEIGHTS_GET(&weights, conv_42_b)
+#define conv_43_w GEMMINI_WEIGHTS_GET(&weights, conv_43_w)
+#define conv_43_b GEMMINI_WEIGHTS_GET(&weights, conv_43_b)
+#define conv_44_w GEMMINI_WEIGHTS_GET(&weights, conv_44_w)
+#define conv_44_b GEMMINI_WEIGHTS_GET(&weights, conv_44_b)
+#define conv_45_w GEMMINI_WEIGHTS_GET(&weights, conv_45_w)
+#define conv_45_b GEMMINI_WEIGHTS_GET(&weights, conv_45_b)
+#define conv_46_w GEMMINI_WEIGHTS_GET(&weights, conv_46_w)
+#define conv_46_b GEMMINI_WEIGHTS_GET(&weights, conv_46_b)
+#define conv_47_w GEMMINI_WEIGHTS_GET(&weights, conv_47_w)
+#define conv_47_b GEMMINI_WEIGHTS_GET(&weights, conv_47_b)
+#define conv_48_w GEMMINI_WEIGHTS_GET(&weights, conv_48_w)
+#define conv_48_b GEMMINI_WEIGHTS_GET(&weights, conv_48_b)
+#define conv_49_w GEMMINI_WEIGHTS_GET(&weights, conv_49_w)
+#define conv_49_b GEMMINI_WEIGHTS_GET(&weights, conv_49_b)
+#define conv_50_w GEMMINI_WEIGHTS_GET(&weights, conv_50_w)
+#define conv_50_b GEMMINI_WEIGHTS_GET(&weights, conv_50_b)
+#define conv_51_w GEMMINI_WEIGHTS_GET(&weights, conv_51_w)
+#define conv_51_b GEMMINI_WEIGHTS_GET(&weights, conv_51_b)
+#define conv_52_w GEMMINI_WEIGHTS_GET(&weights, conv_52_w)
+#define conv_52_b GEMMINI_WEIGHTS_GET(&weights, conv_52_b)
+#define conv_53_w GEMMINI_WEIGHTS_GET(&weights, conv_53_w)
+#define conv_53_b GEMMINI_WEIGHTS_GET(&weights, conv_53_b)
+#define fc_54_w GEMMINI_WEIGHTS_GET(&weights, fc_54_w)
+#define fc_54_b GEMMINI_WEIGHTS_GET(&weights, fc_54_b)
+
+#elif !defined(BAREMETAL)
+static void export_weights(const char * path) {
+#define BYTES(name) + gemmini_weights_align(sizeof(name))
+    const size_t capacity = GEMMINI_WEIGHTS_ALIGN + RESNET50_WEIGHTS(BYTES, BYTES) +
+        GEMMINI_WEIGHTS_MAX_TENSORS * sizeof(struct gemmini_weights_entry_t);
+#undef BYTES
+
+    static struct gemmini_weights_builder_t builder;
+    void * container;
+    if (posix_memalign(&container, GEMMINI_WEIGHTS_ALIGN, capacity) != 0) {
+        perror("Can't allocate the weight container");
+        exit(1);
+    }
+    gemmini_weights_build_start(&builder, container, capacity);
+
+#define ADD_ELEM(name) gemmini_weights_build_add(&builder, #name, GEMMINI_WEIGHTS_ELEM, \
+        sizeof(name) / sizeof(name[0]), sizeof(name[0]) / sizeof(elem_t), name, 1);
+#define ADD_ACC(name) gemmini_weights_build_add(&builder, #name, GEMMINI_WEIGHTS_ACC, \
+        1, sizeof(name) / sizeof(acc_t), name, 1);
+    RESNET50_WEIGHTS(ADD_ELEM, ADD_ACC)
+#undef ADD_ELEM
+#undef ADD_ACC
+
+    const size_t bytes = gemmini_weights_build_finish(&builder);
+    gemmini_weights_save(path, container, bytes);
+    printf("Wrote %u tensors, %llu bytes, to %s\n", builder.n_tensors, (unsigned long long)bytes, path);
+    free(container);
+}
+#endif
+
+// The layers are submitted asynchronously, so a layer's cycle count normally
+// covers its submission, plus any wait for the layers before it. SYNC_LAYERS
+// waits for each layer to finish before reading the cycle counter, so every
+// count is the layer's own run time, at the cost of the overlap between layers
+#ifndef SYNC_LAYERS
+#define SYNC_LAYERS 0
+#endif
+
+static uint64_t layer_end_cycles() {
+    if (SYNC_LAYERS)
+        gemmini_wait_all();
+    return read_cycles();
+}
+
 int main (int argc, char * argv[]) {
 #ifndef BAREMETAL
     if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
@@ -19,6 +562,19 @@ int main (int argc, char * argv[]) {
     }
 #endif
 
+#if WEIGHTS_FROM_CONTAINER
+#ifdef BAREMETAL
+    gemmini_weights_open(&weights, resnet50_weights, resnet50_weights_end - resnet50_weights);
+#else
+    gemmini_weights_map(&weights, argc >= 5 ? argv[4] : WEIGHTS_PATH);
+#endif
+#elif !defined(BAREMETAL)
+    if (argc >= 2 && strcmp(argv[1], "export") == 0) {
+        export_weights(argc >= 3 ? argv[2] : WEIGHTS_PATH);
+        exit(0);
+    }
+#endif
+
     gemmini_flush(0);
 
     enum tiled_matmul_type_t tiled_matmul_type = WS;
@@ -66,6 +622,10 @@ int main (int argc, char * argv[]) {
         exit(1);
     }
 
+#if ACTIVATION_ARENA
+    plan_activations(conv);
+#endif
+
     uint64_t start, end;
     uint64_t im2col_cycles = 0, matmul_cycles = 0, conv_cycles = 0, pool_cycles = 0, conv_dw_cycles = 0, res_add_cycles = 0, other_cycles = 0;
 
@@ -78,17 +638,17 @@ int main (int argc, char * argv[]) {
             conv_1_params.I, conv_1_params.K,
             images, conv_1_in, &conv_1_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_1_params.I, conv_1_params.J, conv_1_params.K,
+        tiled_matmul_nn_auto_async(conv_1_params.I, conv_1_params.J, conv_1_params.K,
             conv_1_in, conv_1_w, conv_1_b, conv_1_out,
             RELU, conv_1_params.output_scale, true,
             tiled_matmul_type, check, "conv_1");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
       start = read_cycles();
@@ -99,13 +659,13 @@ int main (int argc, char * argv[]) {
             conv_1_params.out_dim_pooled,
             conv_1_out, conv_1_out_pooled, &conv_1_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         pool_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_1_params.batch_size, conv_1_params.in_row_dim, conv_1_params.in_col_dim,
             conv_1_params.in_channels,
             conv_1_params.out_channels, conv_1_params.out_row_dim, conv_1_params.out_col_dim,
@@ -119,12 +679,13 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 1 cycles: %llu \n", end - start);
     }
 
     // conv_2
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -133,33 +694,34 @@ int main (int argc, char * argv[]) {
             conv_2_params.I, conv_2_params.K,
             conv_1_out_pooled, conv_2_in, &conv_2_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_2_params.I, conv_2_params.J, conv_2_params.K,
+        tiled_matmul_nn_auto_async(conv_2_params.I, conv_2_params.J, conv_2_params.K,
             conv_2_in, conv_2_w, conv_2_b, conv_2_out,
             RELU, conv_2_params.output_scale, true,
             tiled_matmul_type, check, "conv_2");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_2_params.I, conv_2_params.J, conv_2_params.K,
+        tiled_matmul_nn_auto_async(conv_2_params.I, conv_2_params.J, conv_2_params.K,
             conv_1_out_pooled, conv_2_w, conv_2_b, conv_2_out,
             RELU, conv_2_params.output_scale, true,
             tiled_matmul_type, check, "conv_2");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 2 cycles: %llu \n", end - start);
     }
 
     // conv_3
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -167,23 +729,23 @@ int main (int argc, char * argv[]) {
             conv_3_params.I, conv_3_params.K,
             conv_2_out, conv_3_in, &conv_3_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_3_params.I, conv_3_params.J, conv_3_params.K,
+        tiled_matmul_nn_auto_async(conv_3_params.I, conv_3_params.J, conv_3_params.K,
             conv_3_in, conv_3_w, conv_3_b, conv_3_out,
             RELU, conv_3_params.output_scale, true,
             tiled_matmul_type, check, "conv_3");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_3_params.batch_size, conv_3_params.in_row_dim, conv_3_params.in_col_dim,
             conv_3_params.in_channels,
             conv_3_params.out_channels, conv_3_params.out_row_dim, conv_3_params.out_col_dim,
@@ -197,38 +759,40 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 3 cycles: %llu \n", end - start);
     }
 
     // conv_4
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_4_params.I, conv_4_params.J, conv_4_params.K,
+        tiled_matmul_nn_auto_async(conv_4_params.I, conv_4_params.J, conv_4_params.K,
             conv_3_out, conv_4_w, conv_4_b, conv_4_out,
             NO_ACTIVATION, conv_4_params.output_scale, true,
             tiled_matmul_type, check, "conv_4");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_4_params.I, conv_4_params.J, conv_4_params.K,
+        tiled_matmul_nn_auto_async(conv_4_params.I, conv_4_params.J, conv_4_params.K,
             conv_3_out, conv_4_w, conv_4_b, conv_4_out,
             NO_ACTIVATION, conv_4_params.output_scale, true,
             tiled_matmul_type, check, "conv_4");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 4 cycles: %llu \n", end - start);
     }
 
     // Downsampling conv_1_out_pooled
     // conv_5
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -237,36 +801,37 @@ int main (int argc, char * argv[]) {
             conv_5_params.I, conv_5_params.K,
             conv_1_out_pooled, conv_5_in, &conv_5_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_5_params.I, conv_5_params.J, conv_5_params.K,
+        tiled_matmul_nn_auto_async(conv_5_params.I, conv_5_params.J, conv_5_params.K,
             conv_5_in, conv_5_w, conv_5_b, conv_5_out,
             NO_ACTIVATION, conv_5_params.output_scale, true,
             tiled_matmul_type, check, "conv_5");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_5_params.I, conv_5_params.J, conv_5_params.K,
+        tiled_matmul_nn_auto_async(conv_5_params.I, conv_5_params.J, conv_5_params.K,
             conv_1_out_pooled, conv_5_w, conv_5_b, conv_5_out,
             NO_ACTIVATION, conv_5_params.output_scale, true,
             tiled_matmul_type, check, "conv_5");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 5 cycles: %llu \n", end - start);
     }
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_4_params.I, conv_4_params.J,
+    tiled_resadd_auto_async(conv_4_params.I, conv_4_params.J,
         conv_4_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -276,35 +841,37 @@ int main (int argc, char * argv[]) {
         true,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
 
     // conv_6
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_6_params.I, conv_6_params.J, conv_6_params.K,
+        tiled_matmul_nn_auto_async(conv_6_params.I, conv_6_params.J, conv_6_params.K,
             conv_4_out, conv_6_w, conv_6_b, conv_6_out,
             RELU, conv_6_params.output_scale, true,
             tiled_matmul_type, check, "conv_6");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_6_params.I, conv_6_params.J, conv_6_params.K,
+        tiled_matmul_nn_auto_async(conv_6_params.I, conv_6_params.J, conv_6_params.K,
             conv_4_out, conv_6_w, conv_6_b, conv_6_out,
             RELU, conv_6_params.output_scale, true,
             tiled_matmul_type, check, "conv_6");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 6 cycles: %llu \n", end - start);
     }
 
     // conv_7
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -312,23 +879,23 @@ int main (int argc, char * argv[]) {
             conv_7_params.I, conv_7_params.K,
             conv_6_out, conv_7_in, &conv_7_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_7_params.I, conv_7_params.J, conv_7_params.K,
+        tiled_matmul_nn_auto_async(conv_7_params.I, conv_7_params.J, conv_7_params.K,
             conv_7_in, conv_7_w, conv_7_b, conv_7_out,
             RELU, conv_7_params.output_scale, true,
             tiled_matmul_type, check, "conv_7");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_7_params.batch_size, conv_7_params.in_row_dim, conv_7_params.in_col_dim,
             conv_7_params.in_channels,
             conv_7_params.out_channels, conv_7_params.out_row_dim, conv_7_params.out_col_dim,
@@ -342,78 +909,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 7 cycles: %llu \n", end - start);
     }
 
     // conv_8
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_8_params.I, conv_8_params.J, conv_8_params.K,
-            conv_7_out, conv_8_w, conv_8_b, conv_8_out,
-            NO_ACTIVATION, conv_8_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_8_params.I, conv_8_params.J, conv_8_params.K,
+            conv_7_out, conv_8_w, conv_8_b, conv_4_out, conv_8_out,
+            conv_8_params.res_scale, RELU, conv_8_params.output_scale, true,
             tiled_matmul_type, check, "conv_8");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_8_params.I, conv_8_params.J, conv_8_params.K,
-            conv_7_out, conv_8_w, conv_8_b, conv_8_out,
-            NO_ACTIVATION, conv_8_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_8_params.I, conv_8_params.J, conv_8_params.K,
+            conv_7_out, conv_8_w, conv_8_b, conv_4_out, conv_8_out,
+            conv_8_params.res_scale, RELU, conv_8_params.output_scale, true,
             tiled_matmul_type, check, "conv_8");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 8 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_8_params.I, conv_8_params.J,
-        conv_8_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_4_out,
-        conv_8_out,
-        conv_8_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-
     // conv_9
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_9_params.I, conv_9_params.J, conv_9_params.K,
+        tiled_matmul_nn_auto_async(conv_9_params.I, conv_9_params.J, conv_9_params.K,
             conv_8_out, conv_9_w, conv_9_b, conv_9_out,
             RELU, conv_9_params.output_scale, true,
             tiled_matmul_type, check, "conv_9");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_9_params.I, conv_9_params.J, conv_9_params.K,
+        tiled_matmul_nn_auto_async(conv_9_params.I, conv_9_params.J, conv_9_params.K,
             conv_8_out, conv_9_w, conv_9_b, conv_9_out,
             RELU, conv_9_params.output_scale, true,
             tiled_matmul_type, check, "conv_9");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 9 cycles: %llu \n", end - start);
     }
 
     // conv_10
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -421,23 +975,23 @@ int main (int argc, char * argv[]) {
             conv_10_params.I, conv_10_params.K,
             conv_9_out, conv_10_in, &conv_10_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_10_params.I, conv_10_params.J, conv_10_params.K,
+        tiled_matmul_nn_auto_async(conv_10_params.I, conv_10_params.J, conv_10_params.K,
             conv_10_in, conv_10_w, conv_10_b, conv_10_out,
             RELU, conv_10_params.output_scale, true,
             tiled_matmul_type, check, "conv_10");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_10_params.batch_size, conv_10_params.in_row_dim, conv_10_params.in_col_dim,
             conv_10_params.in_channels,
             conv_10_params.out_channels, conv_10_params.out_row_dim, conv_10_params.out_col_dim,
@@ -451,78 +1005,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 10 cycles: %llu \n", end - start);
     }
 
     // conv_11
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_11_params.I, conv_11_params.J, conv_11_params.K,
-            conv_10_out, conv_11_w, conv_11_b, conv_11_out,
-            NO_ACTIVATION, conv_11_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_11_params.I, conv_11_params.J, conv_11_params.K,
+            conv_10_out, conv_11_w, conv_11_b, conv_8_out, conv_11_out,
+            conv_11_params.res_scale, RELU, conv_11_params.output_scale, true,
             tiled_matmul_type, check, "conv_11");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_11_params.I, conv_11_params.J, conv_11_params.K,
-            conv_10_out, conv_11_w, conv_11_b, conv_11_out,
-            NO_ACTIVATION, conv_11_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_11_params.I, conv_11_params.J, conv_11_params.K,
+            conv_10_out, conv_11_w, conv_11_b, conv_8_out, conv_11_out,
+            conv_11_params.res_scale, RELU, conv_11_params.output_scale, true,
             tiled_matmul_type, check, "conv_11");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 11 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_11_params.I, conv_11_params.J,
-        conv_11_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_8_out,
-        conv_11_out,
-        conv_11_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-
     // conv_12
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_12_params.I, conv_12_params.J, conv_12_params.K,
+        tiled_matmul_nn_auto_async(conv_12_params.I, conv_12_params.J, conv_12_params.K,
             conv_11_out, conv_12_w, conv_12_b, conv_12_out,
             RELU, conv_12_params.output_scale, true,
             tiled_matmul_type, check, "conv_12");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_12_params.I, conv_12_params.J, conv_12_params.K,
+        tiled_matmul_nn_auto_async(conv_12_params.I, conv_12_params.J, conv_12_params.K,
             conv_11_out, conv_12_w, conv_12_b, conv_12_out,
             RELU, conv_12_params.output_scale, true,
             tiled_matmul_type, check, "conv_12");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 12 cycles: %llu \n", end - start);
     }
 
     // conv_13
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -530,23 +1071,23 @@ int main (int argc, char * argv[]) {
             conv_13_params.I, conv_13_params.K,
             conv_12_out, conv_13_in, &conv_13_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_13_params.I, conv_13_params.J, conv_13_params.K,
+        tiled_matmul_nn_auto_async(conv_13_params.I, conv_13_params.J, conv_13_params.K,
             conv_13_in, conv_13_w, conv_13_b, conv_13_out,
             RELU, conv_13_params.output_scale, true,
             tiled_matmul_type, check, "conv_13");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_13_params.batch_size, conv_13_params.in_row_dim, conv_13_params.in_col_dim,
             conv_13_params.in_channels,
             conv_13_params.out_channels, conv_13_params.out_row_dim, conv_13_params.out_col_dim,
@@ -560,38 +1101,40 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 13 cycles: %llu \n", end - start);
     }
 
     // conv_14
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_14_params.I, conv_14_params.J, conv_14_params.K,
+        tiled_matmul_nn_auto_async(conv_14_params.I, conv_14_params.J, conv_14_params.K,
             conv_13_out, conv_14_w, conv_14_b, conv_14_out,
             NO_ACTIVATION, conv_14_params.output_scale, true,
             tiled_matmul_type, check, "conv_14");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_14_params.I, conv_14_params.J, conv_14_params.K,
+        tiled_matmul_nn_auto_async(conv_14_params.I, conv_14_params.J, conv_14_params.K,
             conv_13_out, conv_14_w, conv_14_b, conv_14_out,
             NO_ACTIVATION, conv_14_params.output_scale, true,
             tiled_matmul_type, check, "conv_14");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 14 cycles: %llu \n", end - start);
     }
 
     // Downsampling conv_11_out
     // conv_15
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -599,24 +1142,24 @@ int main (int argc, char * argv[]) {
             conv_15_params.I, conv_15_params.K,
             conv_11_out, conv_15_in, &conv_15_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_15_params.I, conv_15_params.J, conv_15_params.K,
+        tiled_matmul_nn_auto_async(conv_15_params.I, conv_15_params.J, conv_15_params.K,
             conv_15_in, conv_15_w, conv_15_b, conv_15_out,
             NO_ACTIVATION, conv_15_params.output_scale, true,
             tiled_matmul_type, check, "conv_15");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        // tiled_conv_auto(
-        tiled_conv_downsample(
+        // tiled_conv_auto_async(
+        tiled_conv_downsample_async(
             conv_15_params.batch_size, conv_15_params.in_row_dim, conv_15_params.in_col_dim,
             conv_15_params.in_channels,
             conv_15_params.out_channels, conv_15_params.out_row_dim, conv_15_params.out_col_dim,
@@ -631,15 +1174,16 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 15 cycles: %llu \n", end - start);
     }
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_14_params.I, conv_14_params.J,
+    tiled_resadd_auto_async(conv_14_params.I, conv_14_params.J,
         conv_14_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -649,35 +1193,37 @@ int main (int argc, char * argv[]) {
         true,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_16
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_16_params.I, conv_16_params.J, conv_16_params.K,
+        tiled_matmul_nn_auto_async(conv_16_params.I, conv_16_params.J, conv_16_params.K,
             conv_14_out, conv_16_w, conv_16_b, conv_16_out,
             RELU, conv_16_params.output_scale, true,
             tiled_matmul_type, check, "conv_16");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_16_params.I, conv_16_params.J, conv_16_params.K,
+        tiled_matmul_nn_auto_async(conv_16_params.I, conv_16_params.J, conv_16_params.K,
             conv_14_out, conv_16_w, conv_16_b, conv_16_out,
             RELU, conv_16_params.output_scale, true,
             tiled_matmul_type, check, "conv_16");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 16 cycles: %llu \n", end - start);
     }
 
     // conv_17
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -685,23 +1231,23 @@ int main (int argc, char * argv[]) {
             conv_17_params.I, conv_17_params.K,
             conv_16_out, conv_17_in, &conv_17_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_17_params.I, conv_17_params.J, conv_17_params.K,
+        tiled_matmul_nn_auto_async(conv_17_params.I, conv_17_params.J, conv_17_params.K,
             conv_17_in, conv_17_w, conv_17_b, conv_17_out,
             RELU, conv_17_params.output_scale, true,
             tiled_matmul_type, check, "conv_17");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_17_params.batch_size, conv_17_params.in_row_dim, conv_17_params.in_col_dim,
             conv_17_params.in_channels,
             conv_17_params.out_channels, conv_17_params.out_row_dim, conv_17_params.out_col_dim,
@@ -715,78 +1261,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 17 cycles: %llu \n", end - start);
     }
 
     // conv_18
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_18_params.I, conv_18_params.J, conv_18_params.K,
-            conv_17_out, conv_18_w, conv_18_b, conv_18_out,
-            NO_ACTIVATION, conv_18_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_18_params.I, conv_18_params.J, conv_18_params.K,
+            conv_17_out, conv_18_w, conv_18_b, conv_14_out, conv_18_out,
+            conv_18_params.res_scale, RELU, conv_18_params.output_scale, true,
             tiled_matmul_type, check, "conv_18");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_18_params.I, conv_18_params.J, conv_18_params.K,
-            conv_17_out, conv_18_w, conv_18_b, conv_18_out,
-            NO_ACTIVATION, conv_18_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_18_params.I, conv_18_params.J, conv_18_params.K,
+            conv_17_out, conv_18_w, conv_18_b, conv_14_out, conv_18_out,
+            conv_18_params.res_scale, RELU, conv_18_params.output_scale, true,
             tiled_matmul_type, check, "conv_18");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 18 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_18_params.I, conv_18_params.J,
-        conv_18_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_14_out,
-        conv_18_out,
-        conv_18_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_19
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_19_params.I, conv_19_params.J, conv_19_params.K,
+        tiled_matmul_nn_auto_async(conv_19_params.I, conv_19_params.J, conv_19_params.K,
             conv_18_out, conv_19_w, conv_19_b, conv_19_out,
             RELU, conv_19_params.output_scale, true,
             tiled_matmul_type, check, "conv_19");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_19_params.I, conv_19_params.J, conv_19_params.K,
+        tiled_matmul_nn_auto_async(conv_19_params.I, conv_19_params.J, conv_19_params.K,
             conv_18_out, conv_19_w, conv_19_b, conv_19_out,
             RELU, conv_19_params.output_scale, true,
             tiled_matmul_type, check, "conv_19");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 19 cycles: %llu \n", end - start);
     }
 
     // conv_20
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -794,23 +1327,23 @@ int main (int argc, char * argv[]) {
             conv_20_params.I, conv_20_params.K,
             conv_19_out, conv_20_in, &conv_20_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_20_params.I, conv_20_params.J, conv_20_params.K,
+        tiled_matmul_nn_auto_async(conv_20_params.I, conv_20_params.J, conv_20_params.K,
             conv_20_in, conv_20_w, conv_20_b, conv_20_out,
             RELU, conv_20_params.output_scale, true,
             tiled_matmul_type, check, "conv_20");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_20_params.batch_size, conv_20_params.in_row_dim, conv_20_params.in_col_dim,
             conv_20_params.in_channels,
             conv_20_params.out_channels, conv_20_params.out_row_dim, conv_20_params.out_col_dim,
@@ -824,78 +1357,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 20 cycles: %llu \n", end - start);
     }
 
     // conv_21
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_21_params.I, conv_21_params.J, conv_21_params.K,
-            conv_20_out, conv_21_w, conv_21_b, conv_21_out,
-            NO_ACTIVATION, conv_21_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_21_params.I, conv_21_params.J, conv_21_params.K,
+            conv_20_out, conv_21_w, conv_21_b, conv_18_out, conv_21_out,
+            conv_21_params.res_scale, RELU, conv_21_params.output_scale, true,
             tiled_matmul_type, check, "conv_21");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_21_params.I, conv_21_params.J, conv_21_params.K,
-            conv_20_out, conv_21_w, conv_21_b, conv_21_out,
-            NO_ACTIVATION, conv_21_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_21_params.I, conv_21_params.J, conv_21_params.K,
+            conv_20_out, conv_21_w, conv_21_b, conv_18_out, conv_21_out,
+            conv_21_params.res_scale, RELU, conv_21_params.output_scale, true,
             tiled_matmul_type, check, "conv_21");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 21 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_21_params.I, conv_21_params.J,
-        conv_21_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_18_out,
-        conv_21_out,
-        conv_21_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_22
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_22_params.I, conv_22_params.J, conv_22_params.K,
+        tiled_matmul_nn_auto_async(conv_22_params.I, conv_22_params.J, conv_22_params.K,
             conv_21_out, conv_22_w, conv_22_b, conv_22_out,
             RELU, conv_22_params.output_scale, true,
             tiled_matmul_type, check, "conv_22");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_22_params.I, conv_22_params.J, conv_22_params.K,
+        tiled_matmul_nn_auto_async(conv_22_params.I, conv_22_params.J, conv_22_params.K,
             conv_21_out, conv_22_w, conv_22_b, conv_22_out,
             RELU, conv_22_params.output_scale, true,
             tiled_matmul_type, check, "conv_22");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 22 cycles: %llu \n", end - start);
     }
 
     // conv_23
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -903,23 +1423,23 @@ int main (int argc, char * argv[]) {
             conv_23_params.I, conv_23_params.K,
             conv_22_out, conv_23_in, &conv_23_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_23_params.I, conv_23_params.J, conv_23_params.K,
+        tiled_matmul_nn_auto_async(conv_23_params.I, conv_23_params.J, conv_23_params.K,
             conv_23_in, conv_23_w, conv_23_b, conv_23_out,
             RELU, conv_23_params.output_scale, true,
             tiled_matmul_type, check, "conv_23");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_23_params.batch_size, conv_23_params.in_row_dim, conv_23_params.in_col_dim,
             conv_23_params.in_channels,
             conv_23_params.out_channels, conv_23_params.out_row_dim, conv_23_params.out_col_dim,
@@ -933,78 +1453,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 23 cycles: %llu \n", end - start);
     }
 
     // conv_24
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_24_params.I, conv_24_params.J, conv_24_params.K,
-            conv_23_out, conv_24_w, conv_24_b, conv_24_out,
-            NO_ACTIVATION, conv_24_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_24_params.I, conv_24_params.J, conv_24_params.K,
+            conv_23_out, conv_24_w, conv_24_b, conv_21_out, conv_24_out,
+            conv_24_params.res_scale, RELU, conv_24_params.output_scale, true,
             tiled_matmul_type, check, "conv_24");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_24_params.I, conv_24_params.J, conv_24_params.K,
-            conv_23_out, conv_24_w, conv_24_b, conv_24_out,
-            NO_ACTIVATION, conv_24_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_24_params.I, conv_24_params.J, conv_24_params.K,
+            conv_23_out, conv_24_w, conv_24_b, conv_21_out, conv_24_out,
+            conv_24_params.res_scale, RELU, conv_24_params.output_scale, true,
             tiled_matmul_type, check, "conv_24");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 24 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_24_params.I, conv_24_params.J,
-        conv_24_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_21_out,
-        conv_24_out,
-        conv_24_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_25
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_25_params.I, conv_25_params.J, conv_25_params.K,
+        tiled_matmul_nn_auto_async(conv_25_params.I, conv_25_params.J, conv_25_params.K,
             conv_24_out, conv_25_w, conv_25_b, conv_25_out,
             RELU, conv_25_params.output_scale, true,
             tiled_matmul_type, check, "conv_25");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_25_params.I, conv_25_params.J, conv_25_params.K,
+        tiled_matmul_nn_auto_async(conv_25_params.I, conv_25_params.J, conv_25_params.K,
             conv_24_out, conv_25_w, conv_25_b, conv_25_out,
             RELU, conv_25_params.output_scale, true,
             tiled_matmul_type, check, "conv_25");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 25 cycles: %llu \n", end - start);
     }
 
     // conv_26
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1012,23 +1519,23 @@ int main (int argc, char * argv[]) {
             conv_26_params.I, conv_26_params.K,
             conv_25_out, conv_26_in, &conv_26_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_26_params.I, conv_26_params.J, conv_26_params.K,
+        tiled_matmul_nn_auto_async(conv_26_params.I, conv_26_params.J, conv_26_params.K,
             conv_26_in, conv_26_w, conv_26_b, conv_26_out,
             RELU, conv_26_params.output_scale, true,
             tiled_matmul_type, check, "conv_26");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_26_params.batch_size, conv_26_params.in_row_dim, conv_26_params.in_col_dim,
             conv_26_params.in_channels,
             conv_26_params.out_channels, conv_26_params.out_row_dim, conv_26_params.out_col_dim,
@@ -1042,38 +1549,40 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 26 cycles: %llu \n", end - start);
     }
 
     // conv_27
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_27_params.I, conv_27_params.J, conv_27_params.K,
+        tiled_matmul_nn_auto_async(conv_27_params.I, conv_27_params.J, conv_27_params.K,
             conv_26_out, conv_27_w, conv_27_b, conv_27_out,
             NO_ACTIVATION, conv_27_params.output_scale, true,
             tiled_matmul_type, check, "conv_27");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_27_params.I, conv_27_params.J, conv_27_params.K,
+        tiled_matmul_nn_auto_async(conv_27_params.I, conv_27_params.J, conv_27_params.K,
             conv_26_out, conv_27_w, conv_27_b, conv_27_out,
             NO_ACTIVATION, conv_27_params.output_scale, true,
             tiled_matmul_type, check, "conv_27");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 27 cycles: %llu \n", end - start);
     }
 
     // Downsampling conv_24_out
     // conv_28
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1081,24 +1590,24 @@ int main (int argc, char * argv[]) {
             conv_28_params.I, conv_28_params.K,
             conv_24_out, conv_28_in, &conv_28_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_28_params.I, conv_28_params.J, conv_28_params.K,
+        tiled_matmul_nn_auto_async(conv_28_params.I, conv_28_params.J, conv_28_params.K,
             conv_28_in, conv_28_w, conv_28_b, conv_28_out,
             NO_ACTIVATION, conv_28_params.output_scale, true,
             tiled_matmul_type, check, "conv_28");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        // tiled_conv_auto(
-        tiled_conv_downsample(
+        // tiled_conv_auto_async(
+        tiled_conv_downsample_async(
             conv_28_params.batch_size, conv_28_params.in_row_dim, conv_28_params.in_col_dim,
             conv_28_params.in_channels,
             conv_28_params.out_channels, conv_28_params.out_row_dim, conv_28_params.out_col_dim,
@@ -1113,15 +1622,16 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 28 cycles: %llu \n", end - start);
     }
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_27_params.I, conv_27_params.J,
+    tiled_resadd_auto_async(conv_27_params.I, conv_27_params.J,
         conv_27_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -1131,35 +1641,37 @@ int main (int argc, char * argv[]) {
         true,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_29
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_29_params.I, conv_29_params.J, conv_29_params.K,
+        tiled_matmul_nn_auto_async(conv_29_params.I, conv_29_params.J, conv_29_params.K,
             conv_27_out, conv_29_w, conv_29_b, conv_29_out,
             RELU, conv_29_params.output_scale, true,
             tiled_matmul_type, check, "conv_29");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_29_params.I, conv_29_params.J, conv_29_params.K,
+        tiled_matmul_nn_auto_async(conv_29_params.I, conv_29_params.J, conv_29_params.K,
             conv_27_out, conv_29_w, conv_29_b, conv_29_out,
             RELU, conv_29_params.output_scale, true,
             tiled_matmul_type, check, "conv_29");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 29 cycles: %llu \n", end - start);
     }
 
     // conv_30
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1167,23 +1679,23 @@ int main (int argc, char * argv[]) {
             conv_30_params.I, conv_30_params.K,
             conv_29_out, conv_30_in, &conv_30_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_30_params.I, conv_30_params.J, conv_30_params.K,
+        tiled_matmul_nn_auto_async(conv_30_params.I, conv_30_params.J, conv_30_params.K,
             conv_30_in, conv_30_w, conv_30_b, conv_30_out,
             RELU, conv_30_params.output_scale, true,
             tiled_matmul_type, check, "conv_30");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_30_params.batch_size, conv_30_params.in_row_dim, conv_30_params.in_col_dim,
             conv_30_params.in_channels,
             conv_30_params.out_channels, conv_30_params.out_row_dim, conv_30_params.out_col_dim,
@@ -1197,78 +1709,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 30 cycles: %llu \n", end - start);
     }
 
     // conv_31
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_31_params.I, conv_31_params.J, conv_31_params.K,
-            conv_30_out, conv_31_w, conv_31_b, conv_31_out,
-            NO_ACTIVATION, conv_31_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_31_params.I, conv_31_params.J, conv_31_params.K,
+            conv_30_out, conv_31_w, conv_31_b, conv_27_out, conv_31_out,
+            conv_31_params.res_scale, RELU, conv_31_params.output_scale, true,
             tiled_matmul_type, check, "conv_31");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_31_params.I, conv_31_params.J, conv_31_params.K,
-            conv_30_out, conv_31_w, conv_31_b, conv_31_out,
-            NO_ACTIVATION, conv_31_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_31_params.I, conv_31_params.J, conv_31_params.K,
+            conv_30_out, conv_31_w, conv_31_b, conv_27_out, conv_31_out,
+            conv_31_params.res_scale, RELU, conv_31_params.output_scale, true,
             tiled_matmul_type, check, "conv_31");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 31 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_31_params.I, conv_31_params.J,
-        conv_31_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_27_out,
-        conv_31_out,
-        conv_31_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_32
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_32_params.I, conv_32_params.J, conv_32_params.K,
+        tiled_matmul_nn_auto_async(conv_32_params.I, conv_32_params.J, conv_32_params.K,
             conv_31_out, conv_32_w, conv_32_b, conv_32_out,
             RELU, conv_32_params.output_scale, true,
             tiled_matmul_type, check, "conv_32");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_32_params.I, conv_32_params.J, conv_32_params.K,
+        tiled_matmul_nn_auto_async(conv_32_params.I, conv_32_params.J, conv_32_params.K,
             conv_31_out, conv_32_w, conv_32_b, conv_32_out,
             RELU, conv_32_params.output_scale, true,
             tiled_matmul_type, check, "conv_32");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 32 cycles: %llu \n", end - start);
     }
 
     // conv_33
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1276,23 +1775,23 @@ int main (int argc, char * argv[]) {
             conv_33_params.I, conv_33_params.K,
             conv_32_out, conv_33_in, &conv_33_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_33_params.I, conv_33_params.J, conv_33_params.K,
+        tiled_matmul_nn_auto_async(conv_33_params.I, conv_33_params.J, conv_33_params.K,
             conv_33_in, conv_33_w, conv_33_b, conv_33_out,
             RELU, conv_33_params.output_scale, true,
             tiled_matmul_type, check, "conv_33");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_33_params.batch_size, conv_33_params.in_row_dim, conv_33_params.in_col_dim,
             conv_33_params.in_channels,
             conv_33_params.out_channels, conv_33_params.out_row_dim, conv_33_params.out_col_dim,
@@ -1306,78 +1805,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 33 cycles: %llu \n", end - start);
     }
 
     // conv_34
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_34_params.I, conv_34_params.J, conv_34_params.K,
-            conv_33_out, conv_34_w, conv_34_b, conv_34_out,
-            NO_ACTIVATION, conv_34_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_34_params.I, conv_34_params.J, conv_34_params.K,
+            conv_33_out, conv_34_w, conv_34_b, conv_31_out, conv_34_out,
+            conv_34_params.res_scale, RELU, conv_34_params.output_scale, true,
             tiled_matmul_type, check, "conv_34");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_34_params.I, conv_34_params.J, conv_34_params.K,
-            conv_33_out, conv_34_w, conv_34_b, conv_34_out,
-            NO_ACTIVATION, conv_34_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_34_params.I, conv_34_params.J, conv_34_params.K,
+            conv_33_out, conv_34_w, conv_34_b, conv_31_out, conv_34_out,
+            conv_34_params.res_scale, RELU, conv_34_params.output_scale, true,
             tiled_matmul_type, check, "conv_34");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 34 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_34_params.I, conv_34_params.J,
-        conv_34_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_31_out,
-        conv_34_out,
-        conv_34_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_35
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_35_params.I, conv_35_params.J, conv_35_params.K,
+        tiled_matmul_nn_auto_async(conv_35_params.I, conv_35_params.J, conv_35_params.K,
             conv_34_out, conv_35_w, conv_35_b, conv_35_out,
             RELU, conv_35_params.output_scale, true,
             tiled_matmul_type, check, "conv_35");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_35_params.I, conv_35_params.J, conv_35_params.K,
+        tiled_matmul_nn_auto_async(conv_35_params.I, conv_35_params.J, conv_35_params.K,
             conv_34_out, conv_35_w, conv_35_b, conv_35_out,
             RELU, conv_35_params.output_scale, true,
             tiled_matmul_type, check, "conv_35");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 35 cycles: %llu \n", end - start);
     }
 
     // conv_36
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1385,23 +1871,23 @@ int main (int argc, char * argv[]) {
             conv_36_params.I, conv_36_params.K,
             conv_35_out, conv_36_in, &conv_36_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_36_params.I, conv_36_params.J, conv_36_params.K,
+        tiled_matmul_nn_auto_async(conv_36_params.I, conv_36_params.J, conv_36_params.K,
             conv_36_in, conv_36_w, conv_36_b, conv_36_out,
             RELU, conv_36_params.output_scale, true,
             tiled_matmul_type, check, "conv_36");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_36_params.batch_size, conv_36_params.in_row_dim, conv_36_params.in_col_dim,
             conv_36_params.in_channels,
             conv_36_params.out_channels, conv_36_params.out_row_dim, conv_36_params.out_col_dim,
@@ -1415,78 +1901,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 36 cycles: %llu \n", end - start);
     }
 
     // conv_37
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_37_params.I, conv_37_params.J, conv_37_params.K,
-            conv_36_out, conv_37_w, conv_37_b, conv_37_out,
-            NO_ACTIVATION, conv_37_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_37_params.I, conv_37_params.J, conv_37_params.K,
+            conv_36_out, conv_37_w, conv_37_b, conv_34_out, conv_37_out,
+            conv_37_params.res_scale, RELU, conv_37_params.output_scale, true,
             tiled_matmul_type, check, "conv_37");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_37_params.I, conv_37_params.J, conv_37_params.K,
-            conv_36_out, conv_37_w, conv_37_b, conv_37_out,
-            NO_ACTIVATION, conv_37_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_37_params.I, conv_37_params.J, conv_37_params.K,
+            conv_36_out, conv_37_w, conv_37_b, conv_34_out, conv_37_out,
+            conv_37_params.res_scale, RELU, conv_37_params.output_scale, true,
             tiled_matmul_type, check, "conv_37");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 37 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_37_params.I, conv_37_params.J,
-        conv_37_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_34_out,
-        conv_37_out,
-        conv_37_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_38
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_38_params.I, conv_38_params.J, conv_38_params.K,
+        tiled_matmul_nn_auto_async(conv_38_params.I, conv_38_params.J, conv_38_params.K,
             conv_37_out, conv_38_w, conv_38_b, conv_38_out,
             RELU, conv_38_params.output_scale, true,
             tiled_matmul_type, check, "conv_38");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_38_params.I, conv_38_params.J, conv_38_params.K,
+        tiled_matmul_nn_auto_async(conv_38_params.I, conv_38_params.J, conv_38_params.K,
             conv_37_out, conv_38_w, conv_38_b, conv_38_out,
             RELU, conv_38_params.output_scale, true,
             tiled_matmul_type, check, "conv_38");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 38 cycles: %llu \n", end - start);
     }
 
     // conv_39
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1494,23 +1967,23 @@ int main (int argc, char * argv[]) {
             conv_39_params.I, conv_39_params.K,
             conv_38_out, conv_39_in, &conv_39_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_39_params.I, conv_39_params.J, conv_39_params.K,
+        tiled_matmul_nn_auto_async(conv_39_params.I, conv_39_params.J, conv_39_params.K,
             conv_39_in, conv_39_w, conv_39_b, conv_39_out,
             RELU, conv_39_params.output_scale, true,
             tiled_matmul_type, check, "conv_39");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_39_params.batch_size, conv_39_params.in_row_dim, conv_39_params.in_col_dim,
             conv_39_params.in_channels,
             conv_39_params.out_channels, conv_39_params.out_row_dim, conv_39_params.out_col_dim,
@@ -1524,78 +1997,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 39 cycles: %llu \n", end - start);
     }
 
     // conv_40
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_40_params.I, conv_40_params.J, conv_40_params.K,
-            conv_39_out, conv_40_w, conv_40_b, conv_40_out,
-            NO_ACTIVATION, conv_40_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_40_params.I, conv_40_params.J, conv_40_params.K,
+            conv_39_out, conv_40_w, conv_40_b, conv_37_out, conv_40_out,
+            conv_40_params.res_scale, RELU, conv_40_params.output_scale, true,
             tiled_matmul_type, check, "conv_40");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_40_params.I, conv_40_params.J, conv_40_params.K,
-            conv_39_out, conv_40_w, conv_40_b, conv_40_out,
-            NO_ACTIVATION, conv_40_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_40_params.I, conv_40_params.J, conv_40_params.K,
+            conv_39_out, conv_40_w, conv_40_b, conv_37_out, conv_40_out,
+            conv_40_params.res_scale, RELU, conv_40_params.output_scale, true,
             tiled_matmul_type, check, "conv_40");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 40 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_40_params.I, conv_40_params.J,
-        conv_40_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_37_out,
-        conv_40_out,
-        conv_40_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_41
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_41_params.I, conv_41_params.J, conv_41_params.K,
+        tiled_matmul_nn_auto_async(conv_41_params.I, conv_41_params.J, conv_41_params.K,
             conv_40_out, conv_41_w, conv_41_b, conv_41_out,
             RELU, conv_41_params.output_scale, true,
             tiled_matmul_type, check, "conv_41");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_41_params.I, conv_41_params.J, conv_41_params.K,
+        tiled_matmul_nn_auto_async(conv_41_params.I, conv_41_params.J, conv_41_params.K,
             conv_40_out, conv_41_w, conv_41_b, conv_41_out,
             RELU, conv_41_params.output_scale, true,
             tiled_matmul_type, check, "conv_41");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 41 cycles: %llu \n", end - start);
     }
 
     // conv_42
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1603,23 +2063,23 @@ int main (int argc, char * argv[]) {
             conv_42_params.I, conv_42_params.K,
             conv_41_out, conv_42_in, &conv_42_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_42_params.I, conv_42_params.J, conv_42_params.K,
+        tiled_matmul_nn_auto_async(conv_42_params.I, conv_42_params.J, conv_42_params.K,
             conv_42_in, conv_42_w, conv_42_b, conv_42_out,
             RELU, conv_42_params.output_scale, true,
             tiled_matmul_type, check, "conv_42");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_42_params.batch_size, conv_42_params.in_row_dim, conv_42_params.in_col_dim,
             conv_42_params.in_channels,
             conv_42_params.out_channels, conv_42_params.out_row_dim, conv_42_params.out_col_dim,
@@ -1633,78 +2093,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 42 cycles: %llu \n", end - start);
     }
 
     // conv_43
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_43_params.I, conv_43_params.J, conv_43_params.K,
-            conv_42_out, conv_43_w, conv_43_b, conv_43_out,
-            NO_ACTIVATION, conv_43_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_43_params.I, conv_43_params.J, conv_43_params.K,
+            conv_42_out, conv_43_w, conv_43_b, conv_40_out, conv_43_out,
+            conv_43_params.res_scale, RELU, conv_43_params.output_scale, true,
             tiled_matmul_type, check, "conv_43");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_43_params.I, conv_43_params.J, conv_43_params.K,
-            conv_42_out, conv_43_w, conv_43_b, conv_43_out,
-            NO_ACTIVATION, conv_43_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_43_params.I, conv_43_params.J, conv_43_params.K,
+            conv_42_out, conv_43_w, conv_43_b, conv_40_out, conv_43_out,
+            conv_43_params.res_scale, RELU, conv_43_params.output_scale, true,
             tiled_matmul_type, check, "conv_43");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 43 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_43_params.I, conv_43_params.J,
-        conv_43_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_40_out,
-        conv_43_out,
-        conv_43_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_44
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_44_params.I, conv_44_params.J, conv_44_params.K,
+        tiled_matmul_nn_auto_async(conv_44_params.I, conv_44_params.J, conv_44_params.K,
             conv_43_out, conv_44_w, conv_44_b, conv_44_out,
             RELU, conv_44_params.output_scale, true,
             tiled_matmul_type, check, "conv_44");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_44_params.I, conv_44_params.J, conv_44_params.K,
+        tiled_matmul_nn_auto_async(conv_44_params.I, conv_44_params.J, conv_44_params.K,
             conv_43_out, conv_44_w, conv_44_b, conv_44_out,
             RELU, conv_44_params.output_scale, true,
             tiled_matmul_type, check, "conv_44");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 44 cycles: %llu \n", end - start);
     }
 
     // conv_45
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1712,23 +2159,23 @@ int main (int argc, char * argv[]) {
             conv_45_params.I, conv_45_params.K,
             conv_44_out, conv_45_in, &conv_45_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_45_params.I, conv_45_params.J, conv_45_params.K,
+        tiled_matmul_nn_auto_async(conv_45_params.I, conv_45_params.J, conv_45_params.K,
             conv_45_in, conv_45_w, conv_45_b, conv_45_out,
             RELU, conv_45_params.output_scale, true,
             tiled_matmul_type, check, "conv_45");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_45_params.batch_size, conv_45_params.in_row_dim, conv_45_params.in_col_dim,
             conv_45_params.in_channels,
             conv_45_params.out_channels, conv_45_params.out_row_dim, conv_45_params.out_col_dim,
@@ -1742,38 +2189,40 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 45 cycles: %llu \n", end - start);
     }
 
     // conv_46
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_46_params.I, conv_46_params.J, conv_46_params.K,
+        tiled_matmul_nn_auto_async(conv_46_params.I, conv_46_params.J, conv_46_params.K,
             conv_45_out, conv_46_w, conv_46_b, conv_46_out,
             NO_ACTIVATION, conv_46_params.output_scale, true,
             tiled_matmul_type, check, "conv_46");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_46_params.I, conv_46_params.J, conv_46_params.K,
+        tiled_matmul_nn_auto_async(conv_46_params.I, conv_46_params.J, conv_46_params.K,
             conv_45_out, conv_46_w, conv_46_b, conv_46_out,
             NO_ACTIVATION, conv_46_params.output_scale, true,
             tiled_matmul_type, check, "conv_46");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 46 cycles: %llu \n", end - start);
     }
 
     // Downsampling conv_43_out
     // conv_47
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1781,23 +2230,23 @@ int main (int argc, char * argv[]) {
             conv_47_params.I, conv_47_params.K,
             conv_43_out, conv_47_in, &conv_47_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_47_params.I, conv_47_params.J, conv_47_params.K,
+        tiled_matmul_nn_auto_async(conv_47_params.I, conv_47_params.J, conv_47_params.K,
             conv_47_in, conv_47_w, conv_47_b, conv_47_out,
             NO_ACTIVATION, conv_47_params.output_scale, true,
             tiled_matmul_type, check, "conv_47");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_47_params.batch_size, conv_47_params.in_row_dim, conv_47_params.in_col_dim,
             conv_47_params.in_channels,
             conv_47_params.out_channels, conv_47_params.out_row_dim, conv_47_params.out_col_dim,
@@ -1811,15 +2260,16 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 47 cycles: %llu \n", end - start);
     }
 
     // Add residuals
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_resadd_auto(conv_46_params.I, conv_46_params.J,
+    tiled_resadd_auto_async(conv_46_params.I, conv_46_params.J,
         conv_46_params.res_scale,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -1829,35 +2279,37 @@ int main (int argc, char * argv[]) {
         true,
         tiled_matmul_type == CPU ? CPU : WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     res_add_cycles += end - start;
     
     // conv_48
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_48_params.I, conv_48_params.J, conv_48_params.K,
+        tiled_matmul_nn_auto_async(conv_48_params.I, conv_48_params.J, conv_48_params.K,
             conv_46_out, conv_48_w, conv_48_b, conv_48_out,
             RELU, conv_48_params.output_scale, true,
             tiled_matmul_type, check, "conv_48");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_48_params.I, conv_48_params.J, conv_48_params.K,
+        tiled_matmul_nn_auto_async(conv_48_params.I, conv_48_params.J, conv_48_params.K,
             conv_46_out, conv_48_w, conv_48_b, conv_48_out,
             RELU, conv_48_params.output_scale, true,
             tiled_matmul_type, check, "conv_48");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 48 cycles: %llu \n", end - start);
     }
 
     // conv_49
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1865,23 +2317,23 @@ int main (int argc, char * argv[]) {
             conv_49_params.I, conv_49_params.K,
             conv_48_out, conv_49_in, &conv_49_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_49_params.I, conv_49_params.J, conv_49_params.K,
+        tiled_matmul_nn_auto_async(conv_49_params.I, conv_49_params.J, conv_49_params.K,
             conv_49_in, conv_49_w, conv_49_b, conv_49_out,
             RELU, conv_49_params.output_scale, true,
             tiled_matmul_type, check, "conv_49");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_49_params.batch_size, conv_49_params.in_row_dim, conv_49_params.in_col_dim,
             conv_49_params.in_channels,
             conv_49_params.out_channels, conv_49_params.out_row_dim, conv_49_params.out_col_dim,
@@ -1895,78 +2347,65 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 49 cycles: %llu \n", end - start);
     }
 
     // conv_50
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_50_params.I, conv_50_params.J, conv_50_params.K,
-            conv_49_out, conv_50_w, conv_50_b, conv_50_out,
-            NO_ACTIVATION, conv_50_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_50_params.I, conv_50_params.J, conv_50_params.K,
+            conv_49_out, conv_50_w, conv_50_b, conv_46_out, conv_50_out,
+            conv_50_params.res_scale, RELU, conv_50_params.output_scale, true,
             tiled_matmul_type, check, "conv_50");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_50_params.I, conv_50_params.J, conv_50_params.K,
-            conv_49_out, conv_50_w, conv_50_b, conv_50_out,
-            NO_ACTIVATION, conv_50_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_50_params.I, conv_50_params.J, conv_50_params.K,
+            conv_49_out, conv_50_w, conv_50_b, conv_46_out, conv_50_out,
+            conv_50_params.res_scale, RELU, conv_50_params.output_scale, true,
             tiled_matmul_type, check, "conv_50");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 50 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_50_params.I, conv_50_params.J,
-        conv_50_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_46_out,
-        conv_50_out,
-        conv_50_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-    
     // conv_51
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_51_params.I, conv_51_params.J, conv_51_params.K,
+        tiled_matmul_nn_auto_async(conv_51_params.I, conv_51_params.J, conv_51_params.K,
             conv_50_out, conv_51_w, conv_51_b, conv_51_out,
             RELU, conv_51_params.output_scale, true,
             tiled_matmul_type, check, "conv_51");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_51_params.I, conv_51_params.J, conv_51_params.K,
+        tiled_matmul_nn_auto_async(conv_51_params.I, conv_51_params.J, conv_51_params.K,
             conv_50_out, conv_51_w, conv_51_b, conv_51_out,
             RELU, conv_51_params.output_scale, true,
             tiled_matmul_type, check, "conv_51");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 51 cycles: %llu \n", end - start);
     }
 
     // conv_52
+    NEXT_LAYER();
     if (!conv) {
       start = read_cycles();
 
@@ -1974,23 +2413,23 @@ int main (int argc, char * argv[]) {
             conv_52_params.I, conv_52_params.K,
             conv_51_out, conv_52_in, &conv_52_params);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         im2col_cycles += end - start;
 
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_52_params.I, conv_52_params.J, conv_52_params.K,
+        tiled_matmul_nn_auto_async(conv_52_params.I, conv_52_params.J, conv_52_params.K,
             conv_52_in, conv_52_w, conv_52_b, conv_52_out,
             RELU, conv_52_params.output_scale, true,
             tiled_matmul_type, check, "conv_52");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_conv_auto(
+        tiled_conv_auto_async(
             conv_52_params.batch_size, conv_52_params.in_row_dim, conv_52_params.in_col_dim,
             conv_52_params.in_channels,
             conv_52_params.out_channels, conv_52_params.out_row_dim, conv_52_params.out_col_dim,
@@ -2004,72 +2443,61 @@ int main (int argc, char * argv[]) {
 
             tiled_matmul_type);
 
-        end = read_cycles();
+        end = layer_end_cycles();
         conv_cycles += end - start;
         printf("conv 52 cycles: %llu \n", end - start);
     }
 
     // conv_53
+    NEXT_LAYER();
     if (!conv) {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_53_params.I, conv_53_params.J, conv_53_params.K,
-            conv_52_out, conv_53_w, conv_53_b, conv_53_out,
-            NO_ACTIVATION, conv_53_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_53_params.I, conv_53_params.J, conv_53_params.K,
+            conv_52_out, conv_53_w, conv_53_b, conv_50_out, conv_53_out,
+            conv_53_params.res_scale, RELU, conv_53_params.output_scale, true,
             tiled_matmul_type, check, "conv_53");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
 
     } else {
         start = read_cycles();
 
-        tiled_matmul_nn_auto(conv_53_params.I, conv_53_params.J, conv_53_params.K,
-            conv_52_out, conv_53_w, conv_53_b, conv_53_out,
-            NO_ACTIVATION, conv_53_params.output_scale, true,
+        tiled_matmul_nn_resadd_auto_async(conv_53_params.I, conv_53_params.J, conv_53_params.K,
+            conv_52_out, conv_53_w, conv_53_b, conv_50_out, conv_53_out,
+            conv_53_params.res_scale, RELU, conv_53_params.output_scale, true,
             tiled_matmul_type, check, "conv_53");
 
-        end = read_cycles();
+        end = layer_end_cycles();
         matmul_cycles += end - start;
         printf("matmul 53 cycles: %llu \n", end - start);
     }
 
-    // Add residuals
-    start = read_cycles();
-
-    tiled_resadd_auto(conv_53_params.I, conv_53_params.J,
-        conv_53_params.res_scale,
-        MVIN_SCALE_IDENTITY,
-        ACC_SCALE_IDENTITY,
-        conv_50_out,
-        conv_53_out,
-        conv_53_out,
-        true,
-        tiled_matmul_type == CPU ? CPU : WS);
-
-    end = read_cycles();
-    res_add_cycles += end - start;
-
     // Global averaging
+    NEXT_LAYER();
     static elem_t average[4][2048] row_align(1);
 
     start = read_cycles();
 
-    tiled_global_average_auto(conv_53_out, average, conv_53_params.batch_size,
+    tiled_global_average_auto_async(conv_53_out, average, conv_53_params.batch_size,
         conv_53_params.out_channels, conv_53_params.out_row_dim, WS);
 
-    end = read_cycles();
+    end = layer_end_cycles();
     other_cycles += end - start;
 
     // fc_54
+    NEXT_LAYER();
     start = read_cycles();
 
-    tiled_matmul_nn_auto(fc_54_params.I, fc_54_params.J, fc_54_params.K,
+    tiled_matmul_nn_auto_async(fc_54_params.I, fc_54_params.J, fc_54_params.K,
         average, fc_54_w, fc_54_b, fc_54_out,
         NO_ACTIVATION, fc_54_params.output_scale, false,
         tiled_matmul_type, check, "fc_54");
 
-    end = read_cycles();
+    gemmini_wait_read(fc_54_out, sizeof(fc_54_out));
+
+    end = layer_end_cycles();
     matmul_cycles += end - start;
     printf("matmul 54 cycles: %llu \n", end - start);
 
@@ -2093,6 +2521,8 @@ int main (int argc, char * argv[]) {
     uint64_t total_cycles = im2col_cycles + matmul_cycles + pool_cycles + conv_cycles + conv_dw_cycles + res_add_cycles + other_cycles;
 
     printf("\nTotal cycles: %llu (100%%)\n", total_cycles);
+    if (!SYNC_LAYERS)
+        printf("(Layers overlap: each count is submission plus any waiting done in it. Build with SYNC_LAYERS=1 for run times)\n");
     printf("Matmul cycles: %llu (%d%%)\n", matmul_cycles, (matmul_cycles * 100) / total_cycles);
     printf("Im2col cycles: %llu (%d%%)\n", im2col_cycles, (im2col_cycles * 100) / total_cycles);
     printf("Conv cycles: %llu (%d%%)\n", conv_cycles, (conv_cycles * 100) / total_cycles);
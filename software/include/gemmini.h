@@ -11,11 +11,37 @@
 #include <math.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "include/gemmini_params.h"
 
+#ifndef BAREMETAL
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__riscv_vector)
+#include <riscv_vector.h>
+#endif
+
 #define GEMMINI_ASSERTIONS
 
+// Threads that may run at once keep their own copy of the runtime's mutable
+// state: the CPU kernels' scratch buffers and, since each hart drives its own
+// accelerator, everything that tracks one accelerator. Baremetal programs
+// that run on more than one hart must set GEMMINI_HARTS (see gemmini_multi.h)
+#ifndef GEMMINI_HARTS
+#define GEMMINI_HARTS 1
+#endif
+
+#if !defined(BAREMETAL) || GEMMINI_HARTS > 1
+#define GEMMINI_THREAD_LOCAL __thread
+#else
+#define GEMMINI_THREAD_LOCAL
+#endif
+
 // Accelerator interface
 #include "rocc-software/src/xcustom.h"
 
@@ -57,6 +83,8 @@
 #define k_GEMV_LOOP_WS_CONFIG_STRIDES_AB 27
 #define k_GEMV_LOOP_WS_CONFIG_STRIDES_DC 28
 
+#define k_LOOP_WS_CONFIG_HEAD_STRIDES 29
+
 #define CONFIG_EX 0
 #define CONFIG_LD 1
 #define CONFIG_ST 2
@@ -198,8 +226,36 @@ static acc_scale_t_bits acc_scale_t_to_acc_scale_t_bits(acc_scale_t x) {
     return un.b;
 }
 
+// Commands issued between gemmini_capture_begin() and gemmini_capture_end()
+// are also recorded, so they can be replayed later (see gemmini_capture.h)
+struct gemmini_stream;
+static GEMMINI_THREAD_LOCAL struct gemmini_stream * gemmini_capture_stream = NULL;
+static void gemmini_capture_cmd(uint64_t funct, uint64_t rs1, uint64_t rs2);
+
+#define GEMMINI_CMD_FENCE 0x80 // Not a RoCC funct; marks a fence in a captured stream
+
+#define GEMMINI_CAPTURE(funct, rs1, rs2) \
+  ((void)(gemmini_capture_stream != NULL && (gemmini_capture_cmd(funct, rs1, rs2), true)))
+
+#ifdef GEMMINI_EMULATOR
+// Commands are executed by the host-native model in gemmini_emu.h
+static void gemmini_emu_issue(uint64_t funct, uint64_t rs1, uint64_t rs2);
+static uint32_t gemmini_emu_counter_access(uint32_t config_reg);
+
+#define ROCC_INSTRUCTION_RS1_RS2(x, rs1, rs2, funct) \
+  { \
+    const uint64_t _rs1 = (uint64_t)(rs1), _rs2 = (uint64_t)(rs2); \
+    GEMMINI_CAPTURE(funct, _rs1, _rs2); \
+    gemmini_emu_issue(funct, _rs1, _rs2); \
+  }
+#else
 #define ROCC_INSTRUCTION_RS1_RS2(x, rs1, rs2, funct) \
-  ROCC_INSTRUCTION_0_R_R(x, rs1, rs2, funct)
+  { \
+    const uint64_t _rs1 = (uint64_t)(rs1), _rs2 = (uint64_t)(rs2); \
+    GEMMINI_CAPTURE(funct, _rs1, _rs2); \
+    ROCC_INSTRUCTION_0_R_R(x, _rs1, _rs2, funct) \
+  }
+#endif
 
 // mvin and mvout
 #define gemmini_extended_mvin(dram_addr, spad_addr, cols, rows) \
@@ -246,9 +302,125 @@ static acc_scale_t_bits acc_scale_t_to_acc_scale_t_bits(acc_scale_t x) {
 #define gemmini_preload_zeros(C) \
   gemmini_preload(GARBAGE_ADDR, C)
 
+// Config commands only reach the accelerator when they change its state.
+// gemmini_config_shadow mirrors what the issued config commands have set, so
+// tiling functions can re-configure on every call without spending RoCC
+// bandwidth and reservation-station entries on registers that already hold
+// the same values. A register is unknown until it is first configured, and
+// again after anything that reconfigures the accelerator behind the shadow's
+// back: LOOP_CONV_WS sets the load, store and execute strides itself, LN and
+// softmax loops switch norm stat ids, and replayed streams carry their own
+// config commands.
+//
+// In Linux mode, the shadow belongs to a thread, and describes the
+// accelerator of the core it runs on. Threads that issue commands must be
+// pinned to one core, as gemmini_multi_launch does, and must call
+// gemmini_config_shadow_reset() whenever another process may have driven
+// that accelerator since their last command.
+static GEMMINI_THREAD_LOCAL struct {
+  bool ex_valid;
+  uint64_t ex[2];
+
+  bool ld_valid[3];
+  uint64_t ld[3][2];
+
+  bool st_valid;
+  uint64_t st[2];
+
+  // CONFIG_BERT, which only overwrites q_const[q_const_type], and only the
+  // stat id when set_stats_id_only is set
+  bool norm_valid, stat_id_valid, q_const_valid[2];
+  bool act_msb;
+  uint64_t igelu;
+  uint32_t q_const[2];
+  uint8_t stat_id;
+} gemmini_config_shadow;
+
+static void gemmini_config_shadow_reset() {
+  memset(&gemmini_config_shadow, 0, sizeof(gemmini_config_shadow));
+}
+
+static bool gemmini_config_shadow_set(bool * valid, uint64_t shadow[2], uint64_t rs1, uint64_t rs2) {
+  if (*valid && shadow[0] == rs1 && shadow[1] == rs2)
+    return false;
+
+  *valid = true;
+  shadow[0] = rs1;
+  shadow[1] = rs2;
+  return true;
+}
+
+// Records a config command, and returns whether it must be issued
+static bool gemmini_config_shadow_update(uint64_t rs1, uint64_t rs2) {
+  switch (rs1 & 3) {
+    case CONFIG_EX:
+      if ((rs1 >> 7) & 1) {
+        // set_only_strides leaves everything but A_stride and C_stride alone
+        const uint64_t a_stride = (uint64_t)0xffff << 16, c_stride = (uint64_t)0xffff << 48;
+        if (!gemmini_config_shadow.ex_valid)
+          return true;
+
+        const uint64_t ex_rs1 = (gemmini_config_shadow.ex[0] & ~a_stride) | (rs1 & a_stride);
+        const uint64_t ex_rs2 = (gemmini_config_shadow.ex[1] & ~c_stride) | (rs2 & c_stride);
+        return gemmini_config_shadow_set(&gemmini_config_shadow.ex_valid, gemmini_config_shadow.ex, ex_rs1, ex_rs2);
+      }
+      return gemmini_config_shadow_set(&gemmini_config_shadow.ex_valid, gemmini_config_shadow.ex, rs1, rs2);
+
+    case CONFIG_LD: {
+      const int id = (rs1 >> 3) & 3;
+      if (id > 2)
+        return true;
+      return gemmini_config_shadow_set(&gemmini_config_shadow.ld_valid[id], gemmini_config_shadow.ld[id], rs1, rs2);
+    }
+
+    case CONFIG_ST:
+      if (!gemmini_config_shadow_set(&gemmini_config_shadow.st_valid, gemmini_config_shadow.st, rs1, rs2))
+        return false;
+      // The store activation overwrites the norm's act_msb too
+      gemmini_config_shadow.act_msb = false;
+      return true;
+
+    default: {
+      const uint8_t stat_id = (rs1 >> 8) & 0xff;
+      const bool stat_id_same = gemmini_config_shadow.stat_id_valid && gemmini_config_shadow.stat_id == stat_id;
+
+      if ((rs1 >> 17) & 1) {
+        gemmini_config_shadow.stat_id_valid = true;
+        gemmini_config_shadow.stat_id = stat_id;
+        return !stat_id_same;
+      }
+
+      const int type = (rs1 >> 18) & 1;
+      const bool act_msb = (rs1 >> 16) & 1;
+      const uint32_t q_const = rs1 >> 32;
+
+      if (stat_id_same && gemmini_config_shadow.norm_valid && gemmini_config_shadow.act_msb == act_msb &&
+          gemmini_config_shadow.igelu == rs2 &&
+          gemmini_config_shadow.q_const_valid[type] && gemmini_config_shadow.q_const[type] == q_const)
+        return false;
+
+      gemmini_config_shadow.stat_id_valid = true;
+      gemmini_config_shadow.stat_id = stat_id;
+      gemmini_config_shadow.norm_valid = true;
+      gemmini_config_shadow.act_msb = act_msb;
+      gemmini_config_shadow.igelu = rs2;
+      gemmini_config_shadow.q_const_valid[type] = true;
+      gemmini_config_shadow.q_const[type] = q_const;
+      return true;
+    }
+  }
+}
+
+#define GEMMINI_CONFIG(rs1, rs2) \
+  { \
+    const uint64_t _config_rs1 = (uint64_t)(rs1), _config_rs2 = (uint64_t)(rs2); \
+    if (gemmini_config_shadow_update(_config_rs1, _config_rs2)) \
+      ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, _config_rs1, _config_rs2, k_CONFIG) \
+  }
+
 // config
 #define gemmini_extended3_config_ex(dataflow, sys_act, sys_shift, sys_acc_scale, C_stride, A_stride, A_transpose, B_transpose, set_only_strides) \
-    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)acc_scale_t_to_acc_scale_t_bits((acc_scale_t)sys_acc_scale) << 32) | ((uint64_t)(A_stride) << 16) | (B_transpose << 9) | (A_transpose << 8) | ((set_only_strides) << 7) | ((sys_act) << 3) | ((dataflow) << 2) | CONFIG_EX, ((uint64_t)(C_stride) << 48) | (sys_shift), k_CONFIG); \
+    GEMMINI_CONFIG(((uint64_t)acc_scale_t_to_acc_scale_t_bits((acc_scale_t)sys_acc_scale) << 32) | ((uint64_t)(A_stride) << 16) | (B_transpose << 9) | (A_transpose << 8) | ((set_only_strides) << 7) | ((sys_act) << 3) | ((dataflow) << 2) | CONFIG_EX, ((uint64_t)(C_stride) << 48) | (sys_shift)); \
 
 #define gemmini_extended2_config_ex(dataflow, sys_act, sys_shift, A_stride, A_transpose, B_transpose) \
   gemmini_extended3_config_ex(dataflow, sys_act, sys_shift, ACC_SCALE_IDENTITY, 1, A_stride, A_transpose, B_transpose, false)
@@ -262,7 +434,7 @@ static acc_scale_t_bits acc_scale_t_to_acc_scale_t_bits(acc_scale_t x) {
 // Note: The "pixel_repeats" parameter below is still experimental, andthere is
 // a high chance that it will be removed in future releases.
 #define gemmini_extended5_config_ld(stride, scale, shrunk, block_mvin_stride, pixel_repeats, id) \
-  ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(scale_t_to_scale_t_bits(scale)) << 32) | ((uint64_t)(block_mvin_stride) << 16) | ((uint64_t)(pixel_repeats) << 8) | ((id) << 3) | ((shrunk) << 2) | CONFIG_LD, stride, k_CONFIG)
+  GEMMINI_CONFIG(((uint64_t)(scale_t_to_scale_t_bits(scale)) << 32) | ((uint64_t)(block_mvin_stride) << 16) | ((uint64_t)(pixel_repeats) << 8) | ((id) << 3) | ((shrunk) << 2) | CONFIG_LD, stride)
 
 #define gemmini_extended4_config_ld(stride, scale, shrunk, block_mvin_stride, id) \
   gemmini_extended5_config_ld(stride, scale, shrunk, block_mvin_stride, 1, id) \
@@ -280,7 +452,7 @@ static acc_scale_t_bits acc_scale_t_to_acc_scale_t_bits(acc_scale_t x) {
   gemmini_extended_config_ld(stride, MVIN_SCALE_IDENTITY)
 
 #define gemmini_extended2_config_st(stride, acc_act, acc_scale, pool_stride, pool_size, pool_out_dim, porows, pocols, orows, ocols, upad, lpad) \
-  ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(ocols) << 56) | ((uint64_t)(orows) << 48) | ((uint64_t)(pocols) << 40) | ((uint64_t)(porows) << 32) | ((uint64_t)(pool_out_dim) << 24) | ((uint64_t)(lpad) << 10) | ((uint64_t)(upad) << 8) | ((uint64_t)(pool_size) << 6) | ((uint64_t)(pool_stride) << 4) | ((uint64_t)(acc_act) << 2) | CONFIG_ST, ((uint64_t)acc_scale_t_to_acc_scale_t_bits((acc_scale_t)acc_scale) << 32) | ((uint32_t)stride), k_CONFIG)
+  GEMMINI_CONFIG(((uint64_t)(ocols) << 56) | ((uint64_t)(orows) << 48) | ((uint64_t)(pocols) << 40) | ((uint64_t)(porows) << 32) | ((uint64_t)(pool_out_dim) << 24) | ((uint64_t)(lpad) << 10) | ((uint64_t)(upad) << 8) | ((uint64_t)(pool_size) << 6) | ((uint64_t)(pool_stride) << 4) | ((uint64_t)(acc_act) << 2) | CONFIG_ST, ((uint64_t)acc_scale_t_to_acc_scale_t_bits((acc_scale_t)acc_scale) << 32) | ((uint32_t)stride))
 
 #define gemmini_extended_config_st(stride, acc_act, acc_scale) \
     gemmini_extended2_config_st(stride, acc_act, acc_scale, 0, 0, 0, 0, 0, 0, 0, 0, 0)
@@ -289,21 +461,37 @@ static acc_scale_t_bits acc_scale_t_to_acc_scale_t_bits(acc_scale_t x) {
     gemmini_extended_config_st(stride, NO_ACTIVATION, ACC_SCALE_IDENTITY)
 
 #define gemmini_config_norm(q_const, q_const_type, set_stats_id_only, act_msb, stat_id, igelu_qb, igelu_qc) \
-    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, (((uint64_t) ((uint32_t) q_const)) << 32) | ((q_const_type & 1) << 18) | ((set_stats_id_only & 1) << 17) | ((act_msb & 1) << 16) | ((uint64_t)stat_id << 8) | CONFIG_BERT, ((uint64_t)((uint32_t)(igelu_qc)) << 32) | ((uint64_t)((uint32_t)(igelu_qb))), k_CONFIG)
+    GEMMINI_CONFIG((((uint64_t) ((uint32_t) q_const)) << 32) | ((q_const_type & 1) << 18) | ((set_stats_id_only & 1) << 17) | ((act_msb & 1) << 16) | ((uint64_t)stat_id << 8) | CONFIG_BERT, ((uint64_t)((uint32_t)(igelu_qc)) << 32) | ((uint64_t)((uint32_t)(igelu_qb))))
 
 // flush
 #define gemmini_flush(skip) \
   ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, skip, 0, k_FLUSH)
 
 // fence
-#define gemmini_fence() asm volatile("fence")
+#ifdef GEMMINI_EMULATOR
+#define gemmini_fence() GEMMINI_CAPTURE(GEMMINI_CMD_FENCE, 0, 0)
+#else
+#define gemmini_fence() do { GEMMINI_CAPTURE(GEMMINI_CMD_FENCE, 0, 0); asm volatile("fence"); } while (0)
+#endif
+
+// The kernels that wait for their own results end with gemmini_kernel_fence,
+// which gemmini_async.h skips while it submits them
+static GEMMINI_THREAD_LOCAL bool gemmini_kernel_fence_deferred = false;
+#define gemmini_kernel_fence() do { if (!gemmini_kernel_fence_deferred) gemmini_fence(); } while (0)
 
 // Counter access
+#ifdef GEMMINI_EMULATOR
+#define gemmini_counter_access(rd, config_reg) \
+  { \
+    rd = gemmini_emu_counter_access(config_reg); \
+  }
+#else
 #define gemmini_counter_access(rd, config_reg) \
   { \
     uint32_t _placeholder; \
     ROCC_INSTRUCTION(XCUSTOM_ACC, rd, config_reg, _placeholder, k_COUNTER) \
   }
+#endif
 
 // Read counter
 static uint32_t counter_read(size_t index) {
@@ -352,31 +540,42 @@ int ceil_divide_int(int a, int b){
     return c;
 }
 
-// weight-stationary matmul loop
-#define gemmini_loop_ws(I, J, K, pad_I, pad_J, pad_K, A, B, D, C, A_stride, B_stride, D_stride, C_stride, A_transpose, B_transpose, full_C, low_D, ex_accumulate, act, a_spad_id, b_spad_id, is_resadd, is_mpgemm) \
+// weight-stationary matmul loop. With heads > 1, the loop runs once per head,
+// each time offsetting A, B, D, and C by the head strides configured below.
+// With B_tile_major, B is stored as in tile_major_pack, and B_stride counts
+// tiles rather than elements
+#define gemmini_loop_ws(I, J, K, pad_I, pad_J, pad_K, A, B, D, C, A_stride, B_stride, D_stride, C_stride, A_transpose, B_transpose, B_tile_major, full_C, low_D, ex_accumulate, act, a_spad_id, b_spad_id, is_resadd, is_mpgemm, heads) \
   { \
+    const int _loop_act = (act); \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(pad_K) << 32) | ((uint64_t)(pad_J) << 16) | (uint64_t)(pad_I), ((uint64_t)(K) << 32) | ((uint64_t)(J) << 16) | (uint64_t)(I), k_LOOP_WS_CONFIG_BOUNDS) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, A, B, k_LOOP_WS_CONFIG_ADDRS_AB) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, D, C, k_LOOP_WS_CONFIG_ADDRS_DC) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, A_stride, B_stride, k_LOOP_WS_CONFIG_STRIDES_AB) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, D_stride, C_stride, k_LOOP_WS_CONFIG_STRIDES_DC) \
-    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ( is_mpgemm << 20 | (uint64_t)(a_spad_id) << 18) | ((uint64_t)(b_spad_id) << 16) | ((uint64_t)(act) << 8) | ((low_D) << 2) | ((full_C) << 1) | (ex_accumulate), ((is_resadd) << 2) | ((B_transpose) << 1) | (A_transpose), k_LOOP_WS) \
+    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(heads) << 32) | ( is_mpgemm << 20 | (uint64_t)(a_spad_id) << 18) | ((uint64_t)(b_spad_id) << 16) | ((uint64_t)_loop_act << 8) | ((low_D) << 2) | ((full_C) << 1) | (ex_accumulate), ((B_tile_major) << 3) | ((is_resadd) << 2) | ((B_transpose) << 1) | (A_transpose), k_LOOP_WS) \
+    if (_loop_act == LAYERNORM || _loop_act == SOFTMAX) gemmini_config_shadow.stat_id_valid = false; \
   }
 
+// byte offsets between consecutive heads of a multi-head gemmini_loop_ws
+#define gemmini_loop_ws_config_head_strides(A_head_stride, B_head_stride, D_head_stride, C_head_stride) \
+  ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(B_head_stride) << 32) | (uint32_t)(A_head_stride), ((uint64_t)(C_head_stride) << 32) | (uint32_t)(D_head_stride), k_LOOP_WS_CONFIG_HEAD_STRIDES)
+
 
-#define gemmini_gemv_loop_ws(I, J, K, pad_I, pad_J, pad_K, A, B, D, C, A_stride, B_stride, D_stride, C_stride, A_transpose, B_transpose, full_C, low_D, ex_accumulate, act, a_spad_id, b_spad_id, c_spad_id , is_resadd) \
+#define gemmini_gemv_loop_ws(I, J, K, pad_I, pad_J, pad_K, A, B, D, C, A_stride, B_stride, D_stride, C_stride, A_transpose, B_transpose, B_tile_major, full_C, low_D, ex_accumulate, act, a_spad_id, b_spad_id, c_spad_id , is_resadd) \
   { \
+    const int _loop_act = (act); \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(pad_K) << 32) | ((uint64_t)(pad_J) << 16) | (uint64_t)(pad_I), ((uint64_t)(K) << 32) | ((uint64_t)(J) << 16) | (uint64_t)(I), k_GEMV_LOOP_WS_CONFIG_BOUNDS) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, A, B, k_GEMV_LOOP_WS_CONFIG_ADDRS_AB) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, D, C, k_GEMV_LOOP_WS_CONFIG_ADDRS_DC) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, A_stride, B_stride, k_GEMV_LOOP_WS_CONFIG_STRIDES_AB) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, D_stride, C_stride, k_GEMV_LOOP_WS_CONFIG_STRIDES_DC) \
-    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(a_spad_id) << 22) | ((uint64_t)(b_spad_id) << 19) | (uint64_t)(c_spad_id) << 16 | ((uint64_t)(act) << 8) | ((low_D) << 2) | ((full_C) << 1) | (ex_accumulate), ((is_resadd) << 2) | ((B_transpose) << 1) | (A_transpose), k_GEMV_LOOP_WS) \
+    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(a_spad_id) << 22) | ((uint64_t)(b_spad_id) << 19) | (uint64_t)(c_spad_id) << 16 | ((uint64_t)_loop_act << 8) | ((low_D) << 2) | ((full_C) << 1) | (ex_accumulate), ((B_tile_major) << 3) | ((is_resadd) << 2) | ((B_transpose) << 1) | (A_transpose), k_GEMV_LOOP_WS) \
+    if (_loop_act == LAYERNORM || _loop_act == SOFTMAX) gemmini_config_shadow.stat_id_valid = false; \
   }
 
 
 // weight-stationary conv loop
-#define gemmini_loop_conv_ws(batch_size, in_row_dim, in_col_dim, in_channels, out_channels, out_row_dim, out_col_dim, pool_out_row_dim, pool_out_col_dim, stride, padding, kernel_dim, kernel_dilation, pool_size, pool_stride, pool_padding, batches, porows, pocols, pochs, krows, kcols, kchs, lpad, rpad, upad, dpad, plpad, prpad, pupad, pdpad, orows, ocols, weights, output, bias, input, no_bias, no_pool, downsample, wrot180, input_dilated, activation, trans_output_1203, trans_weight_1203, trans_weight_0132, trans_input_3120, max_pixels_per_row, in_stride, weight_stride, out_stride, dw, a_spad_id, b_spad_id) \
+#define gemmini_loop_conv_ws(batch_size, in_row_dim, in_col_dim, in_channels, out_channels, out_row_dim, out_col_dim, pool_out_row_dim, pool_out_col_dim, stride, padding, kernel_dim, kernel_dilation, pool_size, pool_stride, pool_padding, batches, porows, pocols, pochs, krows, kcols, kchs, lpad, rpad, upad, dpad, plpad, prpad, pupad, pdpad, orows, ocols, weights, output, bias, input, no_bias, no_pool, downsample, wrot180, input_dilated, activation, trans_output_1203, trans_weight_1203, trans_weight_0132, trans_input_3120, max_pixels_per_row, in_stride, weight_stride, out_stride, dw, a_spad_id, b_spad_id, is_mpgemm) \
   { \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(out_channels) << 48) | ((uint64_t)(in_channels) << 32) | ((uint64_t)(in_row_dim) << 16) | (uint64_t)(batch_size), \
       ((uint64_t)(padding) << 56) | ((uint64_t)(stride) << 48) | ((uint64_t)(out_col_dim) << 32) | ((uint64_t)(pool_out_row_dim) << 16) | (uint64_t)(out_row_dim), k_LOOP_CONV_WS_CONFIG_1) \
@@ -390,11 +589,49 @@ int ceil_divide_int(int a, int b){
       output, k_LOOP_CONV_WS_CONFIG_5) \
     ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, bias, \
       input, k_LOOP_CONV_WS_CONFIG_6) \
-    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(a_spad_id) << 18) | ((uint64_t)(b_spad_id) << 16) | ((uint64_t)(max_pixels_per_row) << 8) | ((dw) << 6) | ((trans_input_3120) << 5) | ((trans_weight_0132) << 4) | ((trans_weight_1203) << 3) | ((trans_output_1203) << 2) | ((wrot180) << 1) | (no_bias), \
+    ROCC_INSTRUCTION_RS1_RS2(XCUSTOM_ACC, ((uint64_t)(is_mpgemm) << 20) | ((uint64_t)(a_spad_id) << 18) | ((uint64_t)(b_spad_id) << 16) | ((uint64_t)(max_pixels_per_row) << 8) | ((dw) << 6) | ((trans_input_3120) << 5) | ((trans_weight_0132) << 4) | ((trans_weight_1203) << 3) | ((trans_output_1203) << 2) | ((wrot180) << 1) | (no_bias), \
       ((activation) << 3)| ((input_dilated) << 2) | ((downsample) << 1) | (no_pool), \
       k_LOOP_CONV_WS) \
+    gemmini_config_shadow_reset(); \
   }
 
+// Tile-major weights. Row-major B moves in one DRAM row per DMA request, so
+// a tile only DIM bytes wide costs DIM requests of DIM bytes each. Tile-major
+// B stores every DIM x DIM tile contiguously instead, with the tiles of a
+// rows x cols matrix in row-major order, and loads each tile with
+// TILE_MAJOR_ROWS requests of a full TILE_MAJOR_BLOCKS * DIM bytes.
+//
+// Inside a tile, request q carries tile rows q, q + TILE_MAJOR_ROWS, ...,
+// which the mvin's block stride of TILE_MAJOR_ROWS puts back in order. Packed
+// ternary weights are reordered the same way, as a K x J/4 matrix of bytes
+#define TILE_MAJOR_BLOCKS (MAX_BLOCK_LEN < DIM ? MAX_BLOCK_LEN : DIM)
+#define TILE_MAJOR_ROWS (DIM / TILE_MAJOR_BLOCKS)
+#define TILE_MAJOR_TILES(dim) (((dim) + DIM - 1) / DIM)
+#define TILE_MAJOR_ELEMS(rows, cols) (TILE_MAJOR_TILES(rows) * TILE_MAJOR_TILES(cols) * DIM * DIM)
+
+static size_t tile_major_offset(size_t cols, size_t r, size_t c) {
+  const size_t tile = (r / DIM) * TILE_MAJOR_TILES(cols) + c / DIM;
+  const size_t tile_row = r % DIM;
+  return (tile * DIM + (tile_row % TILE_MAJOR_ROWS) * TILE_MAJOR_BLOCKS + tile_row / TILE_MAJOR_ROWS) * DIM + c % DIM;
+}
+
+// Reorders a row-major rows x cols matrix into TILE_MAJOR_ELEMS(rows, cols)
+// elements of dst, zero-filling the partial tiles at its edges
+static void tile_major_pack(size_t rows, size_t cols, const elem_t * src, size_t stride, elem_t * dst) {
+  const size_t rows_padded = TILE_MAJOR_TILES(rows) * DIM;
+  const size_t cols_padded = TILE_MAJOR_TILES(cols) * DIM;
+
+  for (size_t r = 0; r < rows_padded; r++)
+    for (size_t c = 0; c < cols_padded; c++)
+      dst[tile_major_offset(cols, r, c)] = r < rows && c < cols ? src[r * stride + c] : 0;
+}
+
+static void tile_major_unpack(size_t rows, size_t cols, const elem_t * src, elem_t * dst, size_t stride) {
+  for (size_t r = 0; r < rows; r++)
+    for (size_t c = 0; c < cols; c++)
+      dst[r * stride + c] = src[tile_major_offset(cols, r, c)];
+}
+
 // Tiling functions
 static void sp_tiled_matmul_os(const elem_t * A, const elem_t * B, const void * D, void * C,
         scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
@@ -527,14 +764,14 @@ static void sp_tiled_matmul_ws(const elem_t * A, const elem_t * B,
         bool full_C, bool low_D,
         bool no_bias, bool repeating_bias,
         int act,
-        int a_spad_id, int b_spad_id, bool is_mpgemm) {
+        int a_spad_id, int b_spad_id, bool is_mpgemm, bool b_tile_major, size_t heads) {
 
   // Combined loop
   gemmini_loop_ws(I, J, K, pad_I, pad_J, pad_K, A, B, no_bias ? NULL : D, C,
     A_row_stride, B_row_stride, repeating_bias ? 0 : D_row_stride, C_row_stride,
-    a_transpose, b_transpose,
+    a_transpose, b_transpose, b_tile_major,
     full_C, low_D, !no_bias || D == NULL,
-    act, a_spad_id, b_spad_id, false, is_mpgemm);
+    act, a_spad_id, b_spad_id, false, is_mpgemm, heads);
 }
 
 
@@ -549,7 +786,8 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
         bool a_transpose, bool b_transpose,
         bool full_C, bool low_D,
         uint8_t weightA,
-        int dataflow, bool is_mpgemm) {
+        int dataflow, bool is_mpgemm, bool b_tile_major,
+        size_t heads, size_t head_stride_A, size_t head_stride_B, size_t head_stride_D, size_t head_stride_C) {
 
   const size_t dim_I_padded = (dim_I / DIM + (dim_I % DIM != 0)) * DIM;
   const size_t dim_J_padded = (dim_J / DIM + (dim_J % DIM != 0)) * DIM;
@@ -580,10 +818,23 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
   const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t) ;
   const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
 
+  // Each head's partial sums only survive in the accumulator until the next
+  // head runs, so every head must finish its whole K reduction in one tile
+  if (heads > 1 && K0 > 1) {
+    printf("When running several heads in one loop, the full K dimension of the matrix must fit in one tile\n");
+    exit(1);
+  }
+
   gemmini_extended_config_ex(dataflow, act & 3, 0, 1, a_transpose, b_transpose);
   gemmini_extended_config_st(stride_C * sizeof_C, act & 3, scale);
   gemmini_extended3_config_ld(stride_A * sizeof(elem_t), A_scale_factor, false, 0);
-  gemmini_extended3_config_ld(stride_B * sizeof(elem_t), B_scale_factor, false, 1);
+  if (b_tile_major) {
+    // stride_B counts tiles, and each tile moves in as TILE_MAJOR_ROWS full requests
+    stride_B = b_transpose ? dim_K_padded / DIM : dim_J_padded / DIM;
+    gemmini_extended4_config_ld(TILE_MAJOR_BLOCKS * DIM * sizeof(elem_t), B_scale_factor, false, TILE_MAJOR_ROWS, 1);
+  } else {
+    gemmini_extended3_config_ld(stride_B * sizeof(elem_t), B_scale_factor, false, 1);
+  }
   gemmini_extended3_config_ld(repeating_bias ? 0 : (stride_D * sizeof_D), D_scale_factor, low_D, 2);
 
   if (act == IGELU) {
@@ -618,7 +869,7 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
         bool, bool,
         bool, bool,
         bool, bool,
-        int, int, int, bool);
+        int, int, int, bool, bool, size_t);
 
   if (dataflow == OUTPUT_STATIONARY) {
     inner = &sp_tiled_matmul_os;
@@ -629,8 +880,15 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
   // reuse operand if it fits scratchpad
   int a_spad_id = 0;
   int b_spad_id = 0;
-  bool b_reuse = (J0 * K0 <= 2) && (dataflow == WEIGHT_STATIONARY);
-  bool a_reuse = (I0 * K0 <= 2) && (dataflow == WEIGHT_STATIONARY);
+  // (the scratchpad only holds the last head's operands, so heads can't reuse)
+  bool b_reuse = (J0 * K0 <= 2) && (dataflow == WEIGHT_STATIONARY) && heads <= 1;
+  bool a_reuse = (I0 * K0 <= 2) && (dataflow == WEIGHT_STATIONARY) && heads <= 1;
+
+  if (heads > 1) {
+    gemmini_loop_ws_config_head_strides(head_stride_A * sizeof(elem_t),
+        head_stride_B * sizeof(elem_t), head_stride_D * sizeof_D,
+        head_stride_C * sizeof_C);
+  }
 
   for (size_t i0 = 0; i0 < I0; i0++)
     for (size_t j0 = 0; j0 < J0; j0++)
@@ -675,8 +933,13 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
         const elem_t * a = a_transpose ? (A + k0*tile_K*DIM*stride_A + i0*tile_I*DIM)
           : (A + i0*tile_I*DIM*stride_A + k0*tile_K*DIM);
 
-        const elem_t * b = b_transpose ? (B + j0*tile_J*DIM*stride_B + k0*tile_K*DIM)
-          : (B + k0*tile_K*DIM*stride_B + j0*tile_J*DIM);
+        const elem_t * b;
+        if (b_tile_major) {
+          b = B + (b_transpose ? (j0*tile_J*stride_B + k0*tile_K) : (k0*tile_K*stride_B + j0*tile_J)) * DIM * DIM;
+        } else {
+          b = b_transpose ? (B + j0*tile_J*DIM*stride_B + k0*tile_K*DIM)
+            : (B + k0*tile_K*DIM*stride_B + j0*tile_J*DIM);
+        }
 
         if(a_reuse && j0 >= 1) a = NULL;
         if(b_reuse && i0 >= 1) b = NULL;
@@ -689,10 +952,10 @@ static void tiled_matmul_outer(size_t dim_I, size_t dim_J, size_t dim_K,
             a_transpose, b_transpose,
             full_C, low_D,
             no_bias, repeating_bias,
-            act, a_spad_id, b_spad_id, is_mpgemm);
+            act, a_spad_id, b_spad_id, is_mpgemm, b_tile_major, heads);
       }
 
-  gemmini_fence();
+  gemmini_kernel_fence();
 }
 
 
@@ -758,14 +1021,349 @@ static elem_t scale_and_sat(acc_t x, int act, acc_scale_t scale, acc_scale_t ber
 #define GEMMINI_ACC_SCALE(x, scale) (x)
 #endif
 
-static void matmul_cpu(bool transA, bool transB, size_t DIM_I, size_t DIM_J, size_t DIM_K,
-        const elem_t* A, const elem_t* B, const acc_t * D,
+// In Linux mode, the CPU versions of the kernels split their outputs across
+// several threads. gemmini_cpu_threads sets how many, with 0 for one per
+// online hart. Baremetal builds always run them on the calling hart
+#ifndef GEMMINI_CPU_MAX_THREADS
+#define GEMMINI_CPU_MAX_THREADS 64
+#endif
+
+// Kernels with fewer multiply-accumulates than this aren't worth a thread
+#ifndef GEMMINI_CPU_MIN_THREAD_MACS
+#define GEMMINI_CPU_MIN_THREAD_MACS (1 << 16)
+#endif
+
+typedef void (*gemmini_cpu_job_t)(const void * args, size_t start, size_t end);
+
+#ifndef BAREMETAL
+static int gemmini_cpu_threads = 0;
+
+struct gemmini_cpu_range_t {
+  gemmini_cpu_job_t job;
+  const void * args;
+  size_t start, end;
+};
+
+static void * gemmini_cpu_run_range(void * arg) {
+  const struct gemmini_cpu_range_t * range = arg;
+  range->job(range->args, range->start, range->end);
+  return NULL;
+}
+#endif
+
+// Calls job(args, start, end) over [0, n), with each thread taking one
+// contiguous range. Ranges start on multiples of align, so that kernels that
+// compute several outputs at a time keep their blocks whole. macs is the
+// total work, which decides how many threads are worth starting
+static void gemmini_cpu_parallel(size_t n, size_t align, size_t macs,
+        gemmini_cpu_job_t job, const void * args) {
+#ifndef BAREMETAL
+  size_t threads = gemmini_cpu_threads > 0 ? gemmini_cpu_threads : sysconf(_SC_NPROCESSORS_ONLN);
+  const size_t chunks = (n + align - 1) / align;
+  if (threads > GEMMINI_CPU_MAX_THREADS) threads = GEMMINI_CPU_MAX_THREADS;
+  if (threads > chunks) threads = chunks;
+  if (threads > macs / GEMMINI_CPU_MIN_THREAD_MACS) threads = macs / GEMMINI_CPU_MIN_THREAD_MACS;
+
+  if (threads > 1) {
+    const size_t per_thread = (chunks + threads - 1) / threads * align;
+    pthread_t tids[GEMMINI_CPU_MAX_THREADS];
+    struct gemmini_cpu_range_t ranges[GEMMINI_CPU_MAX_THREADS];
+    size_t started = 0;
+
+    // The calling thread takes the first range itself
+    for (size_t start = per_thread; start < n; start += per_thread) {
+      struct gemmini_cpu_range_t * range = &ranges[started];
+      range->job = job;
+      range->args = args;
+      range->start = start;
+      range->end = n - start < per_thread ? n : start + per_thread;
+
+      if (pthread_create(&tids[started], NULL, gemmini_cpu_run_range, range) != 0) {
+        printf("Could not start a CPU kernel thread\n");
+        exit(1);
+      }
+      started++;
+    }
+
+    job(args, 0, per_thread);
+
+    for (size_t t = 0; t < started; t++)
+      pthread_join(tids[t], NULL);
+    return;
+  }
+#endif
+
+  job(args, 0, n);
+}
+
+// I-BERT's integer exponential of q <= 0, with the constants derived from
+// bert_scale as in matmul_cpu_norm_init. This wraps and shifts exactly like
+// AccumulatorScale.iexp: z is bits 16 to 47 of the full product, and a
+// shift of 32 or more underflows to 0
+static acc_t softmax_iexp(acc_t q, acc_t qln2, acc_t qln2_inv, acc_t qb, acc_t qc) {
+  const acc_t neg_q = (acc_t)(0u - (uint32_t)q);
+  const uint32_t z = (uint64_t)((int64_t)neg_q * qln2_inv) >> 16;
+  const acc_t qp = (acc_t)((uint32_t)q + z * (uint32_t)qln2);
+  const uint32_t qp_b = (uint32_t)qp + (uint32_t)qb;
+  const uint32_t q_exp = qp_b * qp_b + (uint32_t)qc;
+  return z < 32 ? (acc_t)(q_exp >> z) : 0;
+}
+
+// exps[j] = softmax_iexp(x[j] - max_q) for n values of a row
+static void softmax_iexp_block(const acc_t * x, size_t n, acc_t max_q,
+        acc_t qln2, acc_t qln2_inv, acc_t qb, acc_t qc, acc_t * exps) {
+  size_t j = 0;
+
+#if defined(__AVX2__)
+  const __m256i vmax = _mm256_set1_epi32(max_q);
+  const __m256i vqln2 = _mm256_set1_epi32(qln2);
+  const __m256i vqln2_inv = _mm256_set1_epi32(qln2_inv);
+  const __m256i vqb = _mm256_set1_epi32(qb);
+  const __m256i vqc = _mm256_set1_epi32(qc);
+
+  for (; j + 8 <= n; j += 8) {
+    const __m256i q = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *)&x[j]), vmax);
+    const __m256i neg_q = _mm256_sub_epi32(_mm256_setzero_si256(), q);
+    const __m256i prod_even = _mm256_mul_epi32(neg_q, vqln2_inv);
+    const __m256i prod_odd = _mm256_mul_epi32(_mm256_srli_epi64(neg_q, 32), vqln2_inv);
+    const __m256i z = _mm256_blend_epi32(_mm256_srli_epi64(prod_even, 16),
+        _mm256_slli_epi64(prod_odd, 16), 0xaa);
+    const __m256i qp = _mm256_add_epi32(q, _mm256_mullo_epi32(z, vqln2));
+    const __m256i t = _mm256_add_epi32(qp, vqb);
+    const __m256i q_exp = _mm256_add_epi32(_mm256_mullo_epi32(t, t), vqc);
+    // srlv already gives 0 for shifts of 32 or more
+    const __m256i e = _mm256_srlv_epi32(q_exp, z);
+    _mm256_storeu_si256((__m256i *)&exps[j], e);
+  }
+#elif defined(__riscv_vector)
+  for (size_t vl; j < n; j += vl) {
+    vl = __riscv_vsetvl_e32m4(n - j);
+    const vuint32m4_t q = __riscv_vsub_vx_u32m4(
+        __riscv_vle32_v_u32m4((const uint32_t *)&x[j], vl), (uint32_t)max_q, vl);
+    const vint32m4_t neg_q = __riscv_vreinterpret_v_u32m4_i32m4(__riscv_vrsub_vx_u32m4(q, 0, vl));
+    const vuint32m4_t prod_lo = __riscv_vreinterpret_v_i32m4_u32m4(__riscv_vmul_vx_i32m4(neg_q, qln2_inv, vl));
+    const vuint32m4_t prod_hi = __riscv_vreinterpret_v_i32m4_u32m4(__riscv_vmulh_vx_i32m4(neg_q, qln2_inv, vl));
+    const vuint32m4_t z = __riscv_vor_vv_u32m4(__riscv_vsrl_vx_u32m4(prod_lo, 16, vl),
+        __riscv_vsll_vx_u32m4(prod_hi, 16, vl), vl);
+    const vuint32m4_t qp = __riscv_vmacc_vx_u32m4(q, (uint32_t)qln2, z, vl);
+    const vuint32m4_t t = __riscv_vadd_vx_u32m4(qp, (uint32_t)qb, vl);
+    const vuint32m4_t q_exp = __riscv_vadd_vx_u32m4(__riscv_vmul_vv_u32m4(t, t, vl), (uint32_t)qc, vl);
+    // vsrl only uses the low 5 bits of each shift
+    const vuint32m4_t e = __riscv_vmerge_vxm_u32m4(__riscv_vsrl_vv_u32m4(q_exp, z, vl), 0,
+        __riscv_vmsgeu_vx_u32m4_b8(z, 32, vl), vl);
+    __riscv_vse32_v_i32m4(&exps[j], __riscv_vreinterpret_v_u32m4_i32m4(e), vl);
+  }
+#endif
+
+  for (; j < n; j++)
+    exps[j] = softmax_iexp((acc_t)((uint32_t)x[j] - (uint32_t)max_q), qln2, qln2_inv, qb, qc);
+}
+
+// Columns of a row that the CPU matmuls hold when normalizing it. Each thread
+// keeps one block of accumulator values per row it normalizes at a time, which
+// is 16 KB for the default, so that rows as wide as a 4K hidden dimension are
+// computed once and every pass runs over the held values
+#ifndef NORM_CPU_BLOCK
+#define NORM_CPU_BLOCK 4096
+#endif
+
+// The state of a layernorm or softmax of one row, which the CPU applies the
+// way the Normalizer does when storing a row. The row is fed to
+// matmul_cpu_norm_block in blocks of accumulator values, once per pass. A row
+// of a single block is computed once. Only rows wider than NORM_CPU_BLOCK are
+// recomputed for each pass, in the order of matmul_cpu_norm_col_block so that
+// each pass starts on the block that the previous one ended with
+struct matmul_cpu_norm {
+  int act;
+  acc_scale_t scale;
+  acc_scale_t bert_scale;
+  size_t DIM_J;
+
+  // LAYERNORM. Wrapping sums give the same mean and variance as summing the
+  // row's acc_t values
+  uint64_t sum;
+  uint64_t sum_sq;
+  acc_t mean;
+  acc_t stddev;
+
+  // SOFTMAX
+  acc_t qln2, qln2_inv, qb, qc;
+  acc_t max_q;
+  acc_t sum_exp;
+  scale_t factor;
+};
+
+static void matmul_cpu_norm_init(struct matmul_cpu_norm * norm, size_t DIM_J,
+        int act, acc_scale_t scale, acc_scale_t bert_scale) {
+  norm->act = act;
+  norm->scale = scale;
+  norm->bert_scale = bert_scale;
+  norm->DIM_J = DIM_J;
+
+  norm->sum = 0;
+  norm->sum_sq = 0;
+
+  if (act == SOFTMAX) {
+    const scale_t a = 0.3585;
+    const scale_t b = 1.353;
+    const scale_t c = 0.344;
+
+    // is SCALE supposed to be input scale?
+    norm->qln2 = (acc_t) (0.693147 / bert_scale);
+    norm->qln2_inv = 65536 / norm->qln2;
+    norm->qb = b / bert_scale;
+    norm->qc = c / (a*bert_scale*bert_scale);
+  } else {
+    norm->qln2 = 0;
+    norm->qln2_inv = 0;
+    norm->qb = 0;
+    norm->qc = 0;
+  }
+
+  norm->max_q = -2147483648;
+  norm->sum_exp = 0;
+}
+
+static int matmul_cpu_norm_passes(int act) {
+  return act == SOFTMAX ? 3 : 2;
+}
+
+// The index of the b-th block of columns that a pass visits
+static size_t matmul_cpu_norm_col_block(int pass, size_t b, size_t blocks) {
+  return pass % 2 == 0 ? b : blocks - 1 - b;
+}
+
+// Feeds the accumulator values of columns [j, j + cols) to a pass. The last
+// pass writes those columns of the output row C
+static void matmul_cpu_norm_block(struct matmul_cpu_norm * norm, int pass,
+        const acc_t * x, size_t j, size_t cols, elem_t * C) {
+  if (norm->act == LAYERNORM) {
+    if (pass == 0) {
+      uint64_t sum = 0, sum_sq = 0;
+      for (size_t jj = 0; jj < cols; jj++) {
+        sum += (uint64_t)(int64_t)x[jj];
+        sum_sq += (uint64_t)((int64_t)x[jj] * x[jj]);
+      }
+      norm->sum += sum;
+      norm->sum_sq += sum_sq;
+    } else {
+      for (size_t jj = 0; jj < cols; jj++) {
+        // TODO I don't think I-BERT uses round-near-even, so we shouldn't either. We just use this rounding mode here in order to match the hardware.
+        const acc_t q = ROUND_NEAR_EVEN((double)(x[jj] - norm->mean) / norm->stddev);
+        C[j + jj] = scale_and_sat(q, norm->act, norm->scale, norm->bert_scale);
+      }
+    }
+  } else if (norm->act == SOFTMAX) {
+    const acc_t max_q = norm->max_q;
+
+    if (pass == 0) {
+      acc_t m = max_q;
+      for (size_t jj = 0; jj < cols; jj++)
+        m = x[jj] > m ? x[jj] : m;
+      norm->max_q = m;
+    } else {
+      acc_t exps[64];
+      for (size_t jj = 0; jj < cols; jj += 64) {
+        const size_t n = cols - jj < 64 ? cols - jj : 64;
+        softmax_iexp_block(x + jj, n, max_q, norm->qln2, norm->qln2_inv, norm->qb, norm->qc, exps);
+
+        if (pass == 1) {
+          for (size_t e = 0; e < n; e++)
+            norm->sum_exp += exps[e];
+        } else {
+          for (size_t e = 0; e < n; e++)
+            C[j + jj + e] = scale_and_sat(exps[e], norm->act, norm->factor, norm->bert_scale);
+        }
+      }
+    }
+  }
+}
+
+// Derives what the next pass needs from the statistics of this one
+static void matmul_cpu_norm_end_pass(struct matmul_cpu_norm * norm, int pass) {
+  if (norm->act == LAYERNORM && pass == 0) {
+    const uint64_t n = norm->DIM_J;
+    norm->mean = (acc_t)norm->sum / (acc_t)n;
+
+    // sum((x - mean)^2), expanded so that it only needs the sums of x and x^2
+    const uint64_t mean = (uint64_t)(int64_t)norm->mean;
+    const uint64_t total_err_sq = norm->sum_sq - 2 * mean * norm->sum + n * mean * mean;
+    const acc_t variance = (acc_t)total_err_sq / (acc_t)n;
+
+    norm->stddev = int_sqrt(variance);
+    if (variance == 0) norm->stddev = 1;
+  } else if (norm->act == SOFTMAX && pass == 1) {
+    norm->factor = (127.f) / (float) norm->sum_exp; // what corresponds to 1 in output?
+  }
+}
+
+// tiled_matmul_resadd_auto brings its residual in with a mvin scale, which
+// saturates to elem_t. A residual scaled up by more than 1 therefore comes in
+// at a scale of at most 1, and the array multiplies it the rest of the way by
+// running it through an m * identity weight tile, "passes" times. With
+// m <= elem_t_max, one pass covers scales of up to elem_t_max
+struct matmul_resadd_scale_t {
+  size_t passes;
+  elem_t m;
+  scale_t mvin_scale;
+};
+
+static struct matmul_resadd_scale_t matmul_resadd_scale(scale_t R_scale_factor) {
+  struct matmul_resadd_scale_t res = {1, 1, R_scale_factor};
+
+  if (R_scale_factor > 1) {
+    res.passes = (size_t)(R_scale_factor / elem_t_max);
+    if (res.passes * elem_t_max < R_scale_factor)
+      res.passes++;
+
+    size_t m = (size_t)(R_scale_factor / res.passes);
+    if (m * res.passes < R_scale_factor)
+      m++;
+    res.m = m;
+
+    res.mvin_scale = R_scale_factor / (res.passes * m);
+  }
+
+  return res;
+}
+
+// What a residual element adds to the accumulator
+static acc_t matmul_resadd_residual(elem_t r, const struct matmul_resadd_scale_t * res) {
+  return (acc_t)res->passes * res->m * MVIN_SCALE(r, res->mvin_scale);
+}
+
+// One element of A * B + D (+ R), before any activation, for the general path
+// of matmul_cpu
+static acc_t matmul_cpu_dot(size_t i, size_t j, size_t DIM_K,
+        const elem_t* A, const elem_t* B, const acc_t * D, const elem_t * R,
+        const size_t A_dim_strides[2], const size_t B_dim_strides[2], size_t stride_D, size_t stride_R,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor, scale_t R_scale_factor,
+        bool repeating_bias) {
+  const size_t bias_row = repeating_bias ? 0 : i;
+  acc_t sum = D == NULL ? 0 : GEMMINI_ACC_SCALE(*(D + bias_row * stride_D + j), D_scale_factor);
+  if (R != NULL) {
+    const struct matmul_resadd_scale_t res = matmul_resadd_scale(R_scale_factor);
+    sum += matmul_resadd_residual(R[i * stride_R + j], &res);
+  }
+
+  for (size_t k = 0; k < DIM_K; k++) {
+    const elem_t* a = A + i * A_dim_strides[0] + k * A_dim_strides[1];
+    const elem_t* b = B + j * B_dim_strides[0] + k * B_dim_strides[1];
+    sum += (GEMMINI_SCALE(*a, A_scale_factor) * GEMMINI_SCALE(*b, B_scale_factor));
+  }
+
+  return sum;
+}
+
+static void matmul_cpu_serial(bool transA, bool transB, size_t DIM_I, size_t DIM_J, size_t DIM_K,
+        const elem_t* A, const elem_t* B, const acc_t * D, const elem_t * R,
         elem_t* C,
-        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
-        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_R, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor, scale_t R_scale_factor,
         int act, acc_scale_t scale, acc_scale_t bert_scale, bool repeating_bias) {
 
   const int no_bias = D == NULL;
+  const struct matmul_resadd_scale_t res = matmul_resadd_scale(R_scale_factor);
   if (act != LAYERNORM && act != SOFTMAX && !transA && !transB && DIM_I % 4 == 0 && DIM_J % 4 == 0) {
     for (size_t i = 0; i < DIM_I; i += 4) {
       for (size_t j = 0; j < DIM_J; j += 4) {
@@ -777,6 +1375,8 @@ static void matmul_cpu(bool transA, bool transB, size_t DIM_I, size_t DIM_J, siz
             const size_t bias_row = repeating_bias ? 0 : i + ii;
             result[ii][jj] = no_bias ? 0 :
               GEMMINI_ACC_SCALE(*(D + bias_row*stride_D + j + jj), D_scale_factor);
+            if (R != NULL)
+              result[ii][jj] += matmul_resadd_residual(*(R + (i + ii)*stride_R + j + jj), &res);
           }
 
         for (size_t k = 0; k < DIM_K; k++) {
@@ -868,94 +1468,345 @@ static void matmul_cpu(bool transA, bool transB, size_t DIM_I, size_t DIM_J, siz
     size_t A_dim_strides[2] = {!transA ? stride_A : 1, !transA ? 1 : stride_A}; // i, j stride
     size_t B_dim_strides[2] = {!transB ? 1 : stride_B, !transB ? stride_B : 1}; // j, k stride
 
-    // We also create a buffer that we can use for layernorms and softmaxes
-    static acc_t c_buffer[1024];
-    const size_t c_buffer_sz = sizeof(c_buffer)/sizeof(c_buffer[0]);
-    if ((act == LAYERNORM || act == SOFTMAX) && DIM_J > c_buffer_sz) {
-      printf("Matmul is too large to normalize\n");
-      exit(1);
+    if (act == LAYERNORM || act == SOFTMAX) {
+      static GEMMINI_THREAD_LOCAL acc_t c_buffer[NORM_CPU_BLOCK];
+      const size_t blocks = DIM_J / NORM_CPU_BLOCK + (DIM_J % NORM_CPU_BLOCK != 0);
+
+      for (size_t i = 0; i < DIM_I; i++) {
+        struct matmul_cpu_norm norm;
+        matmul_cpu_norm_init(&norm, DIM_J, act, scale, bert_scale);
+        size_t computed = blocks;
+
+        for (int pass = 0; pass < matmul_cpu_norm_passes(act); pass++) {
+          for (size_t b = 0; b < blocks; b++) {
+            const size_t block = matmul_cpu_norm_col_block(pass, b, blocks);
+            const size_t j_start = block * NORM_CPU_BLOCK;
+            const size_t cols = DIM_J - j_start < NORM_CPU_BLOCK ? DIM_J - j_start : NORM_CPU_BLOCK;
+
+            if (block != computed) {
+              for (size_t j = 0; j < cols; j++)
+                c_buffer[j] = matmul_cpu_dot(i, j_start + j, DIM_K, A, B, D, R,
+                    A_dim_strides, B_dim_strides, stride_D, stride_R,
+                    A_scale_factor, B_scale_factor, D_scale_factor, R_scale_factor,
+                    repeating_bias);
+              computed = block;
+            }
+
+            matmul_cpu_norm_block(&norm, pass, c_buffer, j_start, cols, C + i * stride_C);
+          }
+
+          matmul_cpu_norm_end_pass(&norm, pass);
+        }
+      }
+    } else {
+      for (size_t i = 0; i < DIM_I; i++)
+        for (size_t j = 0; j < DIM_J; j++) {
+          const acc_t sum = matmul_cpu_dot(i, j, DIM_K, A, B, D, R,
+              A_dim_strides, B_dim_strides, stride_D, stride_R,
+              A_scale_factor, B_scale_factor, D_scale_factor, R_scale_factor,
+              repeating_bias);
+          C[i * stride_C + j] = scale_and_sat(sum, act, scale, bert_scale);
+        }
     }
+  }
+}
 
-    for (size_t i = 0; i < DIM_I; i++) {
-      for (size_t j = 0; j < DIM_J; j++) {
-        elem_t* c = C + (i * stride_C) + j;
+// The arguments of matmul_cpu or mpgemm_cpu, for the threads that each
+// compute a range of the rows or columns of C
+struct matmul_cpu_args_t {
+  bool transA, transB;
+  size_t DIM_I, DIM_J, DIM_K;
+  const elem_t * A;
+  const elem_t * B;
+  const acc_t * D;
+  const elem_t * R;
+  elem_t * C;
+  size_t stride_A, stride_B, stride_D, stride_R, stride_C;
+  scale_t A_scale_factor, B_scale_factor;
+  scale_acc_t D_scale_factor;
+  scale_t R_scale_factor;
+  int act;
+  acc_scale_t scale, bert_scale;
+  bool repeating_bias;
+  bool split_J;
+};
+
+// Layernorms and softmaxes need whole rows, so only other matmuls are split
+// by columns, when C is wider than it is tall
+static bool matmul_cpu_split_J(size_t DIM_I, size_t DIM_J, int act) {
+  return act != LAYERNORM && act != SOFTMAX && DIM_J > DIM_I;
+}
 
-        const size_t bias_row = repeating_bias ? 0 : i;
-        acc_t sum = no_bias ? 0 : GEMMINI_ACC_SCALE(*(D + bias_row * stride_D + j), D_scale_factor);
+static void matmul_cpu_job(const void * arg, size_t start, size_t end) {
+  const struct matmul_cpu_args_t * a = arg;
+
+  if (a->split_J)
+    matmul_cpu_serial(a->transA, a->transB, a->DIM_I, end - start, a->DIM_K,
+        a->A, a->B + (a->transB ? start * a->stride_B : start),
+        a->D == NULL ? NULL : a->D + start, a->R == NULL ? NULL : a->R + start,
+        a->C + start,
+        a->stride_A, a->stride_B, a->stride_D, a->stride_R, a->stride_C,
+        a->A_scale_factor, a->B_scale_factor, a->D_scale_factor, a->R_scale_factor,
+        a->act, a->scale, a->bert_scale, a->repeating_bias);
+  else
+    matmul_cpu_serial(a->transA, a->transB, end - start, a->DIM_J, a->DIM_K,
+        a->A + (a->transA ? start : start * a->stride_A), a->B,
+        a->D == NULL || a->repeating_bias ? a->D : a->D + start * a->stride_D,
+        a->R == NULL ? NULL : a->R + start * a->stride_R,
+        a->C + start * a->stride_C,
+        a->stride_A, a->stride_B, a->stride_D, a->stride_R, a->stride_C,
+        a->A_scale_factor, a->B_scale_factor, a->D_scale_factor, a->R_scale_factor,
+        a->act, a->scale, a->bert_scale, a->repeating_bias);
+}
 
-        for (size_t k = 0; k < DIM_K; k++) {
-          const elem_t* a = A + i * A_dim_strides[0] + k * A_dim_strides[1];
-          const elem_t* b = B + j * B_dim_strides[0] + k * B_dim_strides[1];
-          sum += (GEMMINI_SCALE(*a, A_scale_factor) * GEMMINI_SCALE(*b, B_scale_factor));
+// R, when not NULL, is an elem_t residual added to each output alongside the
+// bias, as tiled_matmul_resadd_auto moves it into the accumulator
+static void matmul_cpu(bool transA, bool transB, size_t DIM_I, size_t DIM_J, size_t DIM_K,
+        const elem_t* A, const elem_t* B, const acc_t * D, const elem_t * R,
+        elem_t* C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_R, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor, scale_t R_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale, bool repeating_bias) {
+  const struct matmul_cpu_args_t args = {transA, transB, DIM_I, DIM_J, DIM_K,
+    A, B, D, R, C, stride_A, stride_B, stride_D, stride_R, stride_C,
+    A_scale_factor, B_scale_factor, D_scale_factor, R_scale_factor,
+    act, scale, bert_scale, repeating_bias,
+    matmul_cpu_split_J(DIM_I, DIM_J, act)};
+
+  // Ranges of 4 keep the 4x4 blocks of matmul_cpu_serial whole
+  gemmini_cpu_parallel(args.split_J ? DIM_J : DIM_I, 4, DIM_I * DIM_J * DIM_K,
+      matmul_cpu_job, &args);
+}
+
+// Packed ternary weights hold four 2-bit codes per byte, starting from the
+// least-significant bits. As in the TernaryMulUnit of the Wontolic array, bit 0
+// enables the weight and bit 1 negates the int8 input, so 0b01 = +1,
+// 0b11 = -1 and 0b00 = 0. The negation wraps within int8.
+#define TERNARY_CODE(packed, slot) (((uint8_t)(packed) >> (2 * (slot))) & 3)
+#define TERNARY_MUL(a, code) \
+  ((code) & 1 ? ((code) & 2 ? (acc_t)(elem_t)(-(a)) : (acc_t)(a)) : 0)
+
+// mpgemm_cpu computes MPGEMM_CPU_ROWS x MPGEMM_CPU_COLS output blocks at a
+// time, reusing each decoded row of weights across the rows of A
+#define MPGEMM_CPU_ROWS 4
+#define MPGEMM_CPU_COLS 16
+
+// Adds A[0:rows][0:K] times the packed weights B[0:K][0:cols/4] to acc, using
+// masked adds instead of multiplies
+static void mpgemm_cpu_block(size_t rows, size_t cols, size_t DIM_K,
+        const elem_t * A, const elem_t * B,
+        size_t stride_A, size_t stride_B,
+        scale_t A_scale_factor,
+        acc_t acc[MPGEMM_CPU_ROWS][MPGEMM_CPU_COLS]) {
+
+#if defined(__AVX2__)
+  if (cols == MPGEMM_CPU_COLS) {
+    const __m256i shifts = _mm256_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14);
+    const __m256i three = _mm256_set1_epi32(3);
+    const __m256i one = _mm256_set1_epi32(1);
+
+    __m256i c[MPGEMM_CPU_ROWS][2];
+    for (size_t r = 0; r < MPGEMM_CPU_ROWS; r++) {
+      c[r][0] = _mm256_loadu_si256((const __m256i *)&acc[r][0]);
+      c[r][1] = _mm256_loadu_si256((const __m256i *)&acc[r][8]);
+    }
+
+    for (size_t k = 0; k < DIM_K; k++) {
+      const uint8_t * b = (const uint8_t *)(B + k * stride_B);
+      __m256i pos[2], neg[2];
+      for (int h = 0; h < 2; h++) {
+        const __m256i packed = _mm256_set1_epi32(b[2*h] | (b[2*h+1] << 8));
+        const __m256i code = _mm256_and_si256(_mm256_srlv_epi32(packed, shifts), three);
+        pos[h] = _mm256_cmpeq_epi32(code, one);
+        neg[h] = _mm256_cmpeq_epi32(code, three);
+      }
+
+      for (size_t r = 0; r < rows; r++) {
+        const elem_t a = GEMMINI_SCALE(A[r * stride_A + k], A_scale_factor);
+        const __m256i va = _mm256_set1_epi32(a);
+        const __m256i vna = _mm256_set1_epi32((elem_t)(-a));
+        for (int h = 0; h < 2; h++) {
+          const __m256i term = _mm256_or_si256(_mm256_and_si256(va, pos[h]),
+              _mm256_and_si256(vna, neg[h]));
+          c[r][h] = _mm256_add_epi32(c[r][h], term);
         }
+      }
+    }
 
-        if (act == LAYERNORM || act == SOFTMAX)
-          c_buffer[j] = sum;
-        else
-          *c = scale_and_sat(sum, act, scale, bert_scale);
+    for (size_t r = 0; r < MPGEMM_CPU_ROWS; r++) {
+      _mm256_storeu_si256((__m256i *)&acc[r][0], c[r][0]);
+      _mm256_storeu_si256((__m256i *)&acc[r][8], c[r][1]);
+    }
+    return;
+  }
+#elif defined(__riscv_vector)
+  if (cols == MPGEMM_CPU_COLS) {
+    for (size_t j = 0; j < cols; ) {
+      const size_t vl = __riscv_vsetvl_e32m4(cols - j);
+      const vuint32m4_t shifts = __riscv_vsll_vx_u32m4(
+          __riscv_vadd_vx_u32m4(__riscv_vid_v_u32m4(vl), j, vl), 1, vl);
+
+      vint32m4_t c[MPGEMM_CPU_ROWS];
+      for (size_t r = 0; r < MPGEMM_CPU_ROWS; r++)
+        c[r] = __riscv_vle32_v_i32m4(&acc[r][j], vl);
+
+      for (size_t k = 0; k < DIM_K; k++) {
+        const uint8_t * b = (const uint8_t *)(B + k * stride_B);
+        const uint32_t packed = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+        const vuint32m4_t code = __riscv_vand_vx_u32m4(
+            __riscv_vsrl_vv_u32m4(__riscv_vmv_v_x_u32m4(packed, vl), shifts, vl), 3, vl);
+        const vbool8_t pos = __riscv_vmseq_vx_u32m4_b8(code, 1, vl);
+        const vbool8_t neg = __riscv_vmseq_vx_u32m4_b8(code, 3, vl);
+
+        for (size_t r = 0; r < rows; r++) {
+          const elem_t a = GEMMINI_SCALE(A[r * stride_A + k], A_scale_factor);
+          c[r] = __riscv_vadd_vx_i32m4_mu(pos, c[r], c[r], a, vl);
+          c[r] = __riscv_vadd_vx_i32m4_mu(neg, c[r], c[r], (elem_t)(-a), vl);
+        }
       }
 
-      if (act == LAYERNORM) {
-        acc_t sum = 0;
-        for (size_t j = 0; j < DIM_J; j++)
-          sum += c_buffer[j];
-        acc_t mean = sum / (acc_t)DIM_J;
+      for (size_t r = 0; r < MPGEMM_CPU_ROWS; r++)
+        __riscv_vse32_v_i32m4(&acc[r][j], c[r], vl);
+      j += vl;
+    }
+    return;
+  }
+#endif
 
-        acc_t total_err_sq = 0;
-        for (size_t j = 0; j < DIM_J; j++)
-          total_err_sq += (c_buffer[j] - mean)*(c_buffer[j] - mean);
-        acc_t variance = total_err_sq / (acc_t)DIM_J;
+  // Portable fallback, also used for the ragged edges of the output
+  for (size_t k = 0; k < DIM_K; k++) {
+    const elem_t * b = B + k * stride_B;
+    acc_t pos[MPGEMM_CPU_COLS], neg[MPGEMM_CPU_COLS];
+    for (size_t j = 0; j < cols; j++) {
+      const int code = TERNARY_CODE(b[j / 4], j % 4);
+      pos[j] = -(acc_t)(code == 1);
+      neg[j] = -(acc_t)(code == 3);
+    }
 
-        acc_t stddev = int_sqrt(variance);
-        if (variance == 0) stddev = 1;
+    for (size_t r = 0; r < rows; r++) {
+      const elem_t a = GEMMINI_SCALE(A[r * stride_A + k], A_scale_factor);
+      const acc_t na = (elem_t)(-a);
+      for (size_t j = 0; j < cols; j++)
+        acc[r][j] += (a & pos[j]) | (na & neg[j]);
+    }
+  }
+}
 
-        for (size_t j = 0; j < DIM_J; j++) {
-          c_buffer[j] -= mean;
-          // c_buffer[j] /= stddev;
-          c_buffer[j] = ROUND_NEAR_EVEN((double)c_buffer[j] / stddev); // TODO I don't think I-BERT uses round-near-even, so we shouldn't either. We just use this rounding mode here in order to match the hardware.
+// CPU version of tiled_mpgemm_auto. B holds DIM_K rows of DIM_J/4 packed bytes
+// (stride_B is in bytes), while D and C have DIM_J columns.
+static void mpgemm_cpu_serial(size_t DIM_I, size_t DIM_J, size_t DIM_K,
+        const elem_t* A, const elem_t* B, const acc_t * D,
+        elem_t* C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale, bool repeating_bias) {
 
-          elem_t* c = C + (i * stride_C) + j;
-          *c = scale_and_sat(c_buffer[j], act, scale, bert_scale);
-        }
-      } else if (act == SOFTMAX) {
-        const scale_t a = 0.3585;
-        const scale_t b = 1.353;
-        const scale_t c = 0.344;
+  const bool no_bias = D == NULL;
+  const bool normalize = act == LAYERNORM || act == SOFTMAX;
 
-        // is SCALE supposed to be input scale?
-        const acc_t qln2 = (acc_t) (0.693147 / bert_scale);
-        const acc_t qln2_inv = 65536 / qln2;
-        const acc_t qb = b / bert_scale;
-        const acc_t qc = c / (a*bert_scale*bert_scale);
+  if (DIM_J % 4 != 0) {
+    printf("dim_J should be a multiple of 4\n");
+    exit(1);
+  }
 
-        // pass 1: get max_q
-        acc_t max_q = -2147483648;
-        for (size_t j = 0; j < DIM_J; j++) {
-          if (c_buffer[j] > max_q) max_q = c_buffer[j];
-        }
+  // Rows that are normalized are computed a block of columns at a time, once
+  // per pass. Other rows are a single pass over a single block
+  static GEMMINI_THREAD_LOCAL acc_t c_buffer[MPGEMM_CPU_ROWS][NORM_CPU_BLOCK];
+  const size_t block_cols = normalize ? NORM_CPU_BLOCK : DIM_J;
+  const size_t blocks = normalize ? DIM_J / NORM_CPU_BLOCK + (DIM_J % NORM_CPU_BLOCK != 0) : 1;
+  const int passes = normalize ? matmul_cpu_norm_passes(act) : 1;
+
+  for (size_t i = 0; i < DIM_I; i += MPGEMM_CPU_ROWS) {
+    const size_t rows = DIM_I - i < MPGEMM_CPU_ROWS ? DIM_I - i : MPGEMM_CPU_ROWS;
+
+    struct matmul_cpu_norm norm[MPGEMM_CPU_ROWS];
+    if (normalize)
+      for (size_t r = 0; r < rows; r++)
+        matmul_cpu_norm_init(&norm[r], DIM_J, act, scale, bert_scale);
+    size_t computed = blocks;
+
+    for (int pass = 0; pass < passes; pass++) {
+      for (size_t b = 0; b < blocks; b++) {
+        const size_t block = matmul_cpu_norm_col_block(pass, b, blocks);
+        const size_t j_start = block * block_cols;
+        const size_t j_end = DIM_J - j_start < block_cols ? DIM_J : j_start + block_cols;
+
+        for (size_t j = j_start; j < j_end && block != computed; j += MPGEMM_CPU_COLS) {
+          const size_t cols = j_end - j < MPGEMM_CPU_COLS ? j_end - j : MPGEMM_CPU_COLS;
+
+          acc_t acc[MPGEMM_CPU_ROWS][MPGEMM_CPU_COLS];
+          for (size_t r = 0; r < MPGEMM_CPU_ROWS; r++)
+            for (size_t jj = 0; jj < MPGEMM_CPU_COLS; jj++) {
+              const size_t bias_row = repeating_bias ? 0 : i + r;
+              acc[r][jj] = no_bias || r >= rows || jj >= cols ? 0 :
+                GEMMINI_ACC_SCALE(D[bias_row * stride_D + j + jj], D_scale_factor);
+            }
 
-        // pass 2: calculate iexp(q_tilde) and sum(q_tilde)
-        acc_t sum_exp = 0;
-        for (size_t j = 0; j < DIM_J; j++) {
-          acc_t q = c_buffer[j] - max_q;
-          acc_t z = (acc_t) (-q * qln2_inv) >> 16;
-          acc_t qp = q + z * qln2;
-          acc_t q_exp = (qp + qb)*(qp + qb) + qc;
-          c_buffer[j] = q_exp >> z;
-          sum_exp += c_buffer[j];
+          mpgemm_cpu_block(rows, cols, DIM_K,
+              A + i * stride_A, B + j / 4,
+              stride_A, stride_B,
+              A_scale_factor, acc);
+
+          for (size_t r = 0; r < rows; r++)
+            for (size_t jj = 0; jj < cols; jj++) {
+              if (normalize)
+                c_buffer[r][j - j_start + jj] = acc[r][jj];
+              else
+                C[(i + r) * stride_C + j + jj] = scale_and_sat(acc[r][jj], act, scale, bert_scale);
+            }
         }
+        computed = block;
 
-        // pass 3: divide by sum
-        scale_t factor = (127.f) / (float) sum_exp; // what corresponds to 1 in output?
-        for (size_t j = 0; j < DIM_J; j++) {
-          elem_t* c = C + (i * stride_C) + j;
-          *c = scale_and_sat(c_buffer[j], act, factor, bert_scale);
-        }
+        if (normalize)
+          for (size_t r = 0; r < rows; r++)
+            matmul_cpu_norm_block(&norm[r], pass, c_buffer[r], j_start, j_end - j_start,
+                C + (i + r) * stride_C);
       }
+
+      if (normalize)
+        for (size_t r = 0; r < rows; r++)
+          matmul_cpu_norm_end_pass(&norm[r], pass);
     }
   }
 }
 
+static void mpgemm_cpu_job(const void * arg, size_t start, size_t end) {
+  const struct matmul_cpu_args_t * a = arg;
+
+  if (a->split_J)
+    mpgemm_cpu_serial(a->DIM_I, end - start, a->DIM_K,
+        a->A, a->B + start / 4,
+        a->D == NULL ? NULL : a->D + start, a->C + start,
+        a->stride_A, a->stride_B, a->stride_D, a->stride_C,
+        a->A_scale_factor, a->D_scale_factor,
+        a->act, a->scale, a->bert_scale, a->repeating_bias);
+  else
+    mpgemm_cpu_serial(end - start, a->DIM_J, a->DIM_K,
+        a->A + start * a->stride_A, a->B,
+        a->D == NULL || a->repeating_bias ? a->D : a->D + start * a->stride_D,
+        a->C + start * a->stride_C,
+        a->stride_A, a->stride_B, a->stride_D, a->stride_C,
+        a->A_scale_factor, a->D_scale_factor,
+        a->act, a->scale, a->bert_scale, a->repeating_bias);
+}
+
+static void mpgemm_cpu(size_t DIM_I, size_t DIM_J, size_t DIM_K,
+        const elem_t* A, const elem_t* B, const acc_t * D,
+        elem_t* C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale, bool repeating_bias) {
+  const struct matmul_cpu_args_t args = {false, false, DIM_I, DIM_J, DIM_K,
+    A, B, D, NULL, C, stride_A, stride_B, stride_D, 0, stride_C,
+    A_scale_factor, MVIN_SCALE_IDENTITY, D_scale_factor, MVIN_SCALE_IDENTITY,
+    act, scale, bert_scale, repeating_bias,
+    matmul_cpu_split_J(DIM_I, DIM_J, act)};
+
+  gemmini_cpu_parallel(args.split_J ? DIM_J : DIM_I,
+      args.split_J ? MPGEMM_CPU_COLS : MPGEMM_CPU_ROWS, DIM_I * DIM_J * DIM_K,
+      mpgemm_cpu_job, &args);
+}
+
 #undef GEMMINI_SCALE
 
 // General matmul which can be run with different dataflows, or on the CPU
@@ -974,7 +1825,12 @@ static void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
         bool transpose_A, bool transpose_B,
         bool full_C, bool low_D,
         uint8_t weightA,
-        enum tiled_matmul_type_t tiled_matmul_type, bool is_mpgemm) {
+        enum tiled_matmul_type_t tiled_matmul_type, bool is_mpgemm, bool b_tile_major) {
+
+  if (b_tile_major && tiled_matmul_type != WS) {
+    printf("Not implemented: tile-major B on a %s matmul\n", tiled_matmul_type == OS ? "OS" : "CPU");
+    exit(1);
+  }
 
 #ifdef GEMMINI_ASSERTIONS
   // Make sure that the tiling factors make sense
@@ -1020,7 +1876,8 @@ static void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
   }
 
   const size_t total_acc_rows =
-      tile_I * tile_J * DIM;      // Rows to store C
+      tile_I * tile_J * DIM *     // Rows to store C
+      (is_mpgemm ? 4 : 1);        // (mpgemm expands each packed column 4x)
 
   if (total_acc_rows > total_acc_size) {
     printf("Not enough space in accumulator to store C\n");
@@ -1068,12 +1925,25 @@ static void tiled_matmul(size_t dim_I, size_t dim_J, size_t dim_K,
         transpose_A, transpose_B,
         full_C, low_D,
         weightA,
-        (int)tiled_matmul_type, is_mpgemm);
-  } else /*if (tiled_matmul_type == CPU)*/ {
-    matmul_cpu(transpose_A, transpose_B, dim_I, dim_J, dim_K,
+        (int)tiled_matmul_type, is_mpgemm, b_tile_major,
+        1, 0, 0, 0, 0);
+  } else if (is_mpgemm) {
+    if (transpose_A || transpose_B) {
+      printf("Not implemented: CPU mpgemm, a_transpose=%d, b_transpose=%d\n", transpose_A, transpose_B);
+      exit(1);
+    }
+
+    // dim_J and stride_B count packed bytes, four outputs each
+    mpgemm_cpu(dim_I, dim_J * 4, dim_K,
             A, B, (const acc_t*) D, (elem_t*)C,
             stride_A, stride_B, stride_D, stride_C,
-            A_scale_factor, B_scale_factor, D_scale_factor,
+            A_scale_factor, D_scale_factor,
+            act, scale, bert_scale, repeating_bias);
+  } else /*if (tiled_matmul_type == CPU)*/ {
+    matmul_cpu(transpose_A, transpose_B, dim_I, dim_J, dim_K,
+            A, B, (const acc_t*) D, NULL, (elem_t*)C,
+            stride_A, stride_B, stride_D, 0, stride_C,
+            A_scale_factor, B_scale_factor, D_scale_factor, MVIN_SCALE_IDENTITY,
             act, scale, bert_scale, repeating_bias);
   }
 }
@@ -1088,9 +1958,11 @@ static size_t tiled_matmul_total_acc_rows(size_t I, size_t J) {
   return (I * J) * DIM;
 }
 
-// This function is for GEMV
+// This function is for GEMV. A small batch of activation rows can be passed
+// through dim_I: rows ride together in DIM-row blocks, and each weight tile is
+// preloaded once and reused by every row block before moving on
 
-static void gemv_auto(size_t dim_I, size_t dim_J, size_t dim_K,
+static void gemv_auto_layout(size_t dim_I, size_t dim_J, size_t dim_K,
         const elem_t* A, const elem_t* B,
         const void * D, void * C,
         size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
@@ -1099,10 +1971,10 @@ static void gemv_auto(size_t dim_I, size_t dim_J, size_t dim_K,
         bool repeating_bias,
         bool transpose_A, bool transpose_B,
         bool full_C, bool low_D,
-        size_t a_spad_id, size_t b_spad_id, size_t c_spad_id){
+        size_t a_spad_id, size_t b_spad_id, size_t c_spad_id, bool b_tile_major){
 
-  if (dim_I != 1) {
-    printf("dim_I is too large. It shouldn't be bigger than DIM");
+  if (dim_I == 0) {
+    printf("dim_I must be at least 1\n");
     exit(1);
   }
   if (transpose_A == true){
@@ -1110,18 +1982,35 @@ static void gemv_auto(size_t dim_I, size_t dim_J, size_t dim_K,
     exit(1);
   }
 
+  const size_t I_PAD = (((dim_I + DIM - 1) / DIM) * DIM);
   const size_t J_PAD = (((dim_J + DIM - 1) / DIM) * DIM);
   const size_t K_PAD = (((dim_K + DIM - 1) / DIM) * DIM);
 
+  const size_t IB = I_PAD / DIM;
   const size_t JB = J_PAD / DIM;
   const size_t KB = K_PAD / DIM;
+
+  if (IB > 1) {
+    // Scratchpad outputs are summed in the bias buffer, which holds a single
+    // row block, so larger batches must go through the accumulator
+    if (c_spad_id != 0) {
+      printf("A batch of more than DIM rows can't be written to a scratchpad bank\n");
+      exit(1);
+    }
+    if (IB * JB * DIM > ACC_ROWS / 2) {
+      printf("The batch doesn't fit in the accumulator. Split it into smaller batches\n");
+      exit(1);
+    }
+  }
   
-  if (KB*DIM != stride_B) {
+  if (b_tile_major) {
+    stride_B = transpose_B ? KB : JB;
+  } else if (KB*DIM != stride_B) {
     printf("stide_B should be equal to KB * DIM ");
     exit(1);
   }
 
-  const size_t pad_I = 15;
+  const size_t pad_I = I_PAD - dim_I;
   const size_t pad_J = J_PAD - dim_J;
   const size_t pad_K = K_PAD - dim_K;
 
@@ -1158,39 +2047,158 @@ static void gemv_auto(size_t dim_I, size_t dim_J, size_t dim_K,
   gemmini_extended_config_ex(WS, act & 3, 0, 1, false, transpose_B);
   gemmini_extended_config_st(stride_C * sizeof_C, act & 3, scale);
   gemmini_extended3_config_ld(stride_A * sizeof(elem_t), A_scale_factor, false, 0);
-  gemmini_extended3_config_ld(stride_B * sizeof(elem_t), B_scale_factor, false, 1);
+  if (b_tile_major) {
+    gemmini_extended4_config_ld(TILE_MAJOR_BLOCKS * DIM * sizeof(elem_t), B_scale_factor, false, TILE_MAJOR_ROWS, 1);
+  } else {
+    gemmini_extended3_config_ld(stride_B * sizeof(elem_t), B_scale_factor, false, 1);
+  }
   gemmini_extended3_config_ld(repeating_bias ? 0 : (stride_D * sizeof_D), D_scale_factor, low_D, 2);
 
-  gemmini_gemv_loop_ws(1, JB, KB, pad_I, pad_J, pad_K, A, B, no_bias ? NULL : D, C,
+  gemmini_gemv_loop_ws(IB, JB, KB, pad_I, pad_J, pad_K, A, B, no_bias ? NULL : D, C,
     stride_A, stride_B, repeating_bias ? 0 : stride_D, stride_C,
-    false, transpose_B,
-    full_C, low_D, false,
+    false, transpose_B, b_tile_major,
+    full_C, low_D, !no_bias,
     act, a_spad_id, b_spad_id, c_spad_id ,false);
 }
 
-//This function is for mpgemm
-
-static void tiled_mpgemm_auto(size_t dim_I, size_t dim_J_out, size_t dim_K,
+static void gemv_auto(size_t dim_I, size_t dim_J, size_t dim_K,
         const elem_t* A, const elem_t* B,
         const void * D, void * C,
         size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
         scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
         int act, acc_scale_t scale, acc_scale_t bert_scale,
         bool repeating_bias,
-        bool full_C, bool low_D){
-
-  if(dim_J_out % 4 != 0 || stride_B % 4 != 0){
-    printf("dim_J, stride_B should be the multiples of 4");
-    exit(1);
-  }
-
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        size_t a_spad_id, size_t b_spad_id, size_t c_spad_id){
+  gemv_auto_layout(dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      a_spad_id, b_spad_id, c_spad_id, false);
+}
 
-    // "db_" means "double-buffered"
-#define db_partition_rows ((BANK_NUM * BANK_ROWS / 2) / 2)
-#define db_mats_in_partition (db_partition_rows / DIM)
-#define db_mats_in_acc ((ACC_ROWS / 2) / DIM)
-#define db_max_tile_i_j ((size_t)sqrt(db_mats_in_acc))
-#define db_max_tile_k (db_mats_in_partition / db_max_tile_i_j)
+// The same, with B reordered by tile_major_pack (B's transpose when
+// transpose_B is set) rather than the K-blocked rows gemv_auto expects
+static void gemv_tile_major_auto(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        size_t a_spad_id, size_t b_spad_id, size_t c_spad_id){
+  gemv_auto_layout(dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, 0, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      a_spad_id, b_spad_id, c_spad_id, true);
+}
+
+// Tuned tiling factors. The *_auto functions look their layer's shape up here
+// before falling back to their own heuristics, but only for WS, which is what
+// gemmini_autotune.h measures. The autotuner fills the table in at runtime and
+// can print it as a header; compile with
+// -DGEMMINI_TUNED_TILES='"tuned_tiles.h"' to start later runs from one.
+#define GEMMINI_TUNE_MATMUL 1
+#define GEMMINI_TUNE_MPGEMM 2
+#define GEMMINI_TUNE_CONV 3
+
+#define GEMMINI_TUNE_KEY_LEN 17
+#define GEMMINI_TUNE_TILES_LEN 7 // tile_I, tile_J, tile_K, or the 7 conv args
+
+#ifndef GEMMINI_TUNE_LUT_SIZE
+#define GEMMINI_TUNE_LUT_SIZE 128
+#endif
+
+struct gemmini_tuned_tiles_t {
+  int kind; // 0 for an empty entry
+  int key[GEMMINI_TUNE_KEY_LEN];
+  int tiles[GEMMINI_TUNE_TILES_LEN];
+};
+
+#ifdef GEMMINI_TUNED_TILES
+#include GEMMINI_TUNED_TILES
+#else
+#define GEMMINI_TUNED_TILE_ENTRIES {0}
+#endif
+
+static struct gemmini_tuned_tiles_t gemmini_tuned_tiles_lut[GEMMINI_TUNE_LUT_SIZE] = {
+  GEMMINI_TUNED_TILE_ENTRIES
+};
+
+static const int * gemmini_tuned_tiles(int kind, const int * key) {
+  for (size_t e = 0; e < GEMMINI_TUNE_LUT_SIZE && gemmini_tuned_tiles_lut[e].kind != 0; e++)
+    if (gemmini_tuned_tiles_lut[e].kind == kind &&
+        memcmp(gemmini_tuned_tiles_lut[e].key, key, sizeof(gemmini_tuned_tiles_lut[e].key)) == 0)
+      return gemmini_tuned_tiles_lut[e].tiles;
+
+  return NULL;
+}
+
+// Keys are zero-padded, so every shape fills all GEMMINI_TUNE_KEY_LEN ints
+#define GEMMINI_TUNE_MATMUL_KEY(dim_I, dim_J, dim_K, act, transpose_A, transpose_B, full_C, low_D) \
+  {(int)(dim_I), (int)(dim_J), (int)(dim_K), act, transpose_A, transpose_B, full_C, low_D}
+
+#define GEMMINI_TUNE_CONV_KEY(batch_size, in_row_dim, in_col_dim, in_channels, out_channels, out_row_dim, out_col_dim, stride, input_dilation, kernel_dilation, padding, kernel_dim, trans_weight_0132, trans_input_3120, pool_size, pool_stride, is_mpgemm) \
+  {batch_size, in_row_dim, in_col_dim, in_channels, out_channels, out_row_dim, out_col_dim, stride, input_dilation, kernel_dilation, padding, kernel_dim, trans_weight_0132, trans_input_3120, pool_size, pool_stride, is_mpgemm}
+
+// Scratchpad rows taken by one mpgemm tile. tile_J counts blocks of DIM packed
+// bytes, so a B tile takes as many rows as an int8 tile but holds 4x the
+// weights
+static size_t tiled_mpgemm_total_spad_rows(size_t I, size_t J, size_t K) {
+  return (I * K + K * J) * DIM;
+}
+
+// Accumulator rows taken by one mpgemm tile. Each packed column block expands
+// into four output blocks in the accumulator
+static size_t tiled_mpgemm_total_acc_rows(size_t I, size_t J) {
+  return (I * J * 4) * DIM;
+}
+
+// Bytes of A and packed B fetched from DRAM by a tiled mpgemm, with all
+// dimensions in DIM-sized blocks. A is refetched once per column tile and B
+// once per row tile; C and D move exactly once whatever the tiling
+static size_t tiled_mpgemm_dram_bytes(size_t I, size_t J, size_t K,
+        size_t tile_I, size_t tile_J) {
+  const size_t I0 = I / tile_I + (I % tile_I != 0);
+  const size_t J0 = J / tile_J + (J % tile_J != 0);
+
+  return (I * K * J0 + K * J * I0) * DIM * DIM * sizeof(elem_t);
+}
+
+//This function is for mpgemm
+
+static void tiled_mpgemm_auto_layout(size_t dim_I, size_t dim_J_out, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_B,
+        bool full_C, bool low_D,
+        enum tiled_matmul_type_t tiled_matmul_type, bool b_tile_major){
+
+  // B is packed as in ternary_pack.h: TERNARY_KJ, with stride_B counting
+  // outputs, or TERNARY_JK_DIM when transpose_B, with stride_B counting
+  // packed bytes per row
+  if(dim_J_out % 4 != 0 || (!transpose_B && !b_tile_major && stride_B % 4 != 0)){
+    printf("dim_J, stride_B should be the multiples of 4");
+    exit(1);
+  }
+  if(transpose_B && b_tile_major){
+    printf("Not implemented: tile-major B on an mpgemm with transpose_B");
+    exit(1);
+  }
+  if(transpose_B && dim_K % DIM != 0){
+    printf("dim_K should be a multiple of DIM when transpose_B is set");
+    exit(1);
+  }
 
     const size_t dim_J = dim_J_out / 4;
 
@@ -1198,52 +2206,68 @@ static void tiled_mpgemm_auto(size_t dim_I, size_t dim_J_out, size_t dim_K,
     const size_t dim_J_padded = (dim_J / DIM + (dim_J % DIM != 0)) * DIM;
     const size_t dim_K_padded = (dim_K / DIM + (dim_K % DIM != 0)) * DIM;
 
-    const size_t max_spad_rows = BANK_NUM * BANK_ROWS / 2;
-    const size_t max_acc_rows =  ACC_ROWS / 2;
-
-    size_t tile_I, tile_J, tile_K;
+    const size_t I_blocks = dim_I_padded / DIM;
+    const size_t J_blocks = dim_J_padded / DIM;
+    const size_t K_blocks = dim_K_padded / DIM;
 
-    if (act == LAYERNORM || act == SOFTMAX) {
-       tile_I = 1;
-       tile_J = dim_J_padded/DIM;
-       tile_K = 1;
-    } else  {
-       tile_I = dim_I_padded/DIM < 2 ? dim_I_padded/DIM : 2;
-       tile_J = dim_J_padded/DIM < 4 ? dim_J_padded/DIM : 4;
-       tile_K = dim_K_padded/DIM < db_max_tile_k ? dim_K_padded/DIM : db_max_tile_k;
-    }
-    // Fill scratchpad as much as possible
-    while (true) {
-      bool increased = false;
+    // LOOP_WS double-buffers both the scratchpad and the accumulator
+    const bool double_buffered = tiled_matmul_type == WS;
 
-      if (tiled_matmul_total_spad_rows(tile_I, tile_J+1, tile_K) <= max_spad_rows &&
-          tiled_matmul_total_acc_rows(tile_I, (tile_J+1)*4) <= max_acc_rows &&
-          (tile_J+1) * DIM <= dim_J_padded) {
-        tile_J++;
-        increased = true;
-      }
+    const size_t max_spad_rows = double_buffered ? BANK_NUM * BANK_ROWS / 2 :
+      BANK_NUM * BANK_ROWS;
+    const size_t max_acc_rows = double_buffered ? ACC_ROWS / 2 : ACC_ROWS;
 
-      if (tiled_matmul_total_spad_rows(tile_I+1, tile_J, tile_K) <= max_spad_rows &&
-          tiled_matmul_total_acc_rows(tile_I+1, tile_J*4) <= max_acc_rows &&
-          (tile_I+1) * DIM <= dim_I_padded) {
-        tile_I++;
-        increased = true;
+    // Layernorm and softmax need whole output rows in the accumulator
+    const bool full_rows = act == LAYERNORM || act == SOFTMAX;
+
+    size_t tile_I = 0, tile_J = 0, tile_K = 0;
+    size_t best_bytes = 0;
+
+    // The accumulator bounds tile_I * tile_J to a handful of blocks, so every
+    // candidate is tried. tile_K then takes all the scratchpad left over, and
+    // the tiling that fetches the fewest bytes of A and B wins
+    for (size_t ti = 1; ti <= I_blocks; ti++) {
+      for (size_t tj = full_rows ? J_blocks : 1; tj <= J_blocks; tj++) {
+        if (tiled_mpgemm_total_acc_rows(ti, tj) > max_acc_rows)
+          break;
+
+        size_t tk = max_spad_rows / tiled_mpgemm_total_spad_rows(ti, tj, 1);
+        if (tk == 0)
+          break;
+        if (tk > K_blocks)
+          tk = K_blocks;
+
+        const size_t bytes = tiled_mpgemm_dram_bytes(I_blocks, J_blocks, K_blocks, ti, tj);
+
+        // On ties, fewer and larger LOOP_WS invocations are cheaper to issue
+        if (tile_I == 0 || bytes < best_bytes ||
+            (bytes == best_bytes && ti * tj * tk > tile_I * tile_J * tile_K)) {
+          tile_I = ti;
+          tile_J = tj;
+          tile_K = tk;
+          best_bytes = bytes;
+        }
       }
+    }
 
-      if (tiled_matmul_total_spad_rows(tile_I, tile_J, tile_K+1) <= max_spad_rows &&
-          (tile_K+1) * DIM <= dim_K_padded) {
-        tile_K++;
-        increased = true;
-      }
+    if (tile_I == 0) {
+      printf("The full J dimension of the matrix must fit in the accumulator for layernorm or softmax\n");
+      exit(1);
+    }
 
-      if (!increased)
-        break;
+    const int tune_key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_MATMUL_KEY(dim_I, dim_J_out, dim_K,
+        act, false, transpose_B, full_C, low_D);
+    const int * tuned = gemmini_tuned_tiles(GEMMINI_TUNE_MPGEMM, tune_key);
+    if (tuned != NULL && tiled_matmul_type == WS) {
+      tile_I = tuned[0];
+      tile_J = tuned[1];
+      tile_K = tuned[2];
     }
 
 #ifdef PRINT_TILE
 #if PRINT_TILE
-    const int spad_rows = tiled_matmul_total_spad_rows(tile_I, tile_J, tile_K);
-    const int acc_rows = tiled_matmul_total_acc_rows(tile_I, tile_J);
+    const int spad_rows = tiled_mpgemm_total_spad_rows(tile_I, tile_J, tile_K);
+    const int acc_rows = tiled_mpgemm_total_acc_rows(tile_I, tile_J);
 
     printf("tile_I: %d\n", tile_I);
     printf("tile_J: %d\n", tile_J);
@@ -1261,27 +2285,90 @@ static void tiled_mpgemm_auto(size_t dim_I, size_t dim_J_out, size_t dim_K,
 
     tiled_matmul(dim_I, dim_J, dim_K,
         A, B, D, C,
-        stride_A, stride_B/4, stride_D, stride_C,
+        stride_A, transpose_B ? stride_B : stride_B/4, stride_D, stride_C,
         A_scale_factor, B_scale_factor, D_scale_factor,
         act, scale, bert_scale, repeating_bias,
         tile_I, tile_J, tile_K,
-        false, false,
+        false, transpose_B,
         full_C, low_D,
         0,
-        WS, true);
+        tiled_matmul_type, true, b_tile_major);
+}
 
-#undef partition_rows
-#undef mats_in_partition
-#undef mats_in_acc
-#undef max_tile_i_j
-#undef max_tile_k
+static void tiled_mpgemm_auto(size_t dim_I, size_t dim_J_out, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_B,
+        bool full_C, bool low_D,
+        enum tiled_matmul_type_t tiled_matmul_type){
+  tiled_mpgemm_auto_layout(dim_I, dim_J_out, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_B, full_C, low_D,
+      tiled_matmul_type, false);
+}
+
+// The same, with B packed as TERNARY_KJ and then reordered by
+// tile_major_pack as a K x dim_J_out/4 matrix of bytes. Only WS is supported
+static void tiled_mpgemm_tile_major_auto(size_t dim_I, size_t dim_J_out, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool full_C, bool low_D,
+        enum tiled_matmul_type_t tiled_matmul_type){
+  tiled_mpgemm_auto_layout(dim_I, dim_J_out, dim_K, A, B, D, C,
+      stride_A, 0, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      false, full_C, low_D,
+      tiled_matmul_type, true);
+}
+
+// GEMV with packed ternary weights, laid out as for tiled_mpgemm_auto. The
+// GEMV loop can't expand packed weights (GemvLoopMatmul has no mpgemm mode),
+// so this runs on LOOP_WS with is_mpgemm set instead. For a batch of at most
+// DIM rows, every tiling keeps the whole batch in one row block, so each
+// weight tile is still moved in only once. As with tiled_mpgemm_auto on the
+// accelerator, the bias preload doesn't cover the widened outputs, so D must
+// be NULL
+static void gemv_mpgemm_auto(size_t dim_I, size_t dim_J_out, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_B,
+        bool full_C, bool low_D) {
+  if (dim_I == 0) {
+    printf("dim_I must be at least 1\n");
+    exit(1);
+  }
+  if (D != NULL) {
+    printf("Not implemented: a bias on a ternary GEMV\n");
+    exit(1);
+  }
 
+  tiled_mpgemm_auto_layout(dim_I, dim_J_out, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_B, full_C, low_D,
+      WS, false);
 }
 
 // This function runs a tiled matrix multiplication, with automatically
 // calculated tiling factors
 
-static void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
+static void tiled_matmul_auto_layout(size_t dim_I, size_t dim_J, size_t dim_K,
         const elem_t* A, const elem_t* B,
         const void * D, void * C,
         size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
@@ -1291,7 +2378,7 @@ static void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
         bool transpose_A, bool transpose_B,
         bool full_C, bool low_D,
         uint8_t weightA,
-        enum tiled_matmul_type_t tiled_matmul_type) {
+        enum tiled_matmul_type_t tiled_matmul_type, bool b_tile_major) {
 
 #define partition_rows (BANK_NUM * BANK_ROWS / 2)
 #define mats_in_partition (partition_rows / DIM)
@@ -1360,6 +2447,15 @@ static void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
         break;
     }
 
+    const int tune_key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_MATMUL_KEY(dim_I, dim_J, dim_K,
+        act, transpose_A, transpose_B, full_C, low_D);
+    const int * tuned = gemmini_tuned_tiles(GEMMINI_TUNE_MATMUL, tune_key);
+    if (tuned != NULL && tiled_matmul_type == WS) {
+      tile_I = tuned[0];
+      tile_J = tuned[1];
+      tile_K = tuned[2];
+    }
+
 #ifdef PRINT_TILE
 #if PRINT_TILE
     const int spad_rows = tiled_matmul_total_spad_rows(tile_I, tile_J, tile_K);
@@ -1388,7 +2484,7 @@ static void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
         transpose_A, transpose_B,
         full_C, low_D,
         weightA,
-        tiled_matmul_type, false);
+        tiled_matmul_type, false, b_tile_major);
 
 #undef partition_rows
 #undef mats_in_partition
@@ -1397,6 +2493,138 @@ static void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
 #undef max_tile_k
 }
 
+static void tiled_matmul_auto(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto_layout(dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      weightA, tiled_matmul_type, false);
+}
+
+// The same, with B reordered by tile_major_pack (B's transpose, a
+// dim_J x dim_K matrix, when transpose_B is set). Only WS is supported
+static void tiled_matmul_tile_major_auto(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  tiled_matmul_auto_layout(dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, 0, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      weightA, tiled_matmul_type, true);
+}
+
+// Runs the same matmul over several heads, where head h reads and writes the
+// matrices at A + h*head_stride_A, B + h*head_stride_B, and so on (strides are
+// in elements, like the row strides). On WS, all heads share one LOOP_WS per
+// tile, so multi-head attention issues a single command sequence instead of
+// one tiled_matmul_auto per head. That needs each head's full K dimension to
+// fit in the scratchpad alongside at least one DIM x DIM tile of the output;
+// larger heads run one tiled_matmul_auto each
+static void tiled_matmul_heads_auto(size_t heads,
+        size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        size_t head_stride_A, size_t head_stride_B, size_t head_stride_D, size_t head_stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+
+  const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+  const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+
+  const size_t dim_I_padded = (dim_I / DIM + (dim_I % DIM != 0)) * DIM;
+  const size_t dim_J_padded = (dim_J / DIM + (dim_J % DIM != 0)) * DIM;
+  const size_t dim_K_padded = (dim_K / DIM + (dim_K % DIM != 0)) * DIM;
+
+  const size_t max_spad_rows = BANK_NUM * BANK_ROWS / 2;
+  const size_t max_acc_rows = ACC_ROWS / 2;
+
+  const size_t tile_K = dim_K_padded/DIM;
+  size_t tile_I = 1;
+  size_t tile_J = act == LAYERNORM || act == SOFTMAX ? dim_J_padded/DIM : 1;
+
+  // Heads whose full K doesn't fit alongside one tile of C (or one row of
+  // tiles, when it's normalized) are tiled one at a time instead
+  const bool fits = tiled_matmul_total_spad_rows(tile_I, tile_J, tile_K) <= max_spad_rows &&
+    tiled_matmul_total_acc_rows(tile_I, tile_J) <= max_acc_rows;
+
+  if (tiled_matmul_type != WS || heads <= 1 || !fits) {
+    for (size_t h = 0; h < heads; h++) {
+      tiled_matmul_auto(dim_I, dim_J, dim_K,
+          A + h * head_stride_A, B + h * head_stride_B,
+          D == NULL ? NULL : (int8_t*)D + h * head_stride_D * sizeof_D,
+          (int8_t*)C + h * head_stride_C * sizeof_C,
+          stride_A, stride_B, stride_D, stride_C,
+          A_scale_factor, B_scale_factor, D_scale_factor,
+          act, scale, bert_scale, repeating_bias,
+          transpose_A, transpose_B,
+          full_C, low_D,
+          weightA,
+          tiled_matmul_type);
+    }
+    return;
+  }
+
+  // Fill scratchpad as much as possible
+  while (true) {
+    bool increased = false;
+
+    if (tiled_matmul_total_spad_rows(tile_I, tile_J+1, tile_K) <= max_spad_rows &&
+        tiled_matmul_total_acc_rows(tile_I, tile_J+1) <= max_acc_rows &&
+        (tile_J+1) * DIM <= dim_J_padded) {
+      tile_J++;
+      increased = true;
+    }
+
+    if (tiled_matmul_total_spad_rows(tile_I+1, tile_J, tile_K) <= max_spad_rows &&
+        tiled_matmul_total_acc_rows(tile_I+1, tile_J) <= max_acc_rows &&
+        (tile_I+1) * DIM <= dim_I_padded) {
+      tile_I++;
+      increased = true;
+    }
+
+    if (!increased)
+      break;
+  }
+
+  tiled_matmul_outer(dim_I, dim_J, dim_K,
+      A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      tile_I, tile_J, tile_K,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B,
+      full_C, low_D,
+      weightA,
+      WEIGHT_STATIONARY, false, false,
+      heads, head_stride_A, head_stride_B, head_stride_D, head_stride_C);
+}
+
 static void sp_tiled_conv(
         int batch_size, int in_row_dim, int in_col_dim, int in_channels,
         int out_channels, int out_row_dim, int out_col_dim,
@@ -1425,7 +2653,7 @@ static void sp_tiled_conv(
         bool trans_weight_1203, bool trans_weight_0132,
 
         bool no_bias, bool no_pool, bool downsample, bool input_dilated,
-        bool dw, int a_spad_id, int b_spad_id) {
+        bool dw, int a_spad_id, int b_spad_id, bool is_mpgemm) {
 
   // When dw convs are true, we assume that kchs and ochs are 1
   if (dw) { kchs = 1; pochs = 1; }
@@ -1468,12 +2696,15 @@ static void sp_tiled_conv(
   // Calculate spad address offsets
   const int out_channels_per_bank = ochs / DIM + (ochs % DIM != 0);
   const int in_channels_per_bank = kchs / DIM + (kchs % DIM != 0);
+  // Packed ternary weights hold four output channels per byte
+  const int wochs = is_mpgemm ? ochs / 4 : ochs;
+  const int weight_channels_per_bank = wochs / DIM + (wochs % DIM != 0);
   const int B_rows = trans_weight_0132 ?
     in_channels_per_bank * kcols * krows * ochs :
-    out_channels_per_bank * kcols * krows * kchs;
+    weight_channels_per_bank * kcols * krows * kchs;
 
-  static uint32_t D_sp_addr_row = 0;
-  static uint32_t C_sp_addr_row = 0;
+  static GEMMINI_THREAD_LOCAL uint32_t D_sp_addr_row = 0;
+  static GEMMINI_THREAD_LOCAL uint32_t C_sp_addr_row = 0;
 
   const uint32_t A_sp_addr_start = 0;
   const uint32_t B_sp_addr_start = BANK_NUM * BANK_ROWS - B_rows;
@@ -1488,7 +2719,7 @@ static void sp_tiled_conv(
     C_sp_addr_row = (C_sp_addr_row + ACC_ROWS / 2) % ACC_ROWS;
   }
 
-  gemmini_loop_conv_ws(batch_size, in_row_dim, in_col_dim, in_channels, out_channels, out_row_dim, out_col_dim, pool_out_row_dim, pool_out_col_dim, stride, padding, kernel_dim, kernel_dilation, pool_size, pool_stride, pool_padding, batches, porows, pocols, pochs, krows, kcols, kchs, lpad, rpad, upad, dpad, plpad, prpad, pupad, pdpad, orows, ocols, weights, output, bias, input, no_bias, no_pool, downsample, wrot180, input_dilated, act, trans_output_1203, trans_weight_1203, trans_weight_0132, trans_input_3120, max_pixels_per_row, in_stride, weight_stride, out_stride, dw, a_spad_id, b_spad_id);
+  gemmini_loop_conv_ws(batch_size, in_row_dim, in_col_dim, in_channels, out_channels, out_row_dim, out_col_dim, pool_out_row_dim, pool_out_col_dim, stride, padding, kernel_dim, kernel_dilation, pool_size, pool_stride, pool_padding, batches, porows, pocols, pochs, krows, kcols, kchs, lpad, rpad, upad, dpad, plpad, prpad, pupad, pdpad, orows, ocols, weights, output, bias, input, no_bias, no_pool, downsample, wrot180, input_dilated, act, trans_output_1203, trans_weight_1203, trans_weight_0132, trans_input_3120, max_pixels_per_row, in_stride, weight_stride, out_stride, dw, a_spad_id, b_spad_id, is_mpgemm);
 
 /*
   if (!no_pool) {
@@ -1850,7 +3081,7 @@ static int tiled_conv_total_spad_rows(bool acc,
         int batches,
         int porows, int pocols, int ochs,
         int krows, int kcols, int kchs,
-        int pool_size, int pool_stride) {
+        int pool_size, int pool_stride, bool is_mpgemm) {
 
     const int orows = porows * pool_stride + pool_size - 1;
     const int ocols = pocols * pool_stride + pool_size - 1;
@@ -1873,93 +3104,22 @@ static int tiled_conv_total_spad_rows(bool acc,
         (batches_per_bank * ichs * (irows >> downsample) * (icols >> downsample)) :
         (in_channels_per_bank * batches * (irows >> downsample) * (icols >> downsample));
 
+    // With mpgemm, weights are packed four output channels per byte, and each
+    // group of DIM output pixels gets its own DIM accumulator rows per channel block
+    const int wochs = is_mpgemm ? ochs / 4 : ochs;
+    const int weight_channels_per_bank = wochs / DIM + (wochs % DIM != 0);
+    const int ocols_padded = is_mpgemm ? (ocols / DIM + (ocols % DIM != 0)) * DIM : ocols;
+
     const int B_rows = trans_weight_0132 ?
       in_channels_per_bank * kcols * krows * ochs :
-      out_channels_per_bank * kcols * krows * kchs;
+      weight_channels_per_bank * kcols * krows * kchs;
 
-    const int C_rows = out_channels_per_bank * batches * orows * ocols;
+    const int C_rows = out_channels_per_bank * batches * orows * ocols_padded;
 
     return acc ? C_rows : A_rows + B_rows;
 }
 
 
-static void conv_cpu_without_pool(
-        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
-        int out_channels, int out_row_dim, int out_col_dim,
-        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
-        int in_stride, int weight_stride, int out_stride,
-        bool wrot180, bool trans_output_1203, bool trans_input_3120,
-        bool trans_weight_1203, bool trans_weight_0132,
-
-        const elem_t * input,
-        const elem_t * weights,
-        const acc_t * bias,
-        elem_t * output,
-
-        int act, acc_scale_t scale) {
-
-  bool no_bias = bias == NULL;
-
-  for (int b = 0; b < batch_size; b++) {
-    for (int orow = 0; orow < out_row_dim; orow++) {
-      for (int ocol = 0; ocol < out_col_dim; ocol++) {
-        for (int och = 0; och < out_channels; och++) {
-
-          acc_t opixel = no_bias ? 0 : bias[och];
-
-          for (int krow = 0; krow < kernel_dim; krow++) {
-            if ((orow * stride + krow * kernel_dilation - padding) % input_dilation != 0)
-              continue;
-
-            const int irow = (orow * stride + krow * kernel_dilation - padding) / input_dilation;
-
-            for (int kcol = 0; kcol < kernel_dim; kcol++) {
-              if ((ocol * stride + kcol * kernel_dilation - padding) % input_dilation != 0)
-                continue;
-
-              const int icol = (ocol * stride + kcol * kernel_dilation - padding) / input_dilation;
-
-              for (int kch = 0; kch < in_channels; kch++) {
-                const elem_t *in = input + (b * in_row_dim * in_col_dim + irow * in_col_dim + icol) * in_stride + kch;
-                if (trans_input_3120) {
-                  // NHWC to CHWN
-                  in = input + (kch * in_row_dim * in_col_dim + irow * in_col_dim + icol) * batch_size + b;
-                }
-
-                elem_t ipixel = irow < 0 || irow >= in_row_dim || icol < 0 || icol >= in_col_dim ?
-                    0 : *in;
-
-                const int krow_ = wrot180 ? kernel_dim - krow - 1 : krow;
-                const int kcol_ = wrot180 ? kernel_dim - kcol - 1 : kcol;
-
-                elem_t weight = *(weights + (krow_ * kernel_dim * in_channels + kcol_ * in_channels + kch) * weight_stride + och);
-                if (trans_weight_1203) {
-                  // HWIO to WIHO
-                  weight = *(weights + (kch * kernel_dim * kernel_dim  + krow_ * kernel_dim + kcol_) * out_channels + och);
-                } else if (trans_weight_0132) {
-                  // HWIO to HWOI
-                  weight = *(weights + (krow_ * kernel_dim * out_channels + kcol_ * out_channels + och) * in_channels + kch);
-                }
-
-                opixel += weight * ipixel;
-              }
-            }
-          }
-
-          elem_t *out = output + (b * out_row_dim * out_col_dim + orow * out_col_dim + ocol) * out_stride + och;
-          if (trans_output_1203) {
-            // NHWC to HWNC
-            out = output + (orow * out_col_dim * batch_size + ocol * batch_size + b) * out_channels + och;
-          }
-
-          *out = scale_and_sat(opixel, act, scale, 0);
-        }
-      }
-    }
-  }
-}
-
-
 static void conv_dw_cpu_without_pool(
         int batch_size, int in_row_dim, int in_col_dim,
         int channels, int out_row_dim, int out_col_dim,
@@ -1970,14 +3130,15 @@ static void conv_dw_cpu_without_pool(
         const acc_t * bias,
         elem_t * output,
 
-        int act, acc_scale_t scale) {
+        int act, acc_scale_t scale,
+        int ch_start, int ch_end) {
 
   bool no_bias = bias == NULL;
 
   for (int b = 0; b < batch_size; b++) {
     for (int orow = 0; orow < out_row_dim; orow++) {
       for (int ocol = 0; ocol < out_col_dim; ocol++) {
-        for (int ch = 0; ch < channels; ch++) {
+        for (int ch = ch_start; ch < ch_end; ch++) {
           acc_t opixel = no_bias ? 0 : bias[ch];
 
           for (int krow = 0; krow < kernel_dim; krow++) {
@@ -2007,7 +3168,68 @@ static void conv_dw_cpu_without_pool(
 }
 
 
-static void conv_cpu(
+// conv_cpu works through blocks of CONV_CPU_PIXELS output pixels and
+// CONV_CPU_OCHS output channels. For each kernel position, it gathers the
+// input pixels under that block, CONV_CPU_KCHS input channels at a time, into
+// a small im2col patch, and multiplies the patch with the matching rows of the
+// weights. Ternary blocks reuse mpgemm_cpu_block, so they must tile into its
+// blocks
+#define CONV_CPU_PIXELS 16
+#define CONV_CPU_KCHS 64
+#define CONV_CPU_OCHS 64
+
+// Adds patch[0:pixels][0:kchs] times W[0:kchs][0:ochs] to acc
+static void conv_cpu_block(size_t pixels, size_t ochs, size_t kchs,
+        elem_t patch[CONV_CPU_PIXELS][CONV_CPU_KCHS],
+        const elem_t * W, size_t stride_W,
+        acc_t acc[CONV_CPU_PIXELS][CONV_CPU_OCHS]) {
+  for (size_t p = 0; p < pixels; p++) {
+    acc_t row[CONV_CPU_OCHS];
+    for (size_t o = 0; o < ochs; o++)
+      row[o] = acc[p][o];
+
+    for (size_t c = 0; c < kchs; c++) {
+      const acc_t a = patch[p][c];
+      const elem_t * w = W + c * stride_W;
+      for (size_t o = 0; o < ochs; o++)
+        row[o] += a * w[o];
+    }
+
+    for (size_t o = 0; o < ochs; o++)
+      acc[p][o] = row[o];
+  }
+}
+
+// Same as conv_cpu_block, but W holds packed ternary weights. och0 % 4 == 0
+static void conv_cpu_mpgemm_block(size_t pixels, size_t ochs, size_t kchs,
+        elem_t patch[CONV_CPU_PIXELS][CONV_CPU_KCHS],
+        const elem_t * W, size_t stride_W,
+        acc_t acc[CONV_CPU_PIXELS][CONV_CPU_OCHS]) {
+  for (size_t p = 0; p < pixels; p += MPGEMM_CPU_ROWS) {
+    const size_t rows = pixels - p < MPGEMM_CPU_ROWS ? pixels - p : MPGEMM_CPU_ROWS;
+
+    for (size_t o = 0; o < ochs; o += MPGEMM_CPU_COLS) {
+      const size_t cols = ochs - o < MPGEMM_CPU_COLS ? ochs - o : MPGEMM_CPU_COLS;
+
+      acc_t block[MPGEMM_CPU_ROWS][MPGEMM_CPU_COLS];
+      for (size_t r = 0; r < MPGEMM_CPU_ROWS; r++)
+        for (size_t j = 0; j < MPGEMM_CPU_COLS; j++)
+          block[r][j] = r < rows && j < cols ? acc[p + r][o + j] : 0;
+
+      mpgemm_cpu_block(rows, cols, kchs, patch[p], W + o / 4,
+          CONV_CPU_KCHS, stride_W, MVIN_SCALE_IDENTITY, block);
+
+      for (size_t r = 0; r < rows; r++)
+        for (size_t j = 0; j < cols; j++)
+          acc[p + r][o + j] = block[r][j];
+    }
+  }
+}
+
+// CPU version of tiled_conv, for the output channels in [och_start, och_end).
+// Pooling is fused: each output pixel is maxed into every pooling window that
+// covers it, so none is computed twice
+static void conv_cpu_serial(
         int batch_size, int in_row_dim, int in_col_dim, int in_channels,
         int out_channels, int out_row_dim, int out_col_dim,
         int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
@@ -2021,105 +3243,188 @@ static void conv_cpu(
         elem_t * output,
 
         int act, acc_scale_t scale,
-        int pool_size, int pool_stride, int pool_padding) {
+        int pool_size, int pool_stride, int pool_padding,
+        bool is_mpgemm,
+        int och_start, int och_end) {
 
+  const bool no_bias = bias == NULL;
   const bool no_pool = pool_stride == 0;
-  if (no_pool) {
-    conv_cpu_without_pool(
-        batch_size, in_row_dim, in_col_dim, in_channels,
-        out_channels, out_row_dim, out_col_dim,
-        stride, input_dilation, kernel_dilation, padding, kernel_dim,
-        in_stride, weight_stride, out_stride,
-        wrot180, trans_output_1203, trans_input_3120,
-        trans_weight_1203, trans_weight_0132,
-        input, weights, bias, output,
-        act, scale);
-    return;
-  }
+  const int pool_out_row_dim = no_pool ? out_row_dim : (out_row_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+  const int pool_out_col_dim = no_pool ? out_col_dim : (out_col_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
 
-  const bool no_bias = bias == NULL;
-  const int pool_out_row_dim = (out_row_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
-  const int pool_out_col_dim = (out_col_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+  // Pooling windows that hang over the edge of the output see zeros there
+  if (!no_pool) {
+    for (int b = 0; b < batch_size; b++) {
+      for (int porow = 0; porow < pool_out_row_dim; porow++) {
+        for (int pocol = 0; pocol < pool_out_col_dim; pocol++) {
+          const int orow = porow * pool_stride - pool_padding;
+          const int ocol = pocol * pool_stride - pool_padding;
+          const bool padded = orow < 0 || orow + pool_size > out_row_dim ||
+            ocol < 0 || ocol + pool_size > out_col_dim;
+
+          elem_t * out = output + (b * pool_out_row_dim * pool_out_col_dim + porow * pool_out_col_dim + pocol) * out_stride;
+          if (trans_output_1203) {
+            // NHWC to HWNC
+            out = output + (porow * pool_out_col_dim * batch_size + pocol * batch_size + b) * out_channels;
+          }
 
-  for (int b = 0; b < batch_size; b++) {
-    for (int porow = 0; porow < pool_out_row_dim; porow++) {
-      for (int pocol = 0; pocol < pool_out_col_dim; pocol++) {
-        for (int poch = 0; poch < out_channels; poch++) {
+          for (int och = och_start; och < och_end; och++)
+            out[och] = padded ? 0 : elem_t_min;
+        }
+      }
+    }
+  }
 
-          elem_t running_max = 0;
-          bool running_max_initialized = false;
+  // Weights that aren't laid out with their output channels in rows of
+  // packed bytes or elements are copied into that layout first
+  const bool weights_in_rows = !trans_weight_0132 && !(is_mpgemm && trans_weight_1203);
 
-          for (int pwrow = 0; pwrow < pool_size; pwrow++) {
-            const int orow = porow * pool_stride + pwrow - pool_padding;
+  // NHWC or, when transposed, CHWN
+  const int in_pixel_stride = trans_input_3120 ? batch_size : in_stride;
+  const int in_channel_stride = trans_input_3120 ? in_row_dim * in_col_dim * batch_size : 1;
 
-            for (int pwcol = 0; pwcol < pool_size; pwcol++) {
-              const int ocol = pocol * pool_stride + pwcol - pool_padding;
+  static GEMMINI_THREAD_LOCAL elem_t patch[CONV_CPU_PIXELS][CONV_CPU_KCHS];
+  static GEMMINI_THREAD_LOCAL elem_t panel[CONV_CPU_KCHS][CONV_CPU_OCHS];
+  static GEMMINI_THREAD_LOCAL acc_t acc[CONV_CPU_PIXELS][CONV_CPU_OCHS];
 
-              if (orow < 0 || orow >= out_row_dim || ocol < 0 || ocol >= out_col_dim) {
-                if (!running_max_initialized || running_max < 0) {
-                  running_max = 0;
-                  running_max_initialized = true;
-                }
-              } else {
+  const int pixels = batch_size * out_row_dim * out_col_dim;
 
-                acc_t opixel = no_bias ? 0 : bias[poch];
+  for (int p_start = 0; p_start < pixels; p_start += CONV_CPU_PIXELS) {
+    const int block_pixels = pixels - p_start < CONV_CPU_PIXELS ? pixels - p_start : CONV_CPU_PIXELS;
 
-                for (int krow = 0; krow < kernel_dim; krow++) {
-                  if ((orow * stride + krow * kernel_dilation - padding) % input_dilation != 0)
-                    continue;
+    int pixel_b[CONV_CPU_PIXELS], pixel_row[CONV_CPU_PIXELS], pixel_col[CONV_CPU_PIXELS];
+    for (int p = 0; p < block_pixels; p++) {
+      pixel_b[p] = (p_start + p) / (out_row_dim * out_col_dim);
+      pixel_row[p] = (p_start + p) / out_col_dim % out_row_dim;
+      pixel_col[p] = (p_start + p) % out_col_dim;
+    }
 
-                  const int irow = (orow * stride + krow * kernel_dilation - padding) / input_dilation;
+    for (int och_block = och_start; och_block < och_end; och_block += CONV_CPU_OCHS) {
+      const int ochs = och_end - och_block < CONV_CPU_OCHS ? och_end - och_block : CONV_CPU_OCHS;
+
+      for (int p = 0; p < block_pixels; p++)
+        for (int o = 0; o < ochs; o++)
+          acc[p][o] = no_bias ? 0 : bias[och_block + o];
+
+      for (int krow = 0; krow < kernel_dim; krow++) {
+        for (int kcol = 0; kcol < kernel_dim; kcol++) {
+          // The input pixel under this kernel position, or NULL for padding
+          const elem_t * in[CONV_CPU_PIXELS];
+          bool any_in = false;
+
+          for (int p = 0; p < block_pixels; p++) {
+            const int irow_dilated = pixel_row[p] * stride + krow * kernel_dilation - padding;
+            const int icol_dilated = pixel_col[p] * stride + kcol * kernel_dilation - padding;
+            const int irow = irow_dilated / input_dilation;
+            const int icol = icol_dilated / input_dilation;
+
+            in[p] = NULL;
+            if (irow_dilated % input_dilation == 0 && icol_dilated % input_dilation == 0 &&
+                irow >= 0 && irow < in_row_dim && icol >= 0 && icol < in_col_dim) {
+              const int b = pixel_b[p];
+              in[p] = trans_input_3120 ?
+                input + (irow * in_col_dim + icol) * in_pixel_stride + b :
+                input + (b * in_row_dim * in_col_dim + irow * in_col_dim + icol) * in_pixel_stride;
+              any_in = true;
+            }
+          }
 
-                  for (int kcol = 0; kcol < kernel_dim; kcol++) {
-                    if ((ocol * stride + kcol * kernel_dilation - padding) % input_dilation != 0)
-                      continue;
-
-                    const int icol = (ocol * stride + kcol * kernel_dilation - padding) / input_dilation;
-
-                    for (int kch = 0; kch < in_channels; kch++) {
-                      const elem_t * in = input + (b * in_row_dim * in_col_dim + irow * in_col_dim + icol) * in_stride + kch;
-                      if (trans_input_3120) {
-                        // NHWC to CHWN
-                        in = input + (kch * in_row_dim * in_col_dim + irow * in_col_dim + icol) * batch_size + b;
-                      }
-
-                      elem_t ipixel = irow < 0 || irow >= in_row_dim || icol < 0 || icol >= in_col_dim ?
-                          0 : *in;
-
-                      const int krow_ = wrot180 ? kernel_dim - krow - 1 : krow;
-                      const int kcol_ = wrot180 ? kernel_dim - kcol - 1 : kcol;
-
-                      elem_t weight = *(weights + (krow_ * kernel_dim * in_channels + kcol_ * in_channels + kch) * weight_stride + poch);
-                      if (trans_weight_1203) {
-                        // HWIO to WIHO
-                        weight = *(weights + (kch * kernel_dim * kernel_dim  + krow_ * kernel_dim + kcol_) * out_channels + poch);
-                      } else if (trans_weight_0132) {
-                        // HWIO to HWOI
-                        weight = *(weights + (krow_ * kernel_dim * out_channels + kcol_ * out_channels + poch) * in_channels + kch);
-                      }
-
-                      opixel += weight * ipixel;
-                    }
-                  }
-                }
+          if (!any_in)
+            continue;
 
-                opixel = scale_and_sat(opixel, act, scale, 0);
-                if (!running_max_initialized || opixel > running_max) {
-                  running_max = opixel;
-                  running_max_initialized = true;
+          const int krow_ = wrot180 ? kernel_dim - krow - 1 : krow;
+          const int kcol_ = wrot180 ? kernel_dim - kcol - 1 : kcol;
+
+          for (int kch_block = 0; kch_block < in_channels; kch_block += CONV_CPU_KCHS) {
+            const int kchs = in_channels - kch_block < CONV_CPU_KCHS ? in_channels - kch_block : CONV_CPU_KCHS;
+
+            for (int p = 0; p < block_pixels; p++)
+              for (int c = 0; c < kchs; c++)
+                patch[p][c] = in[p] == NULL ? 0 : in[p][(kch_block + c) * in_channel_stride];
+
+            const elem_t * W;
+            size_t stride_W;
+            if (weights_in_rows && trans_weight_1203) {
+              // HWIO to WIHO
+              W = weights + (kch_block * kernel_dim * kernel_dim + krow_ * kernel_dim + kcol_) * out_channels + och_block;
+              stride_W = kernel_dim * kernel_dim * out_channels;
+            } else if (weights_in_rows) {
+              // With mpgemm, each weight byte packs four consecutive output channels
+              W = weights + (krow_ * kernel_dim * in_channels + kcol_ * in_channels + kch_block) * weight_stride +
+                (is_mpgemm ? och_block / 4 : och_block);
+              stride_W = weight_stride;
+            } else {
+              for (int c = 0; c < kchs; c++) {
+                const int kch = kch_block + c;
+                if (is_mpgemm)
+                  memset(panel[c], 0, (ochs + 3) / 4);
+
+                for (int o = 0; o < ochs; o++) {
+                  const int och = och_block + o;
+                  const elem_t weight = trans_weight_1203 ?
+                    // HWIO to WIHO
+                    weights[(kch * kernel_dim * kernel_dim + krow_ * kernel_dim + kcol_) * out_channels + och] :
+                    // HWIO to HWOI
+                    weights[(krow_ * kernel_dim * out_channels + kcol_ * out_channels + och) * in_channels + kch];
+
+                  if (is_mpgemm)
+                    panel[c][o / 4] |= TERNARY_CODE(weight, och % 4) << (2 * (o % 4));
+                  else
+                    panel[c][o] = weight;
                 }
               }
 
-              if (pwrow == pool_size - 1 && pwcol == pool_size - 1) {
-                elem_t * out = output + (b * pool_out_row_dim * pool_out_col_dim + porow * pool_out_col_dim + pocol) * out_stride + poch;
-                if (trans_output_1203) {
-                  // NHWC to HWNC
-                  out = output + (porow * pool_out_col_dim * batch_size + pocol * batch_size + b) * out_channels + poch;
-                }
+              W = panel[0];
+              stride_W = CONV_CPU_OCHS;
+            }
 
-                *out = running_max;
-              }
+            if (is_mpgemm)
+              conv_cpu_mpgemm_block(block_pixels, ochs, kchs, patch, W, stride_W, acc);
+            else
+              conv_cpu_block(block_pixels, ochs, kchs, patch, W, stride_W, acc);
+          }
+        }
+      }
+
+      for (int p = 0; p < block_pixels; p++) {
+        const int b = pixel_b[p], orow = pixel_row[p], ocol = pixel_col[p];
+
+        elem_t opixels[CONV_CPU_OCHS];
+        for (int o = 0; o < ochs; o++)
+          opixels[o] = scale_and_sat(acc[p][o], act, scale, 0);
+
+        if (no_pool) {
+          elem_t * out = output + (b * out_row_dim * out_col_dim + orow * out_col_dim + ocol) * out_stride + och_block;
+          if (trans_output_1203) {
+            // NHWC to HWNC
+            out = output + (orow * out_col_dim * batch_size + ocol * batch_size + b) * out_channels + och_block;
+          }
+
+          memcpy(out, opixels, ochs * sizeof(elem_t));
+          continue;
+        }
+
+        // The pooling windows that cover this pixel
+        const int porow_first = orow + pool_padding - pool_size + 1 <= 0 ? 0 :
+          (orow + pool_padding - pool_size + pool_stride) / pool_stride;
+        const int pocol_first = ocol + pool_padding - pool_size + 1 <= 0 ? 0 :
+          (ocol + pool_padding - pool_size + pool_stride) / pool_stride;
+        const int porow_last = (orow + pool_padding) / pool_stride < pool_out_row_dim ?
+          (orow + pool_padding) / pool_stride : pool_out_row_dim - 1;
+        const int pocol_last = (ocol + pool_padding) / pool_stride < pool_out_col_dim ?
+          (ocol + pool_padding) / pool_stride : pool_out_col_dim - 1;
+
+        for (int porow = porow_first; porow <= porow_last; porow++) {
+          for (int pocol = pocol_first; pocol <= pocol_last; pocol++) {
+            elem_t * out = output + (b * pool_out_row_dim * pool_out_col_dim + porow * pool_out_col_dim + pocol) * out_stride + och_block;
+            if (trans_output_1203) {
+              // NHWC to HWNC
+              out = output + (porow * pool_out_col_dim * batch_size + pocol * batch_size + b) * out_channels + och_block;
             }
+
+            for (int o = 0; o < ochs; o++)
+              if (opixels[o] > out[o])
+                out[o] = opixels[o];
           }
         }
       }
@@ -2128,7 +3433,7 @@ static void conv_cpu(
 }
 
 
-static void conv_dw_cpu(
+static void conv_dw_cpu_serial(
         int batch_size, int in_row_dim, int in_col_dim,
         int channels, int out_row_dim, int out_col_dim,
         int stride, int padding, int kernel_dim,
@@ -2139,7 +3444,8 @@ static void conv_dw_cpu(
         elem_t * output,
 
         int act, acc_scale_t scale,
-        int pool_size, int pool_stride, int pool_padding) {
+        int pool_size, int pool_stride, int pool_padding,
+        int ch_start, int ch_end) {
 
   const bool no_pool = pool_stride == 0;
   if (no_pool) {
@@ -2148,7 +3454,8 @@ static void conv_dw_cpu(
         channels, out_row_dim, out_col_dim,
         stride, padding, kernel_dim,
         input, weights, bias, output,
-        act, scale);
+        act, scale,
+        ch_start, ch_end);
     return;
   }
 
@@ -2159,7 +3466,7 @@ static void conv_dw_cpu(
   for (int b = 0; b < batch_size; b++) {
     for (int porow = 0; porow < pool_out_row_dim; porow++) {
       for (int pocol = 0; pocol < pool_out_col_dim; pocol++) {
-        for (int ch = 0; ch < channels; ch++) {
+        for (int ch = ch_start; ch < ch_end; ch++) {
 
           elem_t running_max = 0;
           bool running_max_initialized = false;
@@ -2217,6 +3524,114 @@ static void conv_dw_cpu(
 }
 
 
+// The arguments of conv_cpu or conv_dw_cpu, for the threads that each
+// compute a range of the output channels
+struct conv_cpu_args_t {
+  int batch_size, in_row_dim, in_col_dim, in_channels;
+  int out_channels, out_row_dim, out_col_dim;
+  int stride, input_dilation, kernel_dilation, padding, kernel_dim;
+  int in_stride, weight_stride, out_stride;
+  bool wrot180, trans_output_1203, trans_input_3120;
+  bool trans_weight_1203, trans_weight_0132;
+  const elem_t * input;
+  const elem_t * weights;
+  const acc_t * bias;
+  elem_t * output;
+  int act;
+  acc_scale_t scale;
+  int pool_size, pool_stride, pool_padding;
+  bool is_mpgemm;
+};
+
+static void conv_cpu_job(const void * arg, size_t start, size_t end) {
+  const struct conv_cpu_args_t * a = arg;
+  conv_cpu_serial(
+      a->batch_size, a->in_row_dim, a->in_col_dim, a->in_channels,
+      a->out_channels, a->out_row_dim, a->out_col_dim,
+      a->stride, a->input_dilation, a->kernel_dilation, a->padding, a->kernel_dim,
+      a->in_stride, a->weight_stride, a->out_stride,
+      a->wrot180, a->trans_output_1203, a->trans_input_3120,
+      a->trans_weight_1203, a->trans_weight_0132,
+      a->input, a->weights, a->bias, a->output,
+      a->act, a->scale,
+      a->pool_size, a->pool_stride, a->pool_padding,
+      a->is_mpgemm,
+      start, end);
+}
+
+static void conv_dw_cpu_job(const void * arg, size_t start, size_t end) {
+  const struct conv_cpu_args_t * a = arg;
+  conv_dw_cpu_serial(
+      a->batch_size, a->in_row_dim, a->in_col_dim,
+      a->out_channels, a->out_row_dim, a->out_col_dim,
+      a->stride, a->padding, a->kernel_dim,
+      a->input, a->weights, a->bias, a->output,
+      a->act, a->scale,
+      a->pool_size, a->pool_stride, a->pool_padding,
+      start, end);
+}
+
+static void conv_cpu(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        int in_stride, int weight_stride, int out_stride,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+        bool is_mpgemm) {
+  const struct conv_cpu_args_t args = {
+    batch_size, in_row_dim, in_col_dim, in_channels,
+    out_channels, out_row_dim, out_col_dim,
+    stride, input_dilation, kernel_dilation, padding, kernel_dim,
+    in_stride, weight_stride, out_stride,
+    wrot180, trans_output_1203, trans_input_3120,
+    trans_weight_1203, trans_weight_0132,
+    input, weights, bias, output,
+    act, scale,
+    pool_size, pool_stride, pool_padding,
+    is_mpgemm};
+
+  // Each thread only reads the weights of its own output channels. Ternary
+  // weights pack four channels per byte, which stay with one thread
+  const size_t macs = (size_t)batch_size * out_row_dim * out_col_dim *
+    out_channels * kernel_dim * kernel_dim * in_channels;
+  gemmini_cpu_parallel(out_channels, is_mpgemm ? 4 : 1, macs, conv_cpu_job, &args);
+}
+
+static void conv_dw_cpu(
+        int batch_size, int in_row_dim, int in_col_dim,
+        int channels, int out_row_dim, int out_col_dim,
+        int stride, int padding, int kernel_dim,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding) {
+  const struct conv_cpu_args_t args = {
+    .batch_size = batch_size, .in_row_dim = in_row_dim, .in_col_dim = in_col_dim,
+    .out_channels = channels, .out_row_dim = out_row_dim, .out_col_dim = out_col_dim,
+    .stride = stride, .padding = padding, .kernel_dim = kernel_dim,
+    .input = input, .weights = weights, .bias = bias, .output = output,
+    .act = act, .scale = scale,
+    .pool_size = pool_size, .pool_stride = pool_stride, .pool_padding = pool_padding};
+
+  const size_t macs = (size_t)batch_size * out_row_dim * out_col_dim *
+    channels * kernel_dim * kernel_dim;
+  gemmini_cpu_parallel(channels, 1, macs, conv_dw_cpu_job, &args);
+}
+
+
 static void tiled_conv(
         int batch_size,
         int in_row_dim, int in_col_dim, int in_channels,
@@ -2238,7 +3653,7 @@ static void tiled_conv(
         int act, acc_scale_t scale,
         int pool_size, int pool_stride, int pool_padding,
 
-        enum tiled_matmul_type_t tiled_conv_type) {
+        enum tiled_matmul_type_t tiled_conv_type, bool is_mpgemm) {
 
 #ifdef GEMMINI_ASSERTIONS
   if (trans_weight_1203 && trans_weight_0132) {
@@ -2247,6 +3662,23 @@ static void tiled_conv(
   }
 #endif
 
+    if (is_mpgemm) {
+      // Ternary weights are packed four output channels per byte in HWIO
+      // order, and every tile must cover whole packed blocks of 4*DIM channels
+      if (out_channels % (4*DIM) != 0 || pochs % (4*DIM) != 0) {
+        printf("Ternary convs need out_channels and pochs to be multiples of %d\n", 4*DIM);
+        exit(1);
+      }
+      if (trans_weight_1203 || trans_weight_0132) {
+        printf("Ternary conv weights cannot be transposed\n");
+        exit(1);
+      }
+      if (tiled_conv_type != CPU && (pool_stride != 0 || trans_input_3120 || input_dilation > 1)) {
+        printf("Not implemented: ternary conv on Gemmini with pooling, input dilation, or trans_input_3120\n");
+        exit(1);
+      }
+    }
+
     if (tiled_conv_type == CPU) {
       if (pool_size == 1 && pool_stride == 1 && pool_padding == 0) {
         pool_stride = 0;
@@ -2263,7 +3695,8 @@ static void tiled_conv(
         trans_weight_1203, trans_weight_0132,
         input, weights, bias, output,
         act, scale,
-        pool_size, pool_stride, pool_padding);
+        pool_size, pool_stride, pool_padding,
+        is_mpgemm);
       return;
     } else if (tiled_conv_type == OS) {
       printf("Gemmini convs do not currently support OS\n");
@@ -2298,10 +3731,10 @@ static void tiled_conv(
         // Check that data will fit in scratchpad
         const int spad_rows = tiled_conv_total_spad_rows(false,
             stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-            batches, porows, pocols, pochs, krows, kcols, kchs, pool_size, pool_stride);
+            batches, porows, pocols, pochs, krows, kcols, kchs, pool_size, pool_stride, is_mpgemm);
         const int acc_rows = tiled_conv_total_spad_rows(true,
             stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-            batches, porows, pocols, pochs, krows, kcols, kchs, pool_size, pool_stride);
+            batches, porows, pocols, pochs, krows, kcols, kchs, pool_size, pool_stride, is_mpgemm);
 
         if (spad_rows > BANK_NUM * BANK_ROWS / 2) {
             printf("not enough scratchpad space to store inputs and weights, %d\n", spad_rows);
@@ -2449,7 +3882,7 @@ static void tiled_conv(
                                   kcol_ = kernel_dim - kcol - kcols_;
                                 }
 
-                                const elem_t * weights_slice = weights + (krow_*kernel_dim*in_channels + kcol_*in_channels + kch) * weight_stride + poch;
+                                const elem_t * weights_slice = weights + (krow_*kernel_dim*in_channels + kcol_*in_channels + kch) * weight_stride + (is_mpgemm ? poch / 4 : poch);
                                 if (trans_weight_1203) {
                                   weights_slice = weights + (kch*kernel_dim*kernel_dim + krow_*kernel_dim+kcol_) * out_channels + poch;
                                 } else if (trans_weight_0132) {
@@ -2492,7 +3925,7 @@ static void tiled_conv(
                                     trans_weight_1203, trans_weight_0132,
 
                                     no_bias, no_pool, downsample, input_dilated,
-                                    false, a_spad_id, b_spad_id);
+                                    false, a_spad_id, b_spad_id, is_mpgemm);
 
                             }
                         }
@@ -2564,10 +3997,10 @@ static void tiled_conv_dw(
         // Check that data will fit in scratchpad
         const int spad_rows = tiled_conv_total_spad_rows(false,
             stride, 1, 1, false, false, false,
-            batches, porows, pocols, 1, krows, kcols, 1, pool_size, pool_stride);
+            batches, porows, pocols, 1, krows, kcols, 1, pool_size, pool_stride, false);
         const int acc_rows = tiled_conv_total_spad_rows(true,
             stride, 1, 1, false, false, false,
-            batches, porows, pocols, 1, krows, kcols, 1, pool_size, pool_stride);
+            batches, porows, pocols, 1, krows, kcols, 1, pool_size, pool_stride, false);
 
         if (spad_rows > BANK_NUM * BANK_ROWS / 2) {
             printf("not enough scratchpad space to store inputs and weights, %d\n", spad_rows);
@@ -2675,7 +4108,7 @@ static void tiled_conv_dw(
                                 false, false,
 
                                 no_bias, no_pool, false, false,
-                                true, 0, 0);
+                                true, 0, 0, false);
 
                         }
                     }
@@ -2685,42 +4118,18 @@ static void tiled_conv_dw(
     }
 }
 
-// need to specify each operand/output's stride
-// stride only for trans == false, wrot == false
-static void tiled_conv_stride_auto(
-        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
-        int out_channels, int out_row_dim, int out_col_dim,
-        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
-        int in_stride, int weight_stride, int out_stride, // specify in/output's stride
-        bool wrot180, bool trans_output_1203, bool trans_input_3120,
-        bool trans_weight_1203, bool trans_weight_0132,
-
-        const elem_t * input,
-        const elem_t * weights,
-        const acc_t * bias,
-        elem_t * output,
-
-        int act, acc_scale_t scale,
-        int pool_size, int pool_stride, int pool_padding,
-
-        enum tiled_matmul_type_t tiled_conv_type) {
-
-    const bool no_pool = pool_stride == 0;
-    if (no_pool) {
-        pool_size = 1;
-        pool_stride = 1;
-        pool_padding = 0;
-    }
-
-    const int pool_out_row_dim = (out_row_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
-    const int pool_out_col_dim = (out_col_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
-
-    const bool downsample = stride == 2 && kernel_dim == 1 && padding == 0 && no_pool && in_row_dim % 2 == 0 && in_col_dim % 2 == 0;
-
-    // Tile convolution params
+// Picks the conv tiling factors {batches, porows, pocols, pochs, krows, kcols,
+// kchs}: the largest factors are shrunk until a tile fits in half of the
+// scratchpad and accumulator, and then anything that still fits is grown
+static void tiled_conv_auto_args(int args[7],
+        int batch_size, int in_channels, int out_channels,
+        int pool_out_row_dim, int pool_out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, bool downsample, int kernel_dim,
+        bool trans_weight_0132, bool trans_input_3120,
+        int pool_size, int pool_stride, bool is_mpgemm) {
 
-    // int args[] = {batch_size, porows, pocols, pochs, krows, kcols, kchs};
-    int args[] = {batch_size, pool_out_row_dim, pool_out_col_dim, out_channels, kernel_dim, kernel_dim, in_channels};
+    const int init_args[] = {batch_size, pool_out_row_dim, pool_out_col_dim, out_channels, kernel_dim, kernel_dim, in_channels};
+    memcpy(args, init_args, sizeof(init_args));
     const int max_args[] = {batch_size, pool_out_row_dim, pool_out_col_dim, out_channels, kernel_dim, kernel_dim, in_channels};
 
     const int orows_idx = 1;
@@ -2728,31 +4137,38 @@ static void tiled_conv_stride_auto(
     const int out_channels_idx = 3;
     const int in_channels_idx = 6;
 
+    // Ternary weights pack four output channels per byte, so output channels
+    // are only tiled in whole packed blocks
+    const int och_block = is_mpgemm ? 4*DIM : DIM;
+
     // We divide by 2 for the sake of double-buffering
     const int max_spad_rows = (BANK_NUM*BANK_ROWS / 2);
     const int max_acc_rows = (ACC_ROWS / 2);
 
     int spad_rows = tiled_conv_total_spad_rows(false,
         stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, is_mpgemm);
     int acc_rows = tiled_conv_total_spad_rows(true,
         stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, is_mpgemm);
 
     while (spad_rows > max_spad_rows || acc_rows > max_acc_rows) {
         int max_val = -1;
         int max_idx = -1;
 
-        for (size_t i = 0; i < sizeof(args)/sizeof(args[0]); i++) {
+        for (size_t i = 0; i < sizeof(init_args)/sizeof(init_args[0]); i++) {
             // We avoid reducing ocols when possible to keep the spatial array fully utilized
             if (!(i == ocols_idx && args[i] <= DIM && args[orows_idx] > 1)
+                    && !(is_mpgemm && i == out_channels_idx && args[i] <= och_block)
                     && args[i] > max_val) {
                 max_val = args[i];
                 max_idx = i;
             }
         }
 
-        if (max_idx == out_channels_idx || max_idx == in_channels_idx) {
+        if (max_idx == out_channels_idx && is_mpgemm) {
+            args[max_idx] -= och_block;
+        } else if (max_idx == out_channels_idx || max_idx == in_channels_idx) {
             // For input and output channels, there's no point in subtracting by just one
             if (args[max_idx] % DIM != 0) {
                 args[max_idx] = (args[max_idx] / DIM) * DIM;
@@ -2766,10 +4182,10 @@ static void tiled_conv_stride_auto(
 
         spad_rows = tiled_conv_total_spad_rows(false,
             stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, is_mpgemm);
         acc_rows = tiled_conv_total_spad_rows(true,
             stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, is_mpgemm);
     }
 
     // Check if we can increase ocols
@@ -2785,10 +4201,10 @@ static void tiled_conv_stride_auto(
 
         spad_rows = tiled_conv_total_spad_rows(false,
             stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, is_mpgemm);
         acc_rows = tiled_conv_total_spad_rows(true,
             stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, is_mpgemm);
 
         if (spad_rows <= max_spad_rows && acc_rows <= max_acc_rows) {
             args[ocols_idx] = args_candidate[ocols_idx];
@@ -2801,25 +4217,78 @@ static void tiled_conv_stride_auto(
     while (!nothing_increased) {
         nothing_increased = true;
 
-        for (size_t i = 0; i < sizeof(args)/sizeof(args[0]); i++) {
+        for (size_t i = 0; i < sizeof(init_args)/sizeof(init_args[0]); i++) {
             int args_candidate[] = {args[0], args[1], args[2], args[3], args[4], args[5], args[6]};
-            args_candidate[i]++;
+            args_candidate[i] += is_mpgemm && i == out_channels_idx ? och_block : 1;
 
             if (args_candidate[i] > max_args[i])
                 continue;
 
-            spad_rows = tiled_conv_total_spad_rows(false,
-                stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
-            acc_rows = tiled_conv_total_spad_rows(true,
-                stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+            spad_rows = tiled_conv_total_spad_rows(false,
+                stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
+                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, is_mpgemm);
+            acc_rows = tiled_conv_total_spad_rows(true,
+                stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
+                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, is_mpgemm);
+
+            if (spad_rows <= max_spad_rows && acc_rows <= max_acc_rows) {
+                args[i] = args_candidate[i];
+                nothing_increased = false;
+            }
+        }
+    }
+
+}
+
+// need to specify each operand/output's stride
+// stride only for trans == false, wrot == false
+static void tiled_conv_stride_auto(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        int in_stride, int weight_stride, int out_stride, // specify in/output's stride
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type, bool is_mpgemm) {
+
+    const bool no_pool = pool_stride == 0;
+    if (no_pool) {
+        pool_size = 1;
+        pool_stride = 1;
+        pool_padding = 0;
+    }
+
+    const int pool_out_row_dim = (out_row_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+    const int pool_out_col_dim = (out_col_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+
+    const bool downsample = stride == 2 && kernel_dim == 1 && padding == 0 && no_pool && in_row_dim % 2 == 0 && in_col_dim % 2 == 0;
 
-            if (spad_rows <= max_spad_rows && acc_rows <= max_acc_rows) {
-                args[i] = args_candidate[i];
-                nothing_increased = false;
-            }
-        }
+    // Tile convolution params
+
+    // int args[] = {batch_size, porows, pocols, pochs, krows, kcols, kchs};
+    int args[7];
+    tiled_conv_auto_args(args, batch_size, in_channels, out_channels,
+        pool_out_row_dim, pool_out_col_dim,
+        stride, input_dilation, kernel_dilation, downsample, kernel_dim,
+        trans_weight_0132, trans_input_3120,
+        pool_size, pool_stride, is_mpgemm);
+
+    const int tune_key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_CONV_KEY(batch_size, in_row_dim, in_col_dim,
+        in_channels, out_channels, out_row_dim, out_col_dim,
+        stride, input_dilation, kernel_dilation, padding, kernel_dim,
+        trans_weight_0132, trans_input_3120, pool_size, pool_stride, is_mpgemm);
+    const int * tuned = gemmini_tuned_tiles(GEMMINI_TUNE_CONV, tune_key);
+    if (tuned != NULL && tiled_conv_type == WS) {
+      memcpy(args, tuned, sizeof(args));
     }
 
     const int batches = args[0];
@@ -2830,17 +4299,19 @@ static void tiled_conv_stride_auto(
     const int kcols = args[5];
     const int kchs = args[6];
 
-    /*
-    spad_rows = tiled_conv_total_spad_rows(false,
+#ifdef PRINT_TILE
+#if PRINT_TILE
+    // We divide by 2 for the sake of double-buffering
+    const int max_spad_rows = (BANK_NUM*BANK_ROWS / 2);
+    const int max_acc_rows = (ACC_ROWS / 2);
+
+    const int spad_rows = tiled_conv_total_spad_rows(false,
         stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
-    acc_rows = tiled_conv_total_spad_rows(true,
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, is_mpgemm);
+    const int acc_rows = tiled_conv_total_spad_rows(true,
         stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
-    */
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, is_mpgemm);
 
-#ifdef PRINT_TILE
-#if PRINT_TILE
     printf("batches = %d\n", batches);
     printf("orows   = %d\n", orows);
     printf("ocols   = %d\n", ocols);
@@ -2879,7 +4350,7 @@ static void tiled_conv_stride_auto(
         act, scale,
         pool_size, no_pool ? 0 : pool_stride, pool_padding,
 
-        tiled_conv_type);
+        tiled_conv_type, is_mpgemm);
 }
 
 
@@ -2914,8 +4385,46 @@ static void tiled_conv_auto(
         input, weights, bias, output,
 
         act, scale, pool_size, pool_stride, pool_padding,
-        tiled_conv_type);
+        tiled_conv_type, false);
+
+}
+
+// Convolution with ternary weights, packed four output channels per byte
+// (see ternary_pack.h) in HWIO order, so "weights" holds
+// kernel_dim*kernel_dim*in_channels rows of out_channels/4 bytes.
+// out_channels must be a multiple of 4*DIM. On Gemmini, pooling, input
+// dilation and trans_input_3120 are not supported.
+static void tiled_conv_mpgemm_auto(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type) {
+
+    int in_stride = in_channels;
+    int out_stride = out_channels;
+    int weight_stride = out_channels / 4;
+    tiled_conv_stride_auto(
+        batch_size, in_row_dim, in_col_dim, in_channels,
+        out_channels, out_row_dim, out_col_dim,
+        stride, input_dilation, kernel_dilation, padding, kernel_dim,
+        in_stride, weight_stride, out_stride,
+        wrot180, trans_output_1203, trans_input_3120,
+        false, false,
+
+        input, weights, bias, output,
 
+        act, scale, pool_size, pool_stride, pool_padding,
+        tiled_conv_type, true);
 }
 
 // This function is for a convolution with kernel_dim=1, stride==2, padding=0, and no pooling
@@ -3013,10 +4522,10 @@ static void tiled_conv_dw_auto(
 
     int spad_rows = tiled_conv_total_spad_rows(false,
         stride, 1, 1, false, false, false,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, false);
     int acc_rows = tiled_conv_total_spad_rows(true,
         stride, 1, 1, false, false, false,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, false);
 
     while (spad_rows > max_spad_rows || acc_rows > max_acc_rows) {
         int max_val = -1;
@@ -3045,10 +4554,10 @@ static void tiled_conv_dw_auto(
 
         spad_rows = tiled_conv_total_spad_rows(false,
             stride, 1, 1, false, false, false,
-            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, false);
         acc_rows = tiled_conv_total_spad_rows(true,
             stride, 1, 1, false, false, false,
-            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+            args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, false);
     }
 
     // Check if we can increase ocols
@@ -3064,10 +4573,10 @@ static void tiled_conv_dw_auto(
 
         spad_rows = tiled_conv_total_spad_rows(false,
             stride, 1, 1, false, false, false,
-            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, false);
         acc_rows = tiled_conv_total_spad_rows(true,
             stride, 1, 1, false, false, false,
-            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+            args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, false);
 
         if (spad_rows <= max_spad_rows && acc_rows <= max_acc_rows) {
             args[ocols_idx] = args_candidate[ocols_idx];
@@ -3089,10 +4598,10 @@ static void tiled_conv_dw_auto(
 
             spad_rows = tiled_conv_total_spad_rows(false,
                 stride, 1, 1, false, false, false,
-                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, false);
             acc_rows = tiled_conv_total_spad_rows(true,
                 stride, 1, 1, false, false, false,
-                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride);
+                args_candidate[0], args_candidate[1], args_candidate[2], args_candidate[3], args_candidate[4], args_candidate[5], args_candidate[6], pool_size, pool_stride, false);
 
             if (spad_rows <= max_spad_rows && acc_rows <= max_acc_rows) {
                 args[i] = args_candidate[i];
@@ -3112,10 +4621,10 @@ static void tiled_conv_dw_auto(
     /*
     spad_rows = tiled_conv_total_spad_rows(false,
         stride, 1, 1, false, false, false,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, false);
     acc_rows = tiled_conv_total_spad_rows(true,
         stride, 1, 1, false, false, false,
-        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride);
+        args[0], args[1], args[2], args[3], args[4], args[5], args[6], pool_size, pool_stride, false);
 
     printf("batches = %d\n", batches);
     printf("orows   = %d\n", orows);
@@ -3196,7 +4705,7 @@ static void sp_tiled_resadd(const size_t I, const size_t J,
     int tile_I = (I%DIM == 0) ? (int)(I/DIM) : (int)(I/DIM) + 1;
     int tile_J = (J%DIM == 0) ? (int)(J/DIM) : (int)(J/DIM) + 1;
     //printf("pad I: %d, pad_J: %d, tile_I: %d, tile_J: %d\n", pad_I, pad_J, tile_I, tile_J);
-    gemmini_loop_ws(tile_I, tile_J, 0, pad_I, pad_J, 0, A, B, NULL, C, A_row_stride, B_row_stride, 0, C_row_stride, false, false, false, false, false, relu, 0, 0, true, false);
+    gemmini_loop_ws(tile_I, tile_J, 0, pad_I, pad_J, 0, A, B, NULL, C, A_row_stride, B_row_stride, 0, C_row_stride, false, false, false, false, false, false, relu, 0, 0, true, false, 1);
     /*
     // Use the new mvin2 command to overlap mvin A, mvin B, and mvout C
 
@@ -3285,7 +4794,7 @@ static void tiled_resadd(const size_t I, const size_t J,
         }
     }
 
-    gemmini_fence();
+    gemmini_kernel_fence();
 }
 
 // Compute (A >> A_shift) + B = C
@@ -3356,6 +4865,298 @@ static void tiled_resadd_auto(const size_t I, const size_t J,
         relu, matadd_type);
 }
 
+// The m * identity weight tile that scales residuals up in the array
+static const elem_t * matmul_resadd_identity() {
+  static elem_t identity[DIM][DIM];
+
+  for (size_t i = 0; i < DIM; i++)
+    identity[i][i] = 1;
+
+  return &identity[0][0];
+}
+
+// A tile of tiled_matmul_resadd_auto needs the scratchpad rows of a plain
+// matmul tile, plus, when its residual goes through the array, the residual
+// and the identity tile
+static size_t tiled_matmul_resadd_spad_rows(size_t I, size_t J, size_t K, bool spad_R) {
+  return tiled_matmul_total_spad_rows(I, J, K) + (spad_R ? (I * J + 1) * DIM : 0);
+}
+
+// One output tile of tiled_matmul_resadd_auto. LOOP_WS can only preload one D,
+// so the tile is issued instruction by instruction: the bias moves into the
+// accumulator, the residual accumulates on top of it, and every k step then
+// accumulates A * B. Only the first k tile passes R, and only the last passes C.
+// A residual scaled up by more than 1 is moved into the scratchpad instead, and
+// reaches the accumulator through res->passes products with the m * identity
+static void sp_tiled_matmul_resadd_ws(const elem_t * A, const elem_t * B,
+        const acc_t * D, const elem_t * R, elem_t * C,
+        const struct matmul_resadd_scale_t * res,
+        size_t I, size_t J, size_t K, size_t pad_I, size_t pad_J, size_t pad_K,
+        size_t A_row_stride, size_t B_row_stride, size_t D_row_stride,
+        size_t R_row_stride, size_t C_row_stride,
+        bool repeating_bias) {
+
+  const uint32_t A_sp_addr_start = 0;
+  const uint32_t B_sp_addr_start = BANK_NUM * BANK_ROWS - K * J * DIM;
+  const uint32_t D_sp_addr_start = 1 << (ADDR_LEN-1);
+  const uint32_t C_sp_addr_start = 3 << (ADDR_LEN-2);
+  const uint32_t R_sp_addr_start = I * K * DIM;
+  const uint32_t identity_sp_addr = R_sp_addr_start + I * J * DIM;
+  const bool spad_R = R != NULL && res->m > 1;
+
+  const size_t A_blocks = K <= MAX_BLOCK_LEN ? K : MAX_BLOCK_LEN;
+  const size_t B_blocks = J <= MAX_BLOCK_LEN ? J : MAX_BLOCK_LEN;
+  const size_t D_blocks = J <= MAX_BLOCK_LEN_ACC ? J : MAX_BLOCK_LEN_ACC;
+
+  // Move-in D, then R
+  if (R != NULL) {
+    if (D != NULL) {
+      gemmini_extended3_config_ld(repeating_bias ? 0 : D_row_stride * sizeof(acc_t),
+          MVIN_SCALE_IDENTITY, false, 2);
+
+      for (size_t i = 0; i < I; i++) {
+        for (size_t j = 0; j < J; j += D_blocks) {
+          const size_t bias_row = repeating_bias ? 0 : i;
+          const acc_t * const D_dram_addr = D + (bias_row * D_row_stride + j)*DIM;
+          const uint32_t D_sp_addr = D_sp_addr_start + (i*J + j)*DIM;
+          const size_t blocks = j + D_blocks <= J ? D_blocks : J-j;
+          const size_t cols = blocks * DIM - (j + blocks >= J ? pad_J : 0);
+          const size_t rows = DIM - (i == I-1 ? pad_I : 0);
+          gemmini_extended_mvin3(D_dram_addr, D_sp_addr, cols, rows);
+        }
+      }
+    }
+
+    gemmini_extended3_config_ld(R_row_stride * sizeof(elem_t), res->mvin_scale, true, 2);
+
+    for (size_t i = 0; i < I; i++) {
+      for (size_t j = 0; j < J; j += B_blocks) {
+        const elem_t * const R_dram_addr = R + (i * R_row_stride + j)*DIM;
+        const uint32_t R_sp_addr = (spad_R ? R_sp_addr_start : D != NULL ? C_sp_addr_start : D_sp_addr_start) + (i*J + j)*DIM;
+        const size_t blocks = j + B_blocks <= J ? B_blocks : J-j;
+        const size_t cols = blocks * DIM - (j + blocks >= J ? pad_J : 0);
+        const size_t rows = DIM - (i == I-1 ? pad_I : 0);
+        gemmini_extended_mvin3(R_dram_addr, R_sp_addr, cols, rows);
+      }
+    }
+
+    // The identity comes in scaled by m, which fits in elem_t
+    if (spad_R) {
+      gemmini_extended3_config_ld(DIM * sizeof(elem_t), res->m, false, 2);
+      gemmini_extended_mvin3(matmul_resadd_identity(), identity_sp_addr, DIM, DIM);
+    }
+  }
+
+  // Move-in B
+  for (size_t j = 0; j < J; j += B_blocks) {
+    for (size_t k = 0; k < K; k++) {
+      const elem_t * const B_dram_addr = B + (k*B_row_stride + j)*DIM;
+      const uint32_t B_sp_addr = B_sp_addr_start + (k*J + j)*DIM;
+      const size_t blocks = j + B_blocks <= J ? B_blocks : J-j;
+      const size_t cols = blocks * DIM - (j + blocks >= J ? pad_J : 0);
+      const size_t rows = DIM - (k == K-1 ? pad_K : 0);
+      gemmini_extended_mvin2(B_dram_addr, B_sp_addr, cols, rows);
+    }
+  }
+
+  // Move-in A
+  for (size_t i = 0; i < I; i++) {
+    for (size_t k = 0; k < K; k += A_blocks) {
+      const elem_t * const A_dram_addr = A + (i*A_row_stride + k)*DIM;
+      const uint32_t A_sp_addr = A_sp_addr_start + (i*K + k)*DIM;
+      const size_t blocks = k + A_blocks <= K ? A_blocks : K-k;
+      const size_t cols = blocks * DIM - (k + blocks >= K ? pad_K : 0);
+      const size_t rows = DIM - (i == I-1 ? pad_I : 0);
+      gemmini_extended_mvin(A_dram_addr, A_sp_addr, cols, rows);
+    }
+  }
+
+  // Every pass accumulates m * R, with the identity preloaded only once
+  if (spad_R) {
+    for (size_t p = 0; p < res->passes; p++) {
+      for (size_t i = 0; i < I; i++) {
+        for (size_t j = 0; j < J; j++) {
+          const bool first = p == 0 && i == 0 && j == 0;
+          const uint32_t R_sp_addr = R_sp_addr_start + (i*J + j)*DIM;
+          const uint32_t C_sp_addr = (p == 0 && D == NULL ? D_sp_addr_start : C_sp_addr_start) + (i*J + j)*DIM;
+
+          const size_t C_cols = DIM - (j == J - 1 ? pad_J : 0);
+          const size_t C_rows = DIM - (i == I - 1 ? pad_I : 0);
+
+          gemmini_extended_preload(first ? identity_sp_addr : GARBAGE_ADDR, C_sp_addr,
+              DIM, DIM, C_cols, C_rows);
+
+          if (first) {
+            gemmini_extended_compute_preloaded(R_sp_addr, GARBAGE_ADDR, C_cols, C_rows, DIM, DIM);
+          } else {
+            gemmini_extended_compute_accumulated(R_sp_addr, GARBAGE_ADDR, C_cols, C_rows, DIM, DIM);
+          }
+        }
+      }
+    }
+  }
+
+  // Each weight tile is preloaded once and reused by every row of A
+  for (size_t j = 0; j < J; j++) {
+    for (size_t k = 0; k < K; k++) {
+      const uint32_t B_sp_addr = B_sp_addr_start + (k*J + j)*DIM;
+      const size_t B_cols = DIM - (j == J - 1 ? pad_J : 0);
+      const size_t B_rows = DIM - (k == K - 1 ? pad_K : 0);
+
+      for (size_t i = 0; i < I; i++) {
+        const uint32_t A_sp_addr = A_sp_addr_start + (i*K + k)*DIM;
+        const uint32_t C_sp_addr = C_sp_addr_start + (i*J + j)*DIM;
+
+        const size_t A_cols = DIM - (k == K - 1 ? pad_K : 0);
+        const size_t A_rows = DIM - (i == I - 1 ? pad_I : 0);
+        const size_t C_cols = DIM - (j == J - 1 ? pad_J : 0);
+        const size_t C_rows = DIM - (i == I - 1 ? pad_I : 0);
+
+        gemmini_extended_preload(i == 0 ? B_sp_addr : GARBAGE_ADDR, C_sp_addr,
+            B_cols, B_rows, C_cols, C_rows);
+
+        if (i == 0) {
+          gemmini_extended_compute_preloaded(A_sp_addr, GARBAGE_ADDR, A_cols, A_rows, DIM, DIM);
+        } else {
+          gemmini_extended_compute_accumulated(A_sp_addr, GARBAGE_ADDR, A_cols, A_rows, DIM, DIM);
+        }
+      }
+    }
+  }
+
+  // Move-out C
+  if (C != NULL) {
+    for (size_t i = 0; i < I; i++) {
+      for (size_t j = 0; j < J; j++) {
+        elem_t * const C_dram_addr = C + (i*C_row_stride + j)*DIM;
+        const uint32_t C_sp_addr = D_sp_addr_start + (i*J + j)*DIM;
+
+        const size_t C_cols = DIM - (j == J - 1 ? pad_J : 0);
+        const size_t C_rows = DIM - (i == I - 1 ? pad_I : 0);
+
+        gemmini_extended_mvout(C_dram_addr, C_sp_addr, C_cols, C_rows);
+      }
+    }
+  }
+}
+
+// Computes act(A * B + D + R_scale_factor * R), scaled by "scale" like any
+// matmul output. The residual R, an elem_t matrix shaped like C, is added in
+// the accumulator, so C needn't be stored and reloaded by a separate
+// tiled_resadd. A residual scaled down comes in through its mvin scale, and
+// one scaled up goes through the array, as matmul_resadd_scale describes, so
+// it doesn't saturate. C may be R. Only NO_ACTIVATION and RELU are supported,
+// on WS or the CPU
+static void tiled_matmul_resadd_auto(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const acc_t * D, const elem_t * R, elem_t * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_R, size_t stride_C,
+        scale_t R_scale_factor,
+        int act, acc_scale_t scale,
+        bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+
+  if (act != NO_ACTIVATION && act != RELU) {
+    printf("Not implemented: matmul with a residual, act=%d\n", act);
+    exit(1);
+  }
+
+  if (!(R_scale_factor > 0)) {
+    printf("The residual's scale must be positive\n");
+    exit(1);
+  }
+
+  if (tiled_matmul_type == CPU) {
+    matmul_cpu(false, false, dim_I, dim_J, dim_K,
+        A, B, D, R, C,
+        stride_A, stride_B, stride_D, stride_R, stride_C,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, R_scale_factor,
+        act, scale, 0, repeating_bias);
+    return;
+  } else if (tiled_matmul_type != WS) {
+    printf("Not implemented: OS matmul with a residual\n");
+    exit(1);
+  }
+
+  const size_t dim_I_padded = (dim_I / DIM + (dim_I % DIM != 0)) * DIM;
+  const size_t dim_J_padded = (dim_J / DIM + (dim_J % DIM != 0)) * DIM;
+  const size_t dim_K_padded = (dim_K / DIM + (dim_K % DIM != 0)) * DIM;
+
+  // The tiles aren't double-buffered by LOOP_WS, so they may fill the whole
+  // scratchpad and accumulator
+  const size_t max_spad_rows = BANK_NUM * BANK_ROWS;
+  const size_t max_acc_rows = ACC_ROWS;
+
+  const struct matmul_resadd_scale_t res = matmul_resadd_scale(R_scale_factor);
+  const bool spad_R = res.m > 1;
+
+  size_t tile_I = 1, tile_J = 1, tile_K = 1;
+
+  while (true) {
+    bool increased = false;
+
+    if (tiled_matmul_resadd_spad_rows(tile_I, tile_J+1, tile_K, spad_R) <= max_spad_rows &&
+        tiled_matmul_total_acc_rows(tile_I, tile_J+1) <= max_acc_rows &&
+        (tile_J+1) * DIM <= dim_J_padded) {
+      tile_J++;
+      increased = true;
+    }
+
+    if (tiled_matmul_resadd_spad_rows(tile_I+1, tile_J, tile_K, spad_R) <= max_spad_rows &&
+        tiled_matmul_total_acc_rows(tile_I+1, tile_J) <= max_acc_rows &&
+        (tile_I+1) * DIM <= dim_I_padded) {
+      tile_I++;
+      increased = true;
+    }
+
+    if (tiled_matmul_resadd_spad_rows(tile_I, tile_J, tile_K+1, spad_R) <= max_spad_rows &&
+        (tile_K+1) * DIM <= dim_K_padded) {
+      tile_K++;
+      increased = true;
+    }
+
+    if (!increased)
+      break;
+  }
+
+  const size_t I0 = dim_I_padded / (tile_I*DIM) + (dim_I_padded % (tile_I*DIM) != 0);
+  const size_t J0 = dim_J_padded / (tile_J*DIM) + (dim_J_padded % (tile_J*DIM) != 0);
+  const size_t K0 = dim_K_padded / (tile_K*DIM) + (dim_K_padded % (tile_K*DIM) != 0);
+
+  const size_t last_I = dim_I_padded % (tile_I*DIM) == 0 ? tile_I : (dim_I_padded/DIM) % tile_I;
+  const size_t last_J = dim_J_padded % (tile_J*DIM) == 0 ? tile_J : (dim_J_padded/DIM) % tile_J;
+  const size_t last_K = dim_K_padded % (tile_K*DIM) == 0 ? tile_K : (dim_K_padded/DIM) % tile_K;
+
+  const size_t padding_I = dim_I_padded - dim_I;
+  const size_t padding_J = dim_J_padded - dim_J;
+  const size_t padding_K = dim_K_padded - dim_K;
+
+  gemmini_extended_config_ex(WEIGHT_STATIONARY, act & 3, 0, 1, false, false);
+  gemmini_extended_config_st(stride_C * sizeof(elem_t), act & 3, scale);
+  gemmini_extended3_config_ld(stride_A * sizeof(elem_t), MVIN_SCALE_IDENTITY, false, 0);
+  gemmini_extended3_config_ld(stride_B * sizeof(elem_t), MVIN_SCALE_IDENTITY, false, 1);
+
+  for (size_t i0 = 0; i0 < I0; i0++)
+    for (size_t j0 = 0; j0 < J0; j0++)
+      for (size_t k0 = 0; k0 < K0; k0++) {
+        const size_t bias_row = repeating_bias ? 0 : i0*tile_I*DIM;
+        const acc_t * pre = D == NULL ? NULL : D + bias_row*stride_D + j0*tile_J*DIM;
+        const elem_t * residual = k0 != 0 ? NULL : R + i0*tile_I*DIM*stride_R + j0*tile_J*DIM;
+        elem_t * out = k0 == K0-1 ? C + i0*tile_I*DIM*stride_C + j0*tile_J*DIM : NULL;
+
+        sp_tiled_matmul_resadd_ws(
+            A + i0*tile_I*DIM*stride_A + k0*tile_K*DIM,
+            B + k0*tile_K*DIM*stride_B + j0*tile_J*DIM,
+            pre, residual, out, &res,
+            i0 < I0-1 ? tile_I : last_I, j0 < J0-1 ? tile_J : last_J, k0 < K0-1 ? tile_K : last_K,
+            i0 == I0-1 ? padding_I : 0, j0 == J0-1 ? padding_J : 0, k0 == K0-1 ? padding_K : 0,
+            stride_A, stride_B, stride_D, stride_R, stride_C,
+            repeating_bias);
+      }
+
+  gemmini_kernel_fence();
+}
+
 static void global_average_cpu(const elem_t * input, elem_t * output,
     int batches, int channels, int dim) {
   const int count = dim * dim;
@@ -3602,7 +5403,7 @@ static void tiled_norm(const size_t I, const size_t J,
         }
     }
 
-    gemmini_fence();
+    gemmini_kernel_fence();
 }
 
 static void tiled_norm_auto(const size_t I, const size_t J,
@@ -3637,6 +5438,229 @@ static void tiled_norm_auto(const size_t I, const size_t J,
     }
 }
 
+// Block sizes of tiled_attention_auto. Only one block of scores and one block
+// of partial outputs are live at a time, whatever the sequence length
+#define ATTN_BLOCK_Q (4*DIM)
+#define ATTN_BLOCK_KV (4*DIM)
+#define ATTN_MAX_HEAD_DIM 256
+
+// The longest key/value sequence whose full rows of scores fit in half the
+// accumulator, so that tiled_attention_auto can take their softmax there
+#define ATTN_MAX_ONCHIP_SEQ_KV (ACC_ROWS / 2)
+
+// C = A * B (or A * B^T) into full-precision accumulators, for the blocks of
+// tiled_attention_auto. The CPU path of tiled_matmul_auto can't return acc_t
+// outputs, so the CPU computes these blocks itself
+static void attention_block_matmul(size_t I, size_t J, size_t K,
+        const elem_t * A, const elem_t * B, acc_t * C,
+        size_t stride_A, size_t stride_B, size_t stride_C, bool transpose_B,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  if (tiled_matmul_type == CPU) {
+    for (size_t i = 0; i < I; i++)
+      for (size_t j = 0; j < J; j++) {
+        acc_t sum = 0;
+        for (size_t k = 0; k < K; k++)
+          sum += A[i * stride_A + k] * (transpose_B ? B[j * stride_B + k] : B[k * stride_B + j]);
+        C[i * stride_C + j] = sum;
+      }
+    return;
+  }
+
+  tiled_matmul_auto(I, J, K,
+      A, B, NULL, C,
+      stride_A, stride_B, 0, stride_C,
+      MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+      NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+      false, transpose_B,
+      true, false,
+      0,
+      tiled_matmul_type);
+  gemmini_fence();
+}
+
+// tiled_attention_auto for key/value sequences too long for the accumulator.
+// K and V are streamed in ATTN_BLOCK_KV-row blocks and the softmax is computed
+// online on the core: each query row keeps a running max and exponent sum,
+// and its partial output is rescaled whenever the max grows. The I-BERT
+// exponentials match a SOFTMAX matmul's only up to a few output units.
+static void tiled_attention_online(size_t seq_len_q, size_t seq_len_kv, size_t head_dim,
+        const elem_t * Q, const elem_t * K, const elem_t * V, elem_t * out,
+        size_t stride_Q, size_t stride_K, size_t stride_V, size_t stride_out,
+        acc_scale_t bert_scale,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+
+  if (gemmini_capture_stream != NULL) {
+    printf("Attention over more than %d keys runs its softmax on the core, so it can't be captured\n",
+        ATTN_MAX_ONCHIP_SEQ_KV);
+    exit(1);
+  }
+
+  if (head_dim > ATTN_MAX_HEAD_DIM) {
+    printf("head_dim can't be larger than %d\n", ATTN_MAX_HEAD_DIM);
+    exit(1);
+  }
+
+  const scale_t a = 0.3585;
+  const scale_t b = 1.353;
+  const scale_t c = 0.344;
+
+  const acc_t qln2 = (acc_t) (0.693147 / bert_scale);
+  const acc_t qln2_inv = 65536 / qln2;
+  const acc_t qb = b / bert_scale;
+  const acc_t qc = c / (a*bert_scale*bert_scale);
+
+  // Every exponential is taken relative to a max, so iexp(0) stands for 1
+  const float exp_one = softmax_iexp(0, qln2, qln2_inv, qb, qc);
+
+  static acc_t scores[ATTN_BLOCK_Q][ATTN_BLOCK_KV];
+  static elem_t probs[ATTN_BLOCK_Q][ATTN_BLOCK_KV];
+  static acc_t partial[ATTN_BLOCK_Q][ATTN_MAX_HEAD_DIM];
+  static float acc_out[ATTN_BLOCK_Q][ATTN_MAX_HEAD_DIM];
+  static acc_t row_max[ATTN_BLOCK_Q];
+  static float row_sum[ATTN_BLOCK_Q];
+
+  for (size_t q0 = 0; q0 < seq_len_q; q0 += ATTN_BLOCK_Q) {
+    const size_t rows = seq_len_q - q0 < ATTN_BLOCK_Q ? seq_len_q - q0 : ATTN_BLOCK_Q;
+
+    for (size_t i = 0; i < rows; i++) {
+      row_max[i] = -2147483648;
+      row_sum[i] = 0;
+      for (size_t d = 0; d < head_dim; d++)
+        acc_out[i][d] = 0;
+    }
+
+    for (size_t kv0 = 0; kv0 < seq_len_kv; kv0 += ATTN_BLOCK_KV) {
+      const size_t cols = seq_len_kv - kv0 < ATTN_BLOCK_KV ? seq_len_kv - kv0 : ATTN_BLOCK_KV;
+
+      // scores = Q_blk * K_blk^T
+      attention_block_matmul(rows, cols, head_dim,
+          Q + q0 * stride_Q, K + kv0 * stride_K, &scores[0][0],
+          stride_Q, stride_K, ATTN_BLOCK_KV, true, tiled_matmul_type);
+
+      // probs = exp(scores - block max), quantized so that 127 stands for 1.
+      // The running statistics absorb the block's max and exponent sum
+      float block_scale[ATTN_BLOCK_Q];
+      for (size_t i = 0; i < rows; i++) {
+        acc_t block_max = scores[i][0];
+        for (size_t j = 1; j < cols; j++)
+          if (scores[i][j] > block_max) block_max = scores[i][j];
+
+        acc_t block_sum = 0;
+        for (size_t j = 0; j < cols; j++) {
+          const acc_t e = softmax_iexp(scores[i][j] - block_max, qln2, qln2_inv, qb, qc);
+          block_sum += e;
+          probs[i][j] = scale_and_sat(e, NO_ACTIVATION, 127.f / exp_one, 0);
+        }
+        for (size_t j = cols; j < ATTN_BLOCK_KV; j++)
+          probs[i][j] = 0;
+
+        const acc_t new_max = block_max > row_max[i] ? block_max : row_max[i];
+        const float old_scale = row_sum[i] == 0 ? 0 :
+          softmax_iexp(row_max[i] - new_max, qln2, qln2_inv, qb, qc) / exp_one;
+        block_scale[i] = softmax_iexp(block_max - new_max, qln2, qln2_inv, qb, qc) / exp_one;
+
+        row_max[i] = new_max;
+        row_sum[i] = row_sum[i] * old_scale + block_scale[i] * (block_sum / exp_one);
+        for (size_t d = 0; d < head_dim; d++)
+          acc_out[i][d] *= old_scale;
+      }
+
+      // partial = probs * V_blk
+      attention_block_matmul(rows, head_dim, cols,
+          &probs[0][0], V + kv0 * stride_V, &partial[0][0],
+          ATTN_BLOCK_KV, stride_V, ATTN_MAX_HEAD_DIM, false, tiled_matmul_type);
+
+      for (size_t i = 0; i < rows; i++)
+        for (size_t d = 0; d < head_dim; d++)
+          acc_out[i][d] += block_scale[i] * partial[i][d];
+    }
+
+    // The partial outputs are in units of 1/127, so dividing by the exponent
+    // sum gives the probabilities' 127-for-1 scale back
+    for (size_t i = 0; i < rows; i++)
+      for (size_t d = 0; d < head_dim; d++)
+        out[(q0 + i) * stride_out + d] =
+          scale_and_sat(ROUND_NEAR_EVEN(acc_out[i][d] / row_sum[i]), NO_ACTIVATION, ACC_SCALE_IDENTITY, 0);
+  }
+}
+
+// out = softmax(Q * K^T) * V for one attention head, exactly as a SOFTMAX
+// matmul followed by a matmul with V, one ATTN_BLOCK_Q-row block of queries at
+// a time. A block's int32 scores never leave the accumulator, where the
+// Normalizer takes their softmax. There is no path from the accumulator back
+// to the scratchpad, so the block's int8 probabilities go through one of two
+// block-sized buffers on their way to the probs * V matmul. The inner matmuls
+// don't fence, so the only fence of a block sits between its scores and its
+// probs * V, and retires the previous block's probs * V along with the scores.
+// That matmul reads the other buffer, so it overlaps this block's scores. The
+// buffers keep alternating across calls, which lets consecutive heads overlap
+// in the same way. Longer key/value sequences fall back to
+// tiled_attention_online.
+static void tiled_attention_auto(size_t seq_len_q, size_t seq_len_kv, size_t head_dim,
+        const elem_t * Q, const elem_t * K, const elem_t * V, elem_t * out,
+        size_t stride_Q, size_t stride_K, size_t stride_V, size_t stride_out,
+        acc_scale_t bert_scale,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+
+  if (bert_scale <= 0) {
+    printf("The softmax needs a positive bert_scale\n");
+    exit(1);
+  }
+
+  if (seq_len_kv > ATTN_MAX_ONCHIP_SEQ_KV) {
+    tiled_attention_online(seq_len_q, seq_len_kv, head_dim, Q, K, V, out,
+        stride_Q, stride_K, stride_V, stride_out,
+        bert_scale, tiled_matmul_type);
+    return;
+  }
+
+  static GEMMINI_THREAD_LOCAL elem_t probs[2][ATTN_BLOCK_Q * ATTN_MAX_ONCHIP_SEQ_KV];
+  static GEMMINI_THREAD_LOCAL size_t buffer = 0;
+
+  const bool fence_deferred = gemmini_kernel_fence_deferred;
+  gemmini_kernel_fence_deferred = true;
+
+  for (size_t q0 = 0; q0 < seq_len_q; q0 += ATTN_BLOCK_Q) {
+    const size_t rows = seq_len_q - q0 < ATTN_BLOCK_Q ? seq_len_q - q0 : ATTN_BLOCK_Q;
+    elem_t * block_probs = probs[buffer];
+    buffer = 1 - buffer;
+
+    // block_probs = softmax(Q_blk * K^T)
+    tiled_matmul_auto(rows, seq_len_kv, head_dim,
+        Q + q0 * stride_Q, K, NULL, block_probs,
+        stride_Q, stride_K, 0, seq_len_kv,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        SOFTMAX, ACC_SCALE_IDENTITY, bert_scale, false,
+        false, true,
+        false, false,
+        0,
+        tiled_matmul_type);
+
+    // The probabilities must reach memory before they are moved back in
+    gemmini_fence();
+
+    // out_blk = block_probs * V
+    tiled_matmul_auto(rows, head_dim, seq_len_kv,
+        block_probs, V, NULL, out + q0 * stride_out,
+        seq_len_kv, stride_V, 0, stride_out,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        NO_ACTIVATION, ACC_SCALE_IDENTITY, 0, false,
+        false, false,
+        false, false,
+        0,
+        tiled_matmul_type);
+  }
+
+  gemmini_kernel_fence_deferred = fence_deferred;
+  gemmini_kernel_fence();
+}
+
+#ifdef GEMMINI_EMULATOR
+#include "include/gemmini_emu.h"
+#endif
+
+#include "include/gemmini_capture.h"
+
 #undef abs
 
 #endif // SRC_MAIN_C_GEMMINI_H
@@ -0,0 +1,234 @@
+// See LICENSE for license details.
+
+// Activation arena planning.
+//
+// Networks that give every intermediate activation its own static buffer need
+// the sum of all of them in DRAM, although only a few are live at any point.
+// The planner walks the layers in execution order, with the activations each
+// one reads or writes. A tensor is live from the first layer that touches it
+// to the last one, and tensors whose lifetimes overlap get disjoint,
+// GEMMINI_ARENA_ALIGN-aligned ranges of a single arena, so the arena is about
+// as large as the biggest live set.
+//
+//   static struct gemmini_arena_t arena;
+//
+//   GEMMINI_ARENA_USE(&arena, conv_1_out);   // layer 0 writes conv_1_out
+//   gemmini_arena_next_layer(&arena);
+//   GEMMINI_ARENA_USE(&arena, conv_1_out);   // layer 1 reads it...
+//   GEMMINI_ARENA_USE(&arena, conv_2_out);   // ...and writes conv_2_out
+//   gemmini_arena_next_layer(&arena);
+//
+//   gemmini_arena_plan(&arena);
+//   gemmini_arena_bind(&arena, buffer);      // at least arena.size bytes
+//
+//   #define conv_1_out GEMMINI_ARENA_GET(&arena, conv_1_out)
+//
+// GEMMINI_ARENA_USE and GEMMINI_ARENA_GET take the statically declared
+// activation itself, for its size and type. Once every reference goes through
+// GEMMINI_ARENA_GET, the static buffer is unused and the compiler drops it.
+//
+// Planning leaves the arena back at layer 0, and the code that runs the layers
+// calls gemmini_arena_next_layer between them just like the plan did. A tensor
+// fetched outside the layers it was planned for, or a layer past the planned
+// ones, then exits, instead of quietly sharing memory with a live tensor.
+
+#ifndef SRC_MAIN_C_GEMMINI_ARENA_H
+#define SRC_MAIN_C_GEMMINI_ARENA_H
+
+#include <string.h>
+
+#include "include/gemmini.h"
+
+#ifndef GEMMINI_ARENA_MAX_TENSORS
+#define GEMMINI_ARENA_MAX_TENSORS 256
+#endif
+
+// One accumulator row, which keeps every tensor's rows DIM-aligned for both
+// elem_t and acc_t data
+#define GEMMINI_ARENA_ALIGN (DIM * sizeof(acc_t))
+
+struct gemmini_arena_tensor_t {
+  const char * name;
+  size_t bytes;
+  int first_layer, last_layer;
+  size_t offset;
+};
+
+struct gemmini_arena_t {
+  struct gemmini_arena_tensor_t tensors[GEMMINI_ARENA_MAX_TENSORS];
+  size_t n_tensors;
+  int layer;
+
+  // Set by gemmini_arena_plan
+  int n_layers;
+  size_t size;
+  bool planned;
+
+  char * base;
+};
+
+#define GEMMINI_ARENA_USE(arena, name) gemmini_arena_use((arena), #name, sizeof(name))
+#define GEMMINI_ARENA_GET(arena, name) (*(__typeof__(name) *)gemmini_arena_ptr((arena), #name))
+
+static void gemmini_arena_reset(struct gemmini_arena_t * arena) {
+  arena->n_tensors = 0;
+  arena->layer = 0;
+  arena->n_layers = 0;
+  arena->size = 0;
+  arena->planned = false;
+  arena->base = NULL;
+}
+
+static struct gemmini_arena_tensor_t * gemmini_arena_find(struct gemmini_arena_t * arena, const char * name) {
+  for (size_t t = 0; t < arena->n_tensors; t++)
+    if (strcmp(arena->tensors[t].name, name) == 0)
+      return &arena->tensors[t];
+  return NULL;
+}
+
+// Marks "name" as read or written by the current layer
+static void gemmini_arena_use(struct gemmini_arena_t * arena, const char * name, size_t bytes) {
+  if (arena->planned) {
+    printf("Can't add %s to an arena that has already been planned\n", name);
+    exit(1);
+  }
+
+  struct gemmini_arena_tensor_t * tensor = gemmini_arena_find(arena, name);
+
+  if (tensor == NULL) {
+    if (arena->n_tensors >= GEMMINI_ARENA_MAX_TENSORS) {
+      printf("Too many tensors in the arena; increase GEMMINI_ARENA_MAX_TENSORS\n");
+      exit(1);
+    }
+
+    tensor = &arena->tensors[arena->n_tensors++];
+    tensor->name = name;
+    tensor->bytes = bytes;
+    tensor->first_layer = arena->layer;
+  } else if (tensor->bytes != bytes) {
+    printf("%s is used with %llu bytes and with %llu bytes\n", name,
+        (unsigned long long)tensor->bytes, (unsigned long long)bytes);
+    exit(1);
+  }
+
+  tensor->last_layer = arena->layer;
+}
+
+static void gemmini_arena_next_layer(struct gemmini_arena_t * arena) {
+  arena->layer++;
+
+  if (arena->planned && arena->layer >= arena->n_layers) {
+    printf("Layer %d runs past the %d layers the arena was planned for\n",
+        arena->layer, arena->n_layers);
+    exit(1);
+  }
+}
+
+static bool gemmini_arena_live_together(const struct gemmini_arena_tensor_t * a,
+        const struct gemmini_arena_tensor_t * b) {
+  return a->first_layer <= b->last_layer && b->first_layer <= a->last_layer;
+}
+
+// Places the tensors largest first, each at the lowest offset that doesn't
+// collide with an already placed tensor that is live at the same time. The
+// big early activations then claim the bottom of the arena, and the small
+// later ones fill the gaps they leave behind
+static void gemmini_arena_plan(struct gemmini_arena_t * arena) {
+  const size_t n = arena->n_tensors;
+  size_t order[GEMMINI_ARENA_MAX_TENSORS];
+
+  for (size_t t = 0; t < n; t++) {
+    // Insertion sort, by size and then by first use
+    size_t pos = t;
+    for (; pos > 0; pos--) {
+      const struct gemmini_arena_tensor_t * prev = &arena->tensors[order[pos - 1]];
+      const struct gemmini_arena_tensor_t * cur = &arena->tensors[t];
+      if (prev->bytes > cur->bytes ||
+          (prev->bytes == cur->bytes && prev->first_layer <= cur->first_layer))
+        break;
+      order[pos] = order[pos - 1];
+    }
+    order[pos] = t;
+  }
+
+  arena->size = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    struct gemmini_arena_tensor_t * tensor = &arena->tensors[order[i]];
+    const size_t bytes = (tensor->bytes + GEMMINI_ARENA_ALIGN - 1) / GEMMINI_ARENA_ALIGN * GEMMINI_ARENA_ALIGN;
+    size_t offset = 0;
+
+    // Every collision moves the candidate offset up, so rescan until a pass
+    // finds none
+    bool moved = true;
+    while (moved) {
+      moved = false;
+
+      for (size_t j = 0; j < i; j++) {
+        const struct gemmini_arena_tensor_t * placed = &arena->tensors[order[j]];
+
+        if (gemmini_arena_live_together(tensor, placed) &&
+            offset < placed->offset + placed->bytes && placed->offset < offset + bytes) {
+          offset = (placed->offset + placed->bytes + GEMMINI_ARENA_ALIGN - 1) / GEMMINI_ARENA_ALIGN * GEMMINI_ARENA_ALIGN;
+          moved = true;
+        }
+      }
+    }
+
+    tensor->offset = offset;
+    if (offset + bytes > arena->size)
+      arena->size = offset + bytes;
+  }
+
+  arena->n_layers = arena->layer;
+  arena->layer = 0;
+  arena->planned = true;
+}
+
+// What separate buffers for every tensor would take
+static size_t gemmini_arena_unplanned_size(const struct gemmini_arena_t * arena) {
+  size_t size = 0;
+  for (size_t t = 0; t < arena->n_tensors; t++)
+    size += arena->tensors[t].bytes;
+  return size;
+}
+
+// "base" must hold arena->size bytes and be GEMMINI_ARENA_ALIGN-aligned
+static void gemmini_arena_bind(struct gemmini_arena_t * arena, void * base) {
+  if (!arena->planned) {
+    printf("The arena must be planned before it is bound\n");
+    exit(1);
+  }
+
+  if ((uintptr_t)base % GEMMINI_ARENA_ALIGN != 0) {
+    printf("The arena's base isn't aligned to %d bytes\n", (int)GEMMINI_ARENA_ALIGN);
+    exit(1);
+  }
+
+  arena->base = base;
+}
+
+static void * gemmini_arena_ptr(struct gemmini_arena_t * arena, const char * name) {
+  const struct gemmini_arena_tensor_t * tensor = gemmini_arena_find(arena, name);
+
+  if (tensor == NULL || arena->base == NULL) {
+    printf("%s isn't in a bound arena\n", name);
+    exit(1);
+  }
+
+  if (arena->layer < tensor->first_layer || arena->layer > tensor->last_layer) {
+    printf("%s is used by layer %d, outside the layers %d to %d it was planned for\n",
+        name, arena->layer, tensor->first_layer, tensor->last_layer);
+    exit(1);
+  }
+
+  return arena->base + tensor->offset;
+}
+
+static void gemmini_arena_print(const struct gemmini_arena_t * arena) {
+  printf("Activation arena: %llu bytes for %llu tensors over %d layers, instead of %llu bytes\n",
+      (unsigned long long)arena->size, (unsigned long long)arena->n_tensors, arena->n_layers,
+      (unsigned long long)gemmini_arena_unplanned_size(arena));
+}
+
+#endif // SRC_MAIN_C_GEMMINI_ARENA_H
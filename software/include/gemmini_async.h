@@ -0,0 +1,507 @@
+// See LICENSE for license details.
+
+// Asynchronous kernel submission.
+//
+// tiled_matmul_auto, tiled_matmul_resadd_auto, tiled_resadd_auto and
+// tiled_norm_auto end with a fence, so the CPU sits idle while each one
+// drains. Their *_async versions below return as soon as the kernel's
+// commands are issued, with a handle for the op instead. The kernels that
+// don't fence (convolutions, GEMVs, global averaging) have *_async versions
+// too, which only add the tracking:
+//
+//   gemmini_handle_t h = tiled_matmul_auto_async(...);
+//   ...                                    // CPU work that doesn't touch C
+//   gemmini_wait(h);                       // or gemmini_wait_read(C, bytes)
+//
+// The runtime remembers the DRAM ranges that each outstanding op reads and
+// writes. Gemmini orders its own commands through the scratchpad but not
+// through DRAM, so a new op that reads what an outstanding op writes, or
+// writes what one reads or writes, is only submitted after a fence. Ops with
+// disjoint ranges run back to back.
+//
+// RoCC reports no completions, so a handle is only known to be done once a
+// fence has retired after it. Waiting on any handle, or on any range an
+// outstanding op touches, fences and completes every op submitted so far.
+// Kernels that run on the CPU (tiled_matmul_type == CPU) run at submission,
+// after waiting on their own inputs and outputs.
+
+#ifndef SRC_MAIN_C_GEMMINI_ASYNC_H
+#define SRC_MAIN_C_GEMMINI_ASYNC_H
+
+#include "include/gemmini.h"
+
+#ifndef GEMMINI_ASYNC_MAX_OPS
+#define GEMMINI_ASYNC_MAX_OPS 64
+#endif
+
+#define GEMMINI_ASYNC_MAX_READS 4
+
+// Handles count up from 1. GEMMINI_HANDLE_DONE is complete from the start
+typedef uint64_t gemmini_handle_t;
+#define GEMMINI_HANDLE_DONE 0
+
+struct gemmini_async_range_t {
+  uintptr_t start, end;
+};
+
+struct gemmini_async_op_t {
+  struct gemmini_async_range_t reads[GEMMINI_ASYNC_MAX_READS];
+  size_t n_reads;
+  struct gemmini_async_range_t write;
+};
+
+static GEMMINI_THREAD_LOCAL struct {
+  struct gemmini_async_op_t ops[GEMMINI_ASYNC_MAX_OPS];
+  size_t n_ops;
+
+  gemmini_handle_t submitted, completed;
+  uint64_t fences;
+} gemmini_async;
+
+// The bytes spanned by a rows x cols matrix of elem_bytes-sized elements,
+// stride elements apart
+static struct gemmini_async_range_t gemmini_async_matrix(const void * base, size_t rows, size_t cols,
+        size_t stride, size_t elem_bytes) {
+  struct gemmini_async_range_t range = {(uintptr_t)base, (uintptr_t)base};
+  if (base != NULL && rows > 0 && cols > 0)
+    range.end += ((rows - 1) * stride + cols) * elem_bytes;
+  return range;
+}
+
+// The bytes spanned by "heads" copies of a range, head_stride bytes apart
+static struct gemmini_async_range_t gemmini_async_heads(struct gemmini_async_range_t head,
+        size_t heads, size_t head_stride) {
+  if (head.start != head.end && heads > 0)
+    head.end += (heads - 1) * head_stride;
+  return head;
+}
+
+static bool gemmini_async_overlap(struct gemmini_async_range_t a, struct gemmini_async_range_t b) {
+  return a.start < b.end && b.start < a.end;
+}
+
+// Whether an op reading "reads" and writing "write" must wait for the
+// outstanding ops
+static bool gemmini_async_conflicts(const struct gemmini_async_range_t * reads, size_t n_reads,
+        struct gemmini_async_range_t write) {
+  for (size_t o = 0; o < gemmini_async.n_ops; o++) {
+    const struct gemmini_async_op_t * op = &gemmini_async.ops[o];
+
+    if (gemmini_async_overlap(op->write, write))
+      return true;
+
+    for (size_t r = 0; r < n_reads; r++)
+      if (gemmini_async_overlap(op->write, reads[r]))
+        return true;
+
+    for (size_t r = 0; r < op->n_reads; r++)
+      if (gemmini_async_overlap(op->reads[r], write))
+        return true;
+  }
+
+  return false;
+}
+
+// Completes every outstanding op
+static void gemmini_wait_all(void) {
+  if (gemmini_async.n_ops == 0)
+    return;
+
+  gemmini_fence();
+  gemmini_async.fences++;
+  gemmini_async.n_ops = 0;
+  gemmini_async.completed = gemmini_async.submitted;
+}
+
+static bool gemmini_done(gemmini_handle_t handle) {
+  return handle <= gemmini_async.completed;
+}
+
+static void gemmini_wait(gemmini_handle_t handle) {
+  if (!gemmini_done(handle))
+    gemmini_wait_all();
+}
+
+// Waits until the CPU can read, or write, bytes at addr
+static void gemmini_wait_read(const void * addr, size_t bytes) {
+  const struct gemmini_async_range_t range = {(uintptr_t)addr, (uintptr_t)addr + bytes};
+  const struct gemmini_async_range_t none = {0, 0};
+  if (gemmini_async_conflicts(&range, 1, none))
+    gemmini_wait_all();
+}
+
+static void gemmini_wait_write(const void * addr, size_t bytes) {
+  const struct gemmini_async_range_t range = {(uintptr_t)addr, (uintptr_t)addr + bytes};
+  if (gemmini_async_conflicts(NULL, 0, range))
+    gemmini_wait_all();
+}
+
+// Makes way for an op with the given ranges. Accelerator ops are recorded,
+// and must then be issued with the kernel's own closing fence deferred
+static gemmini_handle_t gemmini_async_begin(const struct gemmini_async_range_t * reads, size_t n_reads,
+        struct gemmini_async_range_t write, bool on_cpu) {
+  if (gemmini_async_conflicts(reads, n_reads, write) || gemmini_async.n_ops == GEMMINI_ASYNC_MAX_OPS)
+    gemmini_wait_all();
+
+  if (on_cpu)
+    return GEMMINI_HANDLE_DONE;
+
+  struct gemmini_async_op_t * op = &gemmini_async.ops[gemmini_async.n_ops++];
+  op->n_reads = n_reads;
+  for (size_t r = 0; r < n_reads; r++)
+    op->reads[r] = reads[r];
+  op->write = write;
+
+  gemmini_kernel_fence_deferred = true;
+  return ++gemmini_async.submitted;
+}
+
+static void gemmini_async_end(void) {
+  gemmini_kernel_fence_deferred = false;
+}
+
+static gemmini_handle_t tiled_matmul_auto_async(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+  const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+
+  const struct gemmini_async_range_t reads[] = {
+    transpose_A ? gemmini_async_matrix(A, dim_K, dim_I, stride_A, sizeof(elem_t)) :
+      gemmini_async_matrix(A, dim_I, dim_K, stride_A, sizeof(elem_t)),
+    transpose_B ? gemmini_async_matrix(B, dim_J, dim_K, stride_B, sizeof(elem_t)) :
+      gemmini_async_matrix(B, dim_K, dim_J, stride_B, sizeof(elem_t)),
+    gemmini_async_matrix(D, repeating_bias ? 1 : dim_I, dim_J, stride_D, sizeof_D),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_matrix(C, dim_I, dim_J, stride_C, sizeof_C), tiled_matmul_type == CPU);
+
+  tiled_matmul_auto(dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      weightA, tiled_matmul_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+static gemmini_handle_t tiled_matmul_heads_auto_async(size_t heads,
+        size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        size_t head_stride_A, size_t head_stride_B, size_t head_stride_D, size_t head_stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+  const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_heads(transpose_A ? gemmini_async_matrix(A, dim_K, dim_I, stride_A, sizeof(elem_t)) :
+      gemmini_async_matrix(A, dim_I, dim_K, stride_A, sizeof(elem_t)), heads, head_stride_A * sizeof(elem_t)),
+    gemmini_async_heads(transpose_B ? gemmini_async_matrix(B, dim_J, dim_K, stride_B, sizeof(elem_t)) :
+      gemmini_async_matrix(B, dim_K, dim_J, stride_B, sizeof(elem_t)), heads, head_stride_B * sizeof(elem_t)),
+    gemmini_async_heads(gemmini_async_matrix(D, repeating_bias ? 1 : dim_I, dim_J, stride_D, sizeof_D),
+      heads, head_stride_D * sizeof_D),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_heads(gemmini_async_matrix(C, dim_I, dim_J, stride_C, sizeof_C), heads, head_stride_C * sizeof_C),
+      tiled_matmul_type == CPU);
+
+  tiled_matmul_heads_auto(heads, dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      head_stride_A, head_stride_B, head_stride_D, head_stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      weightA, tiled_matmul_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+static gemmini_handle_t tiled_matmul_resadd_auto_async(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const acc_t * D, const elem_t * R, elem_t * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_R, size_t stride_C,
+        scale_t R_scale_factor,
+        int act, acc_scale_t scale,
+        bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(A, dim_I, dim_K, stride_A, sizeof(elem_t)),
+    gemmini_async_matrix(B, dim_K, dim_J, stride_B, sizeof(elem_t)),
+    gemmini_async_matrix(D, repeating_bias ? 1 : dim_I, dim_J, stride_D, sizeof(acc_t)),
+    gemmini_async_matrix(R, dim_I, dim_J, stride_R, sizeof(elem_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 4,
+      gemmini_async_matrix(C, dim_I, dim_J, stride_C, sizeof(elem_t)), tiled_matmul_type == CPU);
+
+  tiled_matmul_resadd_auto(dim_I, dim_J, dim_K, A, B, D, R, C,
+      stride_A, stride_B, stride_D, stride_R, stride_C,
+      R_scale_factor, act, scale, repeating_bias,
+      tiled_matmul_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+// B is in the K-blocked layout that gemv_auto expects, so it spans one
+// stride_B-wide row per padded output column
+static gemmini_handle_t gemv_auto_async(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        size_t a_spad_id, size_t b_spad_id, size_t c_spad_id) {
+  const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+  const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+  const size_t J_PAD = ((dim_J + DIM - 1) / DIM) * DIM;
+
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(A, dim_I, dim_K, stride_A, sizeof(elem_t)),
+    gemmini_async_matrix(B, J_PAD, stride_B, stride_B, sizeof(elem_t)),
+    gemmini_async_matrix(D, repeating_bias ? 1 : dim_I, dim_J, stride_D, sizeof_D),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_matrix(C, dim_I, dim_J, stride_C, sizeof_C), false);
+
+  gemv_auto(dim_I, dim_J, dim_K, A, B, D, C,
+      stride_A, stride_B, stride_D, stride_C,
+      A_scale_factor, B_scale_factor, D_scale_factor,
+      act, scale, bert_scale, repeating_bias,
+      transpose_A, transpose_B, full_C, low_D,
+      a_spad_id, b_spad_id, c_spad_id);
+
+  gemmini_async_end();
+  return handle;
+}
+
+// tiled_conv_auto doesn't fence, so this only adds the dependency tracking
+static gemmini_handle_t tiled_conv_auto_async(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type) {
+  const bool no_pool = pool_stride == 0 || pool_size <= 1;
+  const size_t pool_out_row_dim = no_pool ? out_row_dim : (out_row_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+  const size_t pool_out_col_dim = no_pool ? out_col_dim : (out_col_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(input, 1, (size_t)batch_size * in_row_dim * in_col_dim * in_channels, 0, sizeof(elem_t)),
+    gemmini_async_matrix(weights, 1, (size_t)kernel_dim * kernel_dim * in_channels * out_channels, 0, sizeof(elem_t)),
+    gemmini_async_matrix(bias, 1, out_channels, 0, sizeof(acc_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_matrix(output, 1, batch_size * pool_out_row_dim * pool_out_col_dim * out_channels, 0, sizeof(elem_t)),
+      tiled_conv_type == CPU);
+
+  tiled_conv_auto(batch_size, in_row_dim, in_col_dim, in_channels,
+      out_channels, out_row_dim, out_col_dim,
+      stride, input_dilation, kernel_dilation, padding, kernel_dim,
+      wrot180, trans_output_1203, trans_input_3120,
+      trans_weight_1203, trans_weight_0132,
+      input, weights, bias, output,
+      act, scale, pool_size, pool_stride, pool_padding,
+      tiled_conv_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+static gemmini_handle_t tiled_conv_dw_auto_async(
+        int batch_size, int in_row_dim, int in_col_dim,
+        int channels, int out_row_dim, int out_col_dim,
+        int stride, int padding, int kernel_dim,
+
+        elem_t * input,
+        elem_t * weights,
+        acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type) {
+  const bool no_pool = pool_stride == 0;
+  const size_t pool_out_row_dim = no_pool ? out_row_dim : (out_row_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+  const size_t pool_out_col_dim = no_pool ? out_col_dim : (out_col_dim + 2 * pool_padding - pool_size) / pool_stride + 1;
+
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(input, 1, (size_t)batch_size * in_row_dim * in_col_dim * channels, 0, sizeof(elem_t)),
+    gemmini_async_matrix(weights, 1, (size_t)channels * kernel_dim * kernel_dim, 0, sizeof(elem_t)),
+    gemmini_async_matrix(bias, 1, channels, 0, sizeof(acc_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_matrix(output, 1, batch_size * pool_out_row_dim * pool_out_col_dim * channels, 0, sizeof(elem_t)),
+      tiled_conv_type == CPU);
+
+  tiled_conv_dw_auto(batch_size, in_row_dim, in_col_dim,
+      channels, out_row_dim, out_col_dim,
+      stride, padding, kernel_dim,
+      input, weights, bias, output,
+      act, scale, pool_size, pool_stride, pool_padding,
+      tiled_conv_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+// tiled_conv_downsample issues one tiled_matmul_auto per output row, and
+// their fences are all deferred
+static gemmini_handle_t tiled_conv_downsample_async(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int in_stride, int weight_stride, int out_stride,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+
+        enum tiled_matmul_type_t tiled_conv_type) {
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(input, (size_t)batch_size * in_row_dim * in_col_dim, in_channels, in_stride, sizeof(elem_t)),
+    gemmini_async_matrix(weights, in_channels, out_channels, weight_stride, sizeof(elem_t)),
+    gemmini_async_matrix(bias, 1, out_channels, 0, sizeof(acc_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_matrix(output, (size_t)batch_size * out_row_dim * out_col_dim, out_channels, out_stride, sizeof(elem_t)),
+      tiled_conv_type == CPU);
+
+  tiled_conv_downsample(batch_size, in_row_dim, in_col_dim, in_channels,
+      out_channels, out_row_dim, out_col_dim,
+      in_stride, weight_stride, out_stride,
+      input, weights, bias, output,
+      act, scale, tiled_conv_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+static gemmini_handle_t tiled_resadd_auto_async(const size_t I, const size_t J,
+        const scale_t A_scale,
+        const scale_t B_scale,
+        const acc_scale_t C_scale,
+        const elem_t * A,
+        const elem_t * B,
+        elem_t * C,
+        bool relu,
+        enum tiled_matmul_type_t matadd_type) {
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(A, I, J, J, sizeof(elem_t)),
+    gemmini_async_matrix(B, I, J, J, sizeof(elem_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 2,
+      gemmini_async_matrix(C, I, J, J, sizeof(elem_t)), matadd_type == CPU);
+
+  tiled_resadd_auto(I, J, A_scale, B_scale, C_scale, A, B, C, relu, matadd_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+static gemmini_handle_t tiled_norm_auto_async(const size_t I, const size_t J,
+        const acc_t * in,
+        elem_t * out,
+        const acc_scale_t C_scale,
+        int act,
+        enum tiled_matmul_type_t norm_type) {
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(in, I, J, J, sizeof(acc_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 1,
+      gemmini_async_matrix(out, I, J, J, sizeof(elem_t)), norm_type == CPU);
+
+  tiled_norm_auto(I, J, in, out, C_scale, act, norm_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+static gemmini_handle_t tiled_global_average_auto_async(const elem_t * input, elem_t * output,
+        int batches, int channels, int dim,
+        enum tiled_matmul_type_t type) {
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(input, 1, (size_t)batches * dim * dim * channels, 0, sizeof(elem_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 1,
+      gemmini_async_matrix(output, batches, channels, channels, sizeof(elem_t)), type == CPU);
+
+  tiled_global_average_auto(input, output, batches, channels, dim, type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+// tiled_attention_auto fences once per block of queries, which only retires
+// its own earlier blocks and the ops before it, and defers its closing fence.
+// Key/value sequences too long for the accumulator go through
+// tiled_attention_online, which takes its softmax on the CPU, so those run at
+// submission like the CPU kernels
+static gemmini_handle_t tiled_attention_auto_async(size_t seq_len_q, size_t seq_len_kv, size_t head_dim,
+        const elem_t * Q, const elem_t * K, const elem_t * V, elem_t * out,
+        size_t stride_Q, size_t stride_K, size_t stride_V, size_t stride_out,
+        acc_scale_t bert_scale,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  const struct gemmini_async_range_t reads[] = {
+    gemmini_async_matrix(Q, seq_len_q, head_dim, stride_Q, sizeof(elem_t)),
+    gemmini_async_matrix(K, seq_len_kv, head_dim, stride_K, sizeof(elem_t)),
+    gemmini_async_matrix(V, seq_len_kv, head_dim, stride_V, sizeof(elem_t)),
+  };
+
+  const gemmini_handle_t handle = gemmini_async_begin(reads, 3,
+      gemmini_async_matrix(out, seq_len_q, head_dim, stride_out, sizeof(elem_t)),
+      tiled_matmul_type == CPU || seq_len_kv > ATTN_MAX_ONCHIP_SEQ_KV);
+
+  tiled_attention_auto(seq_len_q, seq_len_kv, head_dim, Q, K, V, out,
+      stride_Q, stride_K, stride_V, stride_out,
+      bert_scale, tiled_matmul_type);
+
+  gemmini_async_end();
+  return handle;
+}
+
+#endif // SRC_MAIN_C_GEMMINI_ASYNC_H
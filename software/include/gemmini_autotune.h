@@ -0,0 +1,456 @@
+// See LICENSE for license details.
+
+// Counter-driven tile autotuning.
+//
+// tiled_matmul_auto, tiled_mpgemm_auto and tiled_conv_auto pick their tiling
+// factors with greedy "grow until it no longer fits" loops. The functions here
+// instead run one layer under a set of candidate tilings, score each with the
+// performance counters, and store the winner in the table that the *_auto
+// functions consult before their own heuristics (gemmini_tuned_tiles in
+// gemmini.h). Every later WS call with the same shape then uses the tuned
+// tiles:
+//
+//   tiled_matmul_autotune(...the arguments of tiled_matmul_auto, minus the type...);
+//   tiled_conv_autotune(...the arguments of tiled_conv_auto, minus the type...);
+//   gemmini_tune_print_lut();
+//
+// Baremetal programs have no filesystem, so the table persists as the header
+// gemmini_tune_print_lut() prints. Save it as, say, tuned_tiles.h and compile
+// with -DGEMMINI_TUNED_TILES='"tuned_tiles.h"' to start from it.
+//
+// A candidate scores max(EXE_ACTIVE_CYCLE, RDMA_ACTIVE_CYCLE) +
+// LOAD_DMA_WAIT_CYCLE. Execution and DMA reads overlap, so the busier of the
+// two bounds the layer, while the load controller's DMA stalls come on top.
+// Each candidate really runs the layer, so its output must not alias any of
+// its inputs.
+
+#ifndef SRC_MAIN_C_GEMMINI_AUTOTUNE_H
+#define SRC_MAIN_C_GEMMINI_AUTOTUNE_H
+
+#include "include/gemmini.h"
+
+// Print every candidate and its score
+#ifndef GEMMINI_TUNE_VERBOSE
+#define GEMMINI_TUNE_VERBOSE 0
+#endif
+
+// Stores "tiles" for a shape, replacing any earlier entry for it
+static void gemmini_tune_store(int kind, const int * key, const int * tiles) {
+  for (size_t e = 0; e < GEMMINI_TUNE_LUT_SIZE; e++) {
+    struct gemmini_tuned_tiles_t * entry = &gemmini_tuned_tiles_lut[e];
+
+    if (entry->kind == 0 ||
+        (entry->kind == kind && memcmp(entry->key, key, sizeof(entry->key)) == 0)) {
+      entry->kind = kind;
+      memcpy(entry->key, key, sizeof(entry->key));
+      memcpy(entry->tiles, tiles, sizeof(entry->tiles));
+      return;
+    }
+  }
+
+  printf("The tuned tile table is full; raise GEMMINI_TUNE_LUT_SIZE\n");
+  exit(1);
+}
+
+static void gemmini_tune_counters_start() {
+  gemmini_fence();
+  counter_configure(0, EXE_ACTIVE_CYCLE);
+  counter_configure(1, RDMA_ACTIVE_CYCLE);
+  counter_configure(2, LOAD_DMA_WAIT_CYCLE);
+}
+
+static uint64_t gemmini_tune_counters_score() {
+  gemmini_fence();
+  const uint64_t exe = counter_read(0);
+  const uint64_t rdma = counter_read(1);
+  const uint64_t dma_wait = counter_read(2);
+
+  counter_configure(0, DISABLE);
+  counter_configure(1, DISABLE);
+  counter_configure(2, DISABLE);
+
+  return (exe > rdma ? exe : rdma) + dma_wait;
+}
+
+static void gemmini_tune_print_tiles(const char * name, const int * tiles, size_t n, uint64_t score) {
+  printf("%s:", name);
+  for (size_t i = 0; i < n; i++)
+    printf(" %d", tiles[i]);
+  printf(" -> %llu\n", (unsigned long long)score);
+}
+
+// Prints the table as a header for GEMMINI_TUNED_TILES
+static void gemmini_tune_print_lut() {
+  printf("// Generated by gemmini_tune_print_lut()\n");
+  printf("#define GEMMINI_TUNED_TILE_ENTRIES \\\n");
+
+  for (size_t e = 0; e < GEMMINI_TUNE_LUT_SIZE && gemmini_tuned_tiles_lut[e].kind != 0; e++) {
+    const struct gemmini_tuned_tiles_t * entry = &gemmini_tuned_tiles_lut[e];
+
+    printf("  {%d, {", entry->kind);
+    for (size_t i = 0; i < GEMMINI_TUNE_KEY_LEN; i++)
+      printf(i == 0 ? "%d" : ", %d", entry->key[i]);
+    printf("}, {");
+    for (size_t i = 0; i < GEMMINI_TUNE_TILES_LEN; i++)
+      printf(i == 0 ? "%d" : ", %d", entry->tiles[i]);
+    printf("}}, \\\n");
+  }
+
+  printf("\n");
+}
+
+// Tile sizes worth trying along a dimension of "blocks" blocks: the powers of
+// two below it, and all of it
+static size_t gemmini_tune_tile_sizes(size_t blocks, size_t sizes[64]) {
+  size_t n = 0;
+  for (size_t s = 1; s < blocks; s *= 2)
+    sizes[n++] = s;
+  sizes[n++] = blocks;
+  return n;
+}
+
+struct gemmini_tune_matmul_t {
+  size_t dim_I, dim_J, dim_K;
+  const elem_t * A;
+  const elem_t * B;
+  const void * D;
+  void * C;
+  size_t stride_A, stride_B, stride_D, stride_C;
+  scale_t A_scale_factor, B_scale_factor;
+  scale_acc_t D_scale_factor;
+  int act;
+  acc_scale_t scale, bert_scale;
+  bool repeating_bias, transpose_A, transpose_B, full_C, low_D;
+  uint8_t weightA;
+};
+
+static void gemmini_tune_matmul_run(int kind, const struct gemmini_tune_matmul_t * mm) {
+  if (kind == GEMMINI_TUNE_MPGEMM)
+    tiled_mpgemm_auto(mm->dim_I, mm->dim_J, mm->dim_K,
+        mm->A, mm->B, mm->D, mm->C,
+        mm->stride_A, mm->stride_B, mm->stride_D, mm->stride_C,
+        mm->A_scale_factor, mm->B_scale_factor, mm->D_scale_factor,
+        mm->act, mm->scale, mm->bert_scale, mm->repeating_bias,
+        mm->transpose_B, mm->full_C, mm->low_D,
+        WS);
+  else
+    tiled_matmul_auto(mm->dim_I, mm->dim_J, mm->dim_K,
+        mm->A, mm->B, mm->D, mm->C,
+        mm->stride_A, mm->stride_B, mm->stride_D, mm->stride_C,
+        mm->A_scale_factor, mm->B_scale_factor, mm->D_scale_factor,
+        mm->act, mm->scale, mm->bert_scale, mm->repeating_bias,
+        mm->transpose_A, mm->transpose_B, mm->full_C, mm->low_D,
+        mm->weightA,
+        WS);
+}
+
+// Tries every (tile_I, tile_J) from gemmini_tune_tile_sizes that fits in half
+// the accumulator, each with every tile_K from gemmini_tune_tile_sizes up to the
+// largest that fits in half the scratchpad. Layernorm and softmax need whole
+// output rows, so for them tile_J always spans all of J
+static void gemmini_tune_matmul(int kind, const struct gemmini_tune_matmul_t * mm) {
+  // Ternary weights pack four outputs per byte, so mpgemm tiles J in packed
+  // blocks
+  const size_t dim_J = kind == GEMMINI_TUNE_MPGEMM ? mm->dim_J / 4 : mm->dim_J;
+
+  const size_t I_blocks = mm->dim_I / DIM + (mm->dim_I % DIM != 0);
+  const size_t J_blocks = dim_J / DIM + (dim_J % DIM != 0);
+  const size_t K_blocks = mm->dim_K / DIM + (mm->dim_K % DIM != 0);
+
+  const size_t max_spad_rows = BANK_NUM * BANK_ROWS / 2;
+  const size_t max_acc_rows = ACC_ROWS / 2;
+
+  const bool full_rows = mm->act == LAYERNORM || mm->act == SOFTMAX;
+
+  const int key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_MATMUL_KEY(mm->dim_I, mm->dim_J, mm->dim_K,
+      mm->act, kind == GEMMINI_TUNE_MPGEMM ? false : mm->transpose_A, mm->transpose_B, mm->full_C, mm->low_D);
+
+  size_t I_sizes[64], J_sizes[64], K_sizes[64];
+  const size_t I_n = gemmini_tune_tile_sizes(I_blocks, I_sizes);
+  const size_t K_n = gemmini_tune_tile_sizes(K_blocks, K_sizes);
+  const size_t J_n = full_rows ? 1 : gemmini_tune_tile_sizes(J_blocks, J_sizes);
+  if (full_rows)
+    J_sizes[0] = J_blocks;
+
+  int best[GEMMINI_TUNE_TILES_LEN] = {0};
+  uint64_t best_score = 0;
+
+  for (size_t i = 0; i < I_n; i++) {
+    for (size_t j = 0; j < J_n; j++) {
+      const size_t ti = I_sizes[i], tj = J_sizes[j];
+
+      const size_t acc_rows = kind == GEMMINI_TUNE_MPGEMM ?
+        tiled_mpgemm_total_acc_rows(ti, tj) : tiled_matmul_total_acc_rows(ti, tj);
+      const size_t spad_rows_per_k = kind == GEMMINI_TUNE_MPGEMM ?
+        tiled_mpgemm_total_spad_rows(ti, tj, 1) : tiled_matmul_total_spad_rows(ti, tj, 1);
+
+      if (acc_rows > max_acc_rows || spad_rows_per_k > max_spad_rows)
+        continue;
+
+      const size_t max_tk = max_spad_rows / spad_rows_per_k;
+      size_t last_tk = 0;
+
+      for (size_t k = 0; k < K_n; k++) {
+        // Sizes past max_tk all clamp to it, so it's tried once
+        const size_t tk = K_sizes[k] > max_tk ? max_tk : K_sizes[k];
+        if (tk == last_tk)
+          continue;
+        last_tk = tk;
+
+        const int tiles[GEMMINI_TUNE_TILES_LEN] = {ti, tj, tk};
+        gemmini_tune_store(kind, key, tiles);
+
+        gemmini_tune_counters_start();
+        gemmini_tune_matmul_run(kind, mm);
+        const uint64_t score = gemmini_tune_counters_score();
+
+#if GEMMINI_TUNE_VERBOSE
+        gemmini_tune_print_tiles("tile_I, tile_J, tile_K", tiles, 3, score);
+#endif
+
+        // On ties, fewer and larger tiles are cheaper to issue
+        if (best[0] == 0 || score < best_score ||
+            (score == best_score && ti * tj * tk > (size_t)(best[0] * best[1] * best[2]))) {
+          memcpy(best, tiles, sizeof(best));
+          best_score = score;
+        }
+      }
+    }
+  }
+
+  if (best[0] == 0) {
+    printf("No tiling of this matmul fits in the scratchpad and accumulator\n");
+    exit(1);
+  }
+
+  gemmini_tune_store(kind, key, best);
+}
+
+static void tiled_matmul_autotune(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA) {
+
+  const struct gemmini_tune_matmul_t mm = {dim_I, dim_J, dim_K, A, B, D, C,
+    stride_A, stride_B, stride_D, stride_C,
+    A_scale_factor, B_scale_factor, D_scale_factor,
+    act, scale, bert_scale, repeating_bias, transpose_A, transpose_B, full_C, low_D,
+    weightA};
+
+  gemmini_tune_matmul(GEMMINI_TUNE_MATMUL, &mm);
+}
+
+static void tiled_mpgemm_autotune(size_t dim_I, size_t dim_J_out, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_B,
+        bool full_C, bool low_D) {
+
+  const struct gemmini_tune_matmul_t mm = {dim_I, dim_J_out, dim_K, A, B, D, C,
+    stride_A, stride_B, stride_D, stride_C,
+    A_scale_factor, B_scale_factor, D_scale_factor,
+    act, scale, bert_scale, repeating_bias, false, transpose_B, full_C, low_D,
+    0};
+
+  gemmini_tune_matmul(GEMMINI_TUNE_MPGEMM, &mm);
+}
+
+// Conv candidates start from tiled_conv_stride_auto's own tiling. Each of
+// batches, porows, pocols, pochs, krows, kcols and kchs is then halved, and the
+// space it frees is given to one of the others, doubling it where that still
+// fits.
+// Channels stay multiples of DIM, or of 4*DIM for packed ternary output
+// channels, so the array stays fully used
+static void tiled_conv_stride_autotune(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        int in_stride, int weight_stride, int out_stride,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        bool is_mpgemm) {
+
+    // The same shape normalization as tiled_conv_stride_auto, so that the keys
+    // match
+    const bool no_pool = pool_stride == 0;
+    const int key_pool_size = no_pool ? 1 : pool_size;
+    const int key_pool_stride = no_pool ? 1 : pool_stride;
+    const int key_pool_padding = no_pool ? 0 : pool_padding;
+
+    const int pool_out_row_dim = (out_row_dim + 2 * key_pool_padding - key_pool_size) / key_pool_stride + 1;
+    const int pool_out_col_dim = (out_col_dim + 2 * key_pool_padding - key_pool_size) / key_pool_stride + 1;
+
+    const bool downsample = stride == 2 && kernel_dim == 1 && padding == 0 && no_pool && in_row_dim % 2 == 0 && in_col_dim % 2 == 0;
+
+    const int key[GEMMINI_TUNE_KEY_LEN] = GEMMINI_TUNE_CONV_KEY(batch_size, in_row_dim, in_col_dim,
+        in_channels, out_channels, out_row_dim, out_col_dim,
+        stride, input_dilation, kernel_dilation, padding, kernel_dim,
+        trans_weight_0132, trans_input_3120, key_pool_size, key_pool_stride, is_mpgemm);
+
+    const int max_args[] = {batch_size, pool_out_row_dim, pool_out_col_dim, out_channels, kernel_dim, kernel_dim, in_channels};
+    const int och_block = is_mpgemm ? 4*DIM : DIM;
+    const int tuned_idx[] = {0, 1, 2, 3, 4, 5, 6};
+    const int n_tuned = sizeof(tuned_idx) / sizeof(tuned_idx[0]);
+
+    const int max_spad_rows = (BANK_NUM*BANK_ROWS / 2);
+    const int max_acc_rows = (ACC_ROWS / 2);
+
+    // Start without a tuned entry, so tiled_conv_auto_args gives the
+    // heuristic's own tiling
+    int start[GEMMINI_TUNE_TILES_LEN];
+    tiled_conv_auto_args(start, batch_size, in_channels, out_channels,
+        pool_out_row_dim, pool_out_col_dim,
+        stride, input_dilation, kernel_dilation, downsample, kernel_dim,
+        trans_weight_0132, trans_input_3120,
+        key_pool_size, key_pool_stride, is_mpgemm);
+
+    int best[GEMMINI_TUNE_TILES_LEN];
+    memcpy(best, start, sizeof(best));
+    uint64_t best_score = 0;
+    bool found = false;
+
+    // Candidate (shrunk, grown) pairs; shrunk == -1 is the starting tiling,
+    // and grown == -1 leaves the freed space unused
+    for (int s = -1; s < n_tuned; s++) {
+      for (int g = -1; g < n_tuned; g++) {
+        if ((s == -1 && g != -1) || (s != -1 && g == s))
+          continue;
+
+        int args[GEMMINI_TUNE_TILES_LEN];
+        memcpy(args, start, sizeof(args));
+
+        if (s != -1) {
+          const int i = tuned_idx[s];
+          const int granularity = i == 3 ? och_block : i == 6 ? DIM : 1;
+          const int halved = (args[i] / 2 / granularity) * granularity;
+
+          if (halved == 0)
+            continue;
+          args[i] = halved;
+        }
+
+        if (g != -1) {
+          const int i = tuned_idx[g];
+          if (args[i] >= max_args[i])
+            continue;
+          args[i] = args[i] * 2 > max_args[i] ? max_args[i] : args[i] * 2;
+        }
+
+        const int spad_rows = tiled_conv_total_spad_rows(false,
+            stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
+            args[0], args[1], args[2], args[3], args[4], args[5], args[6], key_pool_size, key_pool_stride, is_mpgemm);
+        const int acc_rows = tiled_conv_total_spad_rows(true,
+            stride, input_dilation, kernel_dilation, downsample, trans_weight_0132, trans_input_3120,
+            args[0], args[1], args[2], args[3], args[4], args[5], args[6], key_pool_size, key_pool_stride, is_mpgemm);
+
+        if (spad_rows > max_spad_rows || acc_rows > max_acc_rows)
+          continue;
+
+        gemmini_tune_store(GEMMINI_TUNE_CONV, key, args);
+
+        gemmini_tune_counters_start();
+        tiled_conv_stride_auto(
+            batch_size, in_row_dim, in_col_dim, in_channels,
+            out_channels, out_row_dim, out_col_dim,
+            stride, input_dilation, kernel_dilation, padding, kernel_dim,
+            in_stride, weight_stride, out_stride,
+            wrot180, trans_output_1203, trans_input_3120,
+            trans_weight_1203, trans_weight_0132,
+            input, weights, bias, output,
+            act, scale, pool_size, pool_stride, pool_padding,
+            WS, is_mpgemm);
+        const uint64_t score = gemmini_tune_counters_score();
+
+#if GEMMINI_TUNE_VERBOSE
+        gemmini_tune_print_tiles("batches, porows, pocols, pochs, krows, kcols, kchs", args, 7, score);
+#endif
+
+        // Ties keep the earlier candidate, which prefers the heuristic's own
+        // tiling
+        if (!found || score < best_score) {
+          memcpy(best, args, sizeof(best));
+          best_score = score;
+          found = true;
+        }
+      }
+    }
+
+    // With no candidate run, nothing was stored, and tiled_conv_auto keeps its
+    // own heuristic
+    if (found)
+      gemmini_tune_store(GEMMINI_TUNE_CONV, key, best);
+}
+
+static void tiled_conv_autotune(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding) {
+
+    tiled_conv_stride_autotune(
+        batch_size, in_row_dim, in_col_dim, in_channels,
+        out_channels, out_row_dim, out_col_dim,
+        stride, input_dilation, kernel_dilation, padding, kernel_dim,
+        in_channels, out_channels, out_channels,
+        wrot180, trans_output_1203, trans_input_3120,
+        trans_weight_1203, trans_weight_0132,
+        input, weights, bias, output,
+        act, scale, pool_size, pool_stride, pool_padding,
+        false);
+}
+
+static void tiled_conv_mpgemm_autotune(
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding) {
+
+    tiled_conv_stride_autotune(
+        batch_size, in_row_dim, in_col_dim, in_channels,
+        out_channels, out_row_dim, out_col_dim,
+        stride, input_dilation, kernel_dilation, padding, kernel_dim,
+        in_channels, out_channels / 4, out_channels,
+        wrot180, trans_output_1203, trans_input_3120,
+        false, false,
+        input, weights, bias, output,
+        act, scale, pool_size, pool_stride, pool_padding,
+        true);
+}
+
+#endif // SRC_MAIN_C_GEMMINI_AUTOTUNE_H
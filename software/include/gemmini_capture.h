@@ -0,0 +1,223 @@
+// See LICENSE for license details.
+
+// Command-stream capture and replay.
+//
+// A network's tiling functions re-derive their tiling factors and re-issue
+// every RoCC command on each inference, although the commands only change
+// with the addresses of the buffers they read and write. Capturing records
+// the exact (funct, rs1, rs2) sequence of one inference, fences included,
+// while it runs normally. Replaying streams the recorded commands straight to
+// the accelerator, with no tiling work left on the core:
+//
+//   static struct gemmini_cmd cmds[CAPACITY];
+//   struct gemmini_stream stream;
+//   gemmini_stream_init(&stream, cmds, CAPACITY);
+//   const int in = gemmini_stream_buffer(&stream, input, sizeof(input));
+//   const int out = gemmini_stream_buffer(&stream, output, sizeof(output));
+//
+//   gemmini_capture_begin(&stream);
+//   ... run the network once ...
+//   gemmini_capture_end();
+//
+//   const void * buffers[] = {next_input, next_output};
+//   gemmini_stream_replay(&stream, buffers);
+//
+// DRAM addresses that fall inside a registered buffer are stored relative to
+// it, so a replay can rebase them onto a different buffer of the same size.
+// Every other address (weights, intermediate activations) is replayed as
+// captured, so those buffers must stay where they were.
+//
+// Only accelerator commands are recorded. Anything a captured region computes
+// on the core, such as a CPU fallback or a host-side softmax, is not replayed,
+// so such work must be kept outside the captured regions.
+
+#ifndef SRC_MAIN_C_GEMMINI_CAPTURE_H
+#define SRC_MAIN_C_GEMMINI_CAPTURE_H
+
+#define GEMMINI_STREAM_MAX_BUFFERS 8
+
+struct gemmini_cmd {
+  uint64_t rs1;
+  uint64_t rs2;
+  uint16_t funct;
+  uint8_t rs1_buffer; // 1 + index of the buffer rs1 is relative to, or 0
+  uint8_t rs2_buffer;
+};
+
+struct gemmini_stream {
+  struct gemmini_cmd * cmds;
+  size_t len;
+  size_t capacity;
+  bool overflow;
+
+  size_t buffers;
+  uintptr_t buffer_base[GEMMINI_STREAM_MAX_BUFFERS];
+  size_t buffer_size[GEMMINI_STREAM_MAX_BUFFERS];
+};
+
+static void gemmini_stream_init(struct gemmini_stream * stream,
+        struct gemmini_cmd * cmds, size_t capacity) {
+  stream->cmds = cmds;
+  stream->len = 0;
+  stream->capacity = capacity;
+  stream->overflow = false;
+  stream->buffers = 0;
+}
+
+// Registers a buffer whose address may change between replays. Returns its
+// index into the "buffers" array of gemmini_stream_replay
+static int gemmini_stream_buffer(struct gemmini_stream * stream, const void * base, size_t size) {
+  if (stream->buffers >= GEMMINI_STREAM_MAX_BUFFERS) {
+    printf("A command stream can't have more than %d relocatable buffers\n", GEMMINI_STREAM_MAX_BUFFERS);
+    exit(1);
+  }
+
+  stream->buffer_base[stream->buffers] = (uintptr_t)base;
+  stream->buffer_size[stream->buffers] = size;
+  return stream->buffers++;
+}
+
+static void gemmini_capture_begin(struct gemmini_stream * stream) {
+  stream->len = 0;
+  stream->overflow = false;
+  gemmini_capture_stream = stream;
+
+  // Every config the stream relies on must be in it, whatever the state of
+  // the accelerator it is replayed on
+  gemmini_config_shadow_reset();
+}
+
+static void gemmini_capture_end() {
+  struct gemmini_stream * stream = gemmini_capture_stream;
+  gemmini_capture_stream = NULL;
+
+  if (stream != NULL && stream->overflow) {
+    printf("Command stream overflowed its %zu commands\n", stream->capacity);
+    exit(1);
+  }
+}
+
+// Which operands of each command hold a DRAM address
+static bool gemmini_capture_rs1_is_addr(uint64_t funct) {
+  switch (funct) {
+    case k_MVIN: case k_MVIN2: case k_MVIN3: case k_MVOUT:
+    case k_LOOP_WS_CONFIG_ADDRS_AB: case k_LOOP_WS_CONFIG_ADDRS_DC:
+    case k_GEMV_LOOP_WS_CONFIG_ADDRS_AB: case k_GEMV_LOOP_WS_CONFIG_ADDRS_DC:
+    case k_LOOP_CONV_WS_CONFIG_5: case k_LOOP_CONV_WS_CONFIG_6:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool gemmini_capture_rs2_is_addr(uint64_t funct) {
+  switch (funct) {
+    case k_LOOP_WS_CONFIG_ADDRS_AB: case k_LOOP_WS_CONFIG_ADDRS_DC:
+    case k_GEMV_LOOP_WS_CONFIG_ADDRS_AB: case k_GEMV_LOOP_WS_CONFIG_ADDRS_DC:
+    case k_LOOP_CONV_WS_CONFIG_5: case k_LOOP_CONV_WS_CONFIG_6:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Rewrites "addr" relative to the registered buffer that contains it, and
+// returns 1 + that buffer's index, or 0 if no buffer contains it
+static uint8_t gemmini_capture_relocate(const struct gemmini_stream * stream, uint64_t * addr) {
+  for (size_t b = 0; b < stream->buffers; b++)
+    if (*addr >= stream->buffer_base[b] && *addr - stream->buffer_base[b] < stream->buffer_size[b]) {
+      *addr -= stream->buffer_base[b];
+      return b + 1;
+    }
+
+  return 0;
+}
+
+static void gemmini_capture_cmd(uint64_t funct, uint64_t rs1, uint64_t rs2) {
+  struct gemmini_stream * stream = gemmini_capture_stream;
+
+  if (stream->len >= stream->capacity) {
+    stream->overflow = true;
+    return;
+  }
+
+  struct gemmini_cmd * cmd = &stream->cmds[stream->len++];
+  cmd->funct = funct;
+  cmd->rs1_buffer = gemmini_capture_rs1_is_addr(funct) ? gemmini_capture_relocate(stream, &rs1) : 0;
+  cmd->rs2_buffer = gemmini_capture_rs2_is_addr(funct) ? gemmini_capture_relocate(stream, &rs2) : 0;
+  cmd->rs1 = rs1;
+  cmd->rs2 = rs2;
+}
+
+// The funct of a RoCC instruction is an immediate, so each one needs its own
+// instruction encoding
+#define GEMMINI_REPLAY_CASE(funct) \
+  case funct: ROCC_INSTRUCTION_0_R_R(XCUSTOM_ACC, rs1, rs2, funct) break;
+
+static void gemmini_replay_cmd(uint64_t funct, uint64_t rs1, uint64_t rs2) {
+  if (funct == GEMMINI_CMD_FENCE) {
+#ifndef GEMMINI_EMULATOR
+    asm volatile("fence");
+#endif
+    return;
+  }
+
+#ifdef GEMMINI_EMULATOR
+  gemmini_emu_issue(funct, rs1, rs2);
+#else
+  switch (funct) {
+    GEMMINI_REPLAY_CASE(k_CONFIG)
+    GEMMINI_REPLAY_CASE(k_MVIN2)
+    GEMMINI_REPLAY_CASE(k_MVIN)
+    GEMMINI_REPLAY_CASE(k_MVOUT)
+    GEMMINI_REPLAY_CASE(k_COMPUTE_PRELOADED)
+    GEMMINI_REPLAY_CASE(k_COMPUTE_ACCUMULATE)
+    GEMMINI_REPLAY_CASE(k_PRELOAD)
+    GEMMINI_REPLAY_CASE(k_FLUSH)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS_CONFIG_BOUNDS)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS_CONFIG_ADDRS_AB)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS_CONFIG_ADDRS_DC)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS_CONFIG_STRIDES_AB)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS_CONFIG_STRIDES_DC)
+    GEMMINI_REPLAY_CASE(k_MVIN3)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS_CONFIG_1)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS_CONFIG_2)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS_CONFIG_3)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS_CONFIG_4)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS_CONFIG_5)
+    GEMMINI_REPLAY_CASE(k_LOOP_CONV_WS_CONFIG_6)
+    GEMMINI_REPLAY_CASE(k_GEMV_LOOP_WS)
+    GEMMINI_REPLAY_CASE(k_GEMV_LOOP_WS_CONFIG_BOUNDS)
+    GEMMINI_REPLAY_CASE(k_GEMV_LOOP_WS_CONFIG_ADDRS_AB)
+    GEMMINI_REPLAY_CASE(k_GEMV_LOOP_WS_CONFIG_ADDRS_DC)
+    GEMMINI_REPLAY_CASE(k_GEMV_LOOP_WS_CONFIG_STRIDES_AB)
+    GEMMINI_REPLAY_CASE(k_GEMV_LOOP_WS_CONFIG_STRIDES_DC)
+    GEMMINI_REPLAY_CASE(k_LOOP_WS_CONFIG_HEAD_STRIDES)
+    default:
+      printf("Can't replay a command with funct %llu\n", (unsigned long long)funct);
+      exit(1);
+  }
+#endif
+}
+
+#undef GEMMINI_REPLAY_CASE
+
+// Re-issues a captured stream. "buffers[b]" replaces the b-th registered
+// buffer; pass NULL for "buffers", or for one of its entries, to keep the
+// captured address
+static void gemmini_stream_replay(const struct gemmini_stream * stream, const void * const * buffers) {
+  uintptr_t base[GEMMINI_STREAM_MAX_BUFFERS + 1];
+
+  base[0] = 0;
+  for (size_t b = 0; b < stream->buffers; b++)
+    base[b + 1] = buffers != NULL && buffers[b] != NULL ? (uintptr_t)buffers[b] : stream->buffer_base[b];
+
+  for (const struct gemmini_cmd * cmd = stream->cmds; cmd < stream->cmds + stream->len; cmd++)
+    gemmini_replay_cmd(cmd->funct, cmd->rs1 + base[cmd->rs1_buffer], cmd->rs2 + base[cmd->rs2_buffer]);
+
+  gemmini_config_shadow_reset();
+}
+
+#endif // SRC_MAIN_C_GEMMINI_CAPTURE_H
@@ -0,0 +1,1232 @@
+// See LICENSE for license details.
+
+// Host-native functional model of the NPU command stream.
+//
+// When GEMMINI_EMULATOR is defined, gemmini.h routes every RoCC command
+// through gemmini_emu_issue() instead of the custom-3 opcode, so the tests in
+// bareMetalC can be compiled and checked with a plain x86 compiler. The model
+// decodes the same rs1/rs2 bit layouts as the RTL: it keeps a scratchpad and
+// an accumulator, unrolls LOOP_WS and GEMV_LOOP_WS through the same address
+// generation as LoopMatmul.scala and GemvLoopMatmul.scala, and evaluates
+// LOOP_CONV_WS tiles functionally. Ternary (mpgemm) weights are decoded from
+// their packed 2-bit form with the same TERNARY_MUL as mpgemm_cpu.
+//
+// Everything executes synchronously, so fences are no-ops. The performance
+// counters only model DMA traffic and command counts; cycle-type counters
+// which depend on pipeline timing read as zero.
+
+#ifndef SRC_MAIN_C_GEMMINI_EMU_H
+#define SRC_MAIN_C_GEMMINI_EMU_H
+
+#include <string.h>
+
+#define EMU_SP_ROWS (BANK_NUM * BANK_ROWS)
+#define EMU_SP_BANK_ROWS BANK_ROWS
+#define EMU_CONCURRENT_LOOPS 2
+#define EMU_COUNTERS 8
+
+#ifndef GEMMINI_EMU_DMA_LATENCY
+#define GEMMINI_EMU_DMA_LATENCY 64 // Nominal round-trip cycles per DMA request
+#endif
+#ifndef GEMMINI_EMU_DMA_BEAT_BYTES
+#define GEMMINI_EMU_DMA_BEAT_BYTES 16 // Matches dma_buswidth = 128
+#endif
+
+// Local address fields (LocalAddr.scala)
+#define EMU_ADDR_IS_ACC(addr) (((addr) >> 31) & 1)
+#define EMU_ADDR_ACCUMULATE(addr) (((addr) >> 30) & 1)
+#define EMU_ADDR_READ_FULL(addr) (((addr) >> 29) & 1)
+#define EMU_ADDR_NORM_CMD(addr) (((addr) >> 26) & 7)
+#define EMU_ADDR_ROW(addr) ((addr) & 0x3ffffff)
+#define EMU_ADDR_IS_GARBAGE(addr) ((uint32_t)(addr) == GARBAGE_ADDR)
+
+#define EMU_MVIN_SP_ADDR(addr) ((uint32_t)(addr))
+#define EMU_MVIN_ACC_ADDR(addr, accumulate) ((1u << 31) | ((uint32_t)(accumulate) << 30) | (uint32_t)(addr))
+
+// Normalizer commands (NormCmd.scala)
+enum gemmini_emu_norm_cmd_t {
+  EMU_NORM_RESET, EMU_NORM_SUM, EMU_NORM_MEAN, EMU_NORM_VARIANCE,
+  EMU_NORM_INV_STDDEV, EMU_NORM_MAX, EMU_NORM_SUM_EXP, EMU_NORM_INV_SUM_EXP
+};
+
+struct gemmini_emu_ld_config_t {
+  uint64_t stride;
+  scale_t scale;
+  bool shrunk;
+  uint32_t block_stride;
+};
+
+struct gemmini_emu_norm_stats_t {
+  acc_t sum;
+  acc_t count;
+  acc_t mean;
+  acc_t err_sq;
+  acc_t stddev;
+  acc_t max;
+  acc_t sum_exp;
+  bool stale; // Set by RESET, cleared when the next row starts accumulating
+};
+
+// A weight (WS) or bias (OS) tile captured by a preload
+struct gemmini_emu_tile_t {
+  elem_t data[DIM][DIM];
+  size_t rows, cols;
+  bool valid;
+};
+
+struct gemmini_emu_conv_t {
+  uint64_t cfg[6][2];
+  const elem_t * inputs[4];
+  const elem_t * weights[4];
+  acc_t * out_buf;
+  size_t out_buf_len;
+};
+
+static GEMMINI_THREAD_LOCAL struct {
+  // Scratchpad and accumulator
+  elem_t spad[EMU_SP_ROWS][DIM];
+  acc_t acc[ACC_ROWS][DIM];
+
+  // CONFIG_EX
+  int dataflow;
+  int sys_act;
+  int sys_shift;
+  bool a_transpose;
+  bool b_transpose;
+  uint32_t a_stride;
+  uint32_t c_stride;
+
+  // CONFIG_LD, indexed by mvin / mvin2 / mvin3
+  struct gemmini_emu_ld_config_t ld[3];
+
+  // CONFIG_ST
+  uint64_t st_stride;
+  int st_act;
+  acc_scale_t st_scale;
+  int pool_stride;
+
+  // CONFIG_NORM
+  int stat_id;
+  bool act_msb;
+  acc_t q_const[2];
+  acc_t igelu_qb;
+  acc_t igelu_qc;
+  struct gemmini_emu_norm_stats_t stats[NORM_STAT_IDS];
+
+  // Execute pipeline
+  struct gemmini_emu_tile_t preloaded;
+  struct gemmini_emu_tile_t active;
+  uint32_t c_addr;
+  size_t c_rows, c_cols;
+  acc_t os_result[DIM][DIM];
+  acc_t gemv_partial[DIM][DIM*4];
+
+  // Loop unrollers
+  uint64_t loop_ws_cfg[5][2];
+  uint64_t loop_ws_head_strides[2];
+  uint64_t gemv_cfg[5][2];
+  size_t loop_ws_count;
+  size_t gemv_count;
+  uint32_t loop_ws_acc_start;
+  uint32_t gemv_acc_start;
+  struct gemmini_emu_conv_t conv;
+
+  // Counter file
+  // As in CounterFile.scala, configuring a counter only zeroes it when it
+  // counts a built-in event. External events are only zeroed by a global reset
+  uint64_t events[INCREMENTAL_COUNTERS + 8];
+  uint64_t event_base[EMU_COUNTERS];
+  uint64_t external_base[8];
+  uint64_t snapshot[EMU_COUNTERS];
+  int counter_event[EMU_COUNTERS];
+  bool snapshot_taken;
+
+  bool initialized;
+} gemmini_emu;
+
+static void gemmini_emu_reset_stats(struct gemmini_emu_norm_stats_t * s) {
+  memset(s, 0, sizeof(*s));
+  s->max = INT_MIN;
+}
+
+static void gemmini_emu_init() {
+  if (gemmini_emu.initialized)
+    return;
+
+  gemmini_emu.initialized = true;
+  gemmini_emu.dataflow = WEIGHT_STATIONARY;
+  gemmini_emu.a_stride = 1;
+  gemmini_emu.c_stride = 1;
+  gemmini_emu.st_scale = ACC_SCALE_IDENTITY;
+  for (int id = 0; id < 3; id++) {
+    gemmini_emu.ld[id].scale = MVIN_SCALE_IDENTITY;
+    gemmini_emu.ld[id].block_stride = DIM;
+  }
+  for (int id = 0; id < NORM_STAT_IDS; id++)
+    gemmini_emu_reset_stats(&gemmini_emu.stats[id]);
+}
+
+static void gemmini_emu_count(int event, uint64_t amount) {
+  gemmini_emu.events[event] += amount;
+}
+
+static void gemmini_emu_count_dma(bool write, size_t bytes) {
+  const uint64_t beats = (bytes + GEMMINI_EMU_DMA_BEAT_BYTES - 1) / GEMMINI_EMU_DMA_BEAT_BYTES;
+  gemmini_emu_count(write ? WDMA_BYTES_SENT : RDMA_BYTES_REC, bytes);
+  gemmini_emu_count(write ? WDMA_TOTAL_LATENCY : RDMA_TOTAL_LATENCY, GEMMINI_EMU_DMA_LATENCY + beats);
+  gemmini_emu_count(write ? WDMA_ACTIVE_CYCLE : RDMA_ACTIVE_CYCLE, beats);
+}
+
+static elem_t gemmini_emu_clip(acc_t x) {
+  return x > elem_t_max ? elem_t_max : (x < elem_t_min ? elem_t_min : x);
+}
+
+// Accumulator read path: I-GELU, scaling, saturation and ReLU, configured by
+// CONFIG_ST and CONFIG_NORM
+static elem_t gemmini_emu_scale_and_sat(acc_t x, int act, acc_scale_t scale) {
+  if (act == IGELU) {
+    const acc_t qb = gemmini_emu.igelu_qb;
+    const acc_t qc = gemmini_emu.igelu_qc;
+    const acc_t q_sign = x < 0 ? -1 : 1;
+    const acc_t q_clipped = abs(x) > (-qb) ? (-qb) : abs(x);
+    const acc_t q_poly = (q_clipped + qb)*(q_clipped + qb) + qc;
+    x = x * (q_sign * q_poly + qc);
+  }
+
+  x = ACC_SCALE(x, scale);
+  x = gemmini_emu_clip(x);
+  if (act == RELU && x < 0)
+    x = 0;
+  return x;
+}
+
+static acc_t gemmini_emu_iexp(acc_t q) {
+  const acc_t qln2 = gemmini_emu.q_const[0];
+  const acc_t qln2_inv = gemmini_emu.q_const[1];
+  const acc_t qb = gemmini_emu.igelu_qb;
+  const acc_t qc = gemmini_emu.igelu_qc;
+
+  return softmax_iexp(q, qln2, qln2_inv, qb, qc);
+}
+
+// mvin, mvin2, mvin3
+static void gemmini_emu_mvin(int id, uint64_t dram_addr, uint64_t rs2) {
+  const struct gemmini_emu_ld_config_t * cfg = &gemmini_emu.ld[id];
+  const uint32_t local = rs2;
+  const size_t cols = (rs2 >> ADDR_LEN) & 0xffff;
+  const size_t rows = (rs2 >> (ADDR_LEN + 16)) & 0xffff;
+  const bool is_acc = EMU_ADDR_IS_ACC(local);
+  const bool accumulate = EMU_ADDR_ACCUMULATE(local);
+  const size_t row_start = EMU_ADDR_ROW(local);
+  const bool acc_data = is_acc && !cfg->shrunk;
+  const size_t sizeof_data = acc_data ? sizeof(acc_t) : sizeof(elem_t);
+
+  if (EMU_ADDR_IS_GARBAGE(local))
+    return;
+
+  for (size_t r = 0; r < rows; r++) {
+    const int8_t * dram_row = (const int8_t *)dram_addr + r * cfg->stride;
+
+    for (size_t c = 0; c < cols; c++) {
+      const size_t block = c / DIM;
+      const size_t row = row_start + block * cfg->block_stride + r;
+
+      acc_t x = 0;
+      if (dram_addr != 0) {
+        x = acc_data ? ((const acc_t *)dram_row)[c] : ((const elem_t *)dram_row)[c];
+      }
+
+      if (is_acc) {
+        acc_t * dst = &gemmini_emu.acc[row % ACC_ROWS][c % DIM];
+        x = acc_data ? MVIN_SCALE_ACC(x, cfg->scale) : MVIN_SCALE(x, cfg->scale);
+        *dst = accumulate ? *dst + x : x;
+      } else {
+        gemmini_emu.spad[row % EMU_SP_ROWS][c % DIM] = MVIN_SCALE(x, cfg->scale);
+      }
+    }
+  }
+
+  // The LoadController issues one DMA request per row
+  if (dram_addr != 0)
+    for (size_t r = 0; r < rows; r++)
+      gemmini_emu_count_dma(false, cols * sizeof_data);
+  gemmini_emu_count(LOAD_ACTIVE_CYCLE, rows);
+}
+
+// One pass of the Normalizer over a single accumulator row, which may span up
+// to MAX_BLOCK_LEN blocks. Only RESET writes the normalized row to memory.
+static void gemmini_emu_norm_row(uint64_t dram_addr, size_t row, size_t cols, int cmd, int act) {
+  struct gemmini_emu_norm_stats_t * s = &gemmini_emu.stats[gemmini_emu.stat_id % NORM_STAT_IDS];
+
+  if (s->stale && (cmd == EMU_NORM_SUM || cmd == EMU_NORM_MEAN || cmd == EMU_NORM_MAX))
+    gemmini_emu_reset_stats(s);
+
+  for (size_t c = 0; c < cols; c++) {
+    const acc_t v = gemmini_emu.acc[(row + (c / DIM) * DIM) % ACC_ROWS][c % DIM];
+    switch (cmd) {
+      case EMU_NORM_SUM:
+      case EMU_NORM_MEAN:
+        s->sum += v;
+        s->count++;
+        break;
+      case EMU_NORM_VARIANCE:
+      case EMU_NORM_INV_STDDEV:
+        s->err_sq += (v - s->mean)*(v - s->mean);
+        break;
+      case EMU_NORM_MAX:
+        if (v > s->max) s->max = v;
+        s->count++;
+        break;
+      case EMU_NORM_SUM_EXP:
+      case EMU_NORM_INV_SUM_EXP:
+        s->sum_exp += gemmini_emu_iexp(v - s->max);
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (cmd == EMU_NORM_MEAN) {
+    s->mean = s->sum / s->count;
+  } else if (cmd == EMU_NORM_INV_STDDEV) {
+    const acc_t variance = s->err_sq / s->count;
+    s->stddev = variance == 0 ? 1 : int_sqrt(variance);
+  }
+
+  if (cmd != EMU_NORM_RESET)
+    return;
+
+  elem_t * out = (elem_t *)dram_addr;
+  if (act == SOFTMAX) {
+    const acc_scale_t factor = (127.f) / (float) s->sum_exp;
+    for (size_t c = 0; c < cols; c++) {
+      const acc_t v = gemmini_emu.acc[(row + (c / DIM) * DIM) % ACC_ROWS][c % DIM];
+      out[c] = gemmini_emu_scale_and_sat(gemmini_emu_iexp(v - s->max), NO_ACTIVATION, factor);
+    }
+  } else {
+    for (size_t c = 0; c < cols; c++) {
+      const acc_t v = gemmini_emu.acc[(row + (c / DIM) * DIM) % ACC_ROWS][c % DIM];
+      const acc_t x = ROUND_NEAR_EVEN((double)(v - s->mean) / s->stddev);
+      out[c] = gemmini_emu_scale_and_sat(x, NO_ACTIVATION, gemmini_emu.st_scale);
+    }
+  }
+
+  s->stale = true;
+  gemmini_emu_count_dma(true, cols * sizeof(elem_t));
+}
+
+// mvout
+static void gemmini_emu_mvout(uint64_t dram_addr, uint64_t rs2) {
+  const uint32_t local = rs2;
+  const size_t cols = (rs2 >> ADDR_LEN) & 0xffff;
+  const size_t rows = (rs2 >> (ADDR_LEN + 16)) & 0xffff;
+  const size_t row_start = EMU_ADDR_ROW(local);
+
+  if (EMU_ADDR_IS_GARBAGE(local) || dram_addr == 0)
+    return;
+
+  if (gemmini_emu.pool_stride != 0) {
+    printf("Pooling mvouts are only modelled inside LOOP_CONV_WS\n");
+    exit(1);
+  }
+
+  // The Normalizer sees act_msb from CONFIG_NORM on top of the CONFIG_ST act
+  const int act = (gemmini_emu.act_msb << 2) | gemmini_emu.st_act;
+  if (EMU_ADDR_IS_ACC(local) && (EMU_ADDR_NORM_CMD(local) != EMU_NORM_RESET || act == LAYERNORM || act == SOFTMAX)) {
+    for (size_t r = 0; r < rows; r++)
+      gemmini_emu_norm_row(dram_addr + r * gemmini_emu.st_stride, row_start + r, cols, EMU_ADDR_NORM_CMD(local), act);
+    gemmini_emu_count(STORE_ACTIVE_CYCLE, rows);
+    return;
+  }
+
+  const bool full = EMU_ADDR_IS_ACC(local) && EMU_ADDR_READ_FULL(local);
+  const size_t sizeof_data = full ? sizeof(acc_t) : sizeof(elem_t);
+
+  for (size_t r = 0; r < rows; r++) {
+    int8_t * dram_row = (int8_t *)dram_addr + r * gemmini_emu.st_stride;
+
+    for (size_t c = 0; c < cols; c++) {
+      const size_t row = row_start + (c / DIM) * DIM + r;
+
+      if (!EMU_ADDR_IS_ACC(local)) {
+        ((elem_t *)dram_row)[c] = gemmini_emu.spad[row % EMU_SP_ROWS][c % DIM];
+      } else if (full) {
+        ((acc_t *)dram_row)[c] = gemmini_emu.acc[row % ACC_ROWS][c % DIM];
+      } else {
+        ((elem_t *)dram_row)[c] = gemmini_emu_scale_and_sat(gemmini_emu.acc[row % ACC_ROWS][c % DIM],
+            gemmini_emu.st_act, gemmini_emu.st_scale);
+      }
+    }
+  }
+
+  gemmini_emu_count_dma(true, rows * cols * sizeof_data);
+  gemmini_emu_count(STORE_ACTIVE_CYCLE, rows);
+}
+
+static void gemmini_emu_config(uint64_t rs1, uint64_t rs2) {
+  switch (rs1 & 3) {
+    case CONFIG_EX:
+      if (!((rs1 >> 7) & 1)) {
+        gemmini_emu.dataflow = (rs1 >> 2) & 1;
+        gemmini_emu.sys_act = (rs1 >> 3) & 3;
+        gemmini_emu.sys_shift = rs2 & 0xffffffff;
+        gemmini_emu.a_transpose = (rs1 >> 8) & 1;
+        gemmini_emu.b_transpose = (rs1 >> 9) & 1;
+      }
+      gemmini_emu.a_stride = (rs1 >> 16) & 0xffff;
+      gemmini_emu.c_stride = (rs2 >> 48) & 0xffff;
+      break;
+
+    case CONFIG_LD: {
+      const int id = (rs1 >> 3) & 3;
+      union { uint32_t b; scale_t f; } scale = { .b = rs1 >> 32 };
+      gemmini_emu.ld[id].stride = rs2;
+      gemmini_emu.ld[id].scale = scale.f;
+      gemmini_emu.ld[id].shrunk = (rs1 >> 2) & 1;
+      gemmini_emu.ld[id].block_stride = (rs1 >> 16) & 0xffff;
+      break;
+    }
+
+    case CONFIG_ST:
+      gemmini_emu.st_stride = rs2 & 0xffffffff;
+      gemmini_emu.st_act = (rs1 >> 2) & 3;
+      gemmini_emu.act_msb = 0; // the 2-bit field overwrites the whole activation
+      gemmini_emu.st_scale = acc_scale_t_bits_to_acc_scale_t(rs2 >> 32);
+      gemmini_emu.pool_stride = (rs1 >> 4) & 3;
+      break;
+
+    case CONFIG_BERT:
+      gemmini_emu.stat_id = (rs1 >> 8) & 0xff;
+      if (!((rs1 >> 17) & 1)) {
+        gemmini_emu.act_msb = (rs1 >> 16) & 1;
+        gemmini_emu.q_const[(rs1 >> 18) & 1] = (acc_t)(rs1 >> 32);
+        gemmini_emu.igelu_qb = (acc_t)(rs2 & 0xffffffff);
+        gemmini_emu.igelu_qc = (acc_t)(rs2 >> 32);
+      }
+      break;
+  }
+}
+
+static void gemmini_emu_capture_tile(struct gemmini_emu_tile_t * tile, uint64_t rs) {
+  const uint32_t local = rs;
+  tile->cols = (rs >> ADDR_LEN) & 0xffff;
+  tile->rows = (rs >> (ADDR_LEN + 16)) & 0x7fff;
+  tile->valid = !EMU_ADDR_IS_GARBAGE(local);
+
+  memset(tile->data, 0, sizeof(tile->data));
+  if (!tile->valid)
+    return;
+
+  for (size_t r = 0; r < DIM; r++) {
+    const size_t row = EMU_ADDR_ROW(local) + r;
+    memcpy(tile->data[r], gemmini_emu.spad[row % EMU_SP_ROWS], DIM * sizeof(elem_t));
+  }
+}
+
+// Weight (k, n) of the active WS tile. For packed ternary tiles, n ranges over
+// 4*DIM outputs and the 2-bit code is returned instead.
+static acc_t gemmini_emu_weight(const struct gemmini_emu_tile_t * w, size_t k, size_t n, bool is_mpgemm) {
+  if (!w->valid)
+    return 0;
+
+  if (!is_mpgemm) {
+    if (gemmini_emu.b_transpose)
+      return k < w->rows && n < w->cols ? w->data[n][k] : 0;
+    return k < w->rows && n < w->cols ? w->data[k][n] : 0;
+  }
+
+  if (k >= w->rows || n / 4 >= w->cols)
+    return 0;
+
+  if (gemmini_emu.b_transpose) {
+    // Row n/4 holds four groups of DIM/4 bytes, one group per output column
+    const elem_t packed = w->data[n / 4][(n % 4) * (DIM / 4) + k / 4];
+    return TERNARY_CODE(packed, k % 4);
+  }
+
+  return TERNARY_CODE(w->data[k][n / 4], n % 4);
+}
+
+static acc_t gemmini_emu_a(uint32_t a_addr, size_t a_rows, size_t a_cols, size_t i, size_t k) {
+  if (i >= a_rows || k >= a_cols)
+    return 0;
+  const size_t row = gemmini_emu.a_transpose ? a_addr + k : a_addr + i * gemmini_emu.a_stride;
+  const size_t col = gemmini_emu.a_transpose ? i : k;
+  return gemmini_emu.spad[row % EMU_SP_ROWS][col];
+}
+
+static void gemmini_emu_preload(uint64_t rs1, uint64_t rs2) {
+  gemmini_emu_capture_tile(&gemmini_emu.preloaded, rs1);
+  gemmini_emu.c_addr = rs2;
+  gemmini_emu.c_cols = (rs2 >> ADDR_LEN) & 0xffff;
+  gemmini_emu.c_rows = (rs2 >> (ADDR_LEN + 16)) & 0x7fff;
+}
+
+static void gemmini_emu_write_c(size_t r, size_t n, acc_t x, size_t row_offset, bool last_k) {
+  const uint32_t c = gemmini_emu.c_addr;
+  const size_t row = EMU_ADDR_ROW(c) + row_offset + r * gemmini_emu.c_stride;
+
+  if (EMU_ADDR_IS_ACC(c)) {
+    acc_t * dst = &gemmini_emu.acc[row % ACC_ROWS][n];
+    *dst = EMU_ADDR_ACCUMULATE(c) ? *dst + x : x;
+    return;
+  }
+
+  // Scratchpad outputs are summed in the bias buffer until the last k step
+  gemmini_emu.gemv_partial[r][row_offset + n] += x;
+  if (!last_k)
+    return;
+
+  x = gemmini_emu.gemv_partial[r][row_offset + n];
+  gemmini_emu.gemv_partial[r][row_offset + n] = 0;
+
+  if (gemmini_emu.dataflow == OUTPUT_STATIONARY)
+    x = ROUNDING_RIGHT_SHIFT(x, gemmini_emu.sys_shift);
+  x = gemmini_emu_clip(x);
+  if (gemmini_emu.sys_act == RELU && x < 0)
+    x = 0;
+  gemmini_emu.spad[row % EMU_SP_ROWS][n] = x;
+}
+
+static void gemmini_emu_compute_ws(uint64_t rs1, uint64_t rs2, bool flip) {
+  const uint32_t a_addr = rs1;
+  const size_t a_cols = (rs1 >> ADDR_LEN) & 0xffff;
+  const size_t a_rows = (rs1 >> (ADDR_LEN + 16)) & 0x7fff;
+  const bool not_last_k = rs1 >> 63;
+  const uint32_t d_addr = rs2;
+  const bool is_mpgemm = rs2 >> 63;
+  const size_t outputs = is_mpgemm ? 4 * DIM : DIM;
+
+  if (flip)
+    gemmini_emu.active = gemmini_emu.preloaded;
+
+  if (EMU_ADDR_IS_GARBAGE(gemmini_emu.c_addr))
+    return;
+
+  for (size_t r = 0; r < gemmini_emu.c_rows && r < DIM; r++) {
+    for (size_t n = 0; n < outputs; n++) {
+      if (n % DIM >= gemmini_emu.c_cols)
+        continue;
+
+      acc_t x = 0;
+      for (size_t k = 0; k < DIM; k++) {
+        const elem_t a = gemmini_emu_a(a_addr, a_rows, a_cols, r, k);
+        const acc_t w = gemmini_emu_weight(&gemmini_emu.active, k, n, is_mpgemm);
+        x += is_mpgemm ? TERNARY_MUL(a, w) : a * w;
+      }
+
+      if (!EMU_ADDR_IS_GARBAGE(d_addr) && !is_mpgemm)
+        x += gemmini_emu.spad[(EMU_ADDR_ROW(d_addr) + r) % EMU_SP_ROWS][n];
+
+      // Packed ternary outputs fill four consecutive accumulator blocks
+      gemmini_emu_write_c(r, n % DIM, x, (n / DIM) * DIM, !not_last_k);
+    }
+  }
+
+  gemmini_emu_count(EXE_ACTIVE_CYCLE, DIM);
+}
+
+static void gemmini_emu_compute_os(uint64_t rs1, uint64_t rs2, bool flip) {
+  const uint32_t a_addr = rs1;
+  const size_t a_cols = (rs1 >> ADDR_LEN) & 0xffff;
+  const size_t a_rows = (rs1 >> (ADDR_LEN + 16)) & 0x7fff;
+  const uint32_t b_addr = rs2;
+  const size_t b_cols = (rs2 >> ADDR_LEN) & 0xffff;
+  const size_t b_rows = (rs2 >> (ADDR_LEN + 16)) & 0x7fff;
+
+  if (flip) {
+    const struct gemmini_emu_tile_t * d = &gemmini_emu.preloaded;
+    for (size_t i = 0; i < DIM; i++)
+      for (size_t j = 0; j < DIM; j++)
+        gemmini_emu.os_result[i][j] = d->valid && i < d->rows && j < d->cols ? d->data[i][j] : 0;
+  }
+
+  for (size_t i = 0; i < DIM; i++)
+    for (size_t j = 0; j < DIM; j++)
+      for (size_t k = 0; k < DIM; k++) {
+        const size_t b_row = gemmini_emu.b_transpose ? j : k;
+        const size_t b_col = gemmini_emu.b_transpose ? k : j;
+        const acc_t b = b_row < b_rows && b_col < b_cols && !EMU_ADDR_IS_GARBAGE(b_addr) ?
+          gemmini_emu.spad[(EMU_ADDR_ROW(b_addr) + b_row) % EMU_SP_ROWS][b_col] : 0;
+        gemmini_emu.os_result[i][j] += gemmini_emu_a(a_addr, a_rows, a_cols, i, k) * b;
+      }
+
+  if (EMU_ADDR_IS_GARBAGE(gemmini_emu.c_addr))
+    return;
+
+  for (size_t r = 0; r < gemmini_emu.c_rows && r < DIM; r++)
+    for (size_t n = 0; n < gemmini_emu.c_cols && n < DIM; n++)
+      gemmini_emu_write_c(r, n, gemmini_emu.os_result[r][n], 0, true);
+
+  gemmini_emu_count(EXE_ACTIVE_CYCLE, DIM);
+}
+
+static void gemmini_emu_compute(uint64_t rs1, uint64_t rs2, bool flip) {
+  if (gemmini_emu.dataflow == OUTPUT_STATIONARY)
+    gemmini_emu_compute_os(rs1, rs2, flip);
+  else
+    gemmini_emu_compute_ws(rs1, rs2, flip);
+}
+
+#define EMU_ROWS_COLS(rows, cols) (((uint64_t)(rows) << (ADDR_LEN + 16)) | ((uint64_t)(cols) << ADDR_LEN))
+
+// LOOP_WS, unrolled as in LoopMatmul.scala
+static void gemmini_emu_loop_ws(uint64_t rs1, uint64_t rs2) {
+  uint64_t (*cfg)[2] = gemmini_emu.loop_ws_cfg;
+
+  const size_t max_i = cfg[0][1] & 0xffff;
+  const size_t max_j = (cfg[0][1] >> 16) & 0xffff;
+  const size_t max_k = (cfg[0][1] >> 32) & 0xffff;
+  const size_t pad_i = cfg[0][0] & 0xffff;
+  const size_t pad_j = (cfg[0][0] >> 16) & 0xffff;
+  const size_t pad_k = (cfg[0][0] >> 32) & 0xffff;
+  const uint64_t A = cfg[1][0], B = cfg[1][1], D = cfg[2][0], C = cfg[2][1];
+  const uint64_t A_stride = cfg[3][0], B_stride = cfg[3][1];
+  const uint64_t D_stride = cfg[4][0], C_stride = cfg[4][1];
+
+  const bool ex_accumulate = rs1 & 1;
+  const bool full_C = (rs1 >> 1) & 1;
+  const bool low_D = (rs1 >> 2) & 1;
+  const int act = (rs1 >> 8) & 0xff;
+  const int b_spad_id = (rs1 >> 16) & 3;
+  const int a_spad_id = (rs1 >> 18) & 3;
+  const bool is_mpgemm = (rs1 >> 20) & 1;
+  const bool a_transpose = rs2 & 1;
+  const bool b_transpose = (rs2 >> 1) & 1;
+  const bool is_resadd = (rs2 >> 2) & 1;
+  const bool b_tile_major = ((rs2 >> 3) & 1) && !is_resadd;
+  const bool mpgemm_transpose = is_mpgemm && b_transpose;
+
+  const size_t half = EMU_SP_ROWS / EMU_CONCURRENT_LOOPS;
+  const size_t slot = gemmini_emu.loop_ws_count++ % EMU_CONCURRENT_LOOPS;
+  const uint32_t a_start = a_spad_id ? (a_spad_id - 1) * half : slot * half;
+  const uint32_t b_end = b_spad_id ? b_spad_id * half : (slot + 1) * half;
+  const uint32_t b_start = b_end - max_k * max_j * DIM;
+  const uint32_t acc_start = is_resadd ? slot * (ACC_ROWS / EMU_CONCURRENT_LOOPS) : gemmini_emu.loop_ws_acc_start;
+
+  const uint64_t events_before = gemmini_emu.events[LOAD_ACTIVE_CYCLE] +
+    gemmini_emu.events[EXE_ACTIVE_CYCLE] + gemmini_emu.events[STORE_ACTIVE_CYCLE];
+
+  // ldA, or the first resadd operand into the accumulator
+  if (A != 0) {
+    const size_t mk = is_resadd ? max_j : max_k;
+    const size_t pk = is_resadd ? pad_j : pad_k;
+    const bool t = a_transpose && !is_resadd;
+    const size_t max_row = t ? mk : max_i, max_col = t ? max_i : mk;
+    const size_t row_pad = t ? pk : pad_i, col_pad = t ? pad_i : pk;
+    const size_t max_blocks = max_col <= MAX_BLOCK_LEN ? max_col : MAX_BLOCK_LEN;
+
+    for (size_t row = 0; row < max_row; row++)
+      for (size_t col = 0; col < max_col; col += max_blocks) {
+        const size_t blocks = col + max_blocks <= max_col ? max_blocks : max_col - col;
+        const size_t cols = blocks * DIM - (col + blocks >= max_col ? col_pad : 0);
+        const size_t rows = DIM - (row == max_row - 1 ? row_pad : 0);
+        const uint64_t dram = A + (row * A_stride + col) * DIM * sizeof(elem_t);
+        const uint32_t sp = (is_resadd ? acc_start : a_start) + (row * max_col + col) * DIM;
+        gemmini_emu_mvin(0, dram, EMU_ROWS_COLS(rows, cols) |
+            (is_resadd ? EMU_MVIN_ACC_ADDR(sp, false) : EMU_MVIN_SP_ADDR(sp)));
+      }
+  }
+
+  // ldB, or the second resadd operand accumulated on top of the first
+  if (B != 0) {
+    const size_t mk = is_resadd ? max_i : max_k;
+    const size_t pk = is_resadd ? pad_i : pad_k;
+    const bool t = b_transpose && !is_resadd;
+    const size_t max_row = t ? max_j : mk, max_col = t ? mk : max_j;
+    const size_t row_pad = t ? pad_j : pk, col_pad = t ? pk : pad_j;
+    const size_t max_blocks = b_tile_major ? 1 : max_col <= MAX_BLOCK_LEN ? max_col : MAX_BLOCK_LEN;
+
+    for (size_t row = 0; row < max_row; row++)
+      for (size_t col = 0; col < max_col; col += max_blocks) {
+        const size_t blocks = col + max_blocks <= max_col ? max_blocks : max_col - col;
+        const size_t cols = blocks * DIM - (col + blocks >= max_col ? col_pad : 0);
+        const size_t rows = DIM - (row == max_row - 1 ? row_pad : 0);
+        const uint64_t dram = B + (row * B_stride + col) * DIM * sizeof(elem_t);
+        const uint32_t sp = (is_resadd ? acc_start : b_start) + (row * max_col + col) * DIM;
+
+        if (b_tile_major) {
+          // A whole, zero-padded tile, B_stride tiles per row of tiles
+          gemmini_emu_mvin(1, B + (row * B_stride + col) * DIM * DIM * sizeof(elem_t),
+              EMU_ROWS_COLS(TILE_MAJOR_ROWS, TILE_MAJOR_BLOCKS * DIM) | EMU_MVIN_SP_ADDR(sp));
+          continue;
+        }
+
+        gemmini_emu_mvin(1, dram, EMU_ROWS_COLS(rows, cols) |
+            (is_resadd ? EMU_MVIN_ACC_ADDR(sp, true) : EMU_MVIN_SP_ADDR(sp)));
+      }
+  }
+
+  if (!is_resadd) {
+    // ldD
+    if (D != 0) {
+      const size_t max_blocks = low_D ? (max_j <= MAX_BLOCK_LEN ? max_j : MAX_BLOCK_LEN) :
+        (max_j <= MAX_BLOCK_LEN_ACC ? max_j : MAX_BLOCK_LEN_ACC);
+      const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+
+      for (size_t i = 0; i < max_i; i++)
+        for (size_t j = 0; j < max_j; j += max_blocks) {
+          const size_t blocks = j + max_blocks <= max_j ? max_blocks : max_j - j;
+          const size_t cols = blocks * DIM - (j + blocks >= max_j ? pad_j : 0);
+          const size_t rows = DIM - (i == max_i - 1 ? pad_i : 0);
+          const uint64_t dram = D + (i * D_stride + j) * DIM * sizeof_D;
+          const uint32_t sp = acc_start + (i * max_j + j) * DIM;
+          gemmini_emu_mvin(2, dram, EMU_ROWS_COLS(rows, cols) | EMU_MVIN_ACC_ADDR(sp, false));
+        }
+    }
+
+    // ex
+    const size_t a_max_col = a_transpose ? max_i : max_k;
+    const size_t b_max_col = b_transpose ? max_k : max_j;
+
+    for (size_t k = 0; k < max_k; k++)
+      for (size_t j = 0; j < max_j; j++)
+        for (size_t i = 0; i < max_i; i++) {
+          const size_t a_row = a_transpose ? k : i, a_col = a_transpose ? i : k;
+          const size_t b_row = b_transpose ? j : k, b_col = b_transpose ? k : j;
+          const uint32_t a_addr = a_start + (a_row * a_max_col + a_col) * DIM;
+          const uint32_t b_addr = b_start + (b_row * b_max_col + b_col) * DIM;
+          const uint32_t c_addr = acc_start + (i * max_j + j) * DIM * (is_mpgemm ? 4 : 1);
+
+          const size_t a_cols = DIM - (k == max_k - 1 ? pad_k : 0);
+          const size_t a_rows = DIM - (i == max_i - 1 ? pad_i : 0);
+          const size_t b_cols = DIM - (j == max_j - 1 ? pad_j : 0);
+          const size_t b_rows = DIM - (k == max_k - 1 ? pad_k : 0);
+          const size_t c_cols = DIM - (j == max_j - 1 ? pad_j : 0);
+          const size_t c_rows = DIM - (i == max_i - 1 ? pad_i : 0);
+          const bool flip = mpgemm_transpose || i == 0;
+
+          gemmini_emu_preload(EMU_ROWS_COLS(b_rows, b_cols) | (flip ? b_addr : GARBAGE_ADDR),
+              ((uint64_t)is_mpgemm << 63) | EMU_ROWS_COLS(c_rows, c_cols) |
+              EMU_MVIN_ACC_ADDR(c_addr, ex_accumulate || k != 0));
+          gemmini_emu_compute(EMU_ROWS_COLS(a_rows, a_cols) | a_addr,
+              ((uint64_t)is_mpgemm << 63) | EMU_ROWS_COLS(DIM, DIM) | GARBAGE_ADDR, flip);
+        }
+  }
+
+  // stC
+  if (C != 0) {
+    const size_t st_max_j = is_mpgemm ? max_j * 4 : max_j;
+    const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+    const size_t max_blocks = full_C ? 1 : (st_max_j <= MAX_BLOCK_LEN ? st_max_j : MAX_BLOCK_LEN);
+
+    for (size_t i = 0; i < max_i; i++) {
+      const size_t rows = DIM - (i == max_i - 1 ? pad_i : 0);
+
+      if (act == LAYERNORM || act == SOFTMAX) {
+        static const int ln_cmds[3][2] = {{EMU_NORM_SUM, EMU_NORM_MEAN},
+          {EMU_NORM_VARIANCE, EMU_NORM_INV_STDDEV}, {EMU_NORM_RESET, EMU_NORM_RESET}};
+        static const int sm_cmds[3][2] = {{EMU_NORM_MAX, EMU_NORM_MAX},
+          {EMU_NORM_SUM_EXP, EMU_NORM_INV_SUM_EXP}, {EMU_NORM_RESET, EMU_NORM_RESET}};
+
+        for (size_t ln_row = 0; ln_row < rows; ln_row += NORM_STAT_IDS) {
+          const size_t stat_ids = rows - ln_row > NORM_STAT_IDS ? NORM_STAT_IDS : rows - ln_row;
+
+          for (int cmd = 0; cmd < 3; cmd++)
+            for (size_t stat_id = 0; stat_id < stat_ids; stat_id++) {
+              const size_t r = ln_row + stat_id;
+              gemmini_emu.stat_id = stat_id;
+
+              for (size_t j = 0; j < st_max_j; j += max_blocks) {
+                const size_t blocks = j + max_blocks <= st_max_j ? max_blocks : st_max_j - j;
+                const size_t cols = blocks * DIM - (j + blocks >= st_max_j ? pad_j : 0);
+                const bool last = j + max_blocks >= st_max_j;
+                const int norm_cmd = act == LAYERNORM ? ln_cmds[cmd][last] : sm_cmds[cmd][last];
+                const uint64_t dram = C + ((i * C_stride + j) * DIM + r * C_stride) * sizeof(elem_t);
+                const uint32_t sp = acc_start + (i * st_max_j + j) * DIM + r;
+                gemmini_emu_norm_row(dram, sp, cols, norm_cmd, act);
+              }
+            }
+        }
+        continue;
+      }
+
+      for (size_t j = 0; j < st_max_j; j += max_blocks) {
+        const size_t blocks = j + max_blocks <= st_max_j ? max_blocks : st_max_j - j;
+        const size_t cols = blocks * DIM - (j + blocks >= st_max_j ? pad_j : 0);
+        const uint64_t dram = C + (i * C_stride + j) * DIM * sizeof_C;
+        const uint32_t sp = acc_start + (i * st_max_j + j) * DIM;
+        gemmini_emu_mvout(dram, EMU_ROWS_COLS(rows, cols) | EMU_MVIN_ACC_ADDR(sp, false) |
+            ((uint32_t)full_C << 29));
+      }
+    }
+
+    if (!is_resadd)
+      gemmini_emu.loop_ws_acc_start = (gemmini_emu.loop_ws_acc_start + ACC_ROWS / EMU_CONCURRENT_LOOPS) % ACC_ROWS;
+  }
+
+  gemmini_emu_count(LOOP_MATMUL_ACTIVE_CYCLES, gemmini_emu.events[LOAD_ACTIVE_CYCLE] +
+      gemmini_emu.events[EXE_ACTIVE_CYCLE] + gemmini_emu.events[STORE_ACTIVE_CYCLE] - events_before);
+}
+
+// A LOOP_WS with rs1[47:32] heads runs once per head, with each non-null
+// address advanced by its head stride, as in LoopMatmul.scala
+static void gemmini_emu_loop_ws_heads(uint64_t rs1, uint64_t rs2) {
+  uint64_t (*cfg)[2] = gemmini_emu.loop_ws_cfg;
+  const uint64_t * strides = gemmini_emu.loop_ws_head_strides;
+  const size_t heads = (rs1 >> 32) & 0xffff;
+
+  for (size_t h = 0; h == 0 || h < heads; h++) {
+    if (h != 0) {
+      if (cfg[1][0] != 0) cfg[1][0] += strides[0] & 0xffffffff;
+      if (cfg[1][1] != 0) cfg[1][1] += strides[0] >> 32;
+      if (cfg[2][0] != 0) cfg[2][0] += strides[1] & 0xffffffff;
+      if (cfg[2][1] != 0) cfg[2][1] += strides[1] >> 32;
+    }
+
+    gemmini_emu_loop_ws(rs1, rs2);
+  }
+}
+
+// GEMV_LOOP_WS, unrolled as in GemvLoopMatmul.scala
+static void gemmini_emu_gemv_loop_ws(uint64_t rs1, uint64_t rs2) {
+  uint64_t (*cfg)[2] = gemmini_emu.gemv_cfg;
+
+  const size_t max_i = cfg[0][1] & 0xffff;
+  const size_t max_j = (cfg[0][1] >> 16) & 0xffff;
+  const size_t max_k = (cfg[0][1] >> 32) & 0xffff;
+  const size_t pad_i = cfg[0][0] & 0xffff;
+  const size_t pad_j = (cfg[0][0] >> 16) & 0xffff;
+  const size_t pad_k = (cfg[0][0] >> 32) & 0xffff;
+  const uint64_t A = cfg[1][0], B = cfg[1][1], D = cfg[2][0], C = cfg[2][1];
+  const uint64_t A_stride = cfg[3][0], B_stride = cfg[3][1];
+  const uint64_t D_stride = cfg[4][0], C_stride = cfg[4][1];
+
+  const bool ex_accumulate = rs1 & 1;
+  const bool full_C = (rs1 >> 1) & 1;
+  const bool low_D = (rs1 >> 2) & 1;
+  const int act = (rs1 >> 8) & 0xff;
+  const int c_spad_id = (rs1 >> 16) & 7;
+  const int b_spad_id = (rs1 >> 19) & 7;
+  const int a_spad_id = (rs1 >> 22) & 7;
+  const bool a_transpose = rs2 & 1;
+  const bool b_transpose = (rs2 >> 1) & 1;
+  const bool b_tile_major = (rs2 >> 3) & 1;
+
+  const uint32_t half = EMU_SP_ROWS / EMU_CONCURRENT_LOOPS;
+  const uint32_t slot = gemmini_emu.gemv_count++ % EMU_CONCURRENT_LOOPS;
+  const uint32_t a_start = a_spad_id ? (a_spad_id - 1) * EMU_SP_BANK_ROWS : slot * half;
+  const uint32_t b_start = b_spad_id ? (b_spad_id - 1) * EMU_SP_BANK_ROWS : slot * half + half / 2;
+  const bool is_mvout = c_spad_id == 0;
+  const uint32_t c_start = is_mvout ? gemmini_emu.gemv_acc_start : (c_spad_id - 1) * EMU_SP_BANK_ROWS;
+
+  // ldA
+  if (A != 0) {
+    const size_t max_row = a_transpose ? max_k : max_i, max_col = a_transpose ? max_i : max_k;
+    const size_t row_pad = a_transpose ? pad_k : pad_i, col_pad = a_transpose ? pad_i : pad_k;
+    const size_t max_blocks = max_col <= MAX_BLOCK_LEN ? max_col : MAX_BLOCK_LEN;
+
+    for (size_t row = 0; row < max_row; row++)
+      for (size_t col = 0; col < max_col; col += max_blocks) {
+        const size_t blocks = col + max_blocks <= max_col ? max_blocks : max_col - col;
+        const size_t cols = blocks * DIM - (col + blocks >= max_col ? col_pad : 0);
+        const size_t rows = DIM - (row == max_row - 1 ? row_pad : 0);
+        const uint64_t dram = A + (row * A_stride + col) * DIM * sizeof(elem_t);
+        const uint32_t sp = a_start + (row * max_col + col) * DIM;
+        gemmini_emu_mvin(0, dram, EMU_ROWS_COLS(rows, cols) | EMU_MVIN_SP_ADDR(sp));
+      }
+  }
+
+  // ldB: B is stored K-blocked, each DIM-row block of columns holding its
+  // k blocks side by side, or tile-major
+  if (B != 0) {
+    const size_t max_row = b_transpose ? max_j : max_k, max_col = b_transpose ? max_k : max_j;
+    const size_t max_blocks = b_tile_major ? 1 : max_row <= MAX_BLOCK_LEN ? max_row : MAX_BLOCK_LEN;
+
+    for (size_t col = 0; col < max_col; col++)
+      for (size_t row = 0; row < max_row; row += max_blocks) {
+        const size_t blocks = row + max_blocks <= max_row ? max_blocks : max_row - row;
+        const uint64_t dram = B + (col * B_stride + row) * DIM * sizeof(elem_t);
+        const uint32_t sp = b_start + ((col * max_row + row) * DIM) % EMU_SP_BANK_ROWS;
+
+        if (b_tile_major) {
+          gemmini_emu_mvin(1, B + (row * B_stride + col) * DIM * DIM * sizeof(elem_t),
+              EMU_ROWS_COLS(TILE_MAJOR_ROWS, TILE_MAJOR_BLOCKS * DIM) | EMU_MVIN_SP_ADDR(sp));
+          continue;
+        }
+
+        gemmini_emu_mvin(1, dram, EMU_ROWS_COLS(DIM, blocks * DIM) | EMU_MVIN_SP_ADDR(sp));
+      }
+  }
+
+  // ldD
+  if (D != 0) {
+    const size_t max_blocks = low_D ? (max_j <= MAX_BLOCK_LEN ? max_j : MAX_BLOCK_LEN) :
+      (max_j <= MAX_BLOCK_LEN_ACC ? max_j : MAX_BLOCK_LEN_ACC);
+    const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+
+    for (size_t i = 0; i < max_i; i++)
+      for (size_t j = 0; j < max_j; j += max_blocks) {
+        const size_t blocks = j + max_blocks <= max_j ? max_blocks : max_j - j;
+        const size_t cols = blocks * DIM - (j + blocks >= max_j ? pad_j : 0);
+        const size_t rows = DIM - (i == max_i - 1 ? pad_i : 0);
+        const uint64_t dram = D + (i * D_stride + j) * DIM * sizeof_D;
+        const uint32_t sp = gemmini_emu.gemv_acc_start + (i * max_j + j) * DIM;
+        gemmini_emu_mvin(2, dram, EMU_ROWS_COLS(rows, cols) | EMU_MVIN_ACC_ADDR(sp, false));
+      }
+  }
+
+  // ex
+  const size_t a_max_col = a_transpose ? max_i : max_k;
+  const size_t b_max_row = b_transpose ? max_j : max_k;
+
+  // Row blocks are innermost so each weight tile stays in the array across them
+  for (size_t j = 0; j < max_j; j++)
+    for (size_t k = 0; k < max_k; k++)
+      for (size_t i = 0; i < max_i; i++) {
+        const size_t a_row = a_transpose ? k : i, a_col = a_transpose ? i : k;
+        const size_t b_row = b_transpose ? j : k, b_col = b_transpose ? k : j;
+        const uint32_t a_addr = a_start + (a_row * a_max_col + a_col) * DIM;
+        const uint32_t b_addr = b_start + ((b_col * b_max_row + b_row) * DIM) % EMU_SP_BANK_ROWS;
+        const uint32_t c_addr = c_start + (i * max_j + j) * DIM;
+
+        const size_t a_cols = DIM - (k == max_k - 1 ? pad_k : 0);
+        const size_t a_rows = DIM - (i == max_i - 1 ? pad_i : 0);
+        const size_t b_cols = DIM - (j == max_j - 1 ? pad_j : 0);
+        const size_t b_rows = DIM - (k == max_k - 1 ? pad_k : 0);
+        const size_t c_cols = DIM - (j == max_j - 1 ? pad_j : 0);
+        const size_t c_rows = DIM - (i == max_i - 1 ? pad_i : 0);
+
+        gemmini_emu_preload(EMU_ROWS_COLS(b_rows, b_cols) | (i == 0 ? b_addr : GARBAGE_ADDR),
+            EMU_ROWS_COLS(c_rows, c_cols) |
+            (is_mvout ? EMU_MVIN_ACC_ADDR(c_addr, ex_accumulate || k != 0) : EMU_MVIN_SP_ADDR(c_addr)));
+        gemmini_emu_compute(((uint64_t)(k != max_k - 1) << 63) | EMU_ROWS_COLS(a_rows, a_cols) | a_addr,
+            EMU_ROWS_COLS(DIM, DIM) | GARBAGE_ADDR, i == 0);
+      }
+
+  // stC
+  if (C != 0 && (is_mvout || act != 0)) {
+    const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+    const size_t max_blocks = full_C ? 1 : (max_j <= MAX_BLOCK_LEN ? max_j : MAX_BLOCK_LEN);
+
+    for (size_t i = 0; i < max_i; i++)
+      for (size_t j = 0; j < max_j; j += max_blocks) {
+        const size_t blocks = j + max_blocks <= max_j ? max_blocks : max_j - j;
+        const size_t cols = blocks * DIM - (j + blocks >= max_j ? pad_j : 0);
+        const size_t rows = DIM - (i == max_i - 1 ? pad_i : 0);
+        const uint64_t dram = C + (i * C_stride + j) * DIM * sizeof_C;
+        const uint32_t sp = c_start + (i * max_j + j) * DIM;
+        gemmini_emu_mvout(dram, EMU_ROWS_COLS(rows, cols) | EMU_MVIN_ACC_ADDR(sp, false) |
+            ((uint32_t)full_C << 29));
+      }
+  }
+
+  if (C != 0 && is_mvout)
+    gemmini_emu.gemv_acc_start = (gemmini_emu.gemv_acc_start + ACC_ROWS / EMU_CONCURRENT_LOOPS) % ACC_ROWS;
+}
+
+// LOOP_CONV_WS, evaluated per tile with the same operand layouts as
+// tiled_conv and tiled_conv_dw. Partial sums persist across calls until a
+// call with a non-NULL output drains them, mirroring how the conv loop
+// unroller keeps its accumulator region until the output is stored.
+static void gemmini_emu_loop_conv_ws(uint64_t rs1, uint64_t rs2) {
+  uint64_t (*cfg)[2] = gemmini_emu.conv.cfg;
+
+  const int batch_size = cfg[0][0] & 0xffff;
+  const int in_row_dim = (cfg[0][0] >> 16) & 0xffff;
+  const int in_channels = (cfg[0][0] >> 32) & 0xffff;
+  const int out_channels = (cfg[0][0] >> 48) & 0xffff;
+  const int pool_out_row_dim = (cfg[0][1] >> 16) & 0xffff;
+  const int stride = (cfg[0][1] >> 48) & 0xff;
+
+  const int pool_stride = (cfg[1][0] >> 8) & 0xff;
+  const int pool_size = (cfg[1][0] >> 16) & 0xffff;
+  const int pool_out_col_dim = (cfg[1][0] >> 32) & 0xffff;
+  const int kernel_dim = (cfg[1][0] >> 48) & 0xffff;
+  const int pochs = cfg[1][1] & 0xffff;
+  const int pocols = (cfg[1][1] >> 16) & 0xffff;
+  const int porows = (cfg[1][1] >> 32) & 0xffff;
+  const int batches = (cfg[1][1] >> 48) & 0xffff;
+
+  const int lpad = cfg[2][0] & 0xffff;
+  const int kchs = (cfg[2][0] >> 16) & 0xffff;
+  const int kcols = (cfg[2][0] >> 32) & 0xffff;
+  const int krows = (cfg[2][0] >> 48) & 0xffff;
+  const int in_col_dim = cfg[2][1] & 0xffff;
+  const int plpad = (cfg[2][1] >> 16) & 0xff;
+  const int dpad = (cfg[2][1] >> 24) & 0xff;
+  const int upad = (cfg[2][1] >> 32) & 0xffff;
+  const int rpad = (cfg[2][1] >> 48) & 0xffff;
+
+  const int kernel_dilation = cfg[3][0] & 0x3ff;
+  const int pupad = (cfg[3][0] >> 21) & 0x7ff;
+  const int orows = (cfg[3][0] >> 48) & 0xffff;
+  const int ocols = cfg[3][1] & 0xffff;
+  const int out_stride = (cfg[3][1] >> 16) & 0xffff;
+  const int weight_stride = (cfg[3][1] >> 32) & 0xffff;
+  const int in_stride = (cfg[3][1] >> 48) & 0xffff;
+
+  const elem_t * weights = (const elem_t *)cfg[4][0];
+  elem_t * output = (elem_t *)cfg[4][1];
+  const acc_t * bias = (const acc_t *)cfg[5][0];
+  const elem_t * input = (const elem_t *)cfg[5][1];
+
+  const bool no_bias = rs1 & 1;
+  const bool wrot180 = (rs1 >> 1) & 1;
+  const bool trans_output_1203 = (rs1 >> 2) & 1;
+  const bool trans_weight_1203 = (rs1 >> 3) & 1;
+  const bool trans_weight_0132 = (rs1 >> 4) & 1;
+  const bool trans_input_3120 = (rs1 >> 5) & 1;
+  const bool dw = (rs1 >> 6) & 1;
+  const int b_spad_id = (rs1 >> 16) & 3;
+  const int a_spad_id = (rs1 >> 18) & 3;
+  const bool is_mpgemm = (rs1 >> 20) & 1;
+  const bool input_dilated = (rs2 >> 2) & 1;
+  const int act = (rs2 >> 3) & 0x7;
+
+  const int ochs = dw ? 1 : pochs;
+  const int ichs = dw ? 1 : kchs;
+  const int dilated_krows = krows + (kernel_dilation - 1)*(krows - 1);
+  const int dilated_kcols = kcols + (kernel_dilation - 1)*(kcols - 1);
+  const int irows = orows * stride + dilated_krows - 1;
+  const int icols = ocols * stride + dilated_kcols - 1;
+
+  // Operands which stay resident in the scratchpad are passed as NULL
+  if (input != NULL) gemmini_emu.conv.inputs[a_spad_id] = input;
+  else input = gemmini_emu.conv.inputs[a_spad_id];
+  if (weights != NULL) gemmini_emu.conv.weights[b_spad_id] = weights;
+  else weights = gemmini_emu.conv.weights[b_spad_id];
+
+  const size_t out_len = (size_t)batches * orows * ocols * ochs;
+  if (gemmini_emu.conv.out_buf_len < out_len) {
+    gemmini_emu.conv.out_buf = realloc(gemmini_emu.conv.out_buf, out_len * sizeof(acc_t));
+    gemmini_emu.conv.out_buf_len = out_len;
+  }
+  acc_t * out_buf = gemmini_emu.conv.out_buf;
+
+#define EMU_CONV_OUT(b, orow, ocol, och) out_buf[(((b) * orows + (orow)) * ocols + (ocol)) * ochs + (och)]
+
+  if (bias != NULL) {
+    for (int b = 0; b < batches; b++)
+      for (int orow = 0; orow < orows; orow++)
+        for (int ocol = 0; ocol < ocols; ocol++)
+          for (int och = 0; och < ochs; och++)
+            EMU_CONV_OUT(b, orow, ocol, och) = no_bias ? 0 : bias[och];
+    if (!no_bias)
+      gemmini_emu_count_dma(false, out_len * sizeof(acc_t));
+  }
+
+  for (int b = 0; b < batches; b++)
+    for (int orow = 0; orow < orows; orow++)
+      for (int ocol = 0; ocol < ocols; ocol++)
+        for (int och = 0; och < ochs; och++) {
+          acc_t opixel = 0;
+
+          for (int krow = 0; krow < krows; krow++) {
+            const int irow = orow * stride + krow * kernel_dilation;
+            if (irow < upad || irow >= irows - dpad || (input_dilated && (irow - upad) % 2 != 0))
+              continue;
+            const int in_row = (irow - upad) >> input_dilated;
+
+            for (int kcol = 0; kcol < kcols; kcol++) {
+              const int icol = ocol * stride + kcol * kernel_dilation;
+              if (icol < lpad || icol >= icols - rpad || (input_dilated && (icol - lpad) % 2 != 0))
+                continue;
+              const int in_col = (icol - lpad) >> input_dilated;
+
+              const int krow_ = wrot180 ? krows - krow - 1 : krow;
+              const int kcol_ = wrot180 ? kcols - kcol - 1 : kcol;
+
+              for (int kch = 0; kch < ichs; kch++) {
+                elem_t ipixel = input[((b * in_row_dim + in_row) * in_col_dim + in_col) * in_stride + kch];
+                if (trans_input_3120)
+                  ipixel = input[((kch * in_row_dim + in_row) * in_col_dim + in_col) * batch_size + b];
+
+                // With mpgemm, each weight byte packs four consecutive output channels
+                elem_t weight = weights[(krow_ * kernel_dim * in_channels + kcol_ * in_channels + kch) * weight_stride +
+                    (is_mpgemm ? och / 4 : och)];
+                if (dw)
+                  weight = weights[krow_ * kernel_dim + kcol_];
+                else if (trans_weight_1203)
+                  weight = weights[(kch * kernel_dim * kernel_dim + krow_ * kernel_dim + kcol_) * out_channels + och];
+                else if (trans_weight_0132)
+                  weight = weights[(krow_ * kernel_dim * out_channels + kcol_ * out_channels + och) * in_channels + kch];
+
+                opixel += is_mpgemm ? TERNARY_MUL(ipixel, TERNARY_CODE(weight, och % 4)) : weight * ipixel;
+              }
+            }
+          }
+
+          EMU_CONV_OUT(b, orow, ocol, och) += opixel;
+        }
+
+  gemmini_emu_count(EXE_ACTIVE_CYCLE, (uint64_t)batches * orows * ocols * krows * kcols *
+      ((ichs + DIM - 1) / DIM) * ((ochs + DIM - 1) / DIM));
+  if (gemmini_emu.conv.inputs[a_spad_id] == (const elem_t *)cfg[5][1])
+    gemmini_emu_count_dma(false, (size_t)batches * ((irows - upad - dpad) >> input_dilated) *
+        ((icols - lpad - rpad) >> input_dilated) * ichs);
+  if (gemmini_emu.conv.weights[b_spad_id] == (const elem_t *)cfg[4][0])
+    gemmini_emu_count_dma(false, (size_t)krows * kcols * ichs * (is_mpgemm ? ochs / 4 : ochs));
+
+  if (output == NULL)
+    return;
+
+  // Pooling windows which fall into the padding contribute zeros, as in conv_cpu
+  for (int b = 0; b < batches; b++)
+    for (int porow = 0; porow < porows; porow++)
+      for (int pocol = 0; pocol < pocols; pocol++)
+        for (int och = 0; och < ochs; och++) {
+          elem_t running_max = 0;
+          bool running_max_initialized = false;
+
+          for (int pwrow = 0; pwrow < pool_size; pwrow++)
+            for (int pwcol = 0; pwcol < pool_size; pwcol++) {
+              const int orow = porow * pool_stride + pwrow - pupad;
+              const int ocol = pocol * pool_stride + pwcol - plpad;
+              elem_t opixel = 0;
+              if (orow >= 0 && orow < orows && ocol >= 0 && ocol < ocols)
+                opixel = gemmini_emu_scale_and_sat(EMU_CONV_OUT(b, orow, ocol, och), act, gemmini_emu.st_scale);
+              if (!running_max_initialized || opixel > running_max) {
+                running_max = opixel;
+                running_max_initialized = true;
+              }
+            }
+
+          elem_t * out = output + (b * pool_out_row_dim * pool_out_col_dim + porow * pool_out_col_dim + pocol) * out_stride + och;
+          if (trans_output_1203)
+            out = output + (porow * pool_out_col_dim * batch_size + pocol * batch_size + b) * out_channels + och;
+          *out = running_max;
+        }
+
+  gemmini_emu_count_dma(true, (size_t)batches * porows * pocols * ochs);
+  gemmini_emu_count(STORE_ACTIVE_CYCLE, (uint64_t)batches * porows * pocols);
+
+#undef EMU_CONV_OUT
+}
+
+static uint64_t gemmini_emu_counter_value(int index) {
+  const int event = gemmini_emu.counter_event[index];
+  if (event == 0)
+    return 0;
+  if (event >= INCREMENTAL_COUNTERS)
+    return gemmini_emu.events[event] - gemmini_emu.external_base[event - INCREMENTAL_COUNTERS];
+  return gemmini_emu.events[event] - gemmini_emu.event_base[index];
+}
+
+static uint32_t gemmini_emu_counter_access(uint32_t config_reg) {
+  gemmini_emu_init();
+
+  const int index = (config_reg >> 4) & 0x7;
+
+  if (config_reg & 0x1) {
+    for (int i = 0; i < EMU_COUNTERS; i++)
+      gemmini_emu.event_base[i] = gemmini_emu.events[gemmini_emu.counter_event[i]];
+    for (int e = 0; e < 8; e++)
+      gemmini_emu.external_base[e] = gemmini_emu.events[INCREMENTAL_COUNTERS + e];
+    gemmini_emu.snapshot_taken = false;
+    return 0;
+  }
+
+  if (config_reg & 0x2) {
+    gemmini_emu.snapshot_taken = false;
+    return 0;
+  }
+
+  if (config_reg & 0x4) {
+    for (int i = 0; i < EMU_COUNTERS; i++)
+      gemmini_emu.snapshot[i] = gemmini_emu_counter_value(i);
+    gemmini_emu.snapshot_taken = true;
+    return 0;
+  }
+
+  if (config_reg & 0x8) {
+    int event = (config_reg >> 12) & 0x3f;
+    if (config_reg >> 31)
+      event += INCREMENTAL_COUNTERS;
+    gemmini_emu.counter_event[index] = event;
+    gemmini_emu.event_base[index] = gemmini_emu.events[event];
+    return 0;
+  }
+
+  if (gemmini_emu.snapshot_taken)
+    return gemmini_emu.snapshot[index];
+
+  return gemmini_emu_counter_value(index);
+}
+
+static void gemmini_emu_issue(uint64_t funct, uint64_t rs1, uint64_t rs2) {
+  gemmini_emu_init();
+
+  if (funct == k_MVIN || funct == k_MVIN2 || funct == k_MVIN3 || (funct == k_CONFIG && (rs1 & 3) == CONFIG_LD))
+    gemmini_emu_count(RESERVATION_STATION_LD_COUNT, 1);
+  else if (funct == k_MVOUT || (funct == k_CONFIG && (rs1 & 3) != CONFIG_EX))
+    gemmini_emu_count(RESERVATION_STATION_ST_COUNT, 1);
+  else if (funct == k_PRELOAD || funct == k_COMPUTE_PRELOADED || funct == k_COMPUTE_ACCUMULATE || funct == k_CONFIG)
+    gemmini_emu_count(RESERVATION_STATION_EX_COUNT, 1);
+
+  switch (funct) {
+    case k_CONFIG:
+      gemmini_emu_config(rs1, rs2);
+      break;
+    case k_MVIN:
+      gemmini_emu_mvin(0, rs1, rs2);
+      break;
+    case k_MVIN2:
+      gemmini_emu_mvin(1, rs1, rs2);
+      break;
+    case k_MVIN3:
+      gemmini_emu_mvin(2, rs1, rs2);
+      break;
+    case k_MVOUT:
+      gemmini_emu_mvout(rs1, rs2);
+      break;
+    case k_PRELOAD:
+      gemmini_emu_preload(rs1, rs2);
+      break;
+    case k_COMPUTE_PRELOADED:
+      gemmini_emu_compute(rs1, rs2, true);
+      break;
+    case k_COMPUTE_ACCUMULATE:
+      gemmini_emu_compute(rs1, rs2, false);
+      break;
+    case k_FLUSH:
+      break;
+
+    case k_LOOP_WS_CONFIG_BOUNDS:
+    case k_LOOP_WS_CONFIG_ADDRS_AB:
+    case k_LOOP_WS_CONFIG_ADDRS_DC:
+    case k_LOOP_WS_CONFIG_STRIDES_AB:
+    case k_LOOP_WS_CONFIG_STRIDES_DC:
+      gemmini_emu.loop_ws_cfg[funct - k_LOOP_WS_CONFIG_BOUNDS][0] = rs1;
+      gemmini_emu.loop_ws_cfg[funct - k_LOOP_WS_CONFIG_BOUNDS][1] = rs2;
+      break;
+    case k_LOOP_WS_CONFIG_HEAD_STRIDES:
+      gemmini_emu.loop_ws_head_strides[0] = rs1;
+      gemmini_emu.loop_ws_head_strides[1] = rs2;
+      break;
+    case k_LOOP_WS:
+      gemmini_emu_loop_ws_heads(rs1, rs2);
+      break;
+
+    case k_GEMV_LOOP_WS_CONFIG_BOUNDS:
+    case k_GEMV_LOOP_WS_CONFIG_ADDRS_AB:
+    case k_GEMV_LOOP_WS_CONFIG_ADDRS_DC:
+    case k_GEMV_LOOP_WS_CONFIG_STRIDES_AB:
+    case k_GEMV_LOOP_WS_CONFIG_STRIDES_DC:
+      gemmini_emu.gemv_cfg[funct - k_GEMV_LOOP_WS_CONFIG_BOUNDS][0] = rs1;
+      gemmini_emu.gemv_cfg[funct - k_GEMV_LOOP_WS_CONFIG_BOUNDS][1] = rs2;
+      break;
+    case k_GEMV_LOOP_WS:
+      gemmini_emu_gemv_loop_ws(rs1, rs2);
+      break;
+
+    case k_LOOP_CONV_WS_CONFIG_1:
+    case k_LOOP_CONV_WS_CONFIG_2:
+    case k_LOOP_CONV_WS_CONFIG_3:
+    case k_LOOP_CONV_WS_CONFIG_4:
+    case k_LOOP_CONV_WS_CONFIG_5:
+    case k_LOOP_CONV_WS_CONFIG_6:
+      gemmini_emu.conv.cfg[funct - k_LOOP_CONV_WS_CONFIG_1][0] = rs1;
+      gemmini_emu.conv.cfg[funct - k_LOOP_CONV_WS_CONFIG_1][1] = rs2;
+      break;
+    case k_LOOP_CONV_WS:
+      gemmini_emu_loop_conv_ws(rs1, rs2);
+      break;
+
+    default:
+      printf("Unknown NPU command funct %llu\n", (unsigned long long)funct);
+      exit(1);
+  }
+}
+
+#endif // SRC_MAIN_C_GEMMINI_EMU_H
@@ -0,0 +1,337 @@
+// See LICENSE for license details.
+
+// Splitting layers across several accelerators.
+//
+// SoCs with one accelerator per tile can split a layer between the harts
+// that drive them. As in riscv-tests/mt, every hart calls the same *_multi
+// function with its own id. Each one computes its share of the output on its
+// own accelerator, and then waits at a barrier until the whole output is
+// written:
+//
+//   #define GEMMINI_HARTS 4
+//   #include "include/gemmini_multi.h"
+//
+//   void thread_entry(int cid, int nc) {
+//     tiled_matmul_auto_multi(cid, nc, ...);
+//     ...                                  // every hart can read all of C
+//   }
+//
+// Matmuls split the rows of C between the harts, or its columns when C is
+// wider than it is tall and its rows aren't normalized. Convolutions split
+// their output channels. Shares are whole multiples of DIM (4*DIM for packed
+// ternary columns), so no two accelerators compute parts of one tile.
+// Convolutions with transposed inputs, weights or outputs don't keep their
+// output channels apart, so they run whole on hart 0.
+//
+// The runtime state that tracks one accelerator (config shadow, captures,
+// async ops, the CPU kernels' scratch buffers) is per hart. Baremetal
+// programs must set GEMMINI_HARTS to the most harts they run on before they
+// include any Gemmini header, which moves that state into thread-local
+// storage. tiled_attention_auto's scratch buffers are too large for that, so
+// only one hart may run it at a time.
+//
+// In Linux mode, harts are threads. Each one must stay on its own core,
+// because RoCC commands go to the accelerator of whichever core issues them.
+// gemmini_multi_launch starts them pinned; it needs _GNU_SOURCE to be defined
+// before the program's first include.
+
+#ifndef SRC_MAIN_C_GEMMINI_MULTI_H
+#define SRC_MAIN_C_GEMMINI_MULTI_H
+
+#include "include/gemmini.h"
+
+#ifndef BAREMETAL
+#include <sched.h>
+#endif
+
+// Waits until all ncores harts have arrived. A sense-reversing barrier, like
+// the one in riscv-tests' util.h
+static void gemmini_barrier(int ncores) {
+  static volatile int sense;
+  static volatile int count;
+  static GEMMINI_THREAD_LOCAL int hart_sense;
+
+  __sync_synchronize();
+
+  hart_sense = !hart_sense;
+  if (__sync_fetch_and_add(&count, 1) == ncores - 1) {
+    // The release store to sense orders the count reset before it, so no
+    // hart can arrive at the next barrier and see the old count
+    __atomic_store_n(&count, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&sense, hart_sense, __ATOMIC_RELEASE);
+  } else {
+    while (__atomic_load_n(&sense, __ATOMIC_ACQUIRE) != hart_sense)
+      ;
+  }
+
+  __sync_synchronize();
+}
+
+static void gemmini_multi_check(int ncores) {
+#ifdef BAREMETAL
+  if (ncores > GEMMINI_HARTS) {
+    printf("Can't split a layer across %d harts when GEMMINI_HARTS is %d\n", ncores, GEMMINI_HARTS);
+    exit(1);
+  }
+#endif
+}
+
+// The range [*start, *end) of n that hart coreid gets. Ranges are cut in
+// multiples of align, and the harts' shares differ by at most one of them
+static void gemmini_multi_share(size_t n, size_t align, int coreid, int ncores,
+        size_t * start, size_t * end) {
+  const size_t chunks = n / align + (n % align != 0);
+  const size_t first = chunks * coreid / ncores;
+  const size_t last = chunks * (coreid + 1) / ncores;
+
+  *start = first * align < n ? first * align : n;
+  *end = last * align < n ? last * align : n;
+}
+
+// Waits for this hart's accelerator, then for the other harts
+static void gemmini_multi_join(int ncores) {
+  gemmini_fence();
+  gemmini_barrier(ncores);
+}
+
+static void tiled_matmul_auto_multi(int coreid, int ncores,
+        size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_A, bool transpose_B,
+        bool full_C, bool low_D,
+        uint8_t weightA,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  gemmini_multi_check(ncores);
+
+  const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+  const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+  const bool split_J = matmul_cpu_split_J(dim_I, dim_J, act);
+
+  size_t start, end;
+  gemmini_multi_share(split_J ? dim_J : dim_I, DIM, coreid, ncores, &start, &end);
+
+  if (start < end && split_J) {
+    tiled_matmul_auto(dim_I, end - start, dim_K,
+        A, transpose_B ? B + start * stride_B : B + start,
+        D == NULL ? NULL : (const int8_t*)D + start * sizeof_D,
+        (int8_t*)C + start * sizeof_C,
+        stride_A, stride_B, stride_D, stride_C,
+        A_scale_factor, B_scale_factor, D_scale_factor,
+        act, scale, bert_scale, repeating_bias,
+        transpose_A, transpose_B, full_C, low_D,
+        weightA, tiled_matmul_type);
+  } else if (start < end) {
+    tiled_matmul_auto(end - start, dim_J, dim_K,
+        transpose_A ? A + start : A + start * stride_A, B,
+        D == NULL || repeating_bias ? D : (const int8_t*)D + start * stride_D * sizeof_D,
+        (int8_t*)C + start * stride_C * sizeof_C,
+        stride_A, stride_B, stride_D, stride_C,
+        A_scale_factor, B_scale_factor, D_scale_factor,
+        act, scale, bert_scale, repeating_bias,
+        transpose_A, transpose_B, full_C, low_D,
+        weightA, tiled_matmul_type);
+  }
+
+  gemmini_multi_join(ncores);
+}
+
+// Packed weights are only split by columns when they're laid out as
+// TERNARY_KJ, with the four columns of each byte kept together
+static void tiled_mpgemm_auto_multi(int coreid, int ncores,
+        size_t dim_I, size_t dim_J_out, size_t dim_K,
+        const elem_t* A, const elem_t* B,
+        const void * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_D, size_t stride_C,
+        scale_t A_scale_factor, scale_t B_scale_factor, scale_acc_t D_scale_factor,
+        int act, acc_scale_t scale, acc_scale_t bert_scale,
+        bool repeating_bias,
+        bool transpose_B,
+        bool full_C, bool low_D,
+        enum tiled_matmul_type_t tiled_matmul_type) {
+  gemmini_multi_check(ncores);
+
+  const size_t sizeof_D = low_D ? sizeof(elem_t) : sizeof(acc_t);
+  const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+  const bool split_J = !transpose_B && matmul_cpu_split_J(dim_I, dim_J_out, act);
+
+  size_t start, end;
+  gemmini_multi_share(split_J ? dim_J_out : dim_I, split_J ? 4*DIM : DIM,
+      coreid, ncores, &start, &end);
+
+  if (start < end && split_J) {
+    tiled_mpgemm_auto(dim_I, end - start, dim_K,
+        A, B + start / 4,
+        D == NULL ? NULL : (const int8_t*)D + start * sizeof_D,
+        (int8_t*)C + start * sizeof_C,
+        stride_A, stride_B, stride_D, stride_C,
+        A_scale_factor, B_scale_factor, D_scale_factor,
+        act, scale, bert_scale, repeating_bias,
+        transpose_B, full_C, low_D,
+        tiled_matmul_type);
+  } else if (start < end) {
+    tiled_mpgemm_auto(end - start, dim_J_out, dim_K,
+        A + start * stride_A, B,
+        D == NULL || repeating_bias ? D : (const int8_t*)D + start * stride_D * sizeof_D,
+        (int8_t*)C + start * stride_C * sizeof_C,
+        stride_A, stride_B, stride_D, stride_C,
+        A_scale_factor, B_scale_factor, D_scale_factor,
+        act, scale, bert_scale, repeating_bias,
+        transpose_B, full_C, low_D,
+        tiled_matmul_type);
+  }
+
+  gemmini_multi_join(ncores);
+}
+
+static void tiled_conv_multi(int coreid, int ncores,
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type, bool is_mpgemm) {
+  gemmini_multi_check(ncores);
+
+  const int weight_stride = is_mpgemm ? out_channels / 4 : out_channels;
+  const bool split = !trans_output_1203 && !trans_input_3120 &&
+    !trans_weight_1203 && !trans_weight_0132;
+
+  size_t start = 0, end = coreid == 0 ? out_channels : 0;
+  if (split)
+    gemmini_multi_share(out_channels, is_mpgemm ? 4*DIM : DIM, coreid, ncores, &start, &end);
+
+  if (start < end) {
+    tiled_conv_stride_auto(
+        batch_size, in_row_dim, in_col_dim, in_channels,
+        end - start, out_row_dim, out_col_dim,
+        stride, input_dilation, kernel_dilation, padding, kernel_dim,
+        in_channels, weight_stride, out_channels,
+        wrot180, trans_output_1203, trans_input_3120,
+        trans_weight_1203, trans_weight_0132,
+
+        input,
+        weights + (is_mpgemm ? start / 4 : start),
+        bias == NULL ? NULL : bias + start,
+        output + start,
+
+        act, scale, pool_size, pool_stride, pool_padding,
+        tiled_conv_type, is_mpgemm);
+  }
+
+  gemmini_multi_join(ncores);
+}
+
+static void tiled_conv_auto_multi(int coreid, int ncores,
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+        bool trans_weight_1203, bool trans_weight_0132,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type) {
+  tiled_conv_multi(coreid, ncores,
+      batch_size, in_row_dim, in_col_dim, in_channels,
+      out_channels, out_row_dim, out_col_dim,
+      stride, input_dilation, kernel_dilation, padding, kernel_dim,
+      wrot180, trans_output_1203, trans_input_3120,
+      trans_weight_1203, trans_weight_0132,
+      input, weights, bias, output,
+      act, scale, pool_size, pool_stride, pool_padding,
+      tiled_conv_type, false);
+}
+
+static void tiled_conv_mpgemm_auto_multi(int coreid, int ncores,
+        int batch_size, int in_row_dim, int in_col_dim, int in_channels,
+        int out_channels, int out_row_dim, int out_col_dim,
+        int stride, int input_dilation, int kernel_dilation, int padding, int kernel_dim,
+        bool wrot180, bool trans_output_1203, bool trans_input_3120,
+
+        const elem_t * input,
+        const elem_t * weights,
+        const acc_t * bias,
+        elem_t * output,
+
+        int act, acc_scale_t scale,
+        int pool_size, int pool_stride, int pool_padding,
+
+        enum tiled_matmul_type_t tiled_conv_type) {
+  tiled_conv_multi(coreid, ncores,
+      batch_size, in_row_dim, in_col_dim, in_channels,
+      out_channels, out_row_dim, out_col_dim,
+      stride, input_dilation, kernel_dilation, padding, kernel_dim,
+      wrot180, trans_output_1203, trans_input_3120,
+      false, false,
+      input, weights, bias, output,
+      act, scale, pool_size, pool_stride, pool_padding,
+      tiled_conv_type, true);
+}
+
+#ifndef BAREMETAL
+struct gemmini_multi_hart_t {
+  void (*job)(int coreid, int ncores);
+  int coreid, ncores;
+};
+
+static void * gemmini_multi_run_hart(void * arg) {
+  const struct gemmini_multi_hart_t * hart = arg;
+
+#ifndef GEMMINI_EMULATOR
+  cpu_set_t cores;
+  CPU_ZERO(&cores);
+  CPU_SET(hart->coreid, &cores);
+  if (sched_setaffinity(0, sizeof(cores), &cores) != 0) {
+    printf("Couldn't pin hart %d to its core\n", hart->coreid);
+    exit(1);
+  }
+#endif
+
+  hart->job(hart->coreid, hart->ncores);
+  return NULL;
+}
+
+// The Linux counterpart of riscv-tests' thread_entry: runs job(coreid,
+// ncores) on ncores threads, each pinned to core coreid, and returns once
+// they all have. Emulated accelerators are per thread, so they aren't pinned
+static void gemmini_multi_launch(int ncores, void (*job)(int coreid, int ncores)) {
+  pthread_t threads[ncores];
+  struct gemmini_multi_hart_t harts[ncores];
+
+  for (int h = 0; h < ncores; h++) {
+    harts[h].job = job;
+    harts[h].coreid = h;
+    harts[h].ncores = ncores;
+
+    if (pthread_create(&threads[h], NULL, gemmini_multi_run_hart, &harts[h]) != 0) {
+      printf("Couldn't start hart %d\n", h);
+      exit(1);
+    }
+  }
+
+  for (int h = 0; h < ncores; h++)
+    pthread_join(threads[h], NULL);
+}
+#endif
+
+#endif // SRC_MAIN_C_GEMMINI_MULTI_H
@@ -2,6 +2,7 @@
 #define GEMMINI_NN_H
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #ifndef BAREMETAL
@@ -9,6 +10,7 @@
 #endif
 #include "include/gemmini.h"
 #include "include/gemmini_testutils.h"
+#include "include/gemmini_async.h"
 
 struct ConvParams {
     int batch_size;
@@ -99,7 +101,7 @@ static void tiled_matmul_nn(size_t dim_I, size_t dim_J, size_t dim_K,
         false, false,
         false, false,
         0,
-        tiled_matmul_type, false);
+        tiled_matmul_type, false, false);
 
     if (check) {
         printf("%s: CPU\n", layer_name);
@@ -164,6 +166,109 @@ static void tiled_matmul_nn_auto(size_t dim_I, size_t dim_J, size_t dim_K,
     }
 }
 
+// The same, submitted through gemmini_async.h. With "check", the layer is
+// compared against the CPU straight away, so it runs synchronously
+static gemmini_handle_t tiled_matmul_nn_auto_async(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const void * D, elem_t C[dim_I][dim_J],
+        int act, acc_scale_t scale, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        bool check, char * layer_name)
+{
+    if (check) {
+        gemmini_wait_all();
+        tiled_matmul_nn_auto(dim_I, dim_J, dim_K, A, B, D, C,
+            act, scale, repeating_bias,
+            tiled_matmul_type, check, layer_name);
+        return GEMMINI_HANDLE_DONE;
+    }
+
+    return tiled_matmul_auto_async(dim_I, dim_J, dim_K,
+        (elem_t*)A, (elem_t*)B, D, (elem_t*)C,
+        dim_K, dim_J, dim_J, dim_J,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        act, scale, 0, repeating_bias,
+        false, false,
+        false, false,
+        0,
+        tiled_matmul_type);
+}
+
+// Each pass that scales a fused residual up (see matmul_resadd_scale) is one
+// more sweep of the array over the whole output, issued command by command.
+// By the emulator's execute and DMA counts for ResNet-50's four bottleneck
+// expansions, taking the busiest unit as the bound, one pass beats a matmul
+// followed by tiled_resadd by 2-20%, and two passes tie or lose on three of
+// the four
+#define RESADD_MAX_FUSED_PASSES 1
+
+// A layer followed by a residual addition, C = act(layer + res_scale * R). On
+// WS and the CPU, tiled_matmul_resadd_auto_async adds the residual in the
+// accumulator, at res_scale / scale, unless that takes more than
+// RESADD_MAX_FUSED_PASSES passes. Otherwise, and on OS, which has no fused
+// path, the layer runs with no activation and is followed by a separate
+// tiled_resadd_auto_async
+static gemmini_handle_t tiled_matmul_nn_resadd_auto_async(size_t dim_I, size_t dim_J, size_t dim_K,
+        const elem_t A[dim_I][dim_K], const elem_t B[dim_K][dim_J],
+        const acc_t * D, const elem_t R[dim_I][dim_J], elem_t C[dim_I][dim_J],
+        scale_t res_scale, int act, acc_scale_t scale, bool repeating_bias,
+        enum tiled_matmul_type_t tiled_matmul_type,
+        bool check, char * layer_name)
+{
+    const scale_t R_scale = res_scale / scale;
+
+    if (tiled_matmul_type == OS || matmul_resadd_scale(R_scale).passes > RESADD_MAX_FUSED_PASSES) {
+        tiled_matmul_nn_auto_async(dim_I, dim_J, dim_K, A, B, D, C,
+            NO_ACTIVATION, scale, repeating_bias,
+            tiled_matmul_type, check, layer_name);
+
+        return tiled_resadd_auto_async(dim_I, dim_J,
+            res_scale, MVIN_SCALE_IDENTITY, ACC_SCALE_IDENTITY,
+            (elem_t*)R, (elem_t*)C, (elem_t*)C,
+            act == RELU, tiled_matmul_type == CPU ? CPU : WS);
+    }
+
+    if (check) {
+        gemmini_wait_all();
+
+        // C may be R, so the CPU goes first. Layers are too large for the
+        // reference to live on the stack
+        printf("%s: CPU\n", layer_name);
+        elem_t (*gold)[dim_J] = malloc(dim_I * dim_J * sizeof(elem_t));
+        if (gold == NULL) {
+            printf("Out of memory while checking %s\n", layer_name);
+            exit(1);
+        }
+
+        tiled_matmul_resadd_auto(dim_I, dim_J, dim_K,
+            (elem_t*)A, (elem_t*)B, D, (elem_t*)R, (elem_t*)gold,
+            dim_K, dim_J, dim_J, dim_J, dim_J,
+            R_scale, act, scale, repeating_bias,
+            CPU);
+
+        printf("%s: gemmini\n", layer_name);
+        tiled_matmul_resadd_auto(dim_I, dim_J, dim_K,
+            (elem_t*)A, (elem_t*)B, D, (elem_t*)R, (elem_t*)C,
+            dim_K, dim_J, dim_J, dim_J, dim_J,
+            R_scale, act, scale, repeating_bias,
+            tiled_matmul_type);
+
+        if (!MAT_IS_EQUAL(dim_I, dim_J, C, gold)) {
+            printf("Layer calculated incorrectly: %s\n", layer_name);
+            exit(1);
+        }
+
+        free(gold);
+        return GEMMINI_HANDLE_DONE;
+    }
+
+    return tiled_matmul_resadd_auto_async(dim_I, dim_J, dim_K,
+        (elem_t*)A, (elem_t*)B, D, (elem_t*)R, (elem_t*)C,
+        dim_K, dim_J, dim_J, dim_J, dim_J,
+        R_scale, act, scale, repeating_bias,
+        tiled_matmul_type);
+}
+
 // need to specify stride
 // auto tiling calc
 static void tiled_matmul_nn_stride_auto(size_t dim_I, size_t dim_J, size_t dim_K,
@@ -183,6 +288,9 @@ static void tiled_matmul_nn_stride_auto(size_t dim_I, size_t dim_J, size_t dim_K
         0,
         tiled_matmul_type);
 }
+
+// The CPU layers below first wait for any outstanding gemmini_async.h op
+// that writes their input or reads their output
 static void conv_dw(size_t I, size_t J,
     const size_t batch_size, const size_t channels,
     const size_t in_row_dim, const size_t in_col_dim,
@@ -195,6 +303,9 @@ static void conv_dw(size_t I, size_t J,
     elem_t output [I][J],
     const struct ConvParams * params)
 {
+    gemmini_wait_read(input, batch_size * in_row_dim * in_col_dim * channels * sizeof(elem_t));
+    gemmini_wait_write(output, I * J * sizeof(elem_t));
+
     for (int batch = 0; batch < batch_size; batch++) {
         for (int channel = 0; channel < channels; channel++) {
             for (int out_row = 0; out_row < out_row_dim; out_row++) {
@@ -251,6 +362,9 @@ static void conv_dw_with_col2im(size_t prev_I, size_t prev_J, size_t I, size_t J
     elem_t output [I][J],
     const struct ConvParams * params)
 {
+    gemmini_wait_read(input, prev_I * prev_J * sizeof(elem_t));
+    gemmini_wait_write(output, I * J * sizeof(elem_t));
+
     for (int batch = 0; batch < batch_size; batch++) {
         for (int channel = 0; channel < channels; channel++) {
             for (int out_row = 0; out_row < out_row_dim; out_row++) {
@@ -307,6 +421,9 @@ static void im2col(size_t batch_size, size_t channels, size_t im_row_dim, size_t
     elem_t output[I][K],
     const struct ConvParams * params)
 {
+    gemmini_wait_read(input, batch_size * im_row_dim * im_col_dim * channels * sizeof(elem_t));
+    gemmini_wait_write(output, I * K * sizeof(elem_t));
+
     int patch_row = 0;
 
     for (int n_batch = 0; n_batch < params->batch_size; n_batch++) {
@@ -322,7 +439,7 @@ static void im2col(size_t batch_size, size_t channels, size_t im_row_dim, size_t
                             
                             if (pixel_row < 0 || pixel_row >= params->in_row_dim
                                 || pixel_col < 0 || pixel_col >= params->in_col_dim) {
-                                // output[patch_row][patch_col] = 0;
+                                output[patch_row][patch_col] = 0;
                             } else {
                                 output[patch_row][patch_col] = input[n_batch][pixel_row][pixel_col][im_channel];
                             }
@@ -331,6 +448,11 @@ static void im2col(size_t batch_size, size_t channels, size_t im_row_dim, size_t
                         }
                     }
                 }
+
+                // The output may be a reused buffer, so the padding and any
+                // columns past the kernel are zeroed rather than assumed zero
+                for (; patch_col < K; patch_col++)
+                    output[patch_row][patch_col] = 0;
                 
                 patch_row++;
             }
@@ -344,6 +466,9 @@ static void im2col_with_col2im(size_t prev_I, size_t prev_J,
     elem_t output[next_I][next_K],
     const struct ConvParams * params)
 {
+    gemmini_wait_read(input, prev_I * prev_J * sizeof(elem_t));
+    gemmini_wait_write(output, next_I * next_K * sizeof(elem_t));
+
     int out_row = 0;
 
     for (int n_batch = 0; n_batch < params->batch_size; n_batch++) {
@@ -359,7 +484,7 @@ static void im2col_with_col2im(size_t prev_I, size_t prev_J,
 
                             if (pixel_row < 0 || pixel_row >= params->in_row_dim
                                 || pixel_col < 0 || pixel_col >= params->in_col_dim) {
-                                // output[out_row][out_col] = 0;
+                                output[out_row][out_col] = 0;
                             } else {
                                 int in_row = n_batch * params->in_row_dim * params->in_col_dim + pixel_row * params->in_col_dim + pixel_col;
                                 int in_col = im_channel;
@@ -372,6 +497,9 @@ static void im2col_with_col2im(size_t prev_I, size_t prev_J,
                     }
                 }
 
+                for (; out_col < next_K; out_col++)
+                    output[out_row][out_col] = 0;
+
                 out_row++;
             }
         }
@@ -489,6 +617,9 @@ void pool(size_t batch_size, size_t channels, size_t in_row_dim, size_t in_col_d
     elem_t output[batch_size][out_row_dim][out_col_dim][channels],
     const struct ConvParams * params)
 {
+    gemmini_wait_read(input, batch_size * in_row_dim * in_col_dim * channels * sizeof(elem_t));
+    gemmini_wait_write(output, batch_size * out_row_dim * out_col_dim * channels * sizeof(elem_t));
+
     size_t kernel_size = params->pool_size;
     size_t stride = params->pool_stride;
     // size_t in_dim = params->out_dim;
@@ -533,6 +664,9 @@ void pool_with_col2im(size_t I, size_t J,
     elem_t output[batch_size][out_row_dim][out_col_dim][channels],
     const struct ConvParams * params)
 {
+    gemmini_wait_read(input, I * J * sizeof(elem_t));
+    gemmini_wait_write(output, batch_size * out_row_dim * out_col_dim * channels * sizeof(elem_t));
+
     size_t kernel_size = params->pool_size;
     size_t stride = params->pool_stride;
     size_t in_row_dim = params->out_row_dim;
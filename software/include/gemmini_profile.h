@@ -0,0 +1,257 @@
+// See LICENSE for license details.
+
+// Scoped per-layer profiling.
+//
+// The counter file only has 8 configurable counters, but gemmini_counter.h
+// lists INCREMENTAL_COUNTERS + 7 events. A profiling scope wraps one layer,
+// e.g. a tiled_conv_auto call, and counts a different set of 8 events every
+// time it runs. Running the workload GEMMINI_PROFILE_PASSES times therefore
+// covers every event for every scope:
+//
+//   for (int pass = 0; pass < GEMMINI_PROFILE_PASSES; pass++) {
+//     GEMMINI_PROFILE("conv_1", tiled_conv_auto(...));
+//     GEMMINI_PROFILE("fc_1000", tiled_matmul_auto(...));
+//   }
+//   gemmini_profile_report_csv();
+//
+// Each event is averaged over the runs that counted it, and the cycle count
+// over all of a scope's runs. Scopes fence the accelerator on entry and exit,
+// so that each one only counts its own layer. They can't be nested.
+//
+// The reports give each scope's cycles, DMA bytes, a stall breakdown, and
+// whether its load, store or execute controller was the busiest, followed by
+// the raw value of every event.
+
+#ifndef SRC_MAIN_C_GEMMINI_PROFILE_H
+#define SRC_MAIN_C_GEMMINI_PROFILE_H
+
+#include "include/gemmini.h"
+
+#define GEMMINI_PROFILE_COUNTERS 8
+#define GEMMINI_PROFILE_EVENTS (INCREMENTAL_COUNTERS + 7)
+#define GEMMINI_PROFILE_PASSES ((GEMMINI_PROFILE_EVENTS + GEMMINI_PROFILE_COUNTERS - 1) / GEMMINI_PROFILE_COUNTERS)
+
+#ifndef GEMMINI_PROFILE_MAX_SCOPES
+#define GEMMINI_PROFILE_MAX_SCOPES 64
+#endif
+
+// Indexed by event - 1
+static const char * gemmini_profile_event_names[GEMMINI_PROFILE_EVENTS] = {
+  "MAIN_LD_CYCLES", "MAIN_ST_CYCLES", "MAIN_EX_CYCLES", "MAIN_LD_ST_CYCLES",
+  "MAIN_LD_EX_CYCLES", "MAIN_ST_EX_CYCLES", "MAIN_LD_ST_EX_CYCLES",
+  "LOAD_DMA_WAIT_CYCLE", "LOAD_ACTIVE_CYCLE", "LOAD_SCRATCHPAD_WAIT_CYCLE",
+  "STORE_DMA_WAIT_CYCLE", "STORE_ACTIVE_CYCLE", "STORE_POOLING_CYCLE", "STORE_SCRATCHPAD_WAIT_CYCLE",
+  "DMA_TLB_MISS_CYCLE", "DMA_TLB_HIT_REQ", "DMA_TLB_TOTAL_REQ",
+  "RDMA_ACTIVE_CYCLE", "RDMA_TLB_WAIT_CYCLES", "RDMA_TL_WAIT_CYCLES",
+  "WDMA_ACTIVE_CYCLE", "WDMA_TLB_WAIT_CYCLES", "WDMA_TL_WAIT_CYCLES",
+  "EXE_ACTIVE_CYCLE", "EXE_FLUSH_CYCLE", "EXE_CONTROL_Q_BLOCK_CYCLE",
+  "EXE_PRELOAD_HAZ_CYCLE", "EXE_OVERLAP_HAZ_CYCLE",
+  "SCRATCHPAD_A_WAIT_CYCLE", "SCRATCHPAD_B_WAIT_CYCLE", "SCRATCHPAD_D_WAIT_CYCLE",
+  "ACC_A_WAIT_CYCLE", "ACC_B_WAIT_CYCLE", "ACC_D_WAIT_CYCLE",
+  "A_GARBAGE_CYCLES", "B_GARBAGE_CYCLES", "D_GARBAGE_CYCLES",
+  "IM2COL_MEM_CYCLES", "IM2COL_ACTIVE_CYCLES", "IM2COL_TRANSPOSER_WAIT_CYCLE",
+  "RESERVATION_STATION_FULL_CYCLES", "RESERVATION_STATION_ACTIVE_CYCLES",
+  "LOOP_MATMUL_ACTIVE_CYCLES", "TRANSPOSE_PRELOAD_UNROLLER_ACTIVE_CYCLES",
+  "RESERVATION_STATION_LD_COUNT", "RESERVATION_STATION_ST_COUNT", "RESERVATION_STATION_EX_COUNT",
+  "RDMA_BYTES_REC", "WDMA_BYTES_SENT",
+  "RDMA_TOTAL_LATENCY", "WDMA_TOTAL_LATENCY",
+};
+
+// The stalls reported in each scope's summary
+static const int gemmini_profile_stalls[] = {
+  LOAD_DMA_WAIT_CYCLE, LOAD_SCRATCHPAD_WAIT_CYCLE,
+  STORE_DMA_WAIT_CYCLE, STORE_SCRATCHPAD_WAIT_CYCLE,
+  DMA_TLB_MISS_CYCLE,
+  EXE_CONTROL_Q_BLOCK_CYCLE, EXE_PRELOAD_HAZ_CYCLE, EXE_OVERLAP_HAZ_CYCLE,
+  RESERVATION_STATION_FULL_CYCLES,
+};
+
+struct gemmini_profile_scope_t {
+  const char * name;
+  size_t runs;
+  uint64_t cycles;
+  uint64_t events[GEMMINI_PROFILE_EVENTS + 1]; // Indexed by event
+  uint32_t event_runs[GEMMINI_PROFILE_EVENTS + 1];
+};
+
+static struct gemmini_profile_scope_t gemmini_profile_scopes[GEMMINI_PROFILE_MAX_SCOPES];
+static size_t gemmini_profile_n_scopes = 0;
+
+static struct gemmini_profile_scope_t * gemmini_profile_active = NULL;
+static uint64_t gemmini_profile_start;
+
+// The event counted by "counter" on a scope's "run"-th run, or DISABLE
+static int gemmini_profile_event(size_t run, size_t counter) {
+  const int event = (run % GEMMINI_PROFILE_PASSES) * GEMMINI_PROFILE_COUNTERS + counter + 1;
+  return event <= GEMMINI_PROFILE_EVENTS ? event : DISABLE;
+}
+
+static struct gemmini_profile_scope_t * gemmini_profile_scope(const char * name) {
+  for (size_t s = 0; s < gemmini_profile_n_scopes; s++)
+    if (strcmp(gemmini_profile_scopes[s].name, name) == 0)
+      return &gemmini_profile_scopes[s];
+
+  if (gemmini_profile_n_scopes >= GEMMINI_PROFILE_MAX_SCOPES) {
+    printf("Can't profile more than %d scopes; raise GEMMINI_PROFILE_MAX_SCOPES\n", GEMMINI_PROFILE_MAX_SCOPES);
+    exit(1);
+  }
+
+  struct gemmini_profile_scope_t * scope = &gemmini_profile_scopes[gemmini_profile_n_scopes++];
+  memset(scope, 0, sizeof(*scope));
+  scope->name = name;
+  return scope;
+}
+
+// "name" must outlive the report, e.g. be a string literal
+static void gemmini_profile_begin(const char * name) {
+  if (gemmini_profile_active != NULL) {
+    printf("Profiling scope \"%s\" can't start inside \"%s\"\n", name, gemmini_profile_active->name);
+    exit(1);
+  }
+
+  struct gemmini_profile_scope_t * scope = gemmini_profile_scope(name);
+  gemmini_profile_active = scope;
+
+  gemmini_fence();
+  // Configuring a counter only zeroes it for built-in events. The DMA byte,
+  // latency and reservation station counts are external, and only the global
+  // reset zeroes them
+  counter_reset();
+  for (size_t c = 0; c < GEMMINI_PROFILE_COUNTERS; c++)
+    counter_configure(c, gemmini_profile_event(scope->runs, c));
+
+  gemmini_profile_start = read_cycles();
+}
+
+static void gemmini_profile_end() {
+  struct gemmini_profile_scope_t * scope = gemmini_profile_active;
+  if (scope == NULL) {
+    printf("No profiling scope to end\n");
+    exit(1);
+  }
+
+  gemmini_fence();
+  const uint64_t end = read_cycles();
+
+  scope->cycles += end - gemmini_profile_start;
+  for (size_t c = 0; c < GEMMINI_PROFILE_COUNTERS; c++) {
+    const int event = gemmini_profile_event(scope->runs, c);
+    if (event != DISABLE) {
+      scope->events[event] += counter_read(c);
+      scope->event_runs[event]++;
+    }
+    counter_configure(c, DISABLE);
+  }
+
+  scope->runs++;
+  gemmini_profile_active = NULL;
+}
+
+#define GEMMINI_PROFILE(name, call) \
+  do { \
+    gemmini_profile_begin(name); \
+    call; \
+    gemmini_profile_end(); \
+  } while (0)
+
+// Forgets every scope, e.g. between benchmarks that reuse scope names
+static void gemmini_profile_reset() {
+  gemmini_profile_n_scopes = 0;
+  gemmini_profile_active = NULL;
+}
+
+static bool gemmini_profile_counted(const struct gemmini_profile_scope_t * scope, int event) {
+  return scope->event_runs[event] != 0;
+}
+
+// An event's average over the runs that counted it, or 0 if none did
+static uint64_t gemmini_profile_value(const struct gemmini_profile_scope_t * scope, int event) {
+  return gemmini_profile_counted(scope, event) ? scope->events[event] / scope->event_runs[event] : 0;
+}
+
+// Which controller was busiest: "load", "store" or "execute", or "-" before
+// those events have been counted
+static const char * gemmini_profile_bound(const struct gemmini_profile_scope_t * scope) {
+  if (!gemmini_profile_counted(scope, LOAD_ACTIVE_CYCLE) ||
+      !gemmini_profile_counted(scope, STORE_ACTIVE_CYCLE) ||
+      !gemmini_profile_counted(scope, EXE_ACTIVE_CYCLE))
+    return "-";
+
+  const uint64_t load = gemmini_profile_value(scope, LOAD_ACTIVE_CYCLE);
+  const uint64_t store = gemmini_profile_value(scope, STORE_ACTIVE_CYCLE);
+  const uint64_t exe = gemmini_profile_value(scope, EXE_ACTIVE_CYCLE);
+
+  if (exe >= load && exe >= store)
+    return "execute";
+  return load >= store ? "load" : "store";
+}
+
+// One row per scope. Events that no run of a scope counted are left empty
+static void gemmini_profile_report_csv() {
+  const size_t n_stalls = sizeof(gemmini_profile_stalls) / sizeof(gemmini_profile_stalls[0]);
+
+  printf("scope,runs,cycles,rdma_bytes,wdma_bytes,bound");
+  for (size_t s = 0; s < n_stalls; s++)
+    printf(",%s", gemmini_profile_event_names[gemmini_profile_stalls[s] - 1]);
+  for (int e = 1; e <= GEMMINI_PROFILE_EVENTS; e++)
+    printf(",%s", gemmini_profile_event_names[e - 1]);
+  printf("\n");
+
+  for (size_t i = 0; i < gemmini_profile_n_scopes; i++) {
+    const struct gemmini_profile_scope_t * scope = &gemmini_profile_scopes[i];
+
+    printf("%s,%zu,%llu,%llu,%llu,%s", scope->name, scope->runs,
+        (unsigned long long)(scope->runs ? scope->cycles / scope->runs : 0),
+        (unsigned long long)gemmini_profile_value(scope, RDMA_BYTES_REC),
+        (unsigned long long)gemmini_profile_value(scope, WDMA_BYTES_SENT),
+        gemmini_profile_bound(scope));
+
+    for (size_t s = 0; s < n_stalls; s++)
+      printf(",%llu", (unsigned long long)gemmini_profile_value(scope, gemmini_profile_stalls[s]));
+
+    for (int e = 1; e <= GEMMINI_PROFILE_EVENTS; e++) {
+      if (gemmini_profile_counted(scope, e))
+        printf(",%llu", (unsigned long long)gemmini_profile_value(scope, e));
+      else
+        printf(",");
+    }
+    printf("\n");
+  }
+}
+
+// The same report as one JSON array, with uncounted events as null
+static void gemmini_profile_report_json() {
+  const size_t n_stalls = sizeof(gemmini_profile_stalls) / sizeof(gemmini_profile_stalls[0]);
+
+  printf("[\n");
+  for (size_t i = 0; i < gemmini_profile_n_scopes; i++) {
+    const struct gemmini_profile_scope_t * scope = &gemmini_profile_scopes[i];
+
+    printf("  {\"scope\": \"%s\", \"runs\": %zu, \"cycles\": %llu, \"rdma_bytes\": %llu, \"wdma_bytes\": %llu, \"bound\": \"%s\",\n",
+        scope->name, scope->runs,
+        (unsigned long long)(scope->runs ? scope->cycles / scope->runs : 0),
+        (unsigned long long)gemmini_profile_value(scope, RDMA_BYTES_REC),
+        (unsigned long long)gemmini_profile_value(scope, WDMA_BYTES_SENT),
+        gemmini_profile_bound(scope));
+
+    printf("   \"stalls\": {");
+    for (size_t s = 0; s < n_stalls; s++)
+      printf("%s\"%s\": %llu", s == 0 ? "" : ", ",
+          gemmini_profile_event_names[gemmini_profile_stalls[s] - 1],
+          (unsigned long long)gemmini_profile_value(scope, gemmini_profile_stalls[s]));
+    printf("},\n");
+
+    printf("   \"events\": {");
+    for (int e = 1; e <= GEMMINI_PROFILE_EVENTS; e++) {
+      printf("%s\"%s\": ", e == 1 ? "" : ", ", gemmini_profile_event_names[e - 1]);
+      if (gemmini_profile_counted(scope, e))
+        printf("%llu", (unsigned long long)gemmini_profile_value(scope, e));
+      else
+        printf("null");
+    }
+    printf("}}%s\n", i + 1 < gemmini_profile_n_scopes ? "," : "");
+  }
+  printf("]\n");
+}
+
+#endif // SRC_MAIN_C_GEMMINI_PROFILE_H
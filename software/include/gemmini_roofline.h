@@ -0,0 +1,198 @@
+// See LICENSE for license details.
+
+// Roofline measurements.
+//
+// A roofline point is one layer's operational intensity (MACs per byte of
+// DRAM traffic, from RDMA_BYTES_REC and WDMA_BYTES_SENT) against the MACs per
+// cycle it achieved. The layer is bounded by two ceilings: the DIM x DIM mesh
+// retires at most DIM*DIM MACs per cycle, and the DMA moves at most
+// GEMMINI_DMA_BUS_BYTES per cycle. A layer whose intensity is below the ridge
+// point, peak / bandwidth, can't reach the peak however well it's tiled.
+// Packed ternary weights give each compute 4*DIM outputs, so ternary layers
+// have a compute ceiling four times higher, and a ridge point four times
+// further right, than int8 ones.
+//
+//   struct gemmini_roofline_point_t p;
+//   gemmini_roofline_start();
+//   tiled_matmul_auto(I, J, K, ...);
+//   gemmini_roofline_stop(&p, "matmul", false, (uint64_t)I*J*K);
+//
+// On the emulator, read_cycles() counts host nanoseconds, so only the DMA
+// counters and the intensities they give are meaningful there.
+
+#ifndef SRC_MAIN_C_GEMMINI_ROOFLINE_H
+#define SRC_MAIN_C_GEMMINI_ROOFLINE_H
+
+#include "include/gemmini.h"
+
+// dma_buswidth / 8 in the default config
+#ifndef GEMMINI_DMA_BUS_BYTES
+#define GEMMINI_DMA_BUS_BYTES 16
+#endif
+
+#define GEMMINI_PEAK_MACS_PER_CYCLE (DIM * DIM)
+#define GEMMINI_RIDGE_INTENSITY ((double)GEMMINI_PEAK_MACS_PER_CYCLE / GEMMINI_DMA_BUS_BYTES)
+
+#define GEMMINI_TERNARY_PEAK_MACS_PER_CYCLE (4 * DIM * DIM)
+#define GEMMINI_TERNARY_RIDGE_INTENSITY ((double)GEMMINI_TERNARY_PEAK_MACS_PER_CYCLE / GEMMINI_DMA_BUS_BYTES)
+
+struct gemmini_roofline_point_t {
+  const char * kernel;
+  bool ternary;
+  char shape[48];
+  uint64_t macs;
+  uint64_t rdma_bytes;
+  uint64_t wdma_bytes;
+  uint64_t rdma_latency;
+  uint64_t exe_cycles;
+  uint64_t cycles;
+};
+
+static uint64_t gemmini_roofline_start_cycles;
+
+static void gemmini_roofline_start() {
+  gemmini_fence();
+  // The DMA counters are external, so configuring them doesn't zero them
+  counter_reset();
+  counter_configure(0, RDMA_BYTES_REC);
+  counter_configure(1, WDMA_BYTES_SENT);
+  counter_configure(2, RDMA_TOTAL_LATENCY);
+  counter_configure(3, EXE_ACTIVE_CYCLE);
+  gemmini_roofline_start_cycles = read_cycles();
+}
+
+static void gemmini_roofline_stop(struct gemmini_roofline_point_t * p,
+        const char * kernel, bool ternary, uint64_t macs) {
+  gemmini_fence();
+  p->cycles = read_cycles() - gemmini_roofline_start_cycles;
+
+  p->kernel = kernel;
+  p->ternary = ternary;
+  p->macs = macs;
+  p->rdma_bytes = counter_read(0);
+  p->wdma_bytes = counter_read(1);
+  p->rdma_latency = counter_read(2);
+  p->exe_cycles = counter_read(3);
+
+  for (size_t c = 0; c < 4; c++)
+    counter_configure(c, DISABLE);
+}
+
+// MACs per byte of DRAM traffic
+static double gemmini_roofline_intensity(const struct gemmini_roofline_point_t * p) {
+  const uint64_t bytes = p->rdma_bytes + p->wdma_bytes;
+  return bytes == 0 ? 0 : (double)p->macs / bytes;
+}
+
+static double gemmini_roofline_achieved(const struct gemmini_roofline_point_t * p) {
+  return p->cycles == 0 ? 0 : (double)p->macs / p->cycles;
+}
+
+static int gemmini_roofline_peak(bool ternary) {
+  return ternary ? GEMMINI_TERNARY_PEAK_MACS_PER_CYCLE : GEMMINI_PEAK_MACS_PER_CYCLE;
+}
+
+static double gemmini_roofline_ridge(bool ternary) {
+  return ternary ? GEMMINI_TERNARY_RIDGE_INTENSITY : GEMMINI_RIDGE_INTENSITY;
+}
+
+// The highest MACs per cycle that the ceilings of int8 or ternary weights
+// allow at "intensity"
+static double gemmini_roofline_attainable(double intensity, bool ternary) {
+  const double bw_bound = intensity * GEMMINI_DMA_BUS_BYTES;
+  const int peak = gemmini_roofline_peak(ternary);
+  return bw_bound < peak ? bw_bound : peak;
+}
+
+static void gemmini_roofline_print_csv_header() {
+  printf("kernel,weights,shape,macs,rdma_bytes,wdma_bytes,rdma_latency,exe_cycles,cycles,"
+      "intensity,macs_per_cycle,attainable,bound\n");
+}
+
+static void gemmini_roofline_print_csv(const struct gemmini_roofline_point_t * p) {
+  const double intensity = gemmini_roofline_intensity(p);
+
+  printf("%s,%s,%s,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%.3f,%.3f,%s\n",
+      p->kernel, p->ternary ? "ternary" : "int8", p->shape,
+      (unsigned long long)p->macs,
+      (unsigned long long)p->rdma_bytes, (unsigned long long)p->wdma_bytes,
+      (unsigned long long)p->rdma_latency, (unsigned long long)p->exe_cycles,
+      (unsigned long long)p->cycles,
+      intensity, gemmini_roofline_achieved(p), gemmini_roofline_attainable(intensity, p->ternary),
+      intensity < gemmini_roofline_ridge(p->ternary) ? "bandwidth" : "compute");
+}
+
+// Log-log plot columns and rows per power of two, and the plotted ranges
+#define GEMMINI_ROOFLINE_PLOT_X_STEPS 4
+#define GEMMINI_ROOFLINE_PLOT_X_MIN_LOG2 (-2)
+#define GEMMINI_ROOFLINE_PLOT_X_MAX_LOG2 10
+#define GEMMINI_ROOFLINE_PLOT_Y_STEPS 2
+#define GEMMINI_ROOFLINE_PLOT_Y_MIN_LOG2 (-4)
+
+static int gemmini_roofline_log2_step(double x, int steps, int min_log2, int cells) {
+  if (x <= 0)
+    return 0;
+
+  int cell = (int)floor(log2(x) * steps + 0.5) - min_log2 * steps;
+  return cell < 0 ? 0 : cell >= cells ? cells - 1 : cell;
+}
+
+// Draws the int8 ceilings as '*', the ternary compute ceiling as '^', and each point at (intensity, achieved
+// MACs/cycle) as 'i' for int8 weights, 't' for ternary ones, or '#' where both
+// land. Out-of-range points are clamped to the edges. With "achieved" false,
+// points are drawn on the roof at their attainable MACs/cycle instead, which
+// is the useful view on the emulator
+static void gemmini_roofline_plot(const struct gemmini_roofline_point_t * points, size_t n, bool achieved) {
+  const int y_max_log2 = (int)ceil(log2(GEMMINI_TERNARY_PEAK_MACS_PER_CYCLE));
+  const int cols = (GEMMINI_ROOFLINE_PLOT_X_MAX_LOG2 - GEMMINI_ROOFLINE_PLOT_X_MIN_LOG2) * GEMMINI_ROOFLINE_PLOT_X_STEPS + 1;
+  const int rows = (y_max_log2 - GEMMINI_ROOFLINE_PLOT_Y_MIN_LOG2) * GEMMINI_ROOFLINE_PLOT_Y_STEPS + 1;
+
+  char grid[rows][cols];
+  memset(grid, ' ', sizeof(grid));
+
+  // The ternary roof shares the bandwidth ceiling, which is drawn last
+  for (int ternary = 1; ternary >= 0; ternary--)
+    for (int x = 0; x < cols; x++) {
+      const double intensity = exp2((double)x / GEMMINI_ROOFLINE_PLOT_X_STEPS + GEMMINI_ROOFLINE_PLOT_X_MIN_LOG2);
+      const int y = gemmini_roofline_log2_step(gemmini_roofline_attainable(intensity, ternary),
+          GEMMINI_ROOFLINE_PLOT_Y_STEPS, GEMMINI_ROOFLINE_PLOT_Y_MIN_LOG2, rows);
+      grid[y][x] = ternary ? '^' : '*';
+    }
+
+  for (size_t i = 0; i < n; i++) {
+    const double intensity = gemmini_roofline_intensity(&points[i]);
+    const double macs_per_cycle = achieved ? gemmini_roofline_achieved(&points[i]) :
+      gemmini_roofline_attainable(intensity, points[i].ternary);
+
+    const int x = gemmini_roofline_log2_step(intensity,
+        GEMMINI_ROOFLINE_PLOT_X_STEPS, GEMMINI_ROOFLINE_PLOT_X_MIN_LOG2, cols);
+    const int y = gemmini_roofline_log2_step(macs_per_cycle,
+        GEMMINI_ROOFLINE_PLOT_Y_STEPS, GEMMINI_ROOFLINE_PLOT_Y_MIN_LOG2, rows);
+
+    const char mark = points[i].ternary ? 't' : 'i';
+    grid[y][x] = grid[y][x] == ' ' || grid[y][x] == '*' || grid[y][x] == '^' || grid[y][x] == mark ? mark : '#';
+  }
+
+  printf("MACs/cycle (log2), peak %d int8 and %d ternary; DMA %d bytes/cycle; "
+      "ridge at %.1f and %.1f MACs/byte\n",
+      GEMMINI_PEAK_MACS_PER_CYCLE, GEMMINI_TERNARY_PEAK_MACS_PER_CYCLE, GEMMINI_DMA_BUS_BYTES,
+      GEMMINI_RIDGE_INTENSITY, GEMMINI_TERNARY_RIDGE_INTENSITY);
+
+  for (int y = rows - 1; y >= 0; y--) {
+    if (y % GEMMINI_ROOFLINE_PLOT_Y_STEPS == 0)
+      printf("%5d |", y / GEMMINI_ROOFLINE_PLOT_Y_STEPS + GEMMINI_ROOFLINE_PLOT_Y_MIN_LOG2);
+    else
+      printf("      |");
+    printf("%.*s\n", cols, grid[y]);
+  }
+
+  printf("      +");
+  for (int x = 0; x < cols; x++)
+    printf(x % GEMMINI_ROOFLINE_PLOT_X_STEPS == 0 ? "+" : "-");
+  printf("\n       ");
+  for (int x = 0; x < cols; x += GEMMINI_ROOFLINE_PLOT_X_STEPS)
+    printf("%-*d", GEMMINI_ROOFLINE_PLOT_X_STEPS, x / GEMMINI_ROOFLINE_PLOT_X_STEPS + GEMMINI_ROOFLINE_PLOT_X_MIN_LOG2);
+  printf("\n       MACs/byte (log2)\n");
+}
+
+#endif // SRC_MAIN_C_GEMMINI_ROOFLINE_H
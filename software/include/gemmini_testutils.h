@@ -11,6 +11,9 @@
 #include <math.h>
 #include <limits.h>
 #include <stdbool.h>
+#ifdef GEMMINI_EMULATOR
+#include <time.h>
+#endif
 
 #include "include/gemmini_params.h"
 #include "include/gemmini.h"
@@ -27,7 +30,7 @@
 // #define GEMMINI_ASSERTIONS
 
 // Matmul utility functions
-static void matmul(elem_t A[DIM][DIM], elem_t B[DIM][DIM], elem_t D[DIM][DIM], elem_t C_full[DIM][DIM]) {
+static void matmul(elem_t A[DIM][DIM], elem_t B[DIM][DIM], elem_t D[DIM][DIM], full_t C_full[DIM][DIM]) {
   for (size_t r = 0; r < DIM; r++)
     for (size_t c = 0; c < DIM; c++) {
       C_full[r][c] = D[r][c];
@@ -271,9 +274,16 @@ static int is_equal_transposed(elem_t x[DIM][DIM], elem_t y[DIM][DIM]) {
       result;})
 
 static uint64_t read_cycles() {
+#ifdef GEMMINI_EMULATOR
+    // Host nanoseconds stand in for cycles when running on the emulator
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
     uint64_t cycles;
     asm volatile ("rdcycle %0" : "=r" (cycles));
     return cycles;
+#endif
 
     // const uint32_t * mtime = (uint32_t *)(33554432 + 0xbff8);
     // const uint32_t * mtime = (uint32_t *)(33554432 + 0xbffc);
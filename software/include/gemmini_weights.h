@@ -0,0 +1,362 @@
+// See LICENSE for license details.
+
+// Model weight containers.
+//
+// A container holds every weight and bias tensor of a model, so the tensors
+// can be swapped without rebuilding the program that runs it. The layout is:
+//
+//   gemmini_weights_header_t        at offset 0
+//   tensor data                     each tensor GEMMINI_WEIGHTS_ALIGN-aligned
+//   gemmini_weights_entry_t[]       at header.table_offset
+//
+// Tensors are stored exactly as the kernels read them. elem_t and acc_t
+// tensors are row-major, and ternary tensors use one of the ternary_pack.h
+// layouts, so TERNARY_JK_DIM keeps its DIM-blocked rows. Every tensor has a
+// dequantization scale.
+//
+// Containers are built in memory with gemmini_weights_build_*. On Linux,
+// gemmini_weights_save writes one out and gemmini_weights_map maps one back
+// in. Baremetal programs link the file in with GEMMINI_WEIGHTS_INCBIN.
+// Either way, gemmini_weights_open checks the container and gemmini_weights_get
+// looks tensors up by name.
+
+#ifndef SRC_MAIN_C_GEMMINI_WEIGHTS_H
+#define SRC_MAIN_C_GEMMINI_WEIGHTS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "include/gemmini_params.h"
+#include "include/ternary_pack.h"
+
+#define GEMMINI_WEIGHTS_MAGIC 0x53545747 // "GWTS"
+#define GEMMINI_WEIGHTS_VERSION 1
+#define GEMMINI_WEIGHTS_ALIGN 64
+#define GEMMINI_WEIGHTS_NAME_LEN 48
+
+enum gemmini_weights_type_t {
+  GEMMINI_WEIGHTS_ELEM,     // rows x cols elem_t
+  GEMMINI_WEIGHTS_ACC,      // rows x cols acc_t, usually biases
+  GEMMINI_WEIGHTS_TERNARY,  // a K x J ternary matrix, K = rows, J = cols
+};
+
+struct gemmini_weights_header_t {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t dim;             // DIM that the container was built for
+  uint32_t n_tensors;
+  uint32_t elem_bytes;      // sizeof(elem_t)
+  uint64_t table_offset;
+  uint64_t file_bytes;
+  uint8_t reserved[32];
+};
+
+struct gemmini_weights_entry_t {
+  char name[GEMMINI_WEIGHTS_NAME_LEN];
+  uint32_t type;            // enum gemmini_weights_type_t
+  uint32_t layout;          // enum ternary_layout_t, for ternary tensors
+  uint64_t rows;
+  uint64_t cols;
+  uint64_t offset;          // From the start of the container
+  uint64_t bytes;
+  float scale;
+  uint8_t reserved[36];
+};
+
+struct gemmini_weights_t {
+  const uint8_t * base;
+  size_t bytes;
+  const struct gemmini_weights_header_t * header;
+  const struct gemmini_weights_entry_t * table;
+  bool mapped;
+  size_t mapped_bytes;
+};
+
+static size_t gemmini_weights_align(size_t offset) {
+  return (offset + GEMMINI_WEIGHTS_ALIGN - 1) / GEMMINI_WEIGHTS_ALIGN * GEMMINI_WEIGHTS_ALIGN;
+}
+
+static size_t gemmini_weights_tensor_bytes(enum gemmini_weights_type_t type, uint32_t layout,
+        size_t rows, size_t cols) {
+  if (type == GEMMINI_WEIGHTS_TERNARY)
+    return ternary_packed_bytes(layout, rows, cols);
+  return rows * cols * (type == GEMMINI_WEIGHTS_ACC ? sizeof(acc_t) : sizeof(elem_t));
+}
+
+// Checks a container that has been loaded or linked in at "base". "base" must
+// be GEMMINI_WEIGHTS_ALIGN-aligned, so the tensors are too
+static void gemmini_weights_open(struct gemmini_weights_t * weights, const void * base, size_t bytes) {
+  const struct gemmini_weights_header_t * header = base;
+
+  if ((uintptr_t)base % GEMMINI_WEIGHTS_ALIGN != 0) {
+    printf("Weight containers must be %d-byte aligned\n", GEMMINI_WEIGHTS_ALIGN);
+    exit(1);
+  }
+
+  if (bytes < sizeof(*header) || header->magic != GEMMINI_WEIGHTS_MAGIC) {
+    printf("Not a weight container\n");
+    exit(1);
+  }
+  if (header->version != GEMMINI_WEIGHTS_VERSION) {
+    printf("Weight container version %u is not supported; expected %d\n",
+        header->version, GEMMINI_WEIGHTS_VERSION);
+    exit(1);
+  }
+  if (header->dim != DIM || header->elem_bytes != sizeof(elem_t)) {
+    printf("The weight container was built for DIM=%u with %u-byte elements, not DIM=%d with %d-byte elements\n",
+        header->dim, header->elem_bytes, DIM, (int)sizeof(elem_t));
+    exit(1);
+  }
+  if (header->file_bytes > bytes ||
+      header->table_offset + header->n_tensors * sizeof(struct gemmini_weights_entry_t) > header->file_bytes) {
+    printf("The weight container is truncated\n");
+    exit(1);
+  }
+
+  const struct gemmini_weights_entry_t * table =
+    (const struct gemmini_weights_entry_t *)((const uint8_t *)base + header->table_offset);
+
+  for (uint32_t t = 0; t < header->n_tensors; t++) {
+    const struct gemmini_weights_entry_t * entry = &table[t];
+
+    if (entry->type > GEMMINI_WEIGHTS_TERNARY || entry->offset % GEMMINI_WEIGHTS_ALIGN != 0 ||
+        entry->offset + entry->bytes > header->table_offset ||
+        entry->bytes != gemmini_weights_tensor_bytes(entry->type, entry->layout, entry->rows, entry->cols) ||
+        memchr(entry->name, '\0', GEMMINI_WEIGHTS_NAME_LEN) == NULL) {
+      printf("Tensor %u of the weight container is corrupt\n", t);
+      exit(1);
+    }
+  }
+
+  weights->base = base;
+  weights->bytes = header->file_bytes;
+  weights->header = header;
+  weights->table = table;
+  weights->mapped = false;
+}
+
+static const struct gemmini_weights_entry_t * gemmini_weights_find(const struct gemmini_weights_t * weights,
+        const char * name) {
+  for (uint32_t t = 0; t < weights->header->n_tensors; t++)
+    if (strcmp(weights->table[t].name, name) == 0)
+      return &weights->table[t];
+  return NULL;
+}
+
+// Returns the data of tensor "name", which must take "bytes" bytes
+static const void * gemmini_weights_get(const struct gemmini_weights_t * weights,
+        const char * name, size_t bytes) {
+  const struct gemmini_weights_entry_t * entry = gemmini_weights_find(weights, name);
+
+  if (entry == NULL) {
+    printf("The weight container has no tensor %s\n", name);
+    exit(1);
+  }
+  if (entry->bytes != bytes) {
+    printf("%s has %llu bytes in the weight container, but %llu are expected\n", name,
+        (unsigned long long)entry->bytes, (unsigned long long)bytes);
+    exit(1);
+  }
+
+  return weights->base + entry->offset;
+}
+
+static float gemmini_weights_scale(const struct gemmini_weights_t * weights, const char * name) {
+  const struct gemmini_weights_entry_t * entry = gemmini_weights_find(weights, name);
+
+  if (entry == NULL) {
+    printf("The weight container has no tensor %s\n", name);
+    exit(1);
+  }
+
+  return entry->scale;
+}
+
+// Stands in for a tensor that would otherwise be baked into the program,
+// with the same type. With
+//   #define conv_1_w GEMMINI_WEIGHTS_GET(&weights, conv_1_w)
+// the baked array is no longer referenced, so the compiler drops it
+#define GEMMINI_WEIGHTS_GET(weights, name) \
+  (*(__typeof__(name) *)gemmini_weights_get((weights), #name, sizeof(name)))
+
+// Links the container at "path" into the program as name[] to name_end[].
+// Use at file scope
+#define GEMMINI_WEIGHTS_INCBIN(name, path) \
+  __asm__(".section .rodata.gemmini_weights, \"a\", @progbits\n" \
+      ".balign " GEMMINI_WEIGHTS_STR(GEMMINI_WEIGHTS_ALIGN) "\n" \
+      ".global " #name "\n" #name ":\n" \
+      ".incbin \"" path "\"\n" \
+      ".global " #name "_end\n" #name "_end:\n" \
+      ".previous\n"); \
+  extern const uint8_t name[], name##_end[]
+
+#define GEMMINI_WEIGHTS_STR(x) GEMMINI_WEIGHTS_STR_(x)
+#define GEMMINI_WEIGHTS_STR_(x) #x
+
+// Building containers. The caller provides the buffer, which must be
+// GEMMINI_WEIGHTS_ALIGN-aligned and large enough for the whole container
+
+#ifndef GEMMINI_WEIGHTS_MAX_TENSORS
+#define GEMMINI_WEIGHTS_MAX_TENSORS 512
+#endif
+
+struct gemmini_weights_builder_t {
+  uint8_t * buf;
+  size_t capacity;
+  size_t bytes;
+  struct gemmini_weights_entry_t table[GEMMINI_WEIGHTS_MAX_TENSORS];
+  uint32_t n_tensors;
+};
+
+static void gemmini_weights_build_start(struct gemmini_weights_builder_t * builder, void * buf, size_t capacity) {
+  if ((uintptr_t)buf % GEMMINI_WEIGHTS_ALIGN != 0) {
+    printf("Weight containers must be %d-byte aligned\n", GEMMINI_WEIGHTS_ALIGN);
+    exit(1);
+  }
+
+  builder->buf = buf;
+  builder->capacity = capacity;
+  builder->bytes = gemmini_weights_align(sizeof(struct gemmini_weights_header_t));
+  builder->n_tensors = 0;
+}
+
+// Reserves space for a tensor and returns where its data goes
+static uint8_t * gemmini_weights_build_entry(struct gemmini_weights_builder_t * builder,
+        const char * name, enum gemmini_weights_type_t type, uint32_t layout,
+        size_t rows, size_t cols, float scale) {
+  if (builder->n_tensors >= GEMMINI_WEIGHTS_MAX_TENSORS) {
+    printf("Too many tensors; increase GEMMINI_WEIGHTS_MAX_TENSORS\n");
+    exit(1);
+  }
+  if (strlen(name) >= GEMMINI_WEIGHTS_NAME_LEN) {
+    printf("Tensor name %s is too long\n", name);
+    exit(1);
+  }
+
+  struct gemmini_weights_entry_t * entry = &builder->table[builder->n_tensors++];
+  memset(entry, 0, sizeof(*entry));
+  strcpy(entry->name, name);
+  entry->type = type;
+  entry->layout = layout;
+  entry->rows = rows;
+  entry->cols = cols;
+  entry->offset = builder->bytes;
+  entry->bytes = gemmini_weights_tensor_bytes(type, layout, rows, cols);
+  entry->scale = scale;
+
+  builder->bytes = gemmini_weights_align(entry->offset + entry->bytes);
+  if (builder->bytes > builder->capacity) {
+    printf("The weight container doesn't fit in %llu bytes\n", (unsigned long long)builder->capacity);
+    exit(1);
+  }
+
+  return builder->buf + entry->offset;
+}
+
+// Adds a rows x cols elem_t or acc_t tensor, copied from "data"
+static void gemmini_weights_build_add(struct gemmini_weights_builder_t * builder,
+        const char * name, enum gemmini_weights_type_t type,
+        size_t rows, size_t cols, const void * data, float scale) {
+  uint8_t * dst = gemmini_weights_build_entry(builder, name, type, 0, rows, cols, scale);
+  memcpy(dst, data, gemmini_weights_tensor_bytes(type, 0, rows, cols));
+}
+
+// Adds a K x J ternary tensor, packed into "layout" from W, with element
+// (k, j) at W[k * stride_k + j * stride_j]
+static void gemmini_weights_build_add_ternary(struct gemmini_weights_builder_t * builder,
+        const char * name, enum ternary_layout_t layout, size_t K, size_t J,
+        const elem_t * W, size_t stride_k, size_t stride_j, float scale) {
+  ternary_check_dims(layout, K, J);
+  uint8_t * dst = gemmini_weights_build_entry(builder, name, GEMMINI_WEIGHTS_TERNARY, layout, K, J, scale);
+  ternary_pack(layout, K, J, W, stride_k, stride_j, (elem_t *)dst);
+}
+
+// Writes the table and header, and returns the container's size
+static size_t gemmini_weights_build_finish(struct gemmini_weights_builder_t * builder) {
+  const size_t table_bytes = builder->n_tensors * sizeof(struct gemmini_weights_entry_t);
+
+  if (builder->bytes + table_bytes > builder->capacity) {
+    printf("The weight container doesn't fit in %llu bytes\n", (unsigned long long)builder->capacity);
+    exit(1);
+  }
+
+  memcpy(builder->buf + builder->bytes, builder->table, table_bytes);
+
+  struct gemmini_weights_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.magic = GEMMINI_WEIGHTS_MAGIC;
+  header.version = GEMMINI_WEIGHTS_VERSION;
+  header.dim = DIM;
+  header.n_tensors = builder->n_tensors;
+  header.elem_bytes = sizeof(elem_t);
+  header.table_offset = builder->bytes;
+  header.file_bytes = builder->bytes + table_bytes;
+  memcpy(builder->buf, &header, sizeof(header));
+
+  return header.file_bytes;
+}
+
+#ifndef BAREMETAL
+
+static void gemmini_weights_save(const char * path, const void * container, size_t bytes) {
+  FILE * f = fopen(path, "wb");
+  if (f == NULL || fwrite(container, 1, bytes, f) != bytes || fclose(f) != 0) {
+    printf("Could not write %s\n", path);
+    exit(1);
+  }
+}
+
+// Maps the container at "path" read-only. MAP_POPULATE faults every page in
+// up front, and the mapping is offered to transparent hugepages, so the
+// first layers don't stall on page faults and the weights take few TLB
+// entries. mmap's page alignment covers GEMMINI_WEIGHTS_ALIGN
+static void gemmini_weights_map(struct gemmini_weights_t * weights, const char * path) {
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    printf("Could not open %s\n", path);
+    exit(1);
+  }
+
+#ifdef MAP_POPULATE
+  const int flags = MAP_PRIVATE | MAP_POPULATE;
+#else
+  const int flags = MAP_PRIVATE;
+#endif
+  const void * base = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("Could not map %s\n", path);
+    exit(1);
+  }
+
+#ifdef MADV_HUGEPAGE
+  // Only a hint; file-backed hugepages depend on the kernel and filesystem
+  madvise((void *)base, st.st_size, MADV_HUGEPAGE);
+#endif
+
+  gemmini_weights_open(weights, base, st.st_size);
+  weights->mapped = true;
+  weights->mapped_bytes = st.st_size;
+}
+
+static void gemmini_weights_unmap(struct gemmini_weights_t * weights) {
+  if (weights->mapped)
+    munmap((void *)weights->base, weights->mapped_bytes);
+  weights->base = NULL;
+  weights->mapped = false;
+}
+
+#endif // BAREMETAL
+
+#endif // SRC_MAIN_C_GEMMINI_WEIGHTS_H
@@ -0,0 +1,354 @@
+// See LICENSE for license details.
+
+#ifndef SRC_MAIN_C_TERNARY_PACK_H
+#define SRC_MAIN_C_TERNARY_PACK_H
+
+// Packs ternary weights into the 2-bit codes consumed by mpgemm. Each byte
+// holds four weights, slot s in bits [2s+1:2s], encoded as 0b00 = 0,
+// 0b01 = +1, 0b11 = -1.
+//
+// Weights are described logically as a K x J matrix W (K inputs, J outputs,
+// the B operand of C = A * B). The source may be stored either way round:
+// element (k, j) is read from W[k * stride_k + j * stride_j], so a PyTorch
+// style out x in tensor is packed with stride_k = 1, stride_j = K.
+//
+// On Linux hosts, ternary_pack_file streams a raw int8 weight file into the
+// on-disk format below with several threads, and ternary_file_map maps a
+// packed file back in without copying it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef BAREMETAL
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "include/gemmini_params.h"
+
+enum ternary_layout_t {
+  // K rows of J/4 bytes, weight (k, j) in slot j%4 of byte (k, j/4). This is
+  // the B operand of tiled_mpgemm_auto.
+  TERNARY_KJ,
+  // J rows of K/4 bytes, weight (k, j) in slot k%4 of byte (j, k/4). The
+  // natural packing of an out x in weight tensor.
+  TERNARY_JK,
+  // J/4 rows of K bytes, the B operand of tiled_mpgemm_auto with
+  // transpose_B. Each DIM-byte block of row r holds DIM/4 bytes of K for each
+  // of the outputs 4r..4r+3 in turn, so one scratchpad row carries DIM inputs
+  // for four outputs.
+  TERNARY_JK_DIM,
+};
+
+static uint8_t ternary_encode(int w) {
+  return w > 0 ? 1 : w < 0 ? 3 : 0;
+}
+
+static int ternary_decode(uint8_t code) {
+  return code == 1 ? 1 : code == 3 ? -1 : 0;
+}
+
+static void ternary_check_dims(enum ternary_layout_t layout, size_t K, size_t J) {
+  if ((layout == TERNARY_KJ || layout == TERNARY_JK_DIM) && J % 4 != 0) {
+    printf("J must be a multiple of 4 to pack ternary weights\n");
+    exit(1);
+  }
+  if (layout == TERNARY_JK && K % 4 != 0) {
+    printf("K must be a multiple of 4 to pack ternary weights\n");
+    exit(1);
+  }
+  if (layout == TERNARY_JK_DIM && K % DIM != 0) {
+    printf("K must be a multiple of DIM for the TERNARY_JK_DIM layout\n");
+    exit(1);
+  }
+}
+
+static size_t ternary_packed_rows(enum ternary_layout_t layout, size_t K, size_t J) {
+  return layout == TERNARY_KJ ? K : layout == TERNARY_JK ? J : J / 4;
+}
+
+// Bytes in one packed row
+static size_t ternary_packed_cols(enum ternary_layout_t layout, size_t K, size_t J) {
+  return layout == TERNARY_KJ ? J / 4 : layout == TERNARY_JK ? K / 4 : K;
+}
+
+static size_t ternary_packed_bytes(enum ternary_layout_t layout, size_t K, size_t J) {
+  return ternary_packed_rows(layout, K, J) * ternary_packed_cols(layout, K, J);
+}
+
+// Byte holding weight (k, j), and its slot within that byte
+static size_t ternary_packed_offset(enum ternary_layout_t layout, size_t K, size_t J,
+        size_t k, size_t j, int * slot) {
+  if (layout == TERNARY_KJ) {
+    *slot = j % 4;
+    return k * (J / 4) + j / 4;
+  } else if (layout == TERNARY_JK) {
+    *slot = k % 4;
+    return j * (K / 4) + k / 4;
+  } else {
+    *slot = k % 4;
+    return (j / 4) * K + (k / DIM) * DIM + (j % 4) * (DIM / 4) + (k % DIM) / 4;
+  }
+}
+
+static int ternary_get(enum ternary_layout_t layout, size_t K, size_t J,
+        const elem_t * packed, size_t k, size_t j) {
+  int slot;
+  const uint8_t byte = packed[ternary_packed_offset(layout, K, J, k, j, &slot)];
+  return ternary_decode((byte >> (2 * slot)) & 3);
+}
+
+// Packs the weights in rows [k_start, k_end) and columns [j_start, j_end) of
+// W, where W points at weight (k_start, j_start). Every byte is written whole,
+// so the range must cover complete bytes: the bounds along the packed
+// dimension (J for TERNARY_KJ, K otherwise) must be multiples of 4. Disjoint
+// ranges can be packed concurrently.
+static void ternary_pack_range(enum ternary_layout_t layout, size_t K, size_t J,
+        const elem_t * W, size_t stride_k, size_t stride_j,
+        size_t k_start, size_t k_end, size_t j_start, size_t j_end,
+        elem_t * packed) {
+  const bool along_j = layout == TERNARY_KJ;
+  const size_t step_k = along_j ? 1 : 4;
+  const size_t step_j = along_j ? 4 : 1;
+  const size_t slot_stride = along_j ? stride_j : stride_k;
+
+  for (size_t k = k_start; k < k_end; k += step_k)
+    for (size_t j = j_start; j < j_end; j += step_j) {
+      const elem_t * w = W + (k - k_start) * stride_k + (j - j_start) * stride_j;
+      int slot;
+      const size_t offset = ternary_packed_offset(layout, K, J, k, j, &slot);
+
+      packed[offset] = ternary_encode(w[0]) |
+        (ternary_encode(w[slot_stride]) << 2) |
+        (ternary_encode(w[2 * slot_stride]) << 4) |
+        (ternary_encode(w[3 * slot_stride]) << 6);
+    }
+}
+
+// Packs a whole K x J matrix into ternary_packed_bytes(layout, K, J) bytes
+static void ternary_pack(enum ternary_layout_t layout, size_t K, size_t J,
+        const elem_t * W, size_t stride_k, size_t stride_j, elem_t * packed) {
+  ternary_check_dims(layout, K, J);
+  ternary_pack_range(layout, K, J, W, stride_k, stride_j, 0, K, 0, J, packed);
+}
+
+// Expands packed weights back into -1/0/+1 values, with the same strides
+static void ternary_unpack(enum ternary_layout_t layout, size_t K, size_t J,
+        const elem_t * packed, elem_t * W, size_t stride_k, size_t stride_j) {
+  ternary_check_dims(layout, K, J);
+  for (size_t k = 0; k < K; k++)
+    for (size_t j = 0; j < J; j++)
+      W[k * stride_k + j * stride_j] = ternary_get(layout, K, J, packed, k, j);
+}
+
+// On-disk format: a 64-byte header followed, at data_offset, by the packed
+// matrix exactly as it sits in memory. data_offset is aligned so that a
+// mapped file can be handed straight to mvin.
+
+#define TERNARY_FILE_MAGIC 0x4b505454 // "TTPK"
+#define TERNARY_FILE_VERSION 1
+#define TERNARY_FILE_ALIGN 64
+
+struct ternary_file_header_t {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t layout;
+  uint32_t dim;          // DIM that a TERNARY_JK_DIM file was packed for
+  float scale;           // Dequantization scale of the ternary weights
+  uint64_t K;
+  uint64_t J;
+  uint64_t data_offset;
+  uint64_t data_bytes;
+  uint8_t reserved[16];
+};
+
+#ifndef BAREMETAL
+
+#ifndef TERNARY_PACK_CHUNK_ROWS
+#define TERNARY_PACK_CHUNK_ROWS 1024 // Source rows read per streaming step
+#endif
+
+struct ternary_pack_job_t {
+  enum ternary_layout_t layout;
+  size_t K, J;
+  const elem_t * W;
+  size_t stride_k, stride_j;
+  size_t k_start, k_end, j_start, j_end;
+  elem_t * packed;
+};
+
+static void * ternary_pack_job(void * arg) {
+  const struct ternary_pack_job_t * job = arg;
+  ternary_pack_range(job->layout, job->K, job->J, job->W, job->stride_k, job->stride_j,
+      job->k_start, job->k_end, job->j_start, job->j_end, job->packed);
+  return NULL;
+}
+
+// Packs a raw int8 weight file of K x J values (J x K if src_transposed) into
+// a ternary file at dst_path. The source is streamed TERNARY_PACK_CHUNK_ROWS
+// rows at a time, and each chunk is split across up to `threads` threads
+// which pack straight into the mapped destination file.
+static void ternary_pack_file(const char * src_path, bool src_transposed,
+        size_t K, size_t J, float scale, enum ternary_layout_t layout,
+        const char * dst_path, int threads) {
+  ternary_check_dims(layout, K, J);
+
+  if (threads < 1)
+    threads = 1;
+
+  const size_t src_rows = src_transposed ? J : K;
+  const size_t src_cols = src_transposed ? K : J;
+  const size_t data_offset = TERNARY_FILE_ALIGN;
+  const size_t data_bytes = ternary_packed_bytes(layout, K, J);
+
+  FILE * src = fopen(src_path, "rb");
+  if (src == NULL) {
+    printf("Could not open %s\n", src_path);
+    exit(1);
+  }
+
+  const int fd = open(dst_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, data_offset + data_bytes) != 0) {
+    printf("Could not create %s\n", dst_path);
+    exit(1);
+  }
+
+  uint8_t * dst = mmap(NULL, data_offset + data_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (dst == MAP_FAILED) {
+    printf("Could not map %s\n", dst_path);
+    exit(1);
+  }
+
+  struct ternary_file_header_t header;
+  memset(&header, 0, sizeof(header));
+  header.magic = TERNARY_FILE_MAGIC;
+  header.version = TERNARY_FILE_VERSION;
+  header.layout = layout;
+  header.dim = DIM;
+  header.scale = scale;
+  header.K = K;
+  header.J = J;
+  header.data_offset = data_offset;
+  header.data_bytes = data_bytes;
+  memcpy(dst, &header, sizeof(header));
+
+  elem_t * chunk = malloc(TERNARY_PACK_CHUNK_ROWS * src_cols * sizeof(elem_t));
+  pthread_t * tids = malloc(threads * sizeof(pthread_t));
+  struct ternary_pack_job_t * jobs = malloc(threads * sizeof(struct ternary_pack_job_t));
+  if (chunk == NULL || tids == NULL || jobs == NULL) {
+    printf("Out of memory while packing %s\n", src_path);
+    exit(1);
+  }
+
+  for (size_t row = 0; row < src_rows; row += TERNARY_PACK_CHUNK_ROWS) {
+    const size_t rows = src_rows - row < TERNARY_PACK_CHUNK_ROWS ?
+      src_rows - row : TERNARY_PACK_CHUNK_ROWS;
+
+    if (fread(chunk, sizeof(elem_t), rows * src_cols, src) != rows * src_cols) {
+      printf("%s is shorter than %zu x %zu weights\n", src_path, src_rows, src_cols);
+      exit(1);
+    }
+
+    // Split on multiples of 4 rows, so that no two threads share a byte
+    const size_t quads = (rows + 3) / 4;
+    const size_t quads_per_thread = (quads + threads - 1) / threads;
+    int jobs_started = 0;
+
+    for (int t = 0; t < threads; t++) {
+      const size_t first = row + t * quads_per_thread * 4;
+      if (first >= row + rows)
+        break;
+      const size_t last = first + quads_per_thread * 4 < row + rows ?
+        first + quads_per_thread * 4 : row + rows;
+
+      struct ternary_pack_job_t * job = &jobs[t];
+      job->layout = layout;
+      job->K = K;
+      job->J = J;
+      job->W = chunk + (first - row) * src_cols;
+      job->stride_k = src_transposed ? 1 : src_cols;
+      job->stride_j = src_transposed ? src_cols : 1;
+      job->k_start = src_transposed ? 0 : first;
+      job->k_end = src_transposed ? K : last;
+      job->j_start = src_transposed ? first : 0;
+      job->j_end = src_transposed ? last : J;
+      job->packed = (elem_t *)(dst + data_offset);
+
+      if (pthread_create(&tids[t], NULL, ternary_pack_job, job) != 0) {
+        printf("Could not start a packing thread\n");
+        exit(1);
+      }
+      jobs_started++;
+    }
+
+    for (int t = 0; t < jobs_started; t++)
+      pthread_join(tids[t], NULL);
+  }
+
+  free(jobs);
+  free(tids);
+  free(chunk);
+  fclose(src);
+
+  if (munmap(dst, data_offset + data_bytes) != 0 || close(fd) != 0) {
+    printf("Could not write %s\n", dst_path);
+    exit(1);
+  }
+}
+
+// Maps a ternary file read-only and returns its packed matrix. The header is
+// copied into *header; pass the returned pointer and header to
+// ternary_file_unmap when done.
+static const elem_t * ternary_file_map(const char * path, struct ternary_file_header_t * header) {
+  const int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)) {
+    printf("Could not open %s\n", path);
+    exit(1);
+  }
+
+#ifdef MAP_POPULATE
+  const int flags = MAP_PRIVATE | MAP_POPULATE;
+#else
+  const int flags = MAP_PRIVATE;
+#endif
+  const uint8_t * base = mmap(NULL, st.st_size, PROT_READ, flags, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    printf("Could not map %s\n", path);
+    exit(1);
+  }
+
+  memcpy(header, base, sizeof(*header));
+
+  if (header->magic != TERNARY_FILE_MAGIC || header->version != TERNARY_FILE_VERSION) {
+    printf("%s is not a ternary weight file\n", path);
+    exit(1);
+  }
+  if (header->layout > TERNARY_JK_DIM ||
+      header->data_bytes != ternary_packed_bytes(header->layout, header->K, header->J) ||
+      header->data_offset + header->data_bytes > (uint64_t)st.st_size) {
+    printf("%s is corrupt\n", path);
+    exit(1);
+  }
+  if (header->layout == TERNARY_JK_DIM && header->dim != DIM) {
+    printf("%s was packed for DIM=%u, not %d\n", path, header->dim, DIM);
+    exit(1);
+  }
+
+  return (const elem_t *)(base + header->data_offset);
+}
+
+static void ternary_file_unmap(const elem_t * data, const struct ternary_file_header_t * header) {
+  munmap((uint8_t *)data - header->data_offset, header->data_offset + header->data_bytes);
+}
+
+#endif // BAREMETAL
+
+#endif // SRC_MAIN_C_TERNARY_PACK_H
@@ -1,14 +1,82 @@
+// Splits the FFN's matmuls across this many harts, each driving its own
+// accelerator. The extra harts are threads, so this needs Linux mode
+#ifndef FFN_HARTS
+#define FFN_HARTS 1
+#endif
+
+#if FFN_HARTS > 1
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <math.h>
 #ifndef BAREMETAL
 #include <sys/mman.h>
 #endif
 #include "include/gemmini.h"
 #include "include/gemmini_nn.h"
+#include "include/gemmini_async.h"
+#include "include/gemmini_profile.h"
+#if FFN_HARTS > 1
+#include "include/gemmini_multi.h"
+#endif
+
+// Runs the benchmarks' attention blockwise, without an attn_buf
+#ifndef FLASH_ATTENTION
+#define FLASH_ATTENTION 0
+#endif
+
+// Captures each encoder/decoder benchmark's command stream while it runs, and
+// then times this many replays of it
+#ifndef REPLAY_INFERENCES
+#define REPLAY_INFERENCES 0
+#endif
+
+#if FFN_HARTS > 1 && defined(BAREMETAL)
+#error "FFN_HARTS starts its harts as threads, so it needs Linux mode"
+#endif
+
+#if FFN_HARTS > 1 && REPLAY_INFERENCES
+#error "FFN_HARTS runs the FFN on other threads, so it can't be captured and replayed"
+#endif
+
+#define REPLAY_MAX_CMDS (1 << 16)
+
+// Runs each encoder/decoder benchmark GEMMINI_PROFILE_PASSES times and reports
+// the counter events of its attention and FFN layers as CSV
+#ifndef PROFILE_LAYERS
+#define PROFILE_LAYERS 0
+#endif
+
+#if FFN_HARTS > 1 && PROFILE_LAYERS
+#error "FFN_HARTS runs the FFN on other accelerators than the profiled one"
+#endif
+
+#define PROFILE_LAYER(name, call) \
+    do { \
+        if (PROFILE_LAYERS) gemmini_profile_begin(name); \
+        call; \
+        if (PROFILE_LAYERS) gemmini_profile_end(); \
+    } while (0)
+
+static struct gemmini_cmd replay_cmds[REPLAY_INFERENCES ? REPLAY_MAX_CMDS : 1];
+
+// The real value of one unit of a Q * K^T score, which the I-BERT softmax
+// needs for its exponentials. Q and K are taken as unscaled integers, so this
+// is just attention's 1/sqrt(d) scaling
+static acc_scale_t attention_bert_scale(int hidden_dim_per_head) {
+    return 1.0f / sqrtf(hidden_dim_per_head);
+}
 
 // Note: For self-attention, "enc_out" should be the same as "input".
 // Note: "compression_factor" should be 1 for most use cases.
+// Note: If "attn_buf == NULL", the attention is computed one block of query
+//   rows at a time, and only a block's probabilities are written to memory.
+// Note: Like the other layers below, this submits its kernels through
+//   gemmini_async.h and returns without waiting for them. A kernel is only
+//   fenced off when it reads or overwrites what an outstanding one touches.
 void attention(int hidden_dim, int expansion_dim, int num_heads, int seq_len,
         int compression_factor,
 
@@ -45,7 +113,7 @@ void attention(int hidden_dim, int expansion_dim, int num_heads, int seq_len,
         const acc_t * qkv_b = qkv_bs[i];
         elem_t * qkv_out = qkv_outs[i];
 
-        tiled_matmul_auto(seq_len, hidden_dim_compressed, hidden_dim,
+        tiled_matmul_auto_async(seq_len, hidden_dim_compressed, hidden_dim,
             /*A=*/ qkv_in, /*B=*/ qkv_w,
             /*D=*/ qkv_b, /*C=*/ qkv_out,
             /*stride_A=*/hidden_dim, /*stride_B=*/hidden_dim, /*stride_D=*/0, /*stride_C=*/hidden_dim,
@@ -58,40 +126,42 @@ void attention(int hidden_dim, int expansion_dim, int num_heads, int seq_len,
             WS);
     }
 
-    gemmini_fence();
-
-    // attn = Q * K
-    // attn = softmax(attn)
-    for (int head = 0; head < num_heads; head++) {
-        const elem_t * A = Q_buf + head * hidden_dim_per_head;
-        const elem_t * B = K_buf + head * hidden_dim_per_head;
-        elem_t * C = attn_buf + head * seq_len * seq_len;
-
-        tiled_matmul_auto(seq_len, seq_len, hidden_dim_per_head,
-            /*A=*/ A, /*B=*/ B,
-            /*D=*/ NULL, /*C=*/ C,
+    if (attn_buf == NULL) {
+        // out_buf = softmax(Q * K) * V, blockwise without materialising attn
+        for (int head = 0; head < num_heads; head++) {
+            tiled_attention_auto_async(seq_len, seq_len, hidden_dim_per_head,
+                /*Q=*/ Q_buf + head * hidden_dim_per_head,
+                /*K=*/ K_buf + head * hidden_dim_per_head,
+                /*V=*/ V_buf + head * hidden_dim_per_head,
+                /*out=*/ out_buf + head * hidden_dim_per_head,
+                hidden_dim, hidden_dim, hidden_dim, hidden_dim,
+                attention_bert_scale(hidden_dim_per_head),
+                WS);
+        }
+    } else {
+        // attn = Q * K
+        // attn = softmax(attn)
+        tiled_matmul_heads_auto_async(num_heads, seq_len, seq_len, hidden_dim_per_head,
+            /*A=*/ Q_buf, /*B=*/ K_buf,
+            /*D=*/ NULL, /*C=*/ attn_buf,
             /*stride_A=*/hidden_dim, /*stride_B=*/hidden_dim, /*stride_D=*/0, /*stride_C=*/seq_len,
+            /*head_stride_A=*/hidden_dim_per_head, /*head_stride_B=*/hidden_dim_per_head,
+            /*head_stride_D=*/0, /*head_stride_C=*/seq_len * seq_len,
             MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
-            SOFTMAX, /*scale=*/ ACC_SCALE_IDENTITY, /*bert_scale=*/ 0,
+            SOFTMAX, /*scale=*/ ACC_SCALE_IDENTITY, attention_bert_scale(hidden_dim_per_head),
             /*repeating_bias=*/ false,
             false, /*transpose_B=*/ true,
             false, false,
             0,
             WS);
-    }
-
-    gemmini_fence();
-
-    // out_buf = attn * V
-    for (int head = 0; head < num_heads; head++) {
-        const elem_t * A = attn_buf + head * seq_len * seq_len;
-        const elem_t * B = V_buf + head * hidden_dim_per_head;
-        elem_t * C = out_buf + head * hidden_dim_per_head;
 
-        tiled_matmul_auto(seq_len, hidden_dim_per_head, seq_len,
-            /*A=*/ A, /*B=*/ B,
-            /*D=*/ NULL, /*C=*/ C,
+        // out_buf = attn * V
+        tiled_matmul_heads_auto_async(num_heads, seq_len, hidden_dim_per_head, seq_len,
+            /*A=*/ attn_buf, /*B=*/ V_buf,
+            /*D=*/ NULL, /*C=*/ out_buf,
             /*stride_A=*/seq_len, /*stride_B=*/hidden_dim, /*stride_D=*/0, /*stride_C=*/hidden_dim,
+            /*head_stride_A=*/seq_len * seq_len, /*head_stride_B=*/hidden_dim_per_head,
+            /*head_stride_D=*/0, /*head_stride_C=*/hidden_dim_per_head,
             MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
             NO_ACTIVATION, /*scale=*/ ACC_SCALE_IDENTITY, /*bert_scale=*/ 0,
             /*repeating_bias=*/ false,
@@ -101,10 +171,8 @@ void attention(int hidden_dim, int expansion_dim, int num_heads, int seq_len,
             WS);
     }
 
-    gemmini_fence();
-
     // out_buf_acc = out_buf * Wo
-    tiled_matmul_auto(seq_len, hidden_dim, hidden_dim_compressed,
+    tiled_matmul_auto_async(seq_len, hidden_dim, hidden_dim_compressed,
         /*A=*/ out_buf, /*B=*/ Wo,
         /*D=*/ Wo_b, /*C=*/ out_buf_acc,
         /*stride_A=*/hidden_dim, /*stride_B=*/hidden_dim, /*stride_D=*/0, /*stride_C=*/hidden_dim,
@@ -116,16 +184,14 @@ void attention(int hidden_dim, int expansion_dim, int num_heads, int seq_len,
         0,
         WS);
 
-    gemmini_fence();
-
     // out = LN(out_buf_acc)
-    tiled_norm_auto(seq_len, hidden_dim,
+    tiled_norm_auto_async(seq_len, hidden_dim,
         (acc_t*)out_buf_acc, (elem_t*)out,
         ACC_SCALE_IDENTITY,
         LAYERNORM, WS);
 
     // input = out + input
-    tiled_resadd_auto(seq_len, hidden_dim,
+    tiled_resadd_auto_async(seq_len, hidden_dim,
         MVIN_SCALE_IDENTITY,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -134,8 +200,260 @@ void attention(int hidden_dim, int expansion_dim, int num_heads, int seq_len,
         resadd_out,
         /*relu=*/ false,
         WS);
+}
+
+// K/V cache for token-by-token decoding. Both buffers hold max_seq_len rows of
+// "stride" elements, with the stride and the row count rounded up to DIM so
+// every cached row can be moved in with full-width mvins. The caller's
+// buffers must therefore hold KV_CACHE_ALIGN(max_seq_len) rows of
+// KV_CACHE_ALIGN(hidden_dim_compressed) elements each.
+struct kv_cache {
+    int max_seq_len;
+    int stride;
+    int len;
+    elem_t * K;
+    elem_t * V;
+};
+
+#define KV_CACHE_ALIGN(x) ((((x) + DIM - 1) / DIM) * DIM)
+
+void kv_cache_init(struct kv_cache * cache, int max_seq_len, int hidden_dim_compressed,
+        elem_t * K, elem_t * V)
+{
+    cache->max_seq_len = KV_CACHE_ALIGN(max_seq_len);
+    cache->stride = KV_CACHE_ALIGN(hidden_dim_compressed);
+    cache->len = 0;
+    cache->K = K;
+    cache->V = V;
+}
+
+// Rearranges a row-major rows x cols weight matrix into the tile-major layout
+// that gemv_auto expects: one DIM-row stripe per block of output columns, each
+// holding the DIM x DIM tiles of every block of input rows side by side.
+void gemv_weight_layout(int rows, int cols, const elem_t * src, elem_t * dst)
+{
+    const int KB = (rows + DIM - 1) / DIM;
+    const int JB = (cols + DIM - 1) / DIM;
+
+    for (int jb = 0; jb < JB; jb++)
+        for (int k = 0; k < DIM; k++)
+            for (int kb = 0; kb < KB; kb++)
+                for (int j = 0; j < DIM; j++) {
+                    const int row = kb * DIM + k, col = jb * DIM + j;
+                    *dst++ = row < rows && col < cols ? src[row * cols + col] : 0;
+                }
+}
+
+// out = in * W + b for a single token, with W in gemv_weight_layout. The
+// columns are split so that each gemv_auto call's weights fit in one
+// scratchpad bank and its outputs in half of the accumulator.
+static void decode_gemv(int dim_J, int dim_K,
+        const elem_t * in, const elem_t * W, const acc_t * b,
+        void * out, bool full_C)
+{
+    const int K_PAD = KV_CACHE_ALIGN(dim_K);
+    const int JB_PER_BANK = BANK_ROWS / K_PAD;
+    const int JB_PER_ACC = ACC_ROWS / 2 / DIM;
+    const int J_PER_CALL = (JB_PER_BANK < JB_PER_ACC ? JB_PER_BANK : JB_PER_ACC) * DIM;
+    const size_t sizeof_C = full_C ? sizeof(acc_t) : sizeof(elem_t);
+
+    if (J_PER_CALL == 0) {
+        printf("decode_gemv: %d input features don't fit in a scratchpad bank\n", dim_K);
+        exit(1);
+    }
+
+    for (int j = 0; j < dim_J; j += J_PER_CALL) {
+        const int J = dim_J - j < J_PER_CALL ? dim_J - j : J_PER_CALL;
+
+        gemv_auto_async(1, J, dim_K,
+            /*A=*/ in, /*B=*/ W + j * K_PAD,
+            /*D=*/ b == NULL ? NULL : b + j, /*C=*/ (int8_t*)out + j * sizeof_C,
+            /*stride_A=*/dim_K, /*stride_B=*/K_PAD, /*stride_D=*/0, /*stride_C=*/dim_J,
+            MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+            NO_ACTIVATION, /*scale=*/ ACC_SCALE_IDENTITY, /*bert_scale=*/ 0,
+            /*repeating_bias=*/ true,
+            false, /*transpose_B=*/ false,
+            full_C, false,
+            0, 0, 0);
+    }
+}
+
+// Single-token counterpart of attention() for autoregressive decoding. Only
+// the new token is projected, with GEMVs over weights in gemv_weight_layout;
+// its key and value are appended to "cache", and the token then attends to
+// every cached position. Each step therefore costs O(len) vector work instead
+// of recomputing the full seq_len x seq_len attention.
+//
+// "attn_buf" holds num_heads rows of cache->max_seq_len scores, which
+// kv_cache_init has already rounded up, and "Q_buf" and "out_buf" hold one row
+// of hidden_dim elements.
+void attention_decode(int hidden_dim, int num_heads, int compression_factor,
+        const elem_t * token, elem_t * out, elem_t * resadd_out,
+        const elem_t * Wq, const elem_t * Wk, const elem_t * Wv, const elem_t * Wo,
+
+        const acc_t * Wq_b, const acc_t * Wk_b, const acc_t * Wv_b,
+        const acc_t * Wo_b,
+
+        struct kv_cache * cache,
+        elem_t * Q_buf, elem_t * attn_buf, elem_t * out_buf, acc_t * out_buf_acc)
+{
+    int hidden_dim_compressed = hidden_dim / compression_factor;
+    int hidden_dim_per_head = hidden_dim_compressed / num_heads;
+
+    if (compression_factor < 0) {
+        hidden_dim_compressed = hidden_dim;
+        hidden_dim_per_head = (hidden_dim_compressed / 12) * (-compression_factor);
+    }
+
+    if (cache->len >= cache->max_seq_len) {
+        printf("attention_decode: the K/V cache is full (%d tokens)\n", cache->max_seq_len);
+        exit(1);
+    }
+
+    const int pos = cache->len;
+    const int len = pos + 1;
+
+    // q = Wq * token
+    // K[pos] = Wk * token
+    // V[pos] = Wv * token
+    decode_gemv(hidden_dim_compressed, hidden_dim, token, Wq, Wq_b, Q_buf, false);
+    decode_gemv(hidden_dim_compressed, hidden_dim, token, Wk, Wk_b,
+        cache->K + pos * cache->stride, false);
+    decode_gemv(hidden_dim_compressed, hidden_dim, token, Wv, Wv_b,
+        cache->V + pos * cache->stride, false);
+
+    cache->len = len;
+
+    // attn = q * K
+    // attn = softmax(attn)
+    for (int head = 0; head < num_heads; head++) {
+        const elem_t * A = Q_buf + head * hidden_dim_per_head;
+        const elem_t * B = cache->K + head * hidden_dim_per_head;
+        elem_t * C = attn_buf + head * cache->max_seq_len;
+
+        tiled_matmul_auto_async(1, len, hidden_dim_per_head,
+            /*A=*/ A, /*B=*/ B,
+            /*D=*/ NULL, /*C=*/ C,
+            /*stride_A=*/hidden_dim, /*stride_B=*/cache->stride, /*stride_D=*/0, /*stride_C=*/cache->max_seq_len,
+            MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+            SOFTMAX, /*scale=*/ ACC_SCALE_IDENTITY, attention_bert_scale(hidden_dim_per_head),
+            /*repeating_bias=*/ false,
+            false, /*transpose_B=*/ true,
+            false, false,
+            0,
+            WS);
+    }
+
+    // out_buf = attn * V
+    for (int head = 0; head < num_heads; head++) {
+        const elem_t * A = attn_buf + head * cache->max_seq_len;
+        const elem_t * B = cache->V + head * hidden_dim_per_head;
+        elem_t * C = out_buf + head * hidden_dim_per_head;
+
+        tiled_matmul_auto_async(1, hidden_dim_per_head, len,
+            /*A=*/ A, /*B=*/ B,
+            /*D=*/ NULL, /*C=*/ C,
+            /*stride_A=*/cache->max_seq_len, /*stride_B=*/cache->stride, /*stride_D=*/0, /*stride_C=*/hidden_dim,
+            MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+            NO_ACTIVATION, /*scale=*/ ACC_SCALE_IDENTITY, /*bert_scale=*/ 0,
+            /*repeating_bias=*/ false,
+            false, /*transpose_B=*/ false,
+            false, false,
+            0,
+            WS);
+    }
+
+    // out_buf_acc = out_buf * Wo
+    decode_gemv(hidden_dim, hidden_dim_compressed, out_buf, Wo, Wo_b, out_buf_acc, true);
+
+    // out = LN(out_buf_acc)
+    tiled_norm_auto_async(1, hidden_dim,
+        (acc_t*)out_buf_acc, (elem_t*)out,
+        ACC_SCALE_IDENTITY,
+        LAYERNORM, WS);
+
+    // token = out + token
+    tiled_resadd_auto_async(1, hidden_dim,
+        MVIN_SCALE_IDENTITY,
+        MVIN_SCALE_IDENTITY,
+        ACC_SCALE_IDENTITY,
+        token,
+        out,
+        resadd_out,
+        /*relu=*/ false,
+        WS);
+}
+
+#if FFN_HARTS > 1
+// The matmul that ffn_matmul_hart splits, as gemmini_multi_launch's jobs only
+// take their hart's id
+static struct {
+    size_t I, J, K;
+    const elem_t * A, * B;
+    const acc_t * D;
+    void * C;
+    size_t stride_A, stride_B, stride_C;
+    int act;
+    acc_scale_t bert_scale;
+    bool full_C;
+} ffn_matmul_args;
+
+static void ffn_matmul_hart(int coreid, int ncores)
+{
+    tiled_matmul_auto_multi(coreid, ncores,
+        ffn_matmul_args.I, ffn_matmul_args.J, ffn_matmul_args.K,
+        ffn_matmul_args.A, ffn_matmul_args.B,
+        ffn_matmul_args.D, ffn_matmul_args.C,
+        ffn_matmul_args.stride_A, ffn_matmul_args.stride_B, 0, ffn_matmul_args.stride_C,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        ffn_matmul_args.act, /*scale=*/ ACC_SCALE_IDENTITY, ffn_matmul_args.bert_scale,
+        /*repeating_bias=*/ true,
+        false, /*transpose_B=*/ false,
+        ffn_matmul_args.full_C, false,
+        0,
+        WS);
+}
+#endif
 
-    gemmini_fence();
+// C = act(A * B + D), with D repeated down the rows. With FFN_HARTS > 1, the
+// harts split C between their accelerators, and this returns once they're
+// all done
+static void ffn_matmul(size_t I, size_t J, size_t K,
+        const elem_t * A, const elem_t * B, const acc_t * D, void * C,
+        size_t stride_A, size_t stride_B, size_t stride_C,
+        int act, acc_scale_t bert_scale, bool full_C)
+{
+#if FFN_HARTS > 1
+    // The harts can't see this thread's outstanding kernels
+    gemmini_wait_all();
+
+    ffn_matmul_args.I = I;
+    ffn_matmul_args.J = J;
+    ffn_matmul_args.K = K;
+    ffn_matmul_args.A = A;
+    ffn_matmul_args.B = B;
+    ffn_matmul_args.D = D;
+    ffn_matmul_args.C = C;
+    ffn_matmul_args.stride_A = stride_A;
+    ffn_matmul_args.stride_B = stride_B;
+    ffn_matmul_args.stride_C = stride_C;
+    ffn_matmul_args.act = act;
+    ffn_matmul_args.bert_scale = bert_scale;
+    ffn_matmul_args.full_C = full_C;
+
+    gemmini_multi_launch(FFN_HARTS, ffn_matmul_hart);
+#else
+    tiled_matmul_auto_async(I, J, K,
+        A, B, D, C,
+        stride_A, stride_B, /*stride_D=*/0, stride_C,
+        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
+        act, /*scale=*/ ACC_SCALE_IDENTITY, bert_scale,
+        /*repeating_bias=*/ true,
+        false, /*transpose_B=*/ false,
+        full_C, false,
+        0,
+        WS);
+#endif
 }
 
 void ffn(int hidden_dim, int expansion_dim, int seq_len,
@@ -147,45 +465,27 @@ void ffn(int hidden_dim, int expansion_dim, int seq_len,
 {
     // out = FF1(input)
     // out = GELU(out)
-    tiled_matmul_auto(seq_len, expansion_dim, hidden_dim,
+    ffn_matmul(seq_len, expansion_dim, hidden_dim,
         /*A=*/ input, /*B=*/ ff1_w,
         /*D=*/ ff1_b, /*C=*/ out_buf,
-        /*stride_A=*/hidden_dim, /*stride_B=*/expansion_dim, /*stride_D=*/expansion_dim, /*stride_C=*/expansion_dim,
-        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
-        IGELU, /*scale=*/ ACC_SCALE_IDENTITY, /*bert_scale=*/ ACC_SCALE_IDENTITY,
-        /*repeating_bias=*/ true,
-        false, /*transpose_B=*/ false,
-        false, false,
-        0,
-        WS);
-
-    gemmini_fence();
+        /*stride_A=*/hidden_dim, /*stride_B=*/expansion_dim, /*stride_C=*/expansion_dim,
+        IGELU, /*bert_scale=*/ ACC_SCALE_IDENTITY, /*full_C=*/ false);
 
     // out_buf_acc = FF2(out)
-    tiled_matmul_auto(seq_len, hidden_dim, expansion_dim, 
+    ffn_matmul(seq_len, hidden_dim, expansion_dim,
         /*A=*/ out_buf, /*B=*/ ff2_w,
         /*D=*/ ff2_b, /*C=*/ out_buf_acc,
-        /*stride_A=*/expansion_dim, /*stride_B=*/hidden_dim, /*stride_D=*/expansion_dim, /*stride_C=*/expansion_dim,
-        MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY, MVIN_SCALE_IDENTITY,
-        NO_ACTIVATION, /*scale=*/ ACC_SCALE_IDENTITY, /*bert_scale=*/ 0,
-        /*repeating_bias=*/ true,
-        false, /*transpose_B=*/ false,
-        true, false,
-        0,
-        WS);
-
-    gemmini_fence();
+        /*stride_A=*/expansion_dim, /*stride_B=*/hidden_dim, /*stride_C=*/hidden_dim,
+        NO_ACTIVATION, /*bert_scale=*/ 0, /*full_C=*/ true);
 
     // out = LN(out_buf_acc)
-    tiled_norm_auto(seq_len, hidden_dim,
+    tiled_norm_auto_async(seq_len, hidden_dim,
         (acc_t*)out_buf_acc, (elem_t*)out,
         ACC_SCALE_IDENTITY,
         LAYERNORM, WS);
 
-    gemmini_fence();
-
     // out = out + input
-    tiled_resadd_auto(seq_len, hidden_dim,
+    tiled_resadd_auto_async(seq_len, hidden_dim,
         MVIN_SCALE_IDENTITY,
         MVIN_SCALE_IDENTITY,
         ACC_SCALE_IDENTITY,
@@ -194,8 +494,6 @@ void ffn(int hidden_dim, int expansion_dim, int seq_len,
         out,
         /*relu=*/ false,
         WS);
-
-    gemmini_fence();
 }
 
 // Note: If "enc_out == NULL", then this will act as an encoder layer.
@@ -225,36 +523,41 @@ uint64_t encoder_decoder(
 
     uint64_t start = read_cycles();
 
-    attention(hidden_dim, expansion_dim, num_heads, seq_len, compression_factor,
-        input, input,
-        out, resadd1_buf,
-        Wq, Wk, Wv, Wo,
+    PROFILE_LAYER("self_attention",
+        attention(hidden_dim, expansion_dim, num_heads, seq_len, compression_factor,
+            input, input,
+            out, resadd1_buf,
+            Wq, Wk, Wv, Wo,
 
-        Wq_b, Wk_b, Wv_b,
-        Wo_b,
+            Wq_b, Wk_b, Wv_b,
+            Wo_b,
 
-        Q_buf, K_buf, V_buf,
-        attn_buf, out_buf, out_buf_acc);
+            Q_buf, K_buf, V_buf,
+            attn_buf, out_buf, out_buf_acc));
 
     if (!is_encoder) {
-        attention(hidden_dim, expansion_dim, cross_num_heads, seq_len, compression_factor,
-            resadd1_buf, enc_out,
-            out, resadd2_buf,
-            Wq_cross, Wk_cross, Wv_cross, Wo_cross,
+        PROFILE_LAYER("cross_attention",
+            attention(hidden_dim, expansion_dim, cross_num_heads, seq_len, compression_factor,
+                resadd1_buf, enc_out,
+                out, resadd2_buf,
+                Wq_cross, Wk_cross, Wv_cross, Wo_cross,
 
-            Wq_cross_b, Wk_cross_b, Wv_cross_b,
-            Wo_cross_b,
+                Wq_cross_b, Wk_cross_b, Wv_cross_b,
+                Wo_cross_b,
 
-            Q_buf, K_buf, V_buf,
-            attn_buf, out_buf, out_buf_acc);
+                Q_buf, K_buf, V_buf,
+                attn_buf, out_buf, out_buf_acc));
     }
 
-    ffn(hidden_dim, expansion_dim, seq_len,
-        is_encoder ? resadd1_buf : resadd2_buf,
-        out,
-        ff1_w, ff2_w,
-        ff1_b, ff2_b,
-        out_buf, out_buf_acc);
+    PROFILE_LAYER("ffn",
+        ffn(hidden_dim, expansion_dim, seq_len,
+            is_encoder ? resadd1_buf : resadd2_buf,
+            out,
+            ff1_w, ff2_w,
+            ff1_b, ff2_b,
+            out_buf, out_buf_acc));
+
+    gemmini_wait_all();
 
     uint64_t end = read_cycles();
 
@@ -272,7 +575,7 @@ uint64_t encoder_decoder(
     static const acc_t ff2_b[hidden_dim]; \
     \
     static elem_t QKV_buf[3][seq_len][hidden_dim];\
-    static elem_t attn_buf[num_heads][seq_len][seq_len];\
+    static elem_t attn_buf[FLASH_ATTENTION ? 1 : num_heads][FLASH_ATTENTION ? 1 : seq_len][FLASH_ATTENTION ? 1 : seq_len];\
     static elem_t out_buf[seq_len][expansion_dim];\
     static acc_t out_buf_acc[seq_len][hidden_dim];\
     static elem_t resadd1_buf[seq_len][hidden_dim];\
@@ -295,7 +598,7 @@ uint64_t encoder_decoder(
             ff1_b, ff2_b, \
             \
             QKV_buf[0], QKV_buf[1], QKV_buf[2], \
-            attn_buf, out_buf, out_buf_acc, \
+            FLASH_ATTENTION ? NULL : &attn_buf[0][0][0], out_buf, out_buf_acc, \
             resadd1_buf, resadd2_buf \
     ); \
     \
@@ -309,11 +612,141 @@ uint64_t encoder_decoder(
     \
     char * type_str = is_encoder ? "encoder" : "decoder"; \
     \
+    struct gemmini_stream stream; \
+    if (REPLAY_INFERENCES) { \
+        gemmini_stream_init(&stream, replay_cmds, REPLAY_MAX_CMDS); \
+        gemmini_stream_buffer(&stream, input, sizeof(input)); \
+        gemmini_stream_buffer(&stream, output, sizeof(output)); \
+        gemmini_capture_begin(&stream); \
+    } \
+    \
     uint64_t cycles = ENCODER_DECODER(hidden_dim, expansion_dim, num_heads, cross_num_heads, seq_len, compression_factor, input, is_encoder ? NULL : enc_out, output); \
     \
+    gemmini_capture_end(); \
+    \
     printf("%s stats: %s, hidden_dim=%d, expansion_dim=%d, num_heads=%d, cross_num_heads=%d, seq_len=%d, compression_factor=%d\n", \
             name, type_str, hidden_dim, expansion_dim, num_heads, cross_num_heads, seq_len, compression_factor); \
     printf("%s cycles: %llu\n\n", name, cycles); \
+    \
+    if (REPLAY_INFERENCES) { \
+        uint64_t start = read_cycles(); \
+        int replays; \
+        for (replays = 0; replays < REPLAY_INFERENCES; replays++) \
+            gemmini_stream_replay(&stream, NULL); \
+        uint64_t end = read_cycles(); \
+        \
+        printf("%s replayed cycles: %llu (%zu commands)\n\n", name, (end - start) / replays, stream.len); \
+    } \
+    \
+    if (PROFILE_LAYERS) { \
+        for (int pass = 1; pass < GEMMINI_PROFILE_PASSES; pass++) \
+            ENCODER_DECODER(hidden_dim, expansion_dim, num_heads, cross_num_heads, seq_len, compression_factor, input, is_encoder ? NULL : enc_out, output); \
+        \
+        printf("%s layer profile:\n", name); \
+        gemmini_profile_report_csv(); \
+        printf("\n"); \
+        gemmini_profile_reset(); \
+    } \
+}
+
+#define PRINT_DECODE(name, hidden_dim, num_heads, max_seq_len, tokens) { \
+    static const elem_t Wqkvo[4][hidden_dim][hidden_dim]; \
+    static const acc_t Wqkvo_b[4][hidden_dim]; \
+    static elem_t input[tokens][hidden_dim]; \
+    static elem_t output[hidden_dim]; \
+    \
+    static elem_t K_cache[KV_CACHE_ALIGN(max_seq_len)][KV_CACHE_ALIGN(hidden_dim)]; \
+    static elem_t V_cache[KV_CACHE_ALIGN(max_seq_len)][KV_CACHE_ALIGN(hidden_dim)]; \
+    static elem_t Q_buf[hidden_dim]; \
+    static elem_t attn_buf[num_heads][KV_CACHE_ALIGN(max_seq_len)]; \
+    static elem_t out_buf[hidden_dim]; \
+    static acc_t out_buf_acc[hidden_dim]; \
+    static elem_t resadd_buf[hidden_dim]; \
+    \
+    struct kv_cache cache; \
+    kv_cache_init(&cache, max_seq_len, hidden_dim, &K_cache[0][0], &V_cache[0][0]); \
+    \
+    uint64_t start = read_cycles(); \
+    for (int t = 0; t < tokens; t++) \
+        attention_decode(hidden_dim, num_heads, /*compression_factor=*/1, \
+            input[t], output, resadd_buf, \
+            &Wqkvo[0][0][0], &Wqkvo[1][0][0], &Wqkvo[2][0][0], &Wqkvo[3][0][0], \
+            Wqkvo_b[0], Wqkvo_b[1], Wqkvo_b[2], Wqkvo_b[3], \
+            &cache, Q_buf, &attn_buf[0][0], out_buf, out_buf_acc); \
+    gemmini_wait_all(); \
+    uint64_t end = read_cycles(); \
+    \
+    printf("%s stats: decode, hidden_dim=%d, num_heads=%d, tokens=%d\n", \
+            name, hidden_dim, num_heads, tokens); \
+    printf("%s cycles per token: %llu\n\n", name, (end - start) / tokens); \
+}
+
+// Decodes "tokens" tokens one at a time through the K/V cache, and checks the
+// last one against attention() over all of them. attention() doesn't mask, so
+// its last query row attends to exactly the positions in the cache, and the
+// two must agree bit for bit. attention() biases V with Wk_b, so the check
+// gives V and K the same biases
+#define CHECK_DECODE(name, hidden_dim, num_heads, tokens) { \
+    static elem_t W[4][hidden_dim][hidden_dim]; \
+    static elem_t W_gemv[4][KV_CACHE_ALIGN(hidden_dim) * KV_CACHE_ALIGN(hidden_dim)]; \
+    static acc_t W_b[3][hidden_dim]; \
+    static elem_t input[tokens][hidden_dim]; \
+    \
+    static elem_t QKV_buf[3][tokens][hidden_dim]; \
+    static elem_t attn_buf[FLASH_ATTENTION ? 1 : num_heads][FLASH_ATTENTION ? 1 : tokens][FLASH_ATTENTION ? 1 : tokens]; \
+    static elem_t out_buf[tokens][hidden_dim]; \
+    static acc_t out_buf_acc[tokens][hidden_dim]; \
+    static elem_t output[tokens][hidden_dim]; \
+    static elem_t resadd_buf[tokens][hidden_dim]; \
+    \
+    static elem_t K_cache[KV_CACHE_ALIGN(tokens)][KV_CACHE_ALIGN(hidden_dim)]; \
+    static elem_t V_cache[KV_CACHE_ALIGN(tokens)][KV_CACHE_ALIGN(hidden_dim)]; \
+    static elem_t dec_Q_buf[hidden_dim]; \
+    static elem_t dec_attn_buf[num_heads][KV_CACHE_ALIGN(tokens)]; \
+    static elem_t dec_out_buf[hidden_dim]; \
+    static acc_t dec_out_buf_acc[hidden_dim]; \
+    static elem_t dec_output[hidden_dim]; \
+    static elem_t dec_resadd_buf[hidden_dim]; \
+    \
+    for (int m = 0; m < 4; m++) { \
+        for (int i = 0; i < hidden_dim; i++) \
+            for (int j = 0; j < hidden_dim; j++) \
+                W[m][i][j] = rand() % 16 == 0 ? (rand() % 3) - 1 : 0; \
+        gemv_weight_layout(hidden_dim, hidden_dim, &W[m][0][0], W_gemv[m]); \
+    } \
+    for (int m = 0; m < 3; m++) \
+        for (int j = 0; j < hidden_dim; j++) \
+            W_b[m][j] = (rand() % 64) - 32; \
+    for (int t = 0; t < tokens; t++) \
+        for (int j = 0; j < hidden_dim; j++) \
+            input[t][j] = (rand() % 16) - 8; \
+    \
+    attention(hidden_dim, hidden_dim, num_heads, tokens, /*compression_factor=*/1, \
+        &input[0][0], &input[0][0], &output[0][0], &resadd_buf[0][0], \
+        &W[0][0][0], &W[1][0][0], &W[2][0][0], &W[3][0][0], \
+        W_b[0], W_b[1], W_b[1], W_b[2], \
+        &QKV_buf[0][0][0], &QKV_buf[1][0][0], &QKV_buf[2][0][0], \
+        FLASH_ATTENTION ? NULL : &attn_buf[0][0][0], &out_buf[0][0], &out_buf_acc[0][0]); \
+    \
+    struct kv_cache cache; \
+    kv_cache_init(&cache, tokens, hidden_dim, &K_cache[0][0], &V_cache[0][0]); \
+    \
+    for (int t = 0; t < tokens; t++) \
+        attention_decode(hidden_dim, num_heads, /*compression_factor=*/1, \
+            input[t], dec_output, dec_resadd_buf, \
+            W_gemv[0], W_gemv[1], W_gemv[2], W_gemv[3], \
+            W_b[0], W_b[1], W_b[1], W_b[2], \
+            &cache, dec_Q_buf, &dec_attn_buf[0][0], dec_out_buf, dec_out_buf_acc); \
+    gemmini_wait_all(); \
+    \
+    for (int j = 0; j < hidden_dim; j++) \
+        if (dec_output[j] != output[tokens-1][j] || dec_resadd_buf[j] != resadd_buf[tokens-1][j]) { \
+            printf("%s decode: column %d of token %d is %d (%d after the residual) instead of %d (%d)\nFAIL\n", \
+                name, j, tokens-1, dec_output[j], dec_resadd_buf[j], output[tokens-1][j], resadd_buf[tokens-1][j]); \
+            exit(1); \
+        } \
+    \
+    printf("%s decode matches attention() over %d tokens\n\n", name, tokens); \
 }
 
 int main (int argc, char * argv[]) {
@@ -332,6 +765,12 @@ int main (int argc, char * argv[]) {
     PRINT_ENCODER_DECODER("transformer-small", /*is_encoder=*/true,
             /*hidden_dim=*/512, /*expansion_dim=*/1024, /*num_heads=*/4, /*cross_num_heads=*/4, /*seq_len=*/128, /*compression_factor=*/1);
 
+    PRINT_DECODE("transformer-small",
+            /*hidden_dim=*/512, /*num_heads=*/4, /*max_seq_len=*/128, /*tokens=*/16);
+
+    CHECK_DECODE("transformer-small",
+            /*hidden_dim=*/512, /*num_heads=*/4, /*tokens=*/16);
+
     exit(0);
 }
 
@@ -41,6 +41,8 @@ object GemminiISA {
   val GEMV_LOOP_WS_CONFIG_STRIDES_AB = 27.U
   val GEMV_LOOP_WS_CONFIG_STRIDES_DC = 28.U
 
+  val LOOP_WS_CONFIG_HEAD_STRIDES = 29.U // a_head_stride, b_head_stride | d_head_stride, c_head_stride
+
 
   // rs1[2:0] values
   val CONFIG_EX = 0.U
@@ -134,6 +134,7 @@ class GemvLoopMatmulLdBReq(val block_size: Int, val coreMaxAddrBits: Int, val it
   val addr_start = UInt(log2Up(max_addr+1).W)
   val loop_id = UInt(log2Up(concurrent_loops).W)
   val is_resadd = Bool()
+  val tile_major = Bool()
 }
 
 class GemvLoopMatmulLdB(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth: Int, max_addr: Int, input_w: Int,
@@ -173,11 +174,20 @@ class GemvLoopMatmulLdB(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth
   val col_pad = Mux(req.transpose, req.pad_k, req.pad_j)
   
   val max_col_dim = Mux(req.transpose, req.max_j, req.max_k)
-  val max_blocks = Mux(max_col_dim <= max_block_len.U, max_col_dim, max_block_len.U)
+  val max_blocks = Mux(req.tile_major, 1.U, Mux(max_col_dim <= max_block_len.U, max_col_dim, max_block_len.U))
+
+  // Tile-major B stores each tile contiguously, the tiles in row-major order
+  // with dram_stride tiles per row. A tile moves in as tile_major_rows
+  // full-width rows, which the block stride of tile_major_rows set by
+  // config_ld puts back in order
+  val tile_major_blocks = max_block_len min block_size
+  val tile_major_rows = block_size / tile_major_blocks
 
   val sp_addr_start = req.addr_start
 
-  val dram_offset = (col_iterator * req.dram_stride + row_iterator)  * block_size.U * (input_w/8).U
+  val dram_offset = Mux(req.tile_major,
+    (row_iterator * req.dram_stride + col_iterator) * (block_size * block_size).U,
+    (col_iterator * req.dram_stride + row_iterator) * block_size.U) * (input_w/8).U
   val dram_addr = req.dram_addr + GemvLoopMatmul.castDramOffset(dram_offset)
 
 /*bank size로 wrap around*/
@@ -192,8 +202,8 @@ class GemvLoopMatmulLdB(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth
   val sp_addr   = sp_addr_start + sp_offset     // bank 넘침 없이 주소 계산
 
   val blocks = Mux(row_iterator + max_blocks <= max_row_iterator, max_blocks, max_row_iterator-row_iterator)
-  val cols = (blocks * block_size.U) 
-  val rows = block_size.U 
+  val cols = Mux(req.tile_major, (tile_major_blocks * block_size).U, blocks * block_size.U)
+  val rows = Mux(req.tile_major, tile_major_rows.U, block_size.U)
 
   val mvin_cmd = Wire(new RoCCCommand)
   mvin_cmd := DontCare
@@ -491,9 +501,10 @@ class GemvLoopMatmulExecute(block_size: Int, coreMaxAddrBits: Int, iterator_bitw
   io.i := i
   io.idle := state === idle
 
-  // The order here is k, j, i
+  // The order here is j, k, i, so each weight tile is preloaded once and stays
+  // in the array for every row block of a batched GEMV. LdA walks i, k
   // val ldb_ahead = io.ldb_completed || io.ld_kb > k || (io.ld_kb === k && io.ld_j > j)
-  val lda_ahead = io.lda_completed || io.ld_ka > k || (io.ld_ka === k && io.ld_i > i)
+  val lda_ahead = io.lda_completed || io.ld_i > i || (io.ld_i === i && io.ld_ka > k)
   val ldb_ahead = io.ldb_completed || io.ld_j > j || (io.ld_j === j && io.ld_kb > k)
   val ldd_ahead = io.ldd_completed
   val ld_ahead = lda_ahead && ldb_ahead && ldd_ahead
@@ -509,9 +520,9 @@ class GemvLoopMatmulExecute(block_size: Int, coreMaxAddrBits: Int, iterator_bitw
     when (state === pre) {
       state := comp
     }.otherwise {
-      val next_k = floorAdd(k, 1.U, req.max_k)
-      val next_j = floorAdd(j, 1.U, req.max_j, next_k === 0.U)
-      val next_i = floorAdd(i, 1.U, req.max_i, next_j === 0.U && next_k === 0.U)
+      val next_i = floorAdd(i, 1.U, req.max_i)
+      val next_k = floorAdd(k, 1.U, req.max_k, next_i === 0.U)
+      val next_j = floorAdd(j, 1.U, req.max_j, next_k === 0.U && next_i === 0.U)
 
       k := next_k
       j := next_j
@@ -662,7 +673,7 @@ class GemvLoopMatmulStC(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth
   io.i := i
   io.idle := state === idle
 
-  // The order here is k, j, i when not doing LAYERNORM or SOFTMAX
+  // The order here is j, k, i when not doing LAYERNORM or SOFTMAX
   // val ex_ahead = WireInit(io.ex_completed ||
   //   ((req.act =/= Activation.LAYERNORM) && (req.act =/= Activation.SOFTMAX) &&
   //     (io.ex_k === req.max_k - 1.U &&
@@ -670,7 +681,8 @@ class GemvLoopMatmulStC(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth
   //         ((io.ex_j === j + blocks - 1.U) && io.ex_i > i)))))
   val ex_ahead = WireInit(io.ex_completed ||
       ((req.act =/= Activation.LAYERNORM) && (req.act =/= Activation.SOFTMAX) &&
-       (io.ex_j >= j + blocks || ((io.ex_j === j + blocks - 1.U) && io.ex_i > i))))
+       (io.ex_j >= j + blocks ||
+         ((io.ex_j === j + blocks - 1.U) && io.ex_k === req.max_k - 1.U && io.ex_i > i))))
   when(req.is_resadd){
     ex_ahead := io.ex_completed || (io.ex_i > i || (io.ex_i === i && io.ex_j >= j + blocks))
   }
@@ -754,6 +766,7 @@ class GemvLoopMatmulState(val iterator_bitwidth: Int, val coreMaxAddrBits: Int,
 
   val a_transpose = Bool()
   val b_transpose = Bool()
+  val b_tile_major = Bool()
 
   val act = UInt(Activation.bitwidth.W)
 
@@ -994,6 +1007,7 @@ class GemvLoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_
         loop_being_configured.a_transpose := cmd.bits.cmd.rs2(0)
         loop_being_configured.b_transpose := cmd.bits.cmd.rs2(1)
         is_resadd := cmd.bits.cmd.rs2(2)
+        loop_being_configured.b_tile_major := cmd.bits.cmd.rs2(3)
 
         loop_being_configured.configured := true.B
 
@@ -1041,6 +1055,7 @@ class GemvLoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_
   ldB.io.req.bits.addr_start := Mux(loop_requesting_ldB.b_ex_spad_id === 0.U, loop_requesting_ldB.b_addr_start, (loop_requesting_ldB.b_ex_spad_id - 1.U) * (max_addr / sp_banks).U)
   ldB.io.req.bits.loop_id := loop_requesting_ldB_id
   ldB.io.req.bits.is_resadd := is_resadd
+  ldB.io.req.bits.tile_major := loop_requesting_ldB.b_tile_major && !is_resadd
 
   ldB.io.req.valid := !loop_requesting_ldB.ldb_started && loop_requesting_ldB.configured
 
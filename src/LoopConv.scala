@@ -64,6 +64,11 @@ class LoopConvDerivedParams(val large_iterator_bitwidth: Int, val small_iterator
   val out_channels_per_bank = UInt(small_iterator_bitwidth.W) // TODO this won't work for systolic arrays above 256 in size
   val in_channels_per_bank = UInt(small_iterator_bitwidth.W) // TODO this won't work for systolic arrays above 256 in size
 
+  // With ternary (mpgemm) weights, each weight byte packs four output channels
+  val wochs = UInt(large_iterator_bitwidth.W)
+  val weight_channels_per_bank = UInt(small_iterator_bitwidth.W)
+  val ocol_groups = UInt(small_iterator_bitwidth.W)
+
   val bias_spad_stride = UInt(large_iterator_bitwidth.W)
   val input_spad_stride = UInt(large_iterator_bitwidth.W)
   val weight_spad_stride = UInt(large_iterator_bitwidth.W)
@@ -78,6 +83,7 @@ class LoopConvLdBiasReq(val coreMaxAddrBits: Int, val large_iterator_bitwidth: I
   val addr_start = UInt(log2Up(max_acc_addr).W)
   val dram_addr = UInt(coreMaxAddrBits.W)
   val no_bias = Bool()
+  val is_mpgemm = Bool()
   val loop_id = UInt(log2Up(concurrent_loops).W)
 }
 
@@ -122,7 +128,9 @@ class LoopConvLdBias(block_size: Int, coreMaxAddrBits: Int, large_iterator_bitwi
   // Addresses
   val dram_offset = och * (acc_w/8).U
   val dram_addr = Mux(req.no_bias, 0.U, req.dram_addr + LoopConv.castDramOffset(dram_offset))
-  val spad_addr = acc_addr_start +& (och / block_size.U(och.getWidth.W)) * batches * orows * ocols +& b * orows * ocols +& orow * ocols +& ocol
+  val spad_addr = Mux(req.is_mpgemm,
+    acc_addr_start +& ((b * orows +& orow) * ocol_groups +& ocol / block_size.U) * out_channels_per_bank * block_size.U +& och,
+    acc_addr_start +& (och / block_size.U(och.getWidth.W)) * batches * orows * ocols +& b * orows * ocols +& orow * ocols +& ocol)
 
   // Sizes
   val I = Mux(ocols - ocol > block_size.U, block_size.U, ocols - ocol)
@@ -408,6 +416,7 @@ class LoopConvLdWeightReq(val coreMaxAddrBits: Int, val large_iterator_bitwidth:
   val trans_weight_1203 = Bool()
   val trans_weight_0132 = Bool()
   val dw = Bool()
+  val is_mpgemm = Bool()
   val loop_id = UInt(log2Up(concurrent_loops).W)
 }
 
@@ -441,13 +450,13 @@ class LoopConvLdWeight(block_size: Int, coreMaxAddrBits: Int, large_iterator_bit
 
   // Derived parameters
   val max_chs_per_mvin = {
-    val max_ochs_per_mvin = Mux(ochs < (max_block_len * block_size).U, ochs, (max_block_len * block_size).U)
+    val max_ochs_per_mvin = Mux(wochs < (max_block_len * block_size).U, wochs, (max_block_len * block_size).U)
     val max_kchs_per_mvin = Mux(kchs < (max_block_len * block_size).U, kchs, (max_block_len * block_size).U)
     Mux(req.trans_weight_0132, max_kchs_per_mvin, max_ochs_per_mvin)
   }
 
   val B_rows = Mux(req.trans_weight_0132, in_channels_per_bank * kcols * krows * ochs,
-    out_channels_per_bank * kcols * krows * kchs)
+    weight_channels_per_bank * kcols * krows * kchs)
   val addr_start = req.addr_end - B_rows
 
   val dram_stride = MuxCase(weight_stride, Seq(
@@ -457,6 +466,7 @@ class LoopConvLdWeight(block_size: Int, coreMaxAddrBits: Int, large_iterator_bit
   )) * (input_w/8).U
 
   // Iterators
+  // When req.is_mpgemm is set, "och" counts packed weight bytes rather than output channels
   val och = Reg(UInt(large_iterator_bitwidth.W))
   val krow = Reg(UInt(tiny_iterator_bitwidth.W))
   val kcol = Reg(UInt(tiny_iterator_bitwidth.W))
@@ -478,7 +488,7 @@ class LoopConvLdWeight(block_size: Int, coreMaxAddrBits: Int, large_iterator_bit
   // Sizes
   val J = Mux(req.trans_weight_0132,
     Mux(kchs - kch > max_chs_per_mvin, max_chs_per_mvin, kchs - kch),
-    Mux(ochs - och > max_chs_per_mvin, max_chs_per_mvin, ochs - och))
+    Mux(wochs - och > max_chs_per_mvin, max_chs_per_mvin, wochs - och))
   val K = Mux(req.trans_weight_0132,
     Mux(ochs - och > block_size.U, block_size.U, ochs - och),
     Mux(kchs - kch > block_size.U, block_size.U, kchs - kch))
@@ -554,7 +564,7 @@ class LoopConvLdWeight(block_size: Int, coreMaxAddrBits: Int, large_iterator_bit
       val next_kch = floorAdd(kch, kch_it, kchs)
       val next_kcol = floorAdd(kcol, 1.U, kcols, next_kch === 0.U)
       val next_krow = floorAdd(krow, 1.U, krows, next_kcol === 0.U && next_kch === 0.U)
-      val next_och = floorAdd(och, och_it, ochs, next_krow === 0.U && next_kcol === 0.U && next_kch === 0.U)
+      val next_och = floorAdd(och, och_it, wochs, next_krow === 0.U && next_kcol === 0.U && next_kch === 0.U)
 
       kch := next_kch
       kcol := next_kcol
@@ -590,6 +600,7 @@ class LoopConvExecuteReq(val large_iterator_bitwidth: Int, val small_iterator_bi
   val input_dilated = Bool()
   val trans_weight_0132 = Bool()
   val trans_input_3120 = Bool()
+  val is_mpgemm = Bool()
   val loop_id = UInt(log2Up(concurrent_loops).W)
 }
 
@@ -627,13 +638,14 @@ class LoopConvExecute(block_size: Int, large_iterator_bitwidth: Int, small_itera
 
   // Derived parameters
   val B_rows = Mux(req.trans_weight_0132, in_channels_per_bank * kcols * krows * ochs,
-    out_channels_per_bank * kcols * krows * kchs)
+    weight_channels_per_bank * kcols * krows * kchs)
 
   val a_addr_start = req.a_addr_start
   val b_addr_start = req.b_addr_end - B_rows
   val c_addr_start = /*(BigInt(3) << 30).U |*/ req.c_addr_start
 
   // Iterators
+  // When req.is_mpgemm is set, "och" counts packed weight bytes rather than output channels
   val och = Reg(UInt(large_iterator_bitwidth.W))
   val krow = Reg(UInt(tiny_iterator_bitwidth.W))
   val kcol = Reg(UInt(tiny_iterator_bitwidth.W))
@@ -654,7 +666,7 @@ class LoopConvExecute(block_size: Int, large_iterator_bitwidth: Int, small_itera
   val I = Mux(req.trans_input_3120,
     Mux(batches - b > block_size.U, block_size.U, batches - b),
     undilated(Mux(ocols - ocol > (block_size.U << req.input_dilated).asUInt, (block_size.U << req.input_dilated).asUInt, ocols - ocol)))
-  val J = Mux(ochs - och > block_size.U, block_size.U, ochs - och)
+  val J = Mux(wochs - och > block_size.U, block_size.U, wochs - och)
   val K = pixels * Mux(kchs - kch > block_size.U, block_size.U, kchs - kch)
 
   // Addresses
@@ -666,9 +678,15 @@ class LoopConvExecute(block_size: Int, large_iterator_bitwidth: Int, small_itera
   //   (och / block_size.U) * batches * orows * ocols +& b * orows * ocols +& orow * ocols +& ocol
 
   // The width expansions are added here solely to prevent Verilator's "WIDTH" warnings, despite making the code uglier
-  val c_addr = c_addr_start +&
+  val c_addr_base = c_addr_start +&
     (och / block_size.U(och.getWidth.W)) * batches * orows * ocols +& b * orows * ocols +& orow * ocols +& ocol
 
+  // An mpgemm compute writes its 4*block_size outputs to four consecutive accumulator blocks, so the output channels
+  // of each group of block_size pixels are kept next to each other
+  val c_addr_mpgemm = c_addr_start +&
+    ((b * orows +& orow) * ocol_groups +& ocol / block_size.U) * out_channels_per_bank * block_size.U +& och * 4.U
+  val c_addr = Mux(req.is_mpgemm, c_addr_mpgemm, c_addr_base)
+
   // val new_weights = b === 0.U && orow === 0.U && ocol === 0.U
   val new_weights = Reg(Bool())
   val krow_rot = Mux(req.wrot180, krows - krow - 1.U, krow)
@@ -755,6 +773,7 @@ class LoopConvExecute(block_size: Int, large_iterator_bitwidth: Int, small_itera
     pre_cmd_rs2.num_rows := o.I.asUInt
     pre_cmd_rs2.num_cols := o.J.asUInt
     pre_cmd_rs2.local_addr := cast_to_acc_addr(pre_cmd_rs2.local_addr, o.c_addr, accumulate = true.B, read_full = false.B)
+    pre_cmd_rs2._spacer2 := Cat(req.is_mpgemm, 0.U((pre_cmd_rs2._spacer2.getWidth-1).W))
 
     io.cmd.bits.rs1 := pre_cmd_rs1.asUInt
     io.cmd.bits.rs2 := pre_cmd_rs2.asUInt
@@ -771,6 +790,7 @@ class LoopConvExecute(block_size: Int, large_iterator_bitwidth: Int, small_itera
     comp_cmd_rs2.num_rows := o.I.asUInt
     comp_cmd_rs2.num_cols := o.J.asUInt
     comp_cmd_rs2.local_addr := garbage_addr(comp_cmd_rs2.local_addr)
+    comp_cmd_rs2._spacer2 := Cat(req.is_mpgemm, 0.U((comp_cmd_rs2._spacer2.getWidth-1).W))
 
     io.cmd.bits.rs1 := comp_cmd_rs1.asUInt
     io.cmd.bits.rs2 := comp_cmd_rs2.asUInt
@@ -800,7 +820,7 @@ class LoopConvExecute(block_size: Int, large_iterator_bitwidth: Int, small_itera
         next_kch === 0.U && next_b === 0.U && next_orow === 0.U && next_ocol === 0.U)
       val next_krow = floorAdd(krow, 1.U, krows,
         next_kcol === 0.U && next_kch === 0.U && next_b === 0.U && next_orow === 0.U && next_ocol === 0.U)
-      val next_och = floorAdd(och, block_size.U, ochs, next_krow === 0.U &&
+      val next_och = floorAdd(och, block_size.U, wochs, next_krow === 0.U &&
         next_kcol === 0.U && next_kch === 0.U && next_b === 0.U && next_orow === 0.U && next_ocol === 0.U)
 
       ocol := next_ocol
@@ -847,6 +867,7 @@ class LoopConvStReq(val coreMaxAddrBits: Int, val large_iterator_bitwidth: Int,
   val no_pool = Bool()
   val activation = UInt(2.W) // TODO magic number
   val trans_output_1203 = Bool()
+  val is_mpgemm = Bool()
   val loop_id = UInt(log2Up(concurrent_loops).W)
 }
 
@@ -892,7 +913,9 @@ class LoopConvSt(block_size: Int, coreMaxAddrBits: Int, large_iterator_bitwidth:
     ((orow*out_col_dim*batch_size +& ocol*batch_size +& b) * out_channels +& och) * (input_w/8).U,
     ((b*out_row_dim*out_col_dim +& orow*out_col_dim +& ocol) * out_stride +& och) * (input_w/8).U)
   val dram_addr = req.dram_addr + LoopConv.castDramOffset(dram_offset)
-  val spad_addr = acc_addr_start +& (och / block_size.U(och.getWidth.W)) * batches * orows * ocols +& b * orows * ocols +& orow * ocols +& ocol
+  val spad_addr = Mux(req.is_mpgemm,
+    acc_addr_start +& ((b * orows +& orow) * ocol_groups +& ocol / block_size.U) * out_channels_per_bank * block_size.U +& och,
+    acc_addr_start +& (och / block_size.U(och.getWidth.W)) * batches * orows * ocols +& b * orows * ocols +& orow * ocols +& ocol)
 
   val pool_dram_addr = req.dram_addr + ((b * pool_out_col_dim * pool_out_row_dim) * out_stride + och) * (input_w/8).U
   val pool_spad_addr = acc_addr_start +& (och / block_size.U(och.getWidth.W)) * batches * orows * ocols +& b * orows * ocols
@@ -1078,6 +1101,7 @@ class LoopConvState(val block_size: Int, val large_iterator_bitwidth: Int, val s
   val trans_weight_0132 = Bool()
   val trans_input_3120 = Bool()
   val dw = Bool()
+  val is_mpgemm = Bool()
 
   val max_pixels_per_row = UInt(small_iterator_bitwidth.W)
   val a_ex_spad_id = UInt(2.W)
@@ -1136,7 +1160,11 @@ class LoopConvState(val block_size: Int, val large_iterator_bitwidth: Int, val s
     result.out_channels_per_bank := result.ochs / block_size.U(result.ochs.getWidth.W) +& (result.ochs % block_size.U =/= 0.U)
     result.in_channels_per_bank := result.ichs / block_size.U(result.ochs.getWidth.W) +& (result.ichs % block_size.U =/= 0.U)
 
-    result.bias_spad_stride := batches * orows * ocols
+    result.wochs := Mux(is_mpgemm, pochs >> 2, pochs)
+    result.weight_channels_per_bank := result.wochs / block_size.U(result.ochs.getWidth.W) +& (result.wochs % block_size.U =/= 0.U)
+    result.ocol_groups := ocols / block_size.U(ocols.getWidth.W) +& (ocols % block_size.U =/= 0.U)
+
+    result.bias_spad_stride := Mux(is_mpgemm, block_size.U, batches * orows * ocols)
     result.input_spad_stride := Mux(trans_input_3120,
       result.ichs * (result.irows >> downsample) * (result.icols >> downsample),
       batches * (result.irows >> downsample) * (result.icols >> downsample))
@@ -1363,6 +1391,7 @@ class LoopConv (block_size: Int, coreMaxAddrBits: Int, reservation_station_size:
         loop_being_configured.trans_weight_0132 := has_training_convs.B && cmd.bits.cmd.rs1(4)
         loop_being_configured.trans_input_3120 := has_training_convs.B && cmd.bits.cmd.rs1(5)
         loop_being_configured.dw := has_dw_convs.B && cmd.bits.cmd.rs1(6)
+        loop_being_configured.is_mpgemm := cmd.bits.cmd.rs1(20)
 
         loop_being_configured.no_pool := !has_max_pool.B || cmd.bits.cmd.rs2(0)
         loop_being_configured.activation := cmd.bits.cmd.rs2(4,3)
@@ -1390,6 +1419,7 @@ class LoopConv (block_size: Int, coreMaxAddrBits: Int, reservation_station_size:
   ld_bias.io.req.bits.addr_start := ld_bias_addr_start
   ld_bias.io.req.bits.dram_addr := loop_requesting_ld_bias.bias_dram_addr
   ld_bias.io.req.bits.no_bias := loop_requesting_ld_bias.no_bias
+  ld_bias.io.req.bits.is_mpgemm := loop_requesting_ld_bias.is_mpgemm
   ld_bias.io.req.bits.loop_id := loop_requesting_ld_bias_id
 
   ld_bias.io.req.valid := !loop_requesting_ld_bias.ld_bias_started && loop_requesting_ld_bias.configured
@@ -1434,6 +1464,7 @@ class LoopConv (block_size: Int, coreMaxAddrBits: Int, reservation_station_size:
   ld_weights.io.req.bits.trans_weight_1203 := loop_requesting_ld_weights.trans_weight_1203
   ld_weights.io.req.bits.trans_weight_0132 := loop_requesting_ld_weights.trans_weight_0132
   ld_weights.io.req.bits.dw := loop_requesting_ld_weights.dw
+  ld_weights.io.req.bits.is_mpgemm := loop_requesting_ld_weights.is_mpgemm
   ld_weights.io.req.bits.loop_id := loop_requesting_ld_weights_id
 
   ld_weights.io.req.valid := !loop_requesting_ld_weights.ld_weights_started && loop_requesting_ld_weights.configured
@@ -1457,6 +1488,7 @@ class LoopConv (block_size: Int, coreMaxAddrBits: Int, reservation_station_size:
   ex.io.req.bits.input_dilated := loop_requesting_ex.input_dilated
   ex.io.req.bits.trans_weight_0132 := loop_requesting_ex.trans_weight_0132
   ex.io.req.bits.trans_input_3120 := loop_requesting_ex.trans_input_3120
+  ex.io.req.bits.is_mpgemm := loop_requesting_ex.is_mpgemm
   ex.io.req.bits.loop_id := loop_requesting_ex_id
 
   ex.io.req.valid := !loop_requesting_ex.ex_started && loop_requesting_ex.ld_bias_started &&
@@ -1481,6 +1513,7 @@ class LoopConv (block_size: Int, coreMaxAddrBits: Int, reservation_station_size:
   st.io.req.bits.no_pool := loop_requesting_st.no_pool
   st.io.req.bits.activation := loop_requesting_st.activation
   st.io.req.bits.trans_output_1203 := loop_requesting_st.trans_output_1203
+  st.io.req.bits.is_mpgemm := loop_requesting_st.is_mpgemm
   st.io.req.bits.loop_id := loop_requesting_st_id
 
   st.io.req.valid := !loop_requesting_st.st_started && loop_requesting_st.ex_started && loop_requesting_st.configured
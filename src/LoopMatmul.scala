@@ -157,6 +157,7 @@ class LoopMatmulLdBReq(val block_size: Int, val coreMaxAddrBits: Int, val iterat
   val loop_id = UInt(log2Up(concurrent_loops).W)
   val is_resadd = Bool()
   val mpgemm_transpose = Bool()
+  val tile_major = Bool()
 }
 
 class LoopMatmulLdB(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth: Int, max_addr: Int, input_w: Int,
@@ -196,16 +197,25 @@ class LoopMatmulLdB(block_size: Int, coreMaxAddrBits: Int, iterator_bitwidth: In
   val col_pad = Mux(req.transpose, req.pad_k, req.pad_j)
 
   val max_col_dim = Mux(req.transpose, req.max_k, req.max_j)
-  val max_blocks = Mux(max_col_dim <= max_block_len.U, max_col_dim, max_block_len.U)
+  val max_blocks = Mux(req.tile_major, 1.U, Mux(max_col_dim <= max_block_len.U, max_col_dim, max_block_len.U))
+
+  // Tile-major B stores each tile contiguously, with dram_stride counting
+  // tiles. A tile moves in as tile_major_rows full-width rows, which the
+  // block stride of tile_major_rows set by config_ld puts back in order
+  val tile_major_blocks = max_block_len min block_size
+  val tile_major_rows = block_size / tile_major_blocks
 
   val sp_addr_start = Mux(req.is_resadd, req.addr_end, req.addr_end - req.max_k * req.max_j * block_size.U)
 
-  val dram_offset = (row_iterator * req.dram_stride + col_iterator) * block_size.U * (input_w/8).U
+  val dram_offset = (row_iterator * req.dram_stride + col_iterator) *
+    Mux(req.tile_major, (block_size * block_size).U, block_size.U) * (input_w/8).U
   val dram_addr = req.dram_addr + LoopMatmul.castDramOffset(dram_offset)
   val sp_addr = sp_addr_start + (row_iterator * max_col_iterator + col_iterator) * block_size.U
   val blocks = Mux(col_iterator + max_blocks <= max_col_iterator, max_blocks, max_col_iterator-col_iterator)
-  val cols = (blocks * block_size.U) - Mux(col_iterator + blocks >= max_col_iterator, col_pad, 0.U)
-  val rows = block_size.U - Mux(row_iterator === max_row_iterator-1.U, row_pad, 0.U)
+  val cols = Mux(req.tile_major, (tile_major_blocks * block_size).U,
+    (blocks * block_size.U) - Mux(col_iterator + blocks >= max_col_iterator, col_pad, 0.U))
+  val rows = Mux(req.tile_major, tile_major_rows.U,
+    block_size.U - Mux(row_iterator === max_row_iterator-1.U, row_pad, 0.U))
 
   val mvin_cmd = Wire(new RoCCCommand)
   mvin_cmd := DontCare
@@ -802,6 +812,7 @@ class LoopMatmulState(val iterator_bitwidth: Int, val coreMaxAddrBits: Int, val
 
   val a_transpose = Bool()
   val b_transpose = Bool()
+  val b_tile_major = Bool()
 
   val is_mpgemm = Bool()
 
@@ -942,9 +953,21 @@ class LoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_size
 
   // Wire up unrolled command output
   val is_loop_run_cmd = cmd.bits.cmd.inst.funct === LOOP_WS
-  val is_loop_config_cmd = cmd.bits.cmd.inst.funct >= LOOP_WS_CONFIG_BOUNDS && cmd.bits.cmd.inst.funct <= LOOP_WS_CONFIG_STRIDES_DC
+  val is_loop_config_cmd = (cmd.bits.cmd.inst.funct >= LOOP_WS_CONFIG_BOUNDS && cmd.bits.cmd.inst.funct <= LOOP_WS_CONFIG_STRIDES_DC) ||
+    cmd.bits.cmd.inst.funct === LOOP_WS_CONFIG_HEAD_STRIDES
   val is_loop_cmd = is_loop_run_cmd || is_loop_config_cmd
 
+  // A LOOP_WS with more than one head stays at the front of the command queue until every head has been configured as
+  // its own loop. Each head copies the previous head's config, with its DRAM addresses advanced by the head strides
+  val a_head_stride = Reg(UInt(32.W))
+  val b_head_stride = Reg(UInt(32.W))
+  val d_head_stride = Reg(UInt(32.W))
+  val c_head_stride = Reg(UInt(32.W))
+  val heads_configured = RegInit(0.U(iterator_bitwidth.W))
+  val last_configured_id = Reg(UInt(log2Up(concurrent_loops).W))
+  val num_heads = cmd.bits.cmd.rs1(iterator_bitwidth * 3 - 1, iterator_bitwidth * 2)
+  val is_last_head = heads_configured +& 1.U >= num_heads
+
   io.out.bits.cmd := Mux(loop_configured, unrolled_cmd.bits, cmd.bits.cmd)
   io.out.bits.cmd.status := cmd.bits.cmd.status // TODO This is not guaranteed to be the correct fix! We must fix this
   io.out.bits.rob_id := DontCare
@@ -953,7 +976,7 @@ class LoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_size
   io.out.bits.from_gemv_fsm := Mux(loop_configured, false.B, cmd.bits.from_gemv_fsm)
   io.out.valid := Mux(loop_configured, unrolled_cmd.valid, cmd.valid && !is_loop_config_cmd && !is_loop_run_cmd)
 
-  cmd.ready := Mux(is_loop_cmd, !loop_being_configured.configured, !loop_configured && io.out.ready)
+  cmd.ready := Mux(is_loop_cmd, !loop_being_configured.configured && (!is_loop_run_cmd || is_last_head), !loop_configured && io.out.ready)
   arb.io.out.ready := io.out.ready
 
   // Wire up overloaded signals
@@ -1025,7 +1048,41 @@ class LoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_size
         loop_being_configured.c_dram_stride := cmd.bits.cmd.rs2
       }
 
+      is (LOOP_WS_CONFIG_HEAD_STRIDES) {
+        a_head_stride := cmd.bits.cmd.rs1(31, 0)
+        b_head_stride := cmd.bits.cmd.rs1(63, 32)
+        d_head_stride := cmd.bits.cmd.rs2(31, 0)
+        c_head_stride := cmd.bits.cmd.rs2(63, 32)
+      }
+
       is (LOOP_WS) {
+        when (heads_configured =/= 0.U) {
+          val prev_head = loops(last_configured_id)
+
+          // Null addresses skip their loads or stores, so they stay null for every head
+          def next_head_addr(addr: UInt, stride: UInt): UInt = Mux(addr === 0.U, 0.U, addr + stride)
+
+          loop_being_configured.max_k := prev_head.max_k
+          loop_being_configured.max_j := prev_head.max_j
+          loop_being_configured.max_i := prev_head.max_i
+          loop_being_configured.pad_k := prev_head.pad_k
+          loop_being_configured.pad_j := prev_head.pad_j
+          loop_being_configured.pad_i := prev_head.pad_i
+
+          loop_being_configured.a_dram_addr := next_head_addr(prev_head.a_dram_addr, a_head_stride)
+          loop_being_configured.b_dram_addr := next_head_addr(prev_head.b_dram_addr, b_head_stride)
+          loop_being_configured.d_dram_addr := next_head_addr(prev_head.d_dram_addr, d_head_stride)
+          loop_being_configured.c_dram_addr := next_head_addr(prev_head.c_dram_addr, c_head_stride)
+
+          loop_being_configured.a_dram_stride := prev_head.a_dram_stride
+          loop_being_configured.b_dram_stride := prev_head.b_dram_stride
+          loop_being_configured.d_dram_stride := prev_head.d_dram_stride
+          loop_being_configured.c_dram_stride := prev_head.c_dram_stride
+        }
+
+        heads_configured := Mux(is_last_head, 0.U, heads_configured + 1.U)
+        last_configured_id := loop_being_configured_id
+
         loop_being_configured.ex_accumulate := cmd.bits.cmd.rs1(0)
         loop_being_configured.full_c := cmd.bits.cmd.rs1(1)
         loop_being_configured.low_d := cmd.bits.cmd.rs1(2)
@@ -1036,6 +1093,7 @@ class LoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_size
         loop_being_configured.a_transpose := cmd.bits.cmd.rs2(0)
         loop_being_configured.b_transpose := cmd.bits.cmd.rs2(1)
         is_resadd := cmd.bits.cmd.rs2(2)
+        loop_being_configured.b_tile_major := cmd.bits.cmd.rs2(3)
 
         loop_being_configured.configured := true.B
 
@@ -1083,6 +1141,7 @@ class LoopMatmul(block_size: Int, coreMaxAddrBits: Int, reservation_station_size
   ldB.io.req.bits.loop_id := loop_requesting_ldB_id
   ldB.io.req.bits.is_resadd := is_resadd
   ldB.io.req.bits.mpgemm_transpose := loop_requesting_ldB.is_mpgemm && loop_requesting_ldB.b_transpose
+  ldB.io.req.bits.tile_major := loop_requesting_ldB.b_tile_major && !is_resadd
 
   ldB.io.req.valid := !loop_requesting_ldB.ldb_started && loop_requesting_ldB.configured
 